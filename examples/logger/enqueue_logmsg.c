@@ -17,19 +17,21 @@ ipt_allocator_t *alloc_logs_ptr;
 
 char *msg;
 char *orig;
+int binary = 0;
 static void
 help(void)
 {
-	fprintf(stderr,"usage : enqueue_logmsg -m [message] -o [originator]\n");
+	fprintf(stderr,"usage : enqueue_logmsg -m [message] -o [originator] [-b]\n");
         fprintf(stderr,"message    : The message to be generated.\n");
         fprintf(stderr,"originator : The originator of the message.\n");
+        fprintf(stderr,"-b         : Send a binary message, formatted by the reader.\n");
 }
 
 static int
 parse_and_init_args(int argc, char *argv[])
 {
 	int c;
-	while ((c = getopt (argc, argv, "m:o:?")) != -1)
+	while ((c = getopt (argc, argv, "m:o:b?")) != -1)
          {
 		switch (c)
         	{
@@ -41,6 +43,10 @@ parse_and_init_args(int argc, char *argv[])
 				orig = optarg;
 			break;
 
+			case 'b':
+				binary = 1;
+			break;
+
 			case '?':
 				help();
 				exit(1);
@@ -83,6 +89,19 @@ int main(int argc, char *argv[])
         logger_ptr->set_category(logger_ptr,  IPT_MODULE_ALL  );
         logger_ptr->set_level(logger_ptr,  IPT_LEVEL_ALL  );
 
+	if ( binary )
+	{
+		int format = logger_ptr->register_format(logger_ptr, "%s");
+
+		if ( logger_ptr->enqueue_binary(logger_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, orig, format, msg) < 0 )
+		{
+			printf("failed to enqueue the message\n");
+			return -1;
+		}
+
+		return 0;
+	}
+
         if ( logger_ptr->enqueue(logger_ptr,  IPT_MODULE_ALL  , IPT_LEVEL_ALL,orig, "%s", msg) < 0 )
 	{
 		printf("failed to enqueue the message\n");
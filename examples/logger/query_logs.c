@@ -0,0 +1,129 @@
+#define _XOPEN_SOURCE 700
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log_archive.h"
+
+static ipt_log_archive_query_t query;
+
+static void
+help(void)
+{
+	fprintf(stderr,"usage : query_logs [-f from] [-t to] [-l level] [-o originator] archive ...\n");
+	fprintf(stderr,"from, to   : Seconds since the epoch, or \"YYYY-MM-DD HH:MM:SS\" in local time.\n");
+	fprintf(stderr,"level      : emerg, alert, crit, error, warning, notice, info or debug. Repeat for more than one.\n");
+	fprintf(stderr,"originator : Only the messages of this originator.\n");
+}
+
+static uint64_t
+parse_time(const char *arg)
+{
+	struct tm tm;
+	char *end;
+	long sec;
+
+	memset(&tm, 0, sizeof(tm));
+
+	if ( (end = strptime(arg, "%Y-%m-%d %H:%M:%S", &tm)) != NULL && *end == '\0' )
+	{
+		tm.tm_isdst = -1;
+		return (uint64_t)mktime(&tm) * 1000000000ULL;
+	}
+
+	sec = strtol(arg, &end, 10);
+
+	if ( *end != '\0' || sec < 0 )
+	{
+		help();
+		exit(1);
+	}
+
+	return (uint64_t)sec * 1000000000ULL;
+}
+
+static ipt_log_level_mask_t
+parse_level(const char *arg)
+{
+	static const char *names[] = { "emerg", "alert", "crit", "error", "warning", "notice", "info", "debug" };
+	unsigned int i;
+
+	for ( i = 0; i < sizeof(names) / sizeof(names[0]); i++ )
+	{
+		if ( strcasecmp(arg, names[i]) == 0 )
+		{
+			return 1<<i;
+		}
+	}
+
+	help();
+	exit(1);
+}
+
+static void
+dump_entry(const ipt_logger_message_t *const msg, void *in_ptr)
+{
+	fprintf(stdout,"%s %s %s\n",msg->time, msg->originator, msg->message);
+}
+
+static void
+parse_and_init_args(int argc, char *argv[])
+{
+	int c;
+
+	while ((c = getopt (argc, argv, "f:t:l:o:?")) != -1)
+	{
+		switch (c)
+		{
+			case 'f':
+				query.from_ns = parse_time(optarg);
+			break;
+
+			case 't':
+				/* To the end of the second */
+				query.to_ns = parse_time(optarg) + 999999999ULL;
+			break;
+
+			case 'l':
+				query.level_mask |= parse_level(optarg);
+			break;
+
+			case 'o':
+				query.originator = optarg;
+			break;
+
+			default:
+				help();
+				exit(1);
+			break;
+		}
+	}
+
+	if ( optind == argc )
+	{
+		help();
+		exit(1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i, rtn = 0;
+
+	parse_and_init_args(argc, argv);
+
+	/* Only the chunks that may hold the messages are read */
+	for ( i = optind; i < argc; i++ )
+	{
+		if ( ipt_log_archive_query(argv[i], &query, dump_entry, NULL) < 0 )
+		{
+			fprintf(stderr,"%s is not a log archive\n", argv[i]);
+			rtn = 1;
+		}
+	}
+
+	return rtn;
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "allocator_shm.h"
+#include "reactor.h"
+#include "config.h"
+
+char *name = NULL;
+
+unsigned int interval = 0;
+
+void help(void)
+{
+        fprintf(stderr,"usage : reactor_stats -n [name] [-i seconds]\n");
+        fprintf(stderr,"name    : Name the reactor published its statistics with.\n");
+        fprintf(stderr,"seconds : Print the statistics again every number of seconds.\n");
+}
+
+static int
+parse_and_init_args(int argc, char *argv[])
+{
+        int c;
+        while ((c = getopt (argc, argv, "n:i:?")) != -1)
+         {
+                switch (c)
+                {
+                        case 'n':
+                                name = optarg;
+                        break;
+
+                        case 'i':
+                                interval = atoi(optarg);
+                        break;
+
+                        case '?':
+                                help();
+                                exit(1);
+                        break;
+                }
+        }
+
+	if ( !name ) return 1;
+
+        return 0;
+}
+
+static void
+dump_histogram(const char *label, const ipt_reactor_histogram_t *h)
+{
+	int i;
+
+	printf("%-16s count %llu avg %llu ns max %llu ns\n", label, h->count, h->count ? h->total_ns / h->count : 0, h->max_ns);
+
+	for ( i = 0; i < IPT_REACTOR_STATS_BUCKETS; i++ )
+	{
+		if ( h->buckets[i] == 0 ) continue;
+
+		if ( i == IPT_REACTOR_STATS_BUCKETS - 1 )
+			printf("%16s >= %7u us : %llu\n", "", 1U << (i - 1), h->buckets[i]);
+		else
+			printf("%16s  < %7u us : %llu\n", "", 1U << i, h->buckets[i]);
+	}
+}
+
+static void
+dump_stats(const ipt_reactor_stats_t *stats)
+{
+	unsigned long long dispatch_ns = stats->dispatch.total_ns;
+	int i;
+
+	printf("------------------------ %s --------------------\n", name);
+	printf("iterations       %llu\n", stats->iterations);
+	printf("waiting          %llu ns\n", stats->wait_ns);
+	printf("in upcalls       %llu ns (%.1f%% of the loop)\n", dispatch_ns,
+	       stats->wait_ns + dispatch_ns ? 100.0 * dispatch_ns / (stats->wait_ns + dispatch_ns) : 0.0);
+	printf("notifications    %llu, queue depth %llu, deepest %llu\n", stats->notifications, stats->notify_depth, stats->notify_depth_max);
+
+	dump_histogram("upcalls", &stats->dispatch);
+	dump_histogram("timer lateness", &stats->timer_lateness);
+
+	printf("slowest handlers\n");
+
+	for ( i = 0; i < IPT_REACTOR_STATS_HANDLERS; i++ )
+	{
+		const ipt_reactor_handler_stats_t *h = &stats->slowest[i];
+
+		if ( h->dispatch.count == 0 ) continue;
+
+		printf("handler 0x%llx handle %d\n", h->handler, h->handle);
+
+		dump_histogram("", &h->dispatch);
+	}
+}
+
+int main ( int argc, char *argv[])
+{
+ipt_reactor_stats_t *stats;
+
+	if ( parse_and_init_args(argc,argv) )
+	{
+		printf("failed to parse arguments\n");
+		help();
+		return 1;
+	}
+
+ 	ipt_allocator_t *alloc_ptr = ipt_allocator_shm_attach(IPT_TEST_ALLOCATOR_SHM_KEY);
+
+	if ( alloc_ptr == NULL || !(stats = alloc_ptr->find_registered_object(alloc_ptr, name)) )
+	{
+		printf("Failed to find the reactor statistics.\n");
+		return 1;
+	}
+
+	do
+	{
+		dump_stats(stats);
+
+	} while ( interval && sleep(interval) == 0 );
+
+	return 0;
+}
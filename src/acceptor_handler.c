@@ -61,10 +61,13 @@ ipt_event_handler_t *con_ptr;
 	/* Assign the socket to the event handler */
 	con_ptr->set_handle(con_ptr, sockfd);
 
-	/* Register with the reactor */
+	/* Register with the group, or the reactor */
 	ipt_reactor_t *r_ptr = ((ipt_acceptor_handler_t *)eh_ptr)->reactor;
 
- 	if ( r_ptr->register_handler(r_ptr, con_ptr, EVENT_HANDLER_READ_MASK) < 0 )
+	int rtn = ah_ptr->group ? ah_ptr->group->register_handler(ah_ptr->group, con_ptr, EVENT_HANDLER_READ_MASK) 
+	                        : r_ptr->register_handler(r_ptr, con_ptr, EVENT_HANDLER_READ_MASK);
+
+ 	if ( rtn < 0 )
         {
                 printf("failed to register connection handler\n");
 		close(sockfd);
@@ -90,6 +93,7 @@ ipt_acceptor_handler_t *ipt_acceptor_handler_create(ipt_reactor_t *reactor, ipt_
         this->eh.get_handle = (ipt_handle_t (*)(ipt_event_handler_t*)) get_handle;
 
 	this->reactor = reactor;
+	this->group = NULL;
 	this->num_cons = 0;
 
 	this->create_conn = (ipt_event_handler_t*(*)(ipt_acceptor_handler_t *)) create_conn;
@@ -97,3 +101,16 @@ ipt_acceptor_handler_t *ipt_acceptor_handler_create(ipt_reactor_t *reactor, ipt_
         return this;
 }
 
+ipt_acceptor_handler_t *ipt_acceptor_handler_create_with_group(ipt_reactor_group_t *group, ipt_event_handler_t *(*create_conn)(ipt_acceptor_handler_t *) )
+{
+	ipt_acceptor_handler_t *this = ipt_acceptor_handler_create(NULL, create_conn);
+
+	if ( this == NULL )
+	{
+		return NULL;
+	}
+
+	this->group = group;
+
+	return this;
+}
@@ -2,6 +2,7 @@
 #define __IPT_ACCEPTOR_HANDLER_H__
 
 #include "reactor.h"
+#include "reactor_group.h"
 
 typedef struct ipt_acceptor_handler_t ipt_acceptor_handler_t;
 /**
@@ -14,6 +15,9 @@ struct ipt_acceptor_handler_t
 	/* Parent reactor */
 	ipt_reactor_t *reactor;
 
+	/* Group that the connections are spread over, NULL registers them with the parent reactor */
+	ipt_reactor_group_t *group;
+
 	/* Callback to create connection */
         ipt_event_handler_t * (*create_conn)(ipt_acceptor_handler_t *this);
 
@@ -23,6 +27,12 @@ struct ipt_acceptor_handler_t
 
 ipt_acceptor_handler_t *ipt_acceptor_handler_create(ipt_reactor_t *reactor, ipt_event_handler_t *(*create_con)(ipt_acceptor_handler_t*) );
 
+/**
+ * Create an acceptor that registers each connection with the event loop picked by the group's policy.
+ * The acceptor itself may be registered with any reactor, including one of the group's.
+ */
+ipt_acceptor_handler_t *ipt_acceptor_handler_create_with_group(ipt_reactor_group_t *group, ipt_event_handler_t *(*create_con)(ipt_acceptor_handler_t*) );
+
 #define MAX_NUM_CONNECTIONS (10)
 
 #endif
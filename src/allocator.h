@@ -5,6 +5,12 @@
 /** typedef for struct ipt_allocator_t */
 typedef struct ipt_allocator_t ipt_allocator_t;
 
+/** typedef for the handle of a relocatable (movable) block */
+typedef size_t ipt_allocator_handle_t;
+
+/** The handle returned when a movable block could not be allocated. */
+#define IPT_ALLOCATOR_INVALID_HANDLE ((ipt_allocator_handle_t)0)
+
 /** \defgroup Allocators The collection of allocators. 
  * The allocators manage memory by allocating a contigous block of memory, and each 
  * call to malloc returns byte aligned blocks. As blocks are returned, the memory is 
@@ -26,6 +32,7 @@ typedef struct ipt_allocator_t ipt_allocator_t;
  * 
  * The allocation scheme uses an intrusive list so there is overhead associated with each allocation equal
  * to the size of the linkage structure per allocated block. 
+ * The linkage is 24 bytes on 64 bit platforms, or 16 bytes when built with IPT_COMPACT_OFFSETS.
  */
 struct ipt_allocator_t
 {
@@ -160,6 +167,76 @@ struct ipt_allocator_t
          */
         void * (*get_shared_ptr)(ipt_allocator_t *this);
 
+	/**
+	 * Enable relocation by creating the handle-indirection table. This must be called
+	 * once, by the process that created the allocator, before malloc_movable is used.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] max_handles The maximum number of movable blocks that can be live at once.
+	 *
+	 * @retval 0 Successfully created the handle table.
+	 * @retval -1 Failed to create the handle table.
+	 */
+	int (*enable_relocation)(ipt_allocator_t *this, size_t max_handles);
+
+	/**
+	 * Allocate a movable block. Movable blocks are not addressed directly; they are
+	 * located through their handle, so the compactor is free to slide them towards
+	 * free space. A movable block must not contain offset pointers to memory outside
+	 * of the block, because those offsets are invalidated when the block is moved.
+	 *
+	 * Movable blocks are published to other processes by registering a regular block
+	 * that holds the handle.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] size The size of block to be allocated.
+	 *
+	 * @retval IPT_ALLOCATOR_INVALID_HANDLE Failed to allocate block.
+	 * @retval handle The handle of the allocated block.
+	 */
+	ipt_allocator_handle_t (*malloc_movable)(ipt_allocator_t *this, size_t size);
+
+	/**
+	 * Free a movable block.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] handle The handle returned by malloc_movable.
+	 */
+	void (*free_movable)(ipt_allocator_t *this, ipt_allocator_handle_t handle);
+
+	/**
+	 * Pin a movable block and return its current address. The block will not be moved
+	 * by the compactor until every pin has been released with unpin.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] handle The handle returned by malloc_movable.
+	 *
+	 * @retval NULL  The handle is not valid.
+	 * @retval !NULL The address of the block.
+	 */
+	void * (*pin)(ipt_allocator_t *this, ipt_allocator_handle_t handle);
+
+	/**
+	 * Release a pin taken with pin. The address returned by pin must not be used afterwards.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] handle The handle returned by malloc_movable.
+	 */
+	void (*unpin)(ipt_allocator_t *this, ipt_allocator_handle_t handle);
+
+	/**
+	 * Run one incremental compaction slice. Unpinned movable blocks that sit directly
+	 * above a free block are slid down into it, so that free space bubbles up and
+	 * coalesces. The allocator lock is held only for the duration of the slice.
+	 *
+	 * @param[in] this The allocator's this pointer.
+	 * @param[in] budget The maximum number of bytes moved in this slice. At least one
+	 *                   block is moved if any block can be moved.
+	 *
+	 * @retval size_t The number of bytes moved. Zero means no further progress is possible.
+	 */
+	size_t (*compact)(ipt_allocator_t *this, size_t budget);
+
 };
 
 /**
@@ -27,10 +27,10 @@
 struct __node__
 {
 	/** previous node pointer. */
-	ipt_op_t prev;
+	ipt_link_t prev;
 
 	/** next node pointer.  */
-	ipt_op_t next;
+	ipt_link_t next;
 
 	/** size of this node.  */
 	size_t size;
@@ -50,12 +50,48 @@ struct reg_obj
 	/**
 	 * Pointer ot request object.
 	 */
-	ipt_op_t item;	
+	ipt_link_t item;	
 
 	/**
 	 * The name of the request object.
 	 */
-	ipt_op_t name;
+	ipt_link_t name;
+};
+
+/**
+ * @struct handle_entry
+ *
+ * @brief Entry in the handle-indirection table used to locate movable blocks.
+ */
+struct handle_entry
+{
+	/**
+	 * Offset to the node of the movable block. Points to the null pointer when unused.
+	 */
+	ipt_link_t block;
+
+	/**
+	 * Number of outstanding pins. A pinned block is never moved.
+	 */
+	size_t pin_count;
+
+	/**
+	 * Next unused entry ( 1 based, 0 terminates the list ).
+	 */
+	ipt_allocator_handle_t next_free;
+};
+
+/**
+ * @struct movable_hdr
+ *
+ * @brief Header placed between the node and the data of a movable block.
+ */
+struct movable_hdr
+{
+	/**
+	 * Handle that owns the block. Used by the compactor to find the handle entry.
+	 */
+	ipt_allocator_handle_t handle;
 };
 
 /**
@@ -68,22 +104,22 @@ struct shared_data
 	/**
          * Offset to free list head.
          */
-	ipt_op_t free_list_head;
+	ipt_link_t free_list_head;
 
 	/**
          * Offset to free list tail.
          */
-	ipt_op_t free_list_tail;
+	ipt_link_t free_list_tail;
 
 	/**
          * Offset to registered object list head.
          */
-	ipt_op_t ro_list_head;
+	ipt_link_t ro_list_head;
 
 	/**
          * Offset to registered object list tail.
          */
-	ipt_op_t ro_list_tail;
+	ipt_link_t ro_list_tail;
 
 	/**
          * Bytes allocated.
@@ -101,9 +137,24 @@ struct shared_data
         size_t size;
 
 	/**
-         * used as null pointer.
+         * Offset to the handle table used by movable blocks.
+         */
+	ipt_link_t handle_table;
+
+	/**
+         * Number of entries in the handle table. Zero until relocation is enabled.
          */
-	char __null__;
+	size_t handle_table_size;
+
+	/**
+         * First unused entry in the handle table ( 1 based, 0 if the table is full ).
+         */
+	ipt_allocator_handle_t free_handle;
+
+	/**
+         * used as null pointer. Aligned so that it can be stored in a compact offset pointer.
+         */
+	char __null__ __attribute__ ((aligned (IPT_COP_ALIGN)));
 
 	/** 
          * Semaphore.
@@ -144,14 +195,14 @@ bytes_allocated(private_allocator_t *this)
 
 static void print_registered_object(struct reg_obj *ptr)
 {
-                printf("Registered Object[name:%s]\n",(char*)ipt_op_drf(&ptr->name));
+                printf("Registered Object[name:%s]\n",(char*)ipt_link_drf(&ptr->name));
 }
 static void print_free_block(struct __node__ *ptr)
 {
 		printf("Block[begin:%p, end:%p, prev:%p, next:%p size:%zu]\n",ptr, 
 			ipt_add_offset((char *)ptr,ptr->size), 
-			ipt_op_drf(&ptr->prev),
-			ipt_op_drf(&ptr->next),
+			ipt_link_drf(&ptr->prev),
+			ipt_link_drf(&ptr->next),
 			ptr->size);
 }
 
@@ -161,9 +212,9 @@ static void walk_ro_list(private_allocator_t *this, void (*fnc)(struct reg_obj *
 
 	sem_wait(&this->sd_ptr->sem);
 
-	for ( 	cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->ro_list_head);
+	for ( 	cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->ro_list_head);
 		cur_ptr != (struct __node__ *) &this->sd_ptr->__null__;
-		cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+		cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
 	{
 		(*fnc)((struct reg_obj *) cur_ptr);
 	}
@@ -177,9 +228,9 @@ static void walk_free_list(private_allocator_t *this, void (*fnc)(struct __node_
 
 	sem_wait(&this->sd_ptr->sem);
 
-	for ( 	cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head);
+	for ( 	cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head);
 		cur_ptr != (struct __node__ *) &this->sd_ptr->__null__; 
-		cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+		cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
 	{
 		(*fnc)(cur_ptr);
 	}
@@ -205,12 +256,18 @@ private_malloc(private_allocator_t *this, size_t size)
 	sem_wait(&this->sd_ptr->sem);
 
 	/* Walked the free list and find a chunck big enough */
-	for (   cur_ptr  = (struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head); 
+	for (   cur_ptr  = (struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head); 
 		cur_ptr != (struct __node__ *) &this->sd_ptr->__null__; 
-		cur_ptr  = (struct __node__ *)ipt_op_drf(&cur_ptr->next) )
+		cur_ptr  = (struct __node__ *)ipt_link_drf(&cur_ptr->next) )
   	{
 		if ( cur_ptr->size < sizeof(struct __node__) + size ) continue;
 
+		/* A remainder too small to hold a node is handed out with the block */
+		if ( cur_ptr->size - sizeof(struct __node__) - size < sizeof(struct __node__) )
+		{
+			size = cur_ptr->size - sizeof(struct __node__);
+		}
+
 		/* Split the block by pulling chunk off bottom */	
 		struct __node__ *n_ptr = (struct __node__ *) (ipt_add_offset((char *)cur_ptr, cur_ptr->size - size - sizeof( struct __node__ )));
 
@@ -222,8 +279,8 @@ private_malloc(private_allocator_t *this, size_t size)
 
 		n_ptr->size = sizeof(struct __node__) + size;
 
-      		/* Special Case where size matches exactly */
-		if ( cur_ptr->size ==  sizeof(struct __node__) + size )
+      		/* Special Case where size matches exactly, the whole block is used */
+		if ( n_ptr == cur_ptr )
 		{
 
 			/*      addr a      <     addr b     <  addr c    
@@ -236,25 +293,25 @@ private_malloc(private_allocator_t *this, size_t size)
 			 *                         ^                 
 			 *                      (cur_ptr)          
 			 */
-         		if ( ipt_op_drf(&cur_ptr->prev) != &this->sd_ptr->__null__ )
+         		if ( ipt_link_drf(&cur_ptr->prev) != &this->sd_ptr->__null__ )
          		{
-            			ipt_op_set(&((struct __node__ *)ipt_op_drf(&cur_ptr->prev))->next, ipt_op_drf(&cur_ptr->next));
+            			ipt_link_set(&((struct __node__ *)ipt_link_drf(&cur_ptr->prev))->next, ipt_link_drf(&cur_ptr->next));
          		}
 
-         		if ( ipt_op_drf(&cur_ptr->next) != &this->sd_ptr->__null__)
+         		if ( ipt_link_drf(&cur_ptr->next) != &this->sd_ptr->__null__)
          		{
-            			ipt_op_set(&((struct __node__ *)ipt_op_drf(&cur_ptr->next))->prev, ipt_op_drf(&cur_ptr->prev)); 
+            			ipt_link_set(&((struct __node__ *)ipt_link_drf(&cur_ptr->next))->prev, ipt_link_drf(&cur_ptr->prev)); 
          		}
 
 			/* Update head and tail pointers  */
-			if ( (struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head) == cur_ptr )
+			if ( (struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head) == cur_ptr )
 			{
-				ipt_op_set(&this->sd_ptr->free_list_head, ipt_op_drf(&cur_ptr->prev));
+				ipt_link_set(&this->sd_ptr->free_list_head, ipt_link_drf(&cur_ptr->next));
 			}
 
-			if ( (struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_tail) == cur_ptr )
+			if ( (struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_tail) == cur_ptr )
 			{
-				ipt_op_set(&this->sd_ptr->free_list_tail, ipt_op_drf(&cur_ptr->next));
+				ipt_link_set(&this->sd_ptr->free_list_tail, ipt_link_drf(&cur_ptr->prev));
 			}
 
 		}
@@ -266,6 +323,24 @@ private_malloc(private_allocator_t *this, size_t size)
 
 	return NULL;
 }
+/*
+ * Point the node following a coalesced free node back at it.
+ */
+static void
+relink_next(private_allocator_t *this, struct __node__ *n_ptr)
+{
+	struct __node__ *next_ptr = (struct __node__ *) ipt_link_drf(&n_ptr->next);
+
+	if ( next_ptr != (struct __node__ *) &this->sd_ptr->__null__ )
+	{
+		ipt_link_set(&next_ptr->prev, n_ptr);
+	}
+	else
+	{
+		ipt_link_set(&this->sd_ptr->free_list_tail, n_ptr);
+	}
+}
+
 static void
 private_free(private_allocator_t *this, void *ptr)
 {
@@ -276,18 +351,18 @@ private_free(private_allocator_t *this, void *ptr)
 
 	int tmp_size = n_ptr->size;
 
-	for ( 	cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head);
+	for ( 	cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head);
          	cur_ptr !=  (struct __node__ *)&this->sd_ptr->__null__;
-         	cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+         	cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
 	{
 
 		/* Check to skip block */	
-		if ( ipt_op_drf(&cur_ptr->next)  != &this->sd_ptr->__null__  &&  cur_ptr  < n_ptr) 
+		if ( ipt_link_drf(&cur_ptr->next)  != &this->sd_ptr->__null__  &&  cur_ptr  < n_ptr) 
 		{
 			continue;
 		}
 
-		if ( ipt_op_drf(&cur_ptr->prev) == &this->sd_ptr->__null__ &&  n_ptr <  cur_ptr )
+		if ( ipt_link_drf(&cur_ptr->prev) == &this->sd_ptr->__null__ &&  n_ptr <  cur_ptr )
 		{
 			/*      addr a      <     add b    
 			 *  ---------------- ---------------
@@ -300,20 +375,21 @@ private_free(private_allocator_t *this, void *ptr)
 			 *      (n_ptr)          (cur_ptr)
 			 *                        (head)
 			 */
-			ipt_op_set(&n_ptr->next,cur_ptr);
-			ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-			ipt_op_set(&cur_ptr->prev,n_ptr);
-			ipt_op_set(&this->sd_ptr->free_list_head, n_ptr);
+			ipt_link_set(&n_ptr->next,cur_ptr);
+			ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+			ipt_link_set(&cur_ptr->prev,n_ptr);
+			ipt_link_set(&this->sd_ptr->free_list_head, n_ptr);
 
 			/* Attempt to coalesce */
 			if ( (char *)cur_ptr == ipt_add_offset((char *)n_ptr,n_ptr->size) )
 			{ /* Adjacent and coalesce */
 				n_ptr->size += cur_ptr->size;
-				ipt_op_set(&n_ptr->next,ipt_op_drf(&cur_ptr->next));
+				ipt_link_set(&n_ptr->next,ipt_link_drf(&cur_ptr->next));
+				relink_next(this, n_ptr);
 			}
 			break;
 		}	
-		else if ( ipt_op_drf(&cur_ptr->next)  == &this->sd_ptr->__null__ &&  cur_ptr  < n_ptr)
+		else if ( ipt_link_drf(&cur_ptr->next)  == &this->sd_ptr->__null__ &&  cur_ptr  < n_ptr)
 		{
 			/*      addr a      <     add b    
 			 *  ---------------- ---------------
@@ -326,16 +402,17 @@ private_free(private_allocator_t *this, void *ptr)
 			 *      (cur_ptr)         (n_ptr)
 			 *       (tail)
 			 */
-			ipt_op_set(&n_ptr->prev,cur_ptr);
-			ipt_op_set(&n_ptr->next, &this->sd_ptr->__null__);
-			ipt_op_set(&cur_ptr->next, n_ptr);
-			ipt_op_set(&this->sd_ptr->free_list_tail, n_ptr);
+			ipt_link_set(&n_ptr->prev,cur_ptr);
+			ipt_link_set(&n_ptr->next, &this->sd_ptr->__null__);
+			ipt_link_set(&cur_ptr->next, n_ptr);
+			ipt_link_set(&this->sd_ptr->free_list_tail, n_ptr);
 
 			/* Attempt to coalesce */
 			if ( ipt_add_offset((char *)cur_ptr,cur_ptr->size)  == (char *)n_ptr  )
 			{ /* Adjacent and coalesce */
 				cur_ptr->size += n_ptr->size;
-				ipt_op_set(&cur_ptr->next,ipt_op_drf(&n_ptr->next));
+				ipt_link_set(&cur_ptr->next,ipt_link_drf(&n_ptr->next));
+				ipt_link_set(&this->sd_ptr->free_list_tail, cur_ptr);
 			}
 			break;
 		}
@@ -351,10 +428,10 @@ private_free(private_allocator_t *this, void *ptr)
 			 *                         ^                 ^
 			 *                      (n_ptr)          (cur_ptr)
 			 */
-			ipt_op_set( &((struct __node__ *)ipt_op_drf(&cur_ptr->prev))->next, n_ptr);
-			ipt_op_set(&n_ptr->next,cur_ptr);
-			ipt_op_set(&n_ptr->prev, (void *)ipt_op_drf(&cur_ptr->prev));
-			ipt_op_set(&cur_ptr->prev,n_ptr);
+			ipt_link_set( &((struct __node__ *)ipt_link_drf(&cur_ptr->prev))->next, n_ptr);
+			ipt_link_set(&n_ptr->next,cur_ptr);
+			ipt_link_set(&n_ptr->prev, (void *)ipt_link_drf(&cur_ptr->prev));
+			ipt_link_set(&cur_ptr->prev,n_ptr);
 
 			/* Attempt to coalesce 
 			 * free node is adjacent to it's next node ( i.e current node ).
@@ -362,29 +439,31 @@ private_free(private_allocator_t *this, void *ptr)
 			if ( ipt_add_offset((char*)n_ptr,n_ptr->size) == (char*)cur_ptr)
 			{
 				n_ptr->size += cur_ptr->size;
-				ipt_op_set(&n_ptr->next, ipt_op_drf(&cur_ptr->next));
+				ipt_link_set(&n_ptr->next, ipt_link_drf(&cur_ptr->next));
+				relink_next(this, n_ptr);
 				cur_ptr = n_ptr;
 			}
 
 			/* Attempt to coalesce
 			 * free node is adjacent to it's previous node.
 			 */
-			if ( ipt_add_offset((char*)ipt_op_drf(&n_ptr->prev),((struct __node__ *)ipt_op_drf(&n_ptr->prev))->size) 
+			if ( ipt_add_offset((char*)ipt_link_drf(&n_ptr->prev),((struct __node__ *)ipt_link_drf(&n_ptr->prev))->size) 
 				== (char*)n_ptr)
 			{
 				/* Scenario where the the current node and free node have been coalesced already */
 				if ( cur_ptr == n_ptr )
 				{
-					((struct __node__*)ipt_op_drf(&n_ptr->prev))->size += n_ptr->size;
-					ipt_op_set(&((struct __node__ *)ipt_op_drf(&n_ptr->prev))->next, ipt_op_drf(&n_ptr->next));
-					cur_ptr = ((struct __node__ *)ipt_op_drf(&n_ptr->prev));
+					((struct __node__*)ipt_link_drf(&n_ptr->prev))->size += n_ptr->size;
+					ipt_link_set(&((struct __node__ *)ipt_link_drf(&n_ptr->prev))->next, ipt_link_drf(&n_ptr->next));
+					cur_ptr = ((struct __node__ *)ipt_link_drf(&n_ptr->prev));
+					relink_next(this, cur_ptr);
 				}
 				else
 				{
 					/* Scenario where the free node has not been coalesced with the current pointer */
-					((struct __node__*)ipt_op_drf(&n_ptr->prev))->size += n_ptr->size;
-					ipt_op_set(&((struct __node__ *)ipt_op_drf(&n_ptr->prev))->next, cur_ptr);
-					ipt_op_set(&cur_ptr->prev, ipt_op_drf(&n_ptr->prev) );
+					((struct __node__*)ipt_link_drf(&n_ptr->prev))->size += n_ptr->size;
+					ipt_link_set(&((struct __node__ *)ipt_link_drf(&n_ptr->prev))->next, cur_ptr);
+					ipt_link_set(&cur_ptr->prev, ipt_link_drf(&n_ptr->prev) );
 				}
 			}
 
@@ -393,12 +472,12 @@ private_free(private_allocator_t *this, void *ptr)
    	}
 
 	/* Handle the empty list scenario */
-	if ( ipt_op_drf(&this->sd_ptr->free_list_head)  == &this->sd_ptr->__null__ )
+	if ( ipt_link_drf(&this->sd_ptr->free_list_head)  == &this->sd_ptr->__null__ )
 	{
-		ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-		ipt_op_set(&n_ptr->next, &this->sd_ptr->__null__);
-		ipt_op_set(&this->sd_ptr->free_list_head, n_ptr);
-		ipt_op_set(&this->sd_ptr->free_list_tail, n_ptr);
+		ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+		ipt_link_set(&n_ptr->next, &this->sd_ptr->__null__);
+		ipt_link_set(&this->sd_ptr->free_list_head, n_ptr);
+		ipt_link_set(&this->sd_ptr->free_list_tail, n_ptr);
 	}
 
 	this->sd_ptr->num_blocks_allocated--;
@@ -433,35 +512,35 @@ register_object(private_allocator_t *this, const char *name, void *ptr)
 	strcpy(name_ptr,name);
 
 	/* Update the data */
-	ipt_op_set(&(( struct reg_obj *)n_ptr)->item, ptr);
-	ipt_op_set(&(( struct reg_obj *)n_ptr)->name, (void *)name_ptr);
+	ipt_link_set(&(( struct reg_obj *)n_ptr)->item, ptr);
+	ipt_link_set(&(( struct reg_obj *)n_ptr)->name, (void *)name_ptr);
 
 	/* From here on in, update the linkage */
 
 	/* set the head */
-	if ( ipt_op_drf(&this->sd_ptr->ro_list_head) == &this->sd_ptr->__null__ ) 
+	if ( ipt_link_drf(&this->sd_ptr->ro_list_head) == &this->sd_ptr->__null__ ) 
         {
-		ipt_op_set(&this->sd_ptr->ro_list_head,n_ptr);
+		ipt_link_set(&this->sd_ptr->ro_list_head,n_ptr);
         }
 
 	/* add to the tail of the list*/
-	ipt_op_set(&n_ptr->prev, ipt_op_drf(&this->sd_ptr->ro_list_tail));
-	ipt_op_set(&n_ptr->next,&this->sd_ptr->__null__);
+	ipt_link_set(&n_ptr->prev, ipt_link_drf(&this->sd_ptr->ro_list_tail));
+	ipt_link_set(&n_ptr->next,&this->sd_ptr->__null__);
 
-	ipt_op_set(&(( struct reg_obj *)n_ptr)->item, ptr);
-	ipt_op_set(&(( struct reg_obj *)n_ptr)->name, (void *)name_ptr);
+	ipt_link_set(&(( struct reg_obj *)n_ptr)->item, ptr);
+	ipt_link_set(&(( struct reg_obj *)n_ptr)->name, (void *)name_ptr);
 
-	if ( ipt_op_drf(&this->sd_ptr->ro_list_tail) != &this->sd_ptr->__null__)
+	if ( ipt_link_drf(&this->sd_ptr->ro_list_tail) != &this->sd_ptr->__null__)
 	{
-		ipt_op_set( &((struct __node__ *)ipt_op_drf(&this->sd_ptr->ro_list_tail))->next,n_ptr);
+		ipt_link_set( &((struct __node__ *)ipt_link_drf(&this->sd_ptr->ro_list_tail))->next,n_ptr);
 	}
 
-	if ( ipt_op_drf(&this->sd_ptr->ro_list_head) == &this->sd_ptr->__null__)
+	if ( ipt_link_drf(&this->sd_ptr->ro_list_head) == &this->sd_ptr->__null__)
 	{
-		ipt_op_set(&this->sd_ptr->ro_list_head,n_ptr);
+		ipt_link_set(&this->sd_ptr->ro_list_head,n_ptr);
 	}
 
-	ipt_op_set(&this->sd_ptr->ro_list_tail,n_ptr);
+	ipt_link_set(&this->sd_ptr->ro_list_tail,n_ptr);
 
 	sem_post(&this->sd_ptr->sem);
 
@@ -476,12 +555,12 @@ deregister_object(private_allocator_t *this, const char *name)
 
 	sem_wait(&this->sd_ptr->sem);
 
-        for (   cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->ro_list_head);
+        for (   cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->ro_list_head);
                 cur_ptr !=  (struct __node__ *) &this->sd_ptr->__null__;
-                cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+                cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
         {
                 struct reg_obj *r_ptr = (struct reg_obj *)cur_ptr;
-                if ( !strcmp(name, (char *) ipt_op_drf( &((struct reg_obj *)cur_ptr)->name) ) )
+                if ( !strcmp(name, (char *) ipt_link_drf( &((struct reg_obj *)cur_ptr)->name) ) )
                 {
                         break;
                 }
@@ -489,34 +568,40 @@ deregister_object(private_allocator_t *this, const char *name)
 
         if ( cur_ptr == (struct __node__ *)&this->sd_ptr->__null__ )
         {
+		sem_post(&this->sd_ptr->sem);
                 return NULL;
         }
 
-        /* Update the linkage */
-        if ( ipt_op_drf(&cur_ptr->prev) != &this->sd_ptr->__null__)
+        /* Update the linkage. The first and last elements move the head and the tail. */
+        if ( ipt_link_drf(&cur_ptr->prev) != &this->sd_ptr->__null__)
         {
-                ipt_op_set( &((struct __node__ *)ipt_op_drf(&cur_ptr->prev))->next, ipt_op_drf(&cur_ptr->next) );
+                ipt_link_set( &((struct __node__ *)ipt_link_drf(&cur_ptr->prev))->next, ipt_link_drf(&cur_ptr->next) );
         }
-        if ( ipt_op_drf(&cur_ptr->next) != &this->sd_ptr->__null__)
+        else
         {
-                ipt_op_set( &((struct __node__ *)ipt_op_drf(&cur_ptr->next))->prev, ipt_op_drf(&cur_ptr->prev));
+                ipt_link_set(&this->sd_ptr->ro_list_head, ipt_link_drf(&cur_ptr->next));
         }
-	if ( ipt_op_drf(&cur_ptr->prev) == &this->sd_ptr->__null__ && ipt_op_drf(&cur_ptr->next) == &this->sd_ptr->__null__)
-        { /* only a single element. Set the head and tail to null. */
-		ipt_op_set(&this->sd_ptr->ro_list_head,&this->sd_ptr->__null__);
-		ipt_op_set(&this->sd_ptr->ro_list_tail,&this->sd_ptr->__null__);
+        if ( ipt_link_drf(&cur_ptr->next) != &this->sd_ptr->__null__)
+        {
+                ipt_link_set( &((struct __node__ *)ipt_link_drf(&cur_ptr->next))->prev, ipt_link_drf(&cur_ptr->prev));
+        }
+        else
+        {
+                ipt_link_set(&this->sd_ptr->ro_list_tail, ipt_link_drf(&cur_ptr->prev));
         }
 
 	sem_post(&this->sd_ptr->sem);
 
+        item = ipt_link_drf( &((struct reg_obj *)cur_ptr)->item );
+
         /* free the name */
-        private_free(this,  (void *)ipt_op_drf( &((struct reg_obj *)cur_ptr)->name ) );
+        private_free(this,  (void *)ipt_link_drf( &((struct reg_obj *)cur_ptr)->name ) );
 
         /* free the registration object */
         private_free(this, (void *)cur_ptr );
 
         /* return the item. this is not free'd because the caller allocated it */
-        return ipt_op_drf( &((struct reg_obj *)cur_ptr)->item );
+        return item;
 }
 
 static void * 
@@ -526,14 +611,14 @@ find_registered_object(private_allocator_t *this, const char *name)
 
 	sem_wait(&this->sd_ptr->sem);
 
-        for (   cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->ro_list_head);
+        for (   cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->ro_list_head);
                 cur_ptr !=  (struct __node__ *) &this->sd_ptr->__null__;
-                cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+                cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
         {
-		if ( !strcmp(name, (char *) ipt_op_drf( &((struct reg_obj *)cur_ptr)->name) ) )
+		if ( !strcmp(name, (char *) ipt_link_drf( &((struct reg_obj *)cur_ptr)->name) ) )
 		{
 			sem_post(&this->sd_ptr->sem);
-			return (void *) ipt_op_drf( & (( struct reg_obj *)cur_ptr)->item);
+			return (void *) ipt_link_drf( & (( struct reg_obj *)cur_ptr)->item);
 		}
         }
 
@@ -595,6 +680,291 @@ destroy(ipt_allocator_t *this)
 	return;
 }
 
+static struct handle_entry *
+get_handle_entry(private_allocator_t *this, ipt_allocator_handle_t handle)
+{
+	if ( handle == IPT_ALLOCATOR_INVALID_HANDLE || handle > this->sd_ptr->handle_table_size )
+	{
+		return NULL;
+	}
+
+	return (struct handle_entry *) ipt_link_drf(&this->sd_ptr->handle_table) + handle - 1;
+}
+
+/* Return the handle entry when the block is movable, otherwise NULL. */
+static struct handle_entry *
+get_movable_entry(private_allocator_t *this, struct __node__ *n_ptr)
+{
+	struct handle_entry *h_ptr;
+
+	if ( n_ptr->size < sizeof(struct __node__) + sizeof(struct movable_hdr) )
+	{
+		return NULL;
+	}
+
+	h_ptr = get_handle_entry(this, ((struct movable_hdr *) ipt_add_offset((char *)n_ptr, sizeof(struct __node__)))->handle);
+
+	/* The table must point back at the block, otherwise this is ordinary user data */
+	if ( h_ptr == NULL || ipt_link_drf(&h_ptr->block) != n_ptr )
+	{
+		return NULL;
+	}
+
+	return h_ptr;
+}
+
+static int
+enable_relocation(private_allocator_t *this, size_t max_handles)
+{
+	struct handle_entry *table;
+	size_t i;
+
+	if ( max_handles == 0 || this->sd_ptr->handle_table_size != 0 )
+	{
+		return -1;
+	}
+
+	if ( (table = (struct handle_entry *) private_malloc(this, max_handles * sizeof(struct handle_entry))) == NULL )
+	{
+		return -1;
+	}
+
+	for ( i = 0; i < max_handles; i++ )
+	{
+		ipt_link_set(&table[i].block, &this->sd_ptr->__null__);
+		table[i].pin_count = 0;
+		table[i].next_free = i + 1 < max_handles ? i + 2 : IPT_ALLOCATOR_INVALID_HANDLE;
+	}
+
+	sem_wait(&this->sd_ptr->sem);
+
+	/* Another process won the race */
+	if ( this->sd_ptr->handle_table_size != 0 )
+	{
+		sem_post(&this->sd_ptr->sem);
+		private_free(this, table);
+		return -1;
+	}
+
+	ipt_link_set(&this->sd_ptr->handle_table, table);
+	this->sd_ptr->handle_table_size = max_handles;
+	this->sd_ptr->free_handle = 1;
+
+	sem_post(&this->sd_ptr->sem);
+
+	return 0;
+}
+
+static ipt_allocator_handle_t
+malloc_movable(private_allocator_t *this, size_t size)
+{
+	struct handle_entry *h_ptr;
+	struct movable_hdr *m_ptr;
+	ipt_allocator_handle_t handle;
+
+	if ( (m_ptr = (struct movable_hdr *) private_malloc(this, sizeof(struct movable_hdr) + size)) == NULL )
+	{
+		return IPT_ALLOCATOR_INVALID_HANDLE;
+	}
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (h_ptr = get_handle_entry(this, this->sd_ptr->free_handle)) == NULL )
+	{
+		sem_post(&this->sd_ptr->sem);
+		private_free(this, m_ptr);
+		return IPT_ALLOCATOR_INVALID_HANDLE;
+	}
+
+	handle = this->sd_ptr->free_handle;
+	this->sd_ptr->free_handle = h_ptr->next_free;
+
+	m_ptr->handle = handle;
+	h_ptr->pin_count = 0;
+	ipt_link_set(&h_ptr->block, ipt_sub_offset((char *)m_ptr, sizeof(struct __node__)));
+
+	sem_post(&this->sd_ptr->sem);
+
+	return handle;
+}
+
+static void
+free_movable(private_allocator_t *this, ipt_allocator_handle_t handle)
+{
+	struct handle_entry *h_ptr;
+	struct __node__ *n_ptr;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (h_ptr = get_handle_entry(this, handle)) == NULL || ipt_link_drf(&h_ptr->block) == &this->sd_ptr->__null__ )
+	{
+		sem_post(&this->sd_ptr->sem);
+		return;
+	}
+
+	n_ptr = (struct __node__ *) ipt_link_drf(&h_ptr->block);
+
+	/* Once the entry is released the compactor no longer considers the block movable */
+	ipt_link_set(&h_ptr->block, &this->sd_ptr->__null__);
+	h_ptr->pin_count = 0;
+	h_ptr->next_free = this->sd_ptr->free_handle;
+	this->sd_ptr->free_handle = handle;
+
+	sem_post(&this->sd_ptr->sem);
+
+	private_free(this, ipt_add_offset((char *)n_ptr, sizeof(struct __node__)));
+}
+
+static void *
+pin(private_allocator_t *this, ipt_allocator_handle_t handle)
+{
+	struct handle_entry *h_ptr;
+	char *ptr = NULL;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (h_ptr = get_handle_entry(this, handle)) != NULL && ipt_link_drf(&h_ptr->block) != &this->sd_ptr->__null__ )
+	{
+		h_ptr->pin_count++;
+		ptr = ipt_add_offset((char *)ipt_link_drf(&h_ptr->block), sizeof(struct __node__) + sizeof(struct movable_hdr));
+	}
+
+	sem_post(&this->sd_ptr->sem);
+
+	return ptr;
+}
+
+static void
+unpin(private_allocator_t *this, ipt_allocator_handle_t handle)
+{
+	struct handle_entry *h_ptr;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (h_ptr = get_handle_entry(this, handle)) != NULL && h_ptr->pin_count > 0 )
+	{
+		h_ptr->pin_count--;
+	}
+
+	sem_post(&this->sd_ptr->sem);
+}
+
+/*
+ * Slide the movable block down into the free block that precedes it. The free block
+ * moves up by the size of the movable block and is coalesced with the next free block
+ * when they become adjacent.
+ *
+ *  ---------------- ---------------- ----------------        ---------------- -------------------------------
+ * |   (free node)  |   (movable)    |   (free node)  |      |   (movable)    |       (free node)             |
+ *  ---------------- ---------------- ----------------        ---------------- -------------------------------
+ *         ^                ^                                                        ^
+ *      (f_ptr)          (b_ptr)                                                  (n_ptr)
+ */
+static struct __node__ *
+slide_block(private_allocator_t *this, struct __node__ *f_ptr, struct __node__ *b_ptr, struct handle_entry *h_ptr)
+{
+	struct __node__ *prev_ptr = (struct __node__ *) ipt_link_drf(&f_ptr->prev);
+	struct __node__ *next_ptr = (struct __node__ *) ipt_link_drf(&f_ptr->next);
+	struct __node__ *n_ptr;
+	size_t f_size = f_ptr->size;
+	size_t b_size = b_ptr->size;
+
+	memmove(f_ptr, b_ptr, b_size);
+
+	ipt_link_set(&h_ptr->block, f_ptr);
+
+	n_ptr = (struct __node__ *) ipt_add_offset((char *)f_ptr, b_size);
+
+	n_ptr->size = f_size;
+	ipt_link_set(&n_ptr->prev, prev_ptr);
+	ipt_link_set(&n_ptr->next, next_ptr);
+
+	if ( prev_ptr != (struct __node__ *) &this->sd_ptr->__null__ )
+	{
+		ipt_link_set(&prev_ptr->next, n_ptr);
+	}
+	else
+	{
+		ipt_link_set(&this->sd_ptr->free_list_head, n_ptr);
+	}
+
+	if ( next_ptr != (struct __node__ *) &this->sd_ptr->__null__ )
+	{
+		ipt_link_set(&next_ptr->prev, n_ptr);
+	}
+	else
+	{
+		ipt_link_set(&this->sd_ptr->free_list_tail, n_ptr);
+	}
+
+	/* Attempt to coalesce */
+	if ( next_ptr != (struct __node__ *) &this->sd_ptr->__null__ && ipt_add_offset((char *)n_ptr, n_ptr->size) == (char *)next_ptr )
+	{
+		n_ptr->size += next_ptr->size;
+
+		next_ptr = (struct __node__ *) ipt_link_drf(&next_ptr->next);
+
+		ipt_link_set(&n_ptr->next, next_ptr);
+
+		if ( next_ptr != (struct __node__ *) &this->sd_ptr->__null__ )
+		{
+			ipt_link_set(&next_ptr->prev, n_ptr);
+		}
+		else
+		{
+			ipt_link_set(&this->sd_ptr->free_list_tail, n_ptr);
+		}
+	}
+
+	return n_ptr;
+}
+
+static size_t
+compact(private_allocator_t *this, size_t budget)
+{
+	struct __node__ *cur_ptr;
+	struct __node__ *b_ptr;
+	struct handle_entry *h_ptr;
+	size_t moved = 0;
+	char *end_ptr;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	end_ptr = ipt_add_offset((char *)this->sd_ptr, sizeof(struct shared_data) + this->sd_ptr->size);
+
+	cur_ptr = (struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head);
+
+	while ( cur_ptr != (struct __node__ *) &this->sd_ptr->__null__ )
+	{
+		/* Moving blocks down into the last free block would not merge any free space */
+		if ( ipt_link_drf(&cur_ptr->next) == &this->sd_ptr->__null__ )
+		{
+			break;
+		}
+
+		b_ptr = (struct __node__ *) ipt_add_offset((char *)cur_ptr, cur_ptr->size);
+
+		if ( (char *)b_ptr >= end_ptr || (h_ptr = get_movable_entry(this, b_ptr)) == NULL || h_ptr->pin_count )
+		{
+			cur_ptr = (struct __node__ *) ipt_link_drf(&cur_ptr->next);
+			continue;
+		}
+
+		/* Bound the time slice */
+		if ( moved && moved + b_ptr->size > budget )
+		{
+			break;
+		}
+
+		moved += b_ptr->size;
+
+		cur_ptr = slide_block(this, cur_ptr, b_ptr, h_ptr);
+	}
+
+	sem_post(&this->sd_ptr->sem);
+
+	return moved;
+}
 static void * get_shared_ptr(private_allocator_t *this)
 {
         return (void *)this->sd_ptr;
@@ -604,9 +974,9 @@ static size_t free_blocks(private_allocator_t *this)
         size_t count = 0;
         struct __node__ *cur_ptr;
 
-        for (   cur_ptr = ( struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head);
+        for (   cur_ptr = ( struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head);
                 cur_ptr != (struct __node__ *) &this->sd_ptr->__null__;
-                cur_ptr = ( struct __node__ *) ipt_op_drf(&cur_ptr->next) )
+                cur_ptr = ( struct __node__ *) ipt_link_drf(&cur_ptr->next) )
         {
                 count++;
         }
@@ -627,6 +997,17 @@ ipt_allocator_t * ipt_allocator_shm_create(size_t size, ipt_allocator_shm_key_t
 int shmid;
 void *base_address;
 
+#ifdef IPT_COMPACT_OFFSETS
+	/* Compact offsets can not reach across larger segments */
+	if ( size > IPT_COP_MAX_SEGMENT )
+	{
+		return NULL;
+	}
+#endif
+
+	/* Keep the blocks carved from the end of the segment aligned */
+	size -= size % sizeof(ptrdiff_t);
+
        	if ( (shmid = shmget(id, size + sizeof(struct shared_data), IPC_CREAT | 0777) ) < 0  )
        	{
                	return NULL;
@@ -672,20 +1053,26 @@ void *base_address;
         this->public.get_shared_ptr = (void * (*)(ipt_allocator_t*) ) get_shared_ptr;
         this->public.bytes_remaining = (size_t (*)(ipt_allocator_t*) ) bytes_remaining;
         this->public.free_blocks = (size_t (*)(ipt_allocator_t*) ) free_blocks;
+        this->public.enable_relocation = (int (*)(ipt_allocator_t *, size_t) ) enable_relocation;
+        this->public.malloc_movable = (ipt_allocator_handle_t (*)(ipt_allocator_t *, size_t) ) malloc_movable;
+        this->public.free_movable = (void (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) free_movable;
+        this->public.pin = (void * (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) pin;
+        this->public.unpin = (void (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) unpin;
+        this->public.compact = (size_t (*)(ipt_allocator_t *, size_t) ) compact;
 
 
         /* Start the free list after the private_allocator_t */
-        ipt_op_set(&this->sd_ptr->free_list_head, ipt_add_offset((char *)this->sd_ptr,sizeof(struct shared_data)));
+        ipt_link_set(&this->sd_ptr->free_list_head, ipt_add_offset((char *)this->sd_ptr,sizeof(struct shared_data)));
 
         /* Start the free list after the private_allocator_t */
-        ipt_op_set(&this->sd_ptr->free_list_tail, ipt_add_offset((char *)this->sd_ptr,sizeof(struct shared_data)));
+        ipt_link_set(&this->sd_ptr->free_list_tail, ipt_add_offset((char *)this->sd_ptr,sizeof(struct shared_data)));
 
  	/* Set the node structure */
-        struct __node__ *n_ptr  = (struct __node__ *) ipt_op_drf(&this->sd_ptr->free_list_head);
+        struct __node__ *n_ptr  = (struct __node__ *) ipt_link_drf(&this->sd_ptr->free_list_head);
     
         /* Initialize the node structure */
-        ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-        ipt_op_set(&n_ptr->next, &this->sd_ptr->__null__);
+        ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+        ipt_link_set(&n_ptr->next, &this->sd_ptr->__null__);
 
         /* Shared data is added to original malloc. Node struct is counted as overhead in free block
          *       -----------------------------------------------------
@@ -700,8 +1087,8 @@ void *base_address;
         n_ptr->size = size;
 
 	/* Set the registered object list to null */
-	ipt_op_set(&this->sd_ptr->ro_list_head,&this->sd_ptr->__null__);
-	ipt_op_set(&this->sd_ptr->ro_list_tail,&this->sd_ptr->__null__);
+	ipt_link_set(&this->sd_ptr->ro_list_head,&this->sd_ptr->__null__);
+	ipt_link_set(&this->sd_ptr->ro_list_tail,&this->sd_ptr->__null__);
 
 	return (ipt_allocator_t *) this;
 }
@@ -743,6 +1130,12 @@ void *base_address;
         this->public.get_shared_ptr = (void * (*)(ipt_allocator_t*) ) get_shared_ptr;
         this->public.bytes_remaining = (size_t (*)(ipt_allocator_t*) ) bytes_remaining;
         this->public.free_blocks = (size_t (*)(ipt_allocator_t*) ) free_blocks;
+        this->public.enable_relocation = (int (*)(ipt_allocator_t *, size_t) ) enable_relocation;
+        this->public.malloc_movable = (ipt_allocator_handle_t (*)(ipt_allocator_t *, size_t) ) malloc_movable;
+        this->public.free_movable = (void (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) free_movable;
+        this->public.pin = (void * (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) pin;
+        this->public.unpin = (void (*)(ipt_allocator_t *, ipt_allocator_handle_t) ) unpin;
+        this->public.compact = (size_t (*)(ipt_allocator_t *, size_t) ) compact;
 
 
 	return (ipt_allocator_t *) this;
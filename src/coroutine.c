@@ -0,0 +1,387 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "coroutine.h"
+
+/*
+ * The operations a coroutine waits for.
+ */
+enum
+{
+	OP_NONE = 0,
+	OP_READ,
+	OP_READ_N,
+	OP_WRITE_N,
+	OP_SLEEP,
+	OP_DEQUEUE,
+	OP_YIELD
+};
+
+static void run(ipt_coroutine_t *this);
+
+static int
+get_handle(ipt_coroutine_t *this)
+{
+	return this->reg_handle;
+}
+
+/*
+ * The mask the operation waits for on its handle, 0 when it does not wait on a handle.
+ */
+static ipt_event_handler_mask_t
+op_mask(ipt_coroutine_t *this)
+{
+	switch ( this->op )
+	{
+		case OP_READ:
+		case OP_READ_N:
+		case OP_DEQUEUE:
+			return EVENT_HANDLER_READ_MASK;
+
+		case OP_WRITE_N:
+			return EVENT_HANDLER_WRITE_MASK;
+	}
+
+	return 0;
+}
+
+static void
+remove_registration(ipt_coroutine_t *this)
+{
+	if ( this->reg_mask )
+	{
+		this->reactor->remove_handler(this->reactor, &this->eh, this->reg_mask | EVENT_HANDLER_DONT_CALL_MASK);
+
+		this->reg_mask = 0;
+		this->reg_handle = -1;
+	}
+
+	if ( this->timer )
+	{
+		this->reactor->remove_timer(this->reactor, &this->eh);
+
+		this->timer = 0;
+	}
+}
+
+static void
+yield_work(ipt_coroutine_t *this)
+{
+	if ( this->op == OP_YIELD )
+	{
+		this->op = OP_NONE;
+
+		run(this);
+	}
+}
+
+/*
+ * Wait for the operation the body awaits. The handle stays registered while the body keeps waiting
+ * on it for the same events, so a loop of reads does not register it again for each read.
+ */
+static int
+arm(ipt_coroutine_t *this)
+{
+	ipt_event_handler_mask_t mask = op_mask(this);
+
+	if ( this->reg_mask && (this->reg_handle != this->handle || this->reg_mask != mask) )
+	{
+		this->reactor->remove_handler(this->reactor, &this->eh, this->reg_mask | EVENT_HANDLER_DONT_CALL_MASK);
+
+		this->reg_mask = 0;
+		this->reg_handle = -1;
+	}
+
+	if ( mask && this->reg_mask == 0 )
+	{
+		this->reg_handle = this->handle;
+
+		if ( this->reactor->register_handler(this->reactor, &this->eh, mask) < 0 )
+		{
+			this->reg_handle = -1;
+			return -1;
+		}
+
+		this->reg_mask = mask;
+	}
+
+	if ( this->op == OP_YIELD && this->reactor->post(this->reactor, (ipt_reactor_work_t) yield_work, this) < 0 )
+	{
+		return -1;
+	}
+
+	if ( this->has_timeout )
+	{
+		if ( this->reactor->schedule_timer(this->reactor, &this->eh, &this->timeout, NULL, NULL) < 0 )
+		{
+			return -1;
+		}
+
+		this->timer = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Run the body until it waits or finishes. An operation that can not be waited for completes
+ * with an error, and the body continues.
+ */
+static void
+run(ipt_coroutine_t *this)
+{
+	int status;
+
+	while ( (status = this->fn(this)) == IPT_COROUTINE_WAITING )
+	{
+		if ( arm(this) == 0 )
+		{
+			return;
+		}
+
+		this->result = errno ? -errno : -EIO;
+		this->op = OP_NONE;
+		this->has_timeout = 0;
+	}
+
+	this->op = OP_NONE;
+	this->line = -1;
+
+	remove_registration(this);
+
+	if ( this->done )
+	{
+		this->done(this);
+	}
+}
+
+/*
+ * The operation completed with the result. Cancel its timeout and continue the body.
+ */
+static void
+complete(ipt_coroutine_t *this, ssize_t result)
+{
+	this->result = result;
+	this->op = OP_NONE;
+	this->has_timeout = 0;
+
+	if ( this->timer )
+	{
+		this->reactor->remove_timer(this->reactor, &this->eh);
+
+		this->timer = 0;
+	}
+
+	run(this);
+}
+
+static int
+handle_input(ipt_coroutine_t *this, ipt_handle_t h)
+{
+	ssize_t n;
+
+	if ( this->op == OP_DEQUEUE )
+	{
+		this->node = this->sq_ptr->dequeue(this->sq_ptr);
+
+		complete(this, this->node ? 0 : -EIO);
+		return 0;
+	}
+
+	if ( this->op != OP_READ && this->op != OP_READ_N )
+	{
+		return 0;
+	}
+
+	if ( (n = read(h, this->buf + this->transferred, this->len - this->transferred)) < 0 )
+	{
+		if ( errno != EAGAIN && errno != EINTR )
+		{
+			complete(this, -errno);
+		}
+
+		return 0;
+	}
+
+	this->transferred += n;
+
+	if ( this->op == OP_READ || n == 0 || this->transferred == this->len )
+	{
+		complete(this, this->transferred);
+	}
+
+	return 0;
+}
+
+static int
+handle_output(ipt_coroutine_t *this, ipt_handle_t h)
+{
+	ssize_t n;
+
+	if ( this->op != OP_WRITE_N )
+	{
+		return 0;
+	}
+
+	if ( (n = write(h, this->buf + this->transferred, this->len - this->transferred)) < 0 )
+	{
+		if ( errno != EAGAIN && errno != EINTR )
+		{
+			complete(this, -errno);
+		}
+
+		return 0;
+	}
+
+	if ( (this->transferred += n) == this->len )
+	{
+		complete(this, this->transferred);
+	}
+
+	return 0;
+}
+
+static int
+handle_timeout(ipt_coroutine_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	/* The reactor releases the timer after the upcall */
+	this->timer = 0;
+
+	complete(this, this->op == OP_SLEEP ? 0 : -ETIMEDOUT);
+
+	return 0;
+}
+
+/*
+ * Record the operation the body is about to await.
+ */
+static int
+prepare(ipt_coroutine_t *this, int op, ipt_handle_t h, void *buf, size_t len, const ipt_time_value_t *tv)
+{
+	if ( this->op != OP_NONE || (tv && (tv->tv_sec < 0 || tv->tv_usec < 0)) )
+	{
+		this->result = -EINVAL;
+		errno = EINVAL;
+		return -1;
+	}
+
+	this->op = op;
+	this->handle = h;
+	this->buf = buf;
+	this->len = len;
+	this->transferred = 0;
+	this->has_timeout = tv != NULL;
+
+	if ( tv )
+	{
+		this->timeout = *tv;
+	}
+
+	return 0;
+}
+
+void ipt_coroutine_init(ipt_coroutine_t *this, ipt_reactor_t *reactor, ipt_coroutine_fn_t fn)
+{
+	memset(this, 0, sizeof(ipt_coroutine_t));
+
+	this->reactor = reactor;
+	this->fn = fn;
+	this->handle = -1;
+	this->reg_handle = -1;
+
+	this->eh.handle_input   = (int (*)(ipt_event_handler_t *, ipt_handle_t)) handle_input;
+	this->eh.handle_output  = (int (*)(ipt_event_handler_t *, ipt_handle_t)) handle_output;
+	this->eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *, const void *)) handle_timeout;
+	this->eh.get_handle     = (int (*)(ipt_event_handler_t *)) get_handle;
+}
+
+int ipt_coroutine_start(ipt_coroutine_t *this)
+{
+	if ( this->line > 0 || this->op != OP_NONE )
+	{
+		return -1;
+	}
+
+	this->line = 0;
+	this->result = 0;
+	this->node = NULL;
+
+	run(this);
+
+	return 0;
+}
+
+void ipt_coroutine_cancel(ipt_coroutine_t *this)
+{
+	remove_registration(this);
+
+	this->op = OP_NONE;
+	this->has_timeout = 0;
+	this->line = -1;
+}
+
+int ipt_coroutine_read(ipt_coroutine_t *this, ipt_handle_t h, void *buf, size_t len, const ipt_time_value_t *tv)
+{
+	if ( h < 0 || len == 0 )
+	{
+		this->result = -EINVAL;
+		return -1;
+	}
+
+	return prepare(this, OP_READ, h, buf, len, tv);
+}
+
+int ipt_coroutine_read_n(ipt_coroutine_t *this, ipt_handle_t h, void *buf, size_t len, const ipt_time_value_t *tv)
+{
+	if ( h < 0 || len == 0 )
+	{
+		this->result = -EINVAL;
+		return -1;
+	}
+
+	return prepare(this, OP_READ_N, h, buf, len, tv);
+}
+
+int ipt_coroutine_write_n(ipt_coroutine_t *this, ipt_handle_t h, const void *buf, size_t len, const ipt_time_value_t *tv)
+{
+	if ( h < 0 || len == 0 )
+	{
+		this->result = -EINVAL;
+		return -1;
+	}
+
+	return prepare(this, OP_WRITE_N, h, (void *)buf, len, tv);
+}
+
+int ipt_coroutine_sleep(ipt_coroutine_t *this, const ipt_time_value_t *tv)
+{
+	if ( tv == NULL )
+	{
+		this->result = -EINVAL;
+		return -1;
+	}
+
+	return prepare(this, OP_SLEEP, -1, NULL, 0, tv);
+}
+
+int ipt_coroutine_dequeue(ipt_coroutine_t *this, ipt_shared_queue_t *sq_ptr, const ipt_time_value_t *tv)
+{
+	if ( sq_ptr == NULL || prepare(this, OP_DEQUEUE, sq_ptr->get_fd(sq_ptr), NULL, 0, tv) < 0 )
+	{
+		this->result = -EINVAL;
+		return -1;
+	}
+
+	this->sq_ptr = sq_ptr;
+	this->node = NULL;
+
+	return 0;
+}
+
+int ipt_coroutine_yield(ipt_coroutine_t *this)
+{
+	return prepare(this, OP_YIELD, -1, NULL, 0, NULL);
+}
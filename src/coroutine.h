@@ -0,0 +1,250 @@
+#ifndef __IPCTOOLS_COROUTINE_H__
+#define __IPCTOOLS_COROUTINE_H__
+
+#include "reactor.h"
+#include "shared_queue.h"
+
+/**
+ * \addtogroup Reactor
+ * @{
+ */
+
+/**
+ * typedef for the coroutine structure.
+ */
+typedef struct ipt_coroutine_t ipt_coroutine_t;
+
+/**
+ * The body of a coroutine. It is called again each time the operation it waits for completes,
+ * and continues after the IPT_CO_AWAIT it returned from.
+ *
+ * @param[in] this The coroutine.
+ *
+ * @retval IPT_COROUTINE_WAITING The coroutine waits for an operation.
+ * @retval IPT_COROUTINE_DONE The coroutine has finished.
+ */
+typedef int (*ipt_coroutine_fn_t)(ipt_coroutine_t *this);
+
+/**
+ * The value returned by the body of a coroutine.
+ */
+enum ipt_coroutine_status_t
+{
+	IPT_COROUTINE_WAITING = 0,
+	IPT_COROUTINE_DONE    = 1
+};
+
+/**
+ * @struct ipt_coroutine_t
+ *
+ * @brief A stackless coroutine driven by a reactor.
+ *
+ * The coroutine is an event handler. It waits for its operations by registering itself with the
+ * reactor, and performs them from the upcalls, so the body reads as sequential code without a
+ * thread or a stack of its own. The body is a function written between IPT_CO_BEGIN and IPT_CO_END.
+ * Each wait returns from the function, so local variables do not survive an IPT_CO_AWAIT. Keep
+ * the state in a structure that starts with the coroutine, in the same way as event handlers:
+ *
+ *  struct echo {
+ *     ipt_coroutine_t co;
+ *     char buf[64];
+ *  };
+ *
+ *  static int echo_run(ipt_coroutine_t *co)
+ *  {
+ *     struct echo *e = (struct echo *)co;
+ *
+ *     IPT_CO_BEGIN(co);
+ *
+ *     IPT_CO_AWAIT(co, ipt_coroutine_read(co, fd, e->buf, sizeof(e->buf), NULL));
+ *
+ *     if ( co->result > 0 )
+ *        IPT_CO_AWAIT(co, ipt_coroutine_write_n(co, fd, e->buf, co->result, NULL));
+ *
+ *     IPT_CO_END(co);
+ *  }
+ *
+ * A coroutine waits on one handle at a time, and a handle may only be used by one handler. The body
+ * may not await from within a switch statement, nor twice on the same line.
+ */
+struct ipt_coroutine_t
+{
+	/** the handler registered with the reactor */
+	ipt_event_handler_t eh;
+
+	/** the reactor driving the coroutine */
+	ipt_reactor_t *reactor;
+
+	/** the body */
+	ipt_coroutine_fn_t fn;
+
+	/** called once the coroutine has finished, may free it. May be NULL. */
+	void (*done)(ipt_coroutine_t *this);
+
+	/** where the body continues, 0 before it starts and -1 once it has finished */
+	int line;
+
+	/** result of the last operation, the bytes transferred or -errno. -ETIMEDOUT when it timed out. */
+	ssize_t result;
+
+	/** item taken from the queue by the last ipt_coroutine_dequeue */
+	ipt_shared_queue_node_t *node;
+
+	/** The operation waited for. The rest is private to the coroutine. */
+	int op;
+	ipt_handle_t handle;
+	char *buf;
+	size_t len;
+	size_t transferred;
+	ipt_shared_queue_t *sq_ptr;
+	ipt_time_value_t timeout;
+	int has_timeout;
+
+	/** the handle and mask registered with the reactor, and whether a timer is scheduled */
+	ipt_handle_t reg_handle;
+	ipt_event_handler_mask_t reg_mask;
+	int timer;
+};
+
+/**
+ * Start the body of the coroutine. Continues with IPT_CO_AWAIT and IPT_CO_YIELD.
+ */
+#define IPT_CO_BEGIN(co) switch ( (co)->line ) { case 0:
+
+/**
+ * Wait for an operation. The operation is one of the ipt_coroutine_* calls. The body continues
+ * after the operation completed with co->result, or right away when the operation failed.
+ */
+#define IPT_CO_AWAIT(co, op)                    \
+	do                                      \
+	{                                       \
+		if ( (op) == 0 )                \
+		{                               \
+			(co)->line = __LINE__;  \
+			return IPT_COROUTINE_WAITING; \
+			case __LINE__:;         \
+		}                               \
+	} while ( 0 )
+
+/**
+ * Let the other handlers run first. The coroutine continues as work posted to the reactor.
+ */
+#define IPT_CO_YIELD(co) IPT_CO_AWAIT(co, ipt_coroutine_yield(co))
+
+/**
+ * Finish the coroutine from the body.
+ */
+#define IPT_CO_EXIT(co) do { (co)->line = -1; return IPT_COROUTINE_DONE; } while ( 0 )
+
+/**
+ * End the body of the coroutine.
+ */
+#define IPT_CO_END(co) } (co)->line = -1; return IPT_COROUTINE_DONE
+
+/**
+ * Initialize a coroutine.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] reactor The reactor driving the coroutine.
+ * @param[in] fn The body.
+ */
+void ipt_coroutine_init(ipt_coroutine_t *this, ipt_reactor_t *reactor, ipt_coroutine_fn_t fn);
+
+/**
+ * Run the body until it waits for its first operation. Must be called from the thread running the
+ * reactor, or while the reactor is not running.
+ *
+ * @param[in] this The coroutine.
+ *
+ * @retval 0 The coroutine was started, it may have finished already.
+ * @retval -1 The coroutine is already running.
+ */
+int ipt_coroutine_start(ipt_coroutine_t *this);
+
+/**
+ * Stop the coroutine, and remove it from the reactor. The done callback is not called. A coroutine
+ * that yielded must stay valid until the next pass of the event loop.
+ *
+ * @param[in] this The coroutine.
+ */
+void ipt_coroutine_cancel(ipt_coroutine_t *this);
+
+/**
+ * Read up to len bytes once the handle is readable. The result is the number of bytes read, 0 at the
+ * end of the input.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] h The handle.
+ * @param[out] buf The buffer.
+ * @param[in] len The size of the buffer.
+ * @param[in] tv The longest time to wait, NULL waits until the handle is readable.
+ *
+ * @retval 0 Await the read.
+ * @retval -1 The read can not be waited for.
+ */
+int ipt_coroutine_read(ipt_coroutine_t *this, ipt_handle_t h, void *buf, size_t len, const ipt_time_value_t *tv);
+
+/**
+ * Read len bytes, like recv_n, without blocking the reactor. The result is len, fewer bytes when the
+ * input ended first, or -errno.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] h The handle.
+ * @param[out] buf The buffer.
+ * @param[in] len The number of bytes to read.
+ * @param[in] tv The longest time to wait for all of them, NULL waits until they are read.
+ *
+ * @retval 0 Await the read.
+ * @retval -1 The read can not be waited for.
+ */
+int ipt_coroutine_read_n(ipt_coroutine_t *this, ipt_handle_t h, void *buf, size_t len, const ipt_time_value_t *tv);
+
+/**
+ * Write len bytes, like send_n, without blocking the reactor. The result is len or -errno.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] h The handle.
+ * @param[in] buf The buffer.
+ * @param[in] len The number of bytes to write.
+ * @param[in] tv The longest time to wait for all of them, NULL waits until they are written.
+ *
+ * @retval 0 Await the write.
+ * @retval -1 The write can not be waited for.
+ */
+int ipt_coroutine_write_n(ipt_coroutine_t *this, ipt_handle_t h, const void *buf, size_t len, const ipt_time_value_t *tv);
+
+/**
+ * Sleep on a reactor timer. The result is 0.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] tv The time to sleep.
+ *
+ * @retval 0 Await the timer.
+ * @retval -1 The time is not valid.
+ */
+int ipt_coroutine_sleep(ipt_coroutine_t *this, const ipt_time_value_t *tv);
+
+/**
+ * Take the next item from a shared queue once its doorbell rings. The item is left in co->node,
+ * and the result is 0. The coroutine must be the only reader of the queue in this process.
+ *
+ * @param[in] this The coroutine.
+ * @param[in] sq_ptr The queue.
+ * @param[in] tv The longest time to wait, NULL waits for an item.
+ *
+ * @retval 0 Await the item.
+ * @retval -1 The queue can not be waited for.
+ */
+int ipt_coroutine_dequeue(ipt_coroutine_t *this, ipt_shared_queue_t *sq_ptr, const ipt_time_value_t *tv);
+
+/**
+ * Continue as work posted to the reactor, after the upcalls of this pass. Use IPT_CO_YIELD.
+ *
+ * @param[in] this The coroutine.
+ *
+ * @retval 0 Await the next pass.
+ */
+int ipt_coroutine_yield(ipt_coroutine_t *this);
+
+/** @} */
+#endif
@@ -41,7 +41,9 @@ enum ipt_event_handler_mask_t
 	EVENT_HANDLER_EXCEPT_MASK     = 1<<2,
 	EVENT_HANDLER_SIGNAL_MASK     = 1<<3,
 	EVENT_HANDLER_TIMER_MASK      = 1<<4,
-	EVENT_HANDLER_DONT_CALL_MASK  = 1<<5
+	EVENT_HANDLER_DONT_CALL_MASK  = 1<<5,
+	EVENT_HANDLER_EDGE_TRIGGERED_MASK = 1<<6, /**< Only dispatch on new readiness ( epoll reactor ). */
+	EVENT_HANDLER_ACCEPT_MASK     = 1<<7  /**< A submitted accept completed. */
 };
 
 /**
@@ -107,6 +109,18 @@ struct ipt_event_handler_t
 	 */
 	int (*handle_close)(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask);
 
+	/**
+	 * Called when a read, write or accept submitted to the reactor has completed.
+	 * handle_close is called with the mask when this returns -1.
+	 *
+	 * @param fd I/O handle the operation was submitted for.
+	 * @param mask EVENT_HANDLER_READ_MASK, EVENT_HANDLER_WRITE_MASK or EVENT_HANDLER_ACCEPT_MASK.
+	 * @param result The number of bytes transferred, the accepted handle, or -errno.
+	 * @param buf The buffer passed to the reactor, NULL for an accept.
+	 * @param act The asynchronous completion token passed in when the operation was submitted.
+	 */
+	int (*handle_completion)(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask, ssize_t result, void *buf, const void *act);
+
        /**
          * Destroy the reactor. 
          *
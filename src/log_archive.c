@@ -0,0 +1,594 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef IPT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "log_archive.h"
+#include "support.h"
+
+#define ARCHIVE_MAGIC   "IPTLOGA"
+#define ARCHIVE_VERSION (1)
+#define INDEX_MAGIC     (0x31584449)
+
+typedef struct private_log_archive_t private_log_archive_t;
+typedef struct header_t header_t;
+typedef struct trailer_t trailer_t;
+typedef struct record_t record_t;
+
+/**
+ * @struct header_t
+ *
+ * @brief The start of an archive.
+ */
+struct header_t
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t flags;
+};
+
+/**
+ * @struct trailer_t
+ *
+ * @brief The end of an archive that was closed, after the index.
+ */
+struct trailer_t
+{
+	uint64_t index_offset;
+	uint32_t num_chunks;
+	uint32_t magic;
+};
+
+/**
+ * @struct record_t
+ *
+ * @brief A record in a chunk, followed by the originator and the message. Records are not
+ *        aligned in the chunk, they are copied in and out.
+ */
+struct record_t
+{
+	uint64_t timestamp;
+	uint32_t category_mask;
+	uint32_t level_mask;
+	uint16_t originator_len;
+	uint16_t message_len;
+	uint32_t pad;
+};
+
+struct private_log_archive_t
+{
+	ipt_log_archive_t public;
+
+	int fd;
+	unsigned int flags;
+
+	/* The bytes in the file */
+	size_t size;
+
+	/* The chunk being filled, and its records */
+	ipt_log_archive_chunk_t current;
+	char *chunk;
+
+	/* The compressed records */
+	char *stored;
+	size_t stored_size;
+
+	/* The chunks written, for the index */
+	ipt_log_archive_chunk_t *index;
+	unsigned int num_chunks;
+	unsigned int max_chunks;
+};
+
+uint64_t
+ipt_log_archive_originator_bits(const char *originator)
+{
+	uint64_t h = 14695981039346656037ULL;
+	unsigned int i;
+
+	/* As the logger stores it */
+	for ( i = 0; originator[i] != '\0' && i < sizeof(((ipt_logger_message_t *)0)->originator) - 1; i++ )
+	{
+		h = (h ^ (unsigned char)originator[i]) * 1099511628211ULL;
+	}
+
+	return (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63));
+}
+
+static int
+add_chunk(ipt_log_archive_chunk_t **index, unsigned int *num_chunks, unsigned int *max_chunks, const ipt_log_archive_chunk_t *c)
+{
+	ipt_log_archive_chunk_t *ptr;
+
+	if ( *num_chunks == *max_chunks )
+	{
+		if ( (ptr = realloc(*index, (*max_chunks ? *max_chunks * 2 : 64) * sizeof(ipt_log_archive_chunk_t))) == NULL )
+		{
+			return -1;
+		}
+
+		*index = ptr;
+		*max_chunks = *max_chunks ? *max_chunks * 2 : 64;
+	}
+
+	(*index)[(*num_chunks)++] = *c;
+
+	return 0;
+}
+
+/*
+ * Read the index of the archive, from the end of the file once it was closed. Otherwise the
+ * chunk headers are read, seeking over the records, up to the last chunk written in full.
+ * *end is where the chunks end.
+ */
+static int
+read_index(int fd, ipt_log_archive_chunk_t **index, unsigned int *num_chunks, unsigned int *max_chunks, size_t *end)
+{
+	ipt_log_archive_chunk_t c;
+	struct stat st;
+	header_t header;
+	trailer_t trailer;
+	size_t pos, size;
+
+	*index = NULL;
+	*num_chunks = *max_chunks = 0;
+
+	if ( fstat(fd, &st) < 0 || (size = st.st_size) < sizeof(header_t) )
+	{
+		return -1;
+	}
+
+	if ( pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 || header.version != ARCHIVE_VERSION )
+	{
+		return -1;
+	}
+
+	if ( size >= sizeof(header_t) + sizeof(trailer_t) &&
+	     pread(fd, &trailer, sizeof(trailer), size - sizeof(trailer)) == sizeof(trailer) && trailer.magic == INDEX_MAGIC &&
+	     trailer.index_offset >= sizeof(header_t) &&
+	     trailer.index_offset + trailer.num_chunks * sizeof(ipt_log_archive_chunk_t) + sizeof(trailer_t) == size )
+	{
+		if ( trailer.num_chunks && (*index = malloc(trailer.num_chunks * sizeof(ipt_log_archive_chunk_t))) == NULL )
+		{
+			return -1;
+		}
+
+		if ( pread(fd, *index, trailer.num_chunks * sizeof(ipt_log_archive_chunk_t), trailer.index_offset) == (ssize_t)(trailer.num_chunks * sizeof(ipt_log_archive_chunk_t)) )
+		{
+			*num_chunks = *max_chunks = trailer.num_chunks;
+			*end = trailer.index_offset;
+			return 0;
+		}
+
+		free(*index);
+		*index = NULL;
+	}
+
+	for ( pos = sizeof(header_t); pos + sizeof(c) <= size; pos += sizeof(c) + c.stored_size )
+	{
+		if ( pread(fd, &c, sizeof(c), pos) != sizeof(c) || c.magic != LOG_ARCHIVE_CHUNK_MAGIC || c.offset != pos ||
+		     pos + sizeof(c) + c.stored_size > size )
+		{
+			break;
+		}
+
+		if ( add_chunk(index, num_chunks, max_chunks, &c) < 0 )
+		{
+			free(*index);
+			*index = NULL;
+			return -1;
+		}
+	}
+
+	*end = pos;
+
+	return 0;
+}
+
+static int
+write_all(int fd, const void *buf, size_t len, size_t offset)
+{
+	ssize_t n;
+
+	while ( len )
+	{
+		if ( (n = pwrite(fd, buf, len, offset)) <= 0 )
+		{
+			return -1;
+		}
+
+		buf = (const char *)buf + n;
+		len -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static int
+flush(private_log_archive_t *this)
+{
+	ipt_log_archive_chunk_t *c = &this->current;
+	const char *records = this->chunk;
+	int rtn = 0;
+
+	if ( c->count == 0 )
+	{
+		return 0;
+	}
+
+	c->magic = LOG_ARCHIVE_CHUNK_MAGIC;
+	c->offset = this->size;
+	c->stored_size = c->raw_size;
+
+#ifdef IPT_HAVE_ZLIB
+	if ( this->flags & IPT_LOG_ARCHIVE_COMPRESS )
+	{
+		uLongf len = this->stored_size;
+
+		/* Kept as they are when they do not get smaller */
+		if ( compress2((Bytef *)this->stored, &len, (const Bytef *)this->chunk, c->raw_size, Z_BEST_SPEED) == Z_OK && len < c->raw_size )
+		{
+			records = this->stored;
+			c->stored_size = len;
+			c->flags |= IPT_LOG_ARCHIVE_COMPRESS;
+		}
+	}
+#endif
+
+	if ( add_chunk(&this->index, &this->num_chunks, &this->max_chunks, c) < 0 ||
+	     write_all(this->fd, c, sizeof(*c), this->size) < 0 || write_all(this->fd, records, c->stored_size, this->size + sizeof(*c)) < 0 )
+	{
+		/* A chunk written in part is cut off, and forgotten */
+		if ( this->num_chunks && this->index[this->num_chunks - 1].offset == this->size )
+		{
+			this->num_chunks--;
+		}
+
+		(void)!ftruncate(this->fd, this->size);
+
+		rtn = -1;
+	}
+	else
+	{
+		this->size += sizeof(*c) + c->stored_size;
+		rtn = 1;
+	}
+
+	memset(c, 0, sizeof(*c));
+
+	return rtn;
+}
+
+static int
+append(private_log_archive_t *this, const ipt_logger_message_t *msg)
+{
+	ipt_log_archive_chunk_t *c = &this->current;
+	record_t record;
+	size_t size;
+	char *ptr;
+	int rtn = 0;
+
+	memset(&record, 0, sizeof(record));
+
+	record.timestamp = msg->timestamp;
+	record.category_mask = msg->cmask;
+	record.level_mask = msg->lmask;
+	record.originator_len = strnlen(msg->originator, sizeof(msg->originator) - 1);
+	record.message_len = msg->length ? msg->length - 1 : 0;
+
+	size = sizeof(record) + record.originator_len + record.message_len;
+
+	if ( c->raw_size + size > LOG_ARCHIVE_CHUNK_SIZE && (rtn = flush(this)) < 0 )
+	{
+		return -1;
+	}
+
+	ptr = this->chunk + c->raw_size;
+
+	memcpy(ptr, &record, sizeof(record));
+	memcpy(ptr + sizeof(record), msg->originator, record.originator_len);
+	memcpy(ptr + sizeof(record) + record.originator_len, msg->message, record.message_len);
+
+	if ( c->count == 0 || record.timestamp < c->first_ts )
+	{
+		c->first_ts = record.timestamp;
+	}
+
+	if ( record.timestamp > c->last_ts )
+	{
+		c->last_ts = record.timestamp;
+	}
+
+	c->originators |= ipt_log_archive_originator_bits(msg->originator);
+	c->level_mask |= record.level_mask;
+	c->category_mask |= record.category_mask;
+	c->raw_size += size;
+	c->count++;
+
+	return rtn;
+}
+
+static size_t
+get_size(private_log_archive_t *this, size_t *pending)
+{
+	if ( pending )
+	{
+		*pending = this->current.count ? sizeof(ipt_log_archive_chunk_t) + this->current.raw_size : 0;
+	}
+
+	return this->size;
+}
+
+static void
+destroy(private_log_archive_t *this)
+{
+	trailer_t trailer;
+
+	flush(this);
+
+	trailer.index_offset = this->size;
+	trailer.num_chunks = this->num_chunks;
+	trailer.magic = INDEX_MAGIC;
+
+	/* Without the index, a reader reads the chunk headers */
+	if ( write_all(this->fd, this->index, this->num_chunks * sizeof(ipt_log_archive_chunk_t), this->size) == 0 )
+	{
+		write_all(this->fd, &trailer, sizeof(trailer), this->size + this->num_chunks * sizeof(ipt_log_archive_chunk_t));
+	}
+
+	free(this->index);
+	free(this->stored);
+	free(this->chunk);
+	free(this);
+}
+
+ipt_log_archive_t *ipt_log_archive_create(int fd, unsigned int flags)
+{
+	private_log_archive_t *this;
+	struct stat st;
+	header_t header;
+
+#ifndef IPT_HAVE_ZLIB
+	if ( flags & IPT_LOG_ARCHIVE_COMPRESS )
+	{
+		return NULL;
+	}
+#endif
+
+	if ( fstat(fd, &st) < 0 || (this = malloc(sizeof(private_log_archive_t))) == NULL )
+	{
+		return NULL;
+	}
+
+	memset(this, 0, sizeof(private_log_archive_t));
+
+	this->fd = fd;
+	this->flags = flags;
+
+	if ( (this->chunk = malloc(LOG_ARCHIVE_CHUNK_SIZE)) == NULL )
+	{
+		free(this);
+		return NULL;
+	}
+
+#ifdef IPT_HAVE_ZLIB
+	if ( flags & IPT_LOG_ARCHIVE_COMPRESS )
+	{
+		this->stored_size = compressBound(LOG_ARCHIVE_CHUNK_SIZE);
+
+		if ( (this->stored = malloc(this->stored_size)) == NULL )
+		{
+			free(this->chunk);
+			free(this);
+			return NULL;
+		}
+	}
+#endif
+
+	if ( st.st_size == 0 )
+	{
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+		header.version = ARCHIVE_VERSION;
+
+		if ( write_all(fd, &header, sizeof(header), 0) < 0 )
+		{
+			free(this->stored);
+			free(this->chunk);
+			free(this);
+			return NULL;
+		}
+
+		this->size = sizeof(header);
+	}
+	else if ( read_index(fd, &this->index, &this->num_chunks, &this->max_chunks, &this->size) < 0 || ftruncate(fd, this->size) < 0 )
+	{
+		/* Appended to after the last chunk, the index is written again when the archive is closed */
+		free(this->index);
+		free(this->stored);
+		free(this->chunk);
+		free(this);
+		return NULL;
+	}
+
+	this->public.append   = (int (*)(ipt_log_archive_t *, const ipt_logger_message_t *)) append;
+	this->public.flush    = (int (*)(ipt_log_archive_t *)) flush;
+	this->public.get_size = (size_t (*)(ipt_log_archive_t *, size_t *)) get_size;
+	this->public.destroy  = (void (*)(ipt_log_archive_t *)) destroy;
+
+	return &this->public;
+}
+
+static int
+chunk_matches(const ipt_log_archive_chunk_t *c, const ipt_log_archive_query_t *q, uint64_t bits)
+{
+	if ( (q->from_ns && c->last_ts < q->from_ns) || (q->to_ns && c->first_ts > q->to_ns) )
+	{
+		return 0;
+	}
+
+	if ( (q->level_mask && !(c->level_mask & q->level_mask)) || (q->category_mask && !(c->category_mask & q->category_mask)) )
+	{
+		return 0;
+	}
+
+	return (c->originators & bits) == bits;
+}
+
+static int
+record_matches(const record_t *r, const char *originator, const ipt_log_archive_query_t *q)
+{
+	if ( (q->from_ns && r->timestamp < q->from_ns) || (q->to_ns && r->timestamp > q->to_ns) )
+	{
+		return 0;
+	}
+
+	if ( (q->level_mask && !(r->level_mask & q->level_mask)) || (q->category_mask && !(r->category_mask & q->category_mask)) )
+	{
+		return 0;
+	}
+
+	return q->originator == NULL ||
+	       (r->originator_len == strnlen(q->originator, sizeof(((ipt_logger_message_t *)0)->originator) - 1) &&
+	        memcmp(originator, q->originator, r->originator_len) == 0);
+}
+
+/*
+ * Read the records of a chunk, and call the callback with those that match.
+ */
+static int
+read_chunk(int fd, const ipt_log_archive_chunk_t *c, const ipt_log_archive_query_t *q, time_cache_t *cache, char *records, char *stored,
+           void (*func)(const ipt_logger_message_t *const, void *), void *in_ptr)
+{
+	uint64_t buf[LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf;
+	record_t record;
+	size_t pos;
+	int count = 0;
+
+	if ( c->raw_size > LOG_ARCHIVE_CHUNK_SIZE + LOGGER_MESSAGE_BUFFER_SIZE || c->stored_size > c->raw_size ||
+	     pread(fd, stored, c->stored_size, c->offset + sizeof(*c)) != c->stored_size )
+	{
+		return -1;
+	}
+
+	if ( c->flags & IPT_LOG_ARCHIVE_COMPRESS )
+	{
+#ifdef IPT_HAVE_ZLIB
+		uLongf len = c->raw_size;
+
+		if ( uncompress((Bytef *)records, &len, (const Bytef *)stored, c->stored_size) != Z_OK || len != c->raw_size )
+		{
+			return -1;
+		}
+#else
+		return -1;
+#endif
+	}
+	else
+	{
+		memcpy(records, stored, c->raw_size);
+	}
+
+	for ( pos = 0; pos + sizeof(record) <= c->raw_size; pos += sizeof(record) + record.originator_len + record.message_len )
+	{
+		memcpy(&record, records + pos, sizeof(record));
+
+		if ( pos + sizeof(record) + record.originator_len + record.message_len > c->raw_size ||
+		     record.originator_len >= sizeof(msg->originator) || record.message_len >= LOGGER_MAX_MESSAGE_SIZE )
+		{
+			return -1;
+		}
+
+		if ( !record_matches(&record, records + pos + sizeof(record), q) )
+		{
+			continue;
+		}
+
+		memset(msg, 0, offsetof(ipt_logger_message_t, message));
+
+		msg->cmask = record.category_mask;
+		msg->lmask = record.level_mask;
+		msg->timestamp = record.timestamp;
+		msg->length = record.message_len + 1;
+
+		memcpy(msg->originator, records + pos + sizeof(record), record.originator_len);
+		memcpy(msg->message, records + pos + sizeof(record) + record.originator_len, record.message_len);
+		msg->message[record.message_len] = '\0';
+
+		format_time(cache, record.timestamp, msg->time, sizeof(msg->time));
+
+		func(msg, in_ptr);
+		count++;
+	}
+
+	return count;
+}
+
+int
+ipt_log_archive_query(const char *path, const ipt_log_archive_query_t *query, void (*func)(const ipt_logger_message_t *const, void *), void *in_ptr)
+{
+	ipt_log_archive_query_t all;
+	ipt_log_archive_chunk_t *index;
+	unsigned int num_chunks, max_chunks, i;
+	time_cache_t cache = TIME_CACHE_INITIALIZER;
+	char *records = NULL, *stored = NULL;
+	uint64_t bits;
+	size_t end;
+	int fd, n, count = 0;
+
+	if ( query == NULL )
+	{
+		memset(&all, 0, sizeof(all));
+		query = &all;
+	}
+
+	if ( (fd = open(path, O_RDONLY)) < 0 )
+	{
+		return -1;
+	}
+
+	if ( read_index(fd, &index, &num_chunks, &max_chunks, &end) < 0 )
+	{
+		close(fd);
+		return -1;
+	}
+
+	bits = query->originator ? ipt_log_archive_originator_bits(query->originator) : 0;
+
+	for ( i = 0; i < num_chunks; i++ )
+	{
+		if ( !chunk_matches(&index[i], query, bits) )
+		{
+			continue;
+		}
+
+		/* Large enough for any chunk */
+		if ( records == NULL && ((records = malloc(LOG_ARCHIVE_CHUNK_SIZE + LOGGER_MESSAGE_BUFFER_SIZE)) == NULL ||
+		                         (stored = malloc(LOG_ARCHIVE_CHUNK_SIZE + LOGGER_MESSAGE_BUFFER_SIZE)) == NULL) )
+		{
+			count = -1;
+			break;
+		}
+
+		/* A damaged chunk is passed over */
+		if ( (n = read_chunk(fd, &index[i], query, &cache, records, stored, func, in_ptr)) > 0 )
+		{
+			count += n;
+		}
+	}
+
+	free(records);
+	free(stored);
+	free(index);
+	close(fd);
+
+	return count;
+}
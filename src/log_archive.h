@@ -0,0 +1,191 @@
+#ifndef __IPCTOOLS_LOG_ARCHIVE_H__
+#define __IPCTOOLS_LOG_ARCHIVE_H__
+
+#include <stdint.h>
+#include "logger.h"
+
+/** The raw size of a chunk of records. A chunk is written once it is full, or flushed. */
+#define LOG_ARCHIVE_CHUNK_SIZE (64 * 1024)
+
+/** The magic number of a chunk header */
+#define LOG_ARCHIVE_CHUNK_MAGIC (0x4b4e4843)
+
+/**
+ * typedef for the log archive structure
+ */
+typedef struct ipt_log_archive_t ipt_log_archive_t;
+
+/**
+ * typedef for the chunk header of a log archive
+ */
+typedef struct ipt_log_archive_chunk_t ipt_log_archive_chunk_t;
+
+/**
+ * typedef for a query of a log archive
+ */
+typedef struct ipt_log_archive_query_t ipt_log_archive_query_t;
+
+/**
+ * How the archive is written.
+ */
+enum ipt_log_archive_flags_t
+{
+	/**
+	 * Compress the chunks with zlib. Only available when the library was built with zlib.
+	 */
+	IPT_LOG_ARCHIVE_COMPRESS = 1<<0
+};
+
+/**
+ * @struct ipt_log_archive_chunk_t
+ *
+ * @brief The header of a chunk of records, and its entry in the index.
+ *
+ * An archive is a file header, followed by chunks, followed by the index of the chunks once the
+ * archive is closed:
+ *
+ *  | header | chunk | records | chunk | records | ... | chunk | ... | trailer |
+ *                                                     \--- index ---/
+ *
+ * Each record is a timestamp, the masks, the lengths of the originator and the message, and
+ * their text without the terminating null. A reader looks for the records of a time, a level or
+ * an originator in the index, or in the chunk headers when the archive was not closed, and reads
+ * only the chunks that may hold them.
+ */
+struct ipt_log_archive_chunk_t
+{
+	/** LOG_ARCHIVE_CHUNK_MAGIC */
+	uint32_t magic;
+
+	/** IPT_LOG_ARCHIVE_COMPRESS when the records are compressed */
+	uint32_t flags;
+
+	/** the size of the records, and the size they take in the file */
+	uint32_t raw_size;
+	uint32_t stored_size;
+
+	/** where the chunk starts in the file */
+	uint64_t offset;
+
+	/** the earliest and the latest timestamps of the records */
+	uint64_t first_ts;
+	uint64_t last_ts;
+
+	/** two bits for each originator in the chunk, see ipt_log_archive_originator_bits */
+	uint64_t originators;
+
+	/** the levels and the categories of the records */
+	uint32_t level_mask;
+	uint32_t category_mask;
+
+	/** the number of records */
+	uint32_t count;
+	uint32_t pad;
+};
+
+/**
+ * @struct ipt_log_archive_query_t
+ *
+ * @brief The records a query reads. Zeros match all the records.
+ */
+struct ipt_log_archive_query_t
+{
+	/** the earliest and the latest timestamps, in nanoseconds since the epoch. 0 for no limit. */
+	uint64_t from_ns;
+	uint64_t to_ns;
+
+	/** the levels */
+	ipt_log_level_mask_t level_mask;
+
+	/** the categories */
+	ipt_log_category_mask_t category_mask;
+
+	/** the originator, NULL for all */
+	const char *originator;
+};
+
+/**
+ * @struct ipt_log_archive_t
+ *
+ * @brief Writes the messages of a logger to a binary archive, in chunks indexed by time, level
+ * and originator. Written by the log sink with IPT_LOG_SINK_ARCHIVE, and read with ipt_log_archive_query.
+ */
+struct ipt_log_archive_t
+{
+	/**
+	 * Add a message to the chunk, and write the chunk when it is full.
+	 *
+	 * @param[in] this The this pointer.
+	 * @param[in] msg The message, with its text.
+	 *
+	 * @retval 0 Success.
+	 * @retval 1 Success, the full chunk was written first.
+	 * @retval -1 The chunk could not be written, its records are lost.
+	 */
+	int (*append)(ipt_log_archive_t *this, const ipt_logger_message_t *msg);
+
+	/**
+	 * Write the chunk, even when it is not full.
+	 *
+	 * @param[in] this The this pointer.
+	 *
+	 * @retval 0 Success, there were no records.
+	 * @retval 1 Success, the chunk was written.
+	 * @retval -1 The chunk could not be written, its records are lost.
+	 */
+	int (*flush)(ipt_log_archive_t *this);
+
+	/**
+	 * Get the size of the archive written, without its index.
+	 *
+	 * @param[in] this The this pointer.
+	 * @param[out] pending The size of the records not written yet, before they are compressed. May be NULL.
+	 *
+	 * @retval size_t The size in bytes.
+	 */
+	size_t (*get_size)(ipt_log_archive_t *this, size_t *pending);
+
+	/**
+	 * Write the chunk and the index, and free the archive. The file is not closed.
+	 *
+	 * @param[in] this The this pointer.
+	 */
+	void (*destroy)(ipt_log_archive_t *this);
+};
+
+/**
+ * Write an archive to a file opened for reading and writing. An empty file is started, and an
+ * archive is appended to, after its index.
+ *
+ * @param[in] fd The file.
+ * @param[in] flags IPT_LOG_ARCHIVE_COMPRESS, or 0.
+ *
+ * @retval ipt_log_archive_t* The archive.
+ * @retval NULL Failed, the file is not an archive, or compression is not available.
+ */
+ipt_log_archive_t *ipt_log_archive_create(int fd, unsigned int flags);
+
+/**
+ * Read the records of an archive that match a query, in the order they were written. The time of
+ * each message is formatted as the logger does.
+ *
+ * @param[in] path The archive.
+ * @param[in] query The records to read, NULL for all.
+ * @param[in] func The callback called with each message.
+ * @param[in] in_ptr Pointer to object that will be passed through to the callback.
+ *
+ * @retval >=0 The number of messages read.
+ * @retval -1 The file is not an archive.
+ */
+int ipt_log_archive_query(const char *path, const ipt_log_archive_query_t *query, void (*func)(const ipt_logger_message_t *const, void *), void *in_ptr);
+
+/**
+ * The bits an originator sets in the originators of a chunk.
+ *
+ * @param[in] originator The originator.
+ *
+ * @retval uint64_t The bits.
+ */
+uint64_t ipt_log_archive_originator_bits(const char *originator);
+
+#endif
@@ -0,0 +1,633 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "log_sink.h"
+#include "support.h"
+
+/* The buffers a batch is formatted into, written with one writev */
+#define NUMBER_OF_BUFFERS (16)
+#define BUFFER_SIZE       (64 * 1024)
+
+/* The mapped file grows by this much when there is no size limit */
+#define MMAP_CHUNK_SIZE   (4 * 1024 * 1024)
+
+/* The longest the records of an archive wait in a chunk that is not full */
+#define DEFAULT_MAX_CHUNK_AGE (1000000000ULL)
+
+/* The time, the originator, the message, two spaces and the new line */
+#define MAX_LINE_SIZE (sizeof(((ipt_logger_message_t *)0)->time) + sizeof(((ipt_logger_message_t *)0)->originator) + LOGGER_MAX_MESSAGE_SIZE + 2)
+
+typedef struct private_log_sink_t private_log_sink_t;
+
+struct private_log_sink_t
+{
+	ipt_log_sink_t public;
+
+	ipt_logger_t *logger_ptr;
+
+	/* NULL for the standard output */
+	char *path;
+
+	unsigned int flags;
+
+	int fd;
+
+	/* Writev, the buffers in use and the bytes in them */
+	char *buffers;
+	struct iovec iov[NUMBER_OF_BUFFERS];
+	int num_iov;
+	size_t pending;
+
+	/* Mmap, the mapping of the whole file */
+	char *map;
+	size_t map_size;
+
+	/* The bytes written to the file, not counting the pending bytes */
+	size_t file_size;
+
+	/* The archive written in place of the lines, and its size when it was opened */
+	ipt_log_archive_t *archive;
+	size_t opened_size;
+
+	/* The longest wait in a chunk that is not full, and the first drain that left records in it */
+	uint64_t max_chunk_age;
+	uint64_t chunk_seen;
+
+	/* Rotation */
+	size_t max_size;
+	uint64_t max_age;
+	unsigned int max_files;
+	uint64_t opened;
+
+	ipt_log_sink_stats_t stats;
+};
+
+/*
+ * Map the file at the size given, pre-allocating the blocks so a full disk fails here and not
+ * with a signal on a store into the mapping.
+ */
+static int
+map_file(private_log_sink_t *this, size_t size)
+{
+	char *map;
+
+	if ( posix_fallocate(this->fd, 0, size) != 0 && ftruncate(this->fd, size) < 0 )
+	{
+		return -1;
+	}
+
+	if ( (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0)) == MAP_FAILED )
+	{
+		return -1;
+	}
+
+	if ( this->map )
+	{
+		munmap(this->map, this->map_size);
+	}
+
+	this->map = map;
+	this->map_size = size;
+	this->stats.writes++;
+
+	return 0;
+}
+
+static int
+open_file(private_log_sink_t *this)
+{
+	struct stat st;
+
+	this->opened = monotonic_ns();
+
+	if ( this->path == NULL )
+	{
+		this->fd = STDOUT_FILENO;
+		this->file_size = 0;
+		return 0;
+	}
+
+	/* The archive writes at its own offsets */
+	if ( (this->fd = open(this->path, O_CREAT | O_RDWR | ((this->flags & (IPT_LOG_SINK_MMAP | IPT_LOG_SINK_ARCHIVE)) ? 0 : O_APPEND), 0644)) < 0 )
+	{
+		return -1;
+	}
+
+	if ( fstat(this->fd, &st) < 0 )
+	{
+		close(this->fd);
+		this->fd = -1;
+		return -1;
+	}
+
+	this->file_size = st.st_size;
+
+	if ( this->flags & IPT_LOG_SINK_ARCHIVE )
+	{
+		if ( (this->archive = ipt_log_archive_create(this->fd, (this->flags & IPT_LOG_SINK_COMPRESS) ? IPT_LOG_ARCHIVE_COMPRESS : 0)) == NULL )
+		{
+			close(this->fd);
+			this->fd = -1;
+			return -1;
+		}
+
+		this->file_size = this->opened_size = this->archive->get_size(this->archive, NULL);
+	}
+
+	if ( (this->flags & IPT_LOG_SINK_MMAP) && map_file(this, this->file_size + (this->max_size ? this->max_size : MMAP_CHUNK_SIZE)) < 0 )
+	{
+		close(this->fd);
+		this->fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+close_file(private_log_sink_t *this)
+{
+	if ( this->archive )
+	{
+		this->archive->destroy(this->archive);
+		this->archive = NULL;
+	}
+
+	if ( this->map )
+	{
+		munmap(this->map, this->map_size);
+
+		/* Drop the pre-allocated tail */
+		if ( ftruncate(this->fd, this->file_size) < 0 )
+		{
+			this->stats.errors++;
+		}
+
+		this->map = NULL;
+		this->map_size = 0;
+	}
+
+	if ( this->fd >= 0 && this->fd != STDOUT_FILENO )
+	{
+		close(this->fd);
+	}
+
+	this->fd = -1;
+}
+
+/*
+ * Count a chunk written by the archive.
+ */
+static void
+archive_written(private_log_sink_t *this)
+{
+	size_t size = this->archive->get_size(this->archive, NULL);
+
+	this->stats.writes++;
+	this->stats.bytes += size - this->file_size;
+	this->file_size = size;
+}
+
+static int
+flush(private_log_sink_t *this)
+{
+	struct iovec *iov = this->iov;
+	int cnt = this->num_iov;
+	ssize_t n;
+
+	if ( this->archive )
+	{
+		switch ( this->archive->flush(this->archive) )
+		{
+			case 1:
+				archive_written(this);
+				return 0;
+
+			case 0:
+				return 0;
+
+			default:
+				this->stats.errors++;
+				return -1;
+		}
+	}
+
+	while ( this->pending )
+	{
+		if ( (n = writev(this->fd, iov, cnt)) < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+
+			this->stats.errors++;
+			this->pending = 0;
+			this->num_iov = 0;
+			return -1;
+		}
+
+		this->stats.writes++;
+		this->stats.bytes += n;
+		this->file_size += n;
+		this->pending -= n;
+
+		/* Skip what was written, a short write continues within a buffer */
+		while ( cnt && (size_t)n >= iov->iov_len )
+		{
+			n -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+
+		if ( cnt )
+		{
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	this->num_iov = 0;
+
+	return 0;
+}
+
+static int
+rotate(private_log_sink_t *this)
+{
+	char from[PATH_MAX], to[PATH_MAX];
+	unsigned int i;
+
+	if ( this->path == NULL )
+	{
+		return -1;
+	}
+
+	flush(this);
+
+	close_file(this);
+
+	/* path.(n-1) replaces the oldest, path.n */
+	for ( i = this->max_files; i > 1; i-- )
+	{
+		snprintf(from, sizeof(from), "%s.%u", this->path, i - 1);
+		snprintf(to, sizeof(to), "%s.%u", this->path, i);
+
+		rename(from, to);
+	}
+
+	snprintf(to, sizeof(to), "%s.1", this->path);
+
+	if ( rename(this->path, to) < 0 && errno != ENOENT )
+	{
+		this->stats.errors++;
+	}
+
+	this->stats.rotations++;
+
+	return open_file(this);
+}
+
+/*
+ * Room for a line of len bytes, in the buffers or in the mapping. Rotates the file first when
+ * the line would take it past the largest size.
+ */
+static char *
+reserve(private_log_sink_t *this, size_t len)
+{
+	size_t used = this->file_size + this->pending;
+	struct iovec *iov;
+	char *ptr;
+
+	if ( this->max_size && used && used + len > this->max_size && rotate(this) < 0 )
+	{
+		return NULL;
+	}
+
+	if ( this->fd < 0 )
+	{
+		return NULL;
+	}
+
+	if ( this->flags & IPT_LOG_SINK_MMAP )
+	{
+		if ( this->file_size + len > this->map_size && map_file(this, this->map_size + (this->max_size ? this->max_size : MMAP_CHUNK_SIZE)) < 0 )
+		{
+			return NULL;
+		}
+
+		ptr = this->map + this->file_size;
+
+		this->file_size += len;
+		this->stats.bytes += len;
+
+		return ptr;
+	}
+
+	iov = this->num_iov ? &this->iov[this->num_iov - 1] : NULL;
+
+	if ( iov == NULL || iov->iov_len + len > BUFFER_SIZE )
+	{
+		if ( this->num_iov == NUMBER_OF_BUFFERS && flush(this) < 0 )
+		{
+			return NULL;
+		}
+
+		iov = &this->iov[this->num_iov];
+		iov->iov_base = this->buffers + this->num_iov * BUFFER_SIZE;
+		iov->iov_len = 0;
+
+		this->num_iov++;
+	}
+
+	ptr = (char *)iov->iov_base + iov->iov_len;
+
+	iov->iov_len += len;
+	this->pending += len;
+
+	return ptr;
+}
+
+/*
+ * Add a message to the archive, rotating the file first when the message would take it past the
+ * largest size. The size of a record is taken as its text and a chunk header, more than it needs.
+ */
+static void
+archive_message(private_log_sink_t *this, const ipt_logger_message_t *msg, size_t len)
+{
+	size_t pending, size;
+
+	if ( this->max_size )
+	{
+		size = this->archive->get_size(this->archive, &pending);
+
+		if ( (pending || size > this->opened_size) && size + pending + sizeof(ipt_log_archive_chunk_t) + len > this->max_size && rotate(this) < 0 )
+		{
+			this->stats.errors++;
+			return;
+		}
+	}
+
+	if ( this->archive == NULL )
+	{
+		this->stats.errors++;
+		return;
+	}
+
+	switch ( this->archive->append(this->archive, msg) )
+	{
+		case 1:
+			archive_written(this);
+			break;
+
+		case 0:
+			break;
+
+		default:
+			this->stats.errors++;
+			return;
+	}
+
+	this->stats.messages++;
+}
+
+/*
+ * Copy a message from the logger as a line. Called with the record still owned by the sink.
+ */
+static void
+write_message(const ipt_logger_message_t *const msg, void *in_ptr)
+{
+	private_log_sink_t *this = in_ptr;
+	size_t time_len = strlen(msg->time);
+	size_t originator_len = strlen(msg->originator);
+	size_t message_len = msg->length ? msg->length - 1 : 0;
+	char *ptr;
+
+	if ( this->flags & IPT_LOG_SINK_ARCHIVE )
+	{
+		archive_message(this, msg, originator_len + message_len);
+		return;
+	}
+
+	if ( (ptr = reserve(this, time_len + originator_len + message_len + 3)) == NULL )
+	{
+		this->stats.errors++;
+		return;
+	}
+
+	memcpy(ptr, msg->time, time_len);
+	ptr += time_len;
+	*ptr++ = ' ';
+
+	memcpy(ptr, msg->originator, originator_len);
+	ptr += originator_len;
+	*ptr++ = ' ';
+
+	memcpy(ptr, msg->message, message_len);
+	ptr += message_len;
+	*ptr = '\n';
+
+	this->stats.messages++;
+}
+
+/*
+ * Whether anything was written to the file since it was opened, or appended to.
+ */
+static int
+is_written(private_log_sink_t *this)
+{
+	size_t pending;
+
+	if ( this->archive )
+	{
+		return this->archive->get_size(this->archive, &pending) > this->opened_size || pending;
+	}
+
+	return this->file_size + this->pending != 0;
+}
+
+/*
+ * Write the chunk of the archive that is not full once its records have waited the chunk age, so
+ * a quiet logger does not keep them in memory.
+ */
+static void
+flush_old_chunk(private_log_sink_t *this)
+{
+	size_t pending;
+	uint64_t now;
+
+	this->archive->get_size(this->archive, &pending);
+
+	if ( pending == 0 )
+	{
+		this->chunk_seen = 0;
+		return;
+	}
+
+	now = monotonic_ns();
+
+	if ( this->chunk_seen == 0 )
+	{
+		this->chunk_seen = now;
+	}
+
+	if ( now - this->chunk_seen >= this->max_chunk_age )
+	{
+		flush(this);
+		this->chunk_seen = 0;
+	}
+}
+
+static int
+drain(private_log_sink_t *this)
+{
+	int count;
+
+	if ( this->max_age && is_written(this) && monotonic_ns() - this->opened >= this->max_age )
+	{
+		rotate(this);
+	}
+
+	count = this->logger_ptr->drain(this->logger_ptr, write_message, this);
+
+	/* The archive waits for a full chunk, or for its records to grow old */
+	if ( this->archive == NULL )
+	{
+		flush(this);
+	}
+	else
+	{
+		flush_old_chunk(this);
+	}
+
+	return count;
+}
+
+static int
+handle_timeout(private_log_sink_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	drain(this);
+
+	return 0;
+}
+
+static int
+set_rotation(private_log_sink_t *this, size_t max_size, const ipt_time_value_t *max_age, unsigned int max_files)
+{
+	if ( this->path == NULL || max_files == 0 || (max_size && max_size < MAX_LINE_SIZE) )
+	{
+		return -1;
+	}
+
+	if ( max_age && (max_age->tv_sec < 0 || max_age->tv_usec < 0) )
+	{
+		return -1;
+	}
+
+	this->max_size = max_size;
+	this->max_age = max_age ? (uint64_t)max_age->tv_sec * 1000000000ULL + max_age->tv_usec * 1000ULL : 0;
+	this->max_files = max_files;
+
+	return 0;
+}
+
+static int
+set_chunk_age(private_log_sink_t *this, const ipt_time_value_t *max_age)
+{
+	if ( !(this->flags & IPT_LOG_SINK_ARCHIVE) || max_age == NULL || max_age->tv_sec < 0 || max_age->tv_usec < 0 )
+	{
+		return -1;
+	}
+
+	this->max_chunk_age = (uint64_t)max_age->tv_sec * 1000000000ULL + max_age->tv_usec * 1000ULL;
+
+	return 0;
+}
+
+static void
+get_stats(private_log_sink_t *this, ipt_log_sink_stats_t *stats)
+{
+	*stats = this->stats;
+}
+
+static void
+destroy(private_log_sink_t *this)
+{
+	flush(this);
+
+	close_file(this);
+
+	free(this->buffers);
+	free(this->path);
+	free(this);
+}
+
+ipt_log_sink_t *ipt_log_sink_create(ipt_logger_t *logger_ptr, const char *path, unsigned int flags)
+{
+	private_log_sink_t *this;
+
+	if ( logger_ptr == NULL || (path == NULL && (flags & (IPT_LOG_SINK_MMAP | IPT_LOG_SINK_ARCHIVE))) )
+	{
+		return NULL;
+	}
+
+	if ( (flags & IPT_LOG_SINK_MMAP) && (flags & (IPT_LOG_SINK_ARCHIVE | IPT_LOG_SINK_COMPRESS)) )
+	{
+		return NULL;
+	}
+
+	if ( (this = malloc(sizeof(private_log_sink_t))) == NULL )
+	{
+		return NULL;
+	}
+
+	memset(this, 0, sizeof(private_log_sink_t));
+
+	this->logger_ptr = logger_ptr;
+	this->flags = flags;
+	this->fd = -1;
+	this->max_files = 1;
+	this->max_chunk_age = DEFAULT_MAX_CHUNK_AGE;
+
+	if ( path && (this->path = strdup(path)) == NULL )
+	{
+		free(this);
+		return NULL;
+	}
+
+	if ( !(flags & (IPT_LOG_SINK_MMAP | IPT_LOG_SINK_ARCHIVE)) && (this->buffers = malloc(NUMBER_OF_BUFFERS * BUFFER_SIZE)) == NULL )
+	{
+		free(this->path);
+		free(this);
+		return NULL;
+	}
+
+	if ( open_file(this) < 0 )
+	{
+		free(this->buffers);
+		free(this->path);
+		free(this);
+		return NULL;
+	}
+
+	this->public.eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *, const void *)) handle_timeout;
+
+	this->public.drain         = (int (*)(ipt_log_sink_t *)) drain;
+	this->public.flush         = (int (*)(ipt_log_sink_t *)) flush;
+	this->public.set_rotation  = (int (*)(ipt_log_sink_t *, size_t, const ipt_time_value_t *, unsigned int)) set_rotation;
+	this->public.set_chunk_age = (int (*)(ipt_log_sink_t *, const ipt_time_value_t *)) set_chunk_age;
+	this->public.rotate        = (int (*)(ipt_log_sink_t *)) rotate;
+	this->public.get_stats     = (void (*)(ipt_log_sink_t *, ipt_log_sink_stats_t *)) get_stats;
+	this->public.destroy       = (void (*)(ipt_log_sink_t *)) destroy;
+
+	return &this->public;
+}
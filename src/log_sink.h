@@ -0,0 +1,178 @@
+#ifndef __IPCTOOLS_LOG_SINK_H__
+#define __IPCTOOLS_LOG_SINK_H__
+
+#include <stdint.h>
+#include "event_handler.h"
+#include "logger.h"
+#include "log_archive.h"
+
+/**
+ * typedef for the log sink structure
+ */
+typedef struct ipt_log_sink_t ipt_log_sink_t;
+
+/**
+ * typedef for the log sink statistics
+ */
+typedef struct ipt_log_sink_stats_t ipt_log_sink_stats_t;
+
+/**
+ * How the sink writes its file.
+ */
+enum ipt_log_sink_flags_t
+{
+	/**
+	 * Format the lines into large buffers, and write each batch with one writev.
+	 */
+	IPT_LOG_SINK_WRITEV = 0,
+
+	/**
+	 * Copy the lines into a pre-allocated file mapped in memory. The file is cut to the
+	 * length written when it is rotated or closed, until then it is padded with zeros.
+	 */
+	IPT_LOG_SINK_MMAP   = 1<<0,
+
+	/**
+	 * Write a binary log archive in place of the lines, see ipt_log_archive_t. The records are
+	 * written a chunk at a time. The chunk that is not full is written by flush, or by drain once
+	 * its records have waited the chunk age, see set_chunk_age. Not with IPT_LOG_SINK_MMAP.
+	 */
+	IPT_LOG_SINK_ARCHIVE  = 1<<1,
+
+	/**
+	 * Compress the chunks of the archive.
+	 */
+	IPT_LOG_SINK_COMPRESS = 1<<2
+};
+
+/**
+ * @struct ipt_log_sink_stats_t
+ *
+ * @brief What the sink has written.
+ */
+struct ipt_log_sink_stats_t
+{
+	/** the messages written */
+	uint64_t messages;
+
+	/** the bytes written */
+	uint64_t bytes;
+
+	/** the calls to writev, the times the mapping was extended, or the chunks written */
+	uint64_t writes;
+
+	/** the files rotated */
+	uint64_t rotations;
+
+	/** the messages lost to write errors */
+	uint64_t errors;
+};
+
+/**
+ * @struct ipt_log_sink_t
+ *
+ * @brief Writes the messages of a logger to a file.
+ *
+ * The sink drains the logger in batches. Each message becomes a line "time originator message",
+ * the same as ipt_logger_dump_message. The records are handed back to the producers as soon as
+ * they are copied, before the file is written, so a slow disk or a rotation never blocks them.
+ *
+ * The sink is an event handler. Schedule it on a reactor timer to drain the logger on every timeout:
+ *
+ *  reactor->schedule_timer(reactor, (ipt_event_handler_t *)sink, &interval, &interval, NULL);
+ *
+ * The sink must be used from one thread, and only one process may drain the logger.
+ */
+struct ipt_log_sink_t
+{
+	/**
+	 * Event handler, drains the logger on each timeout.
+	 */
+	ipt_event_handler_t eh;
+
+	/**
+	 * Read the messages from the logger, and write them. Rotates the file when it is
+	 * full or too old.
+	 *
+	 * @param[in] this The this pointer.
+	 *
+	 * @retval int The number of messages read.
+	 */
+	int (*drain)(ipt_log_sink_t *this);
+
+	/**
+	 * Write the lines that are still buffered.
+	 *
+	 * @param[in] this The this pointer.
+	 *
+	 * @retval 0 Success.
+	 * @retval -1 The write failed, the lines are lost.
+	 */
+	int (*flush)(ipt_log_sink_t *this);
+
+	/**
+	 * Rotate the file when it would grow past a size, or when it is older than an age. The
+	 * file is renamed path.1, path.1 is renamed path.2, and so on, and the oldest is removed.
+	 * Not supported when writing to the standard output.
+	 *
+	 * @param[in] this The this pointer.
+	 * @param[in] max_size The largest file in bytes, 0 for no limit. The mapped file is pre-allocated to this size.
+	 * @param[in] max_age The longest time a file is written to, NULL for no limit.
+	 * @param[in] max_files The number of rotated files kept, at least 1.
+	 *
+	 * @retval 0 Success.
+	 * @retval -1 Failed.
+	 */
+	int (*set_rotation)(ipt_log_sink_t *this, size_t max_size, const ipt_time_value_t *max_age, unsigned int max_files);
+
+	/**
+	 * Set the longest time the records of an archive wait in a chunk that is not full, 1 second
+	 * by default. The age is checked by drain, so the records may wait one more drain interval.
+	 *
+	 * @param[in] this The this pointer.
+	 * @param[in] max_age The longest wait, 0 writes the chunk on every drain.
+	 *
+	 * @retval 0 Success.
+	 * @retval -1 Failed, or the sink does not write an archive.
+	 */
+	int (*set_chunk_age)(ipt_log_sink_t *this, const ipt_time_value_t *max_age);
+
+	/**
+	 * Rotate the file now.
+	 *
+	 * @param[in] this The this pointer.
+	 *
+	 * @retval 0 Success.
+	 * @retval -1 Failed, or the sink writes to the standard output.
+	 */
+	int (*rotate)(ipt_log_sink_t *this);
+
+	/**
+	 * Get what the sink has written.
+	 *
+	 * @param[in] this The this pointer.
+	 * @param[out] stats The statistics.
+	 */
+	void (*get_stats)(ipt_log_sink_t *this, ipt_log_sink_stats_t *stats);
+
+	/**
+	 * Write the buffered lines, close the file and free the sink. The logger is not destroyed.
+	 *
+	 * @param[in] this The this pointer.
+	 */
+	void (*destroy)(ipt_log_sink_t *this);
+};
+
+/**
+ * Create a sink for a logger.
+ *
+ * @param[in] logger_ptr The logger to drain.
+ * @param[in] path The file, appended to when it exists. NULL writes to the standard output.
+ * @param[in] flags IPT_LOG_SINK_WRITEV, IPT_LOG_SINK_MMAP or IPT_LOG_SINK_ARCHIVE. The standard output can not be mapped or archived.
+ *
+ * @retval ipt_log_sink_t* The sink.
+ * @retval NULL Failed.
+ */
+ipt_log_sink_t *ipt_log_sink_create(ipt_logger_t *logger_ptr, const char *path, unsigned int flags);
+
+#endif
@@ -2,17 +2,204 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <math.h>
 #include <time.h>
 #include <semaphore.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include "logger.h"
 #include "shared_queue.h"
+#include "offset_ptr.h"
+#include "support.h"
 #include <errno.h>
 
 typedef struct private_logger_t private_logger_t;
 typedef struct shared_data_t shared_data_t;
+typedef struct ring_t ring_t;
+typedef struct record_t record_t;
+typedef struct format_t format_t;
+typedef struct render_context_t render_context_t;
+typedef struct drop_t drop_t;
+typedef struct rate_limit_t rate_limit_t;
+typedef struct rate_bucket_t rate_bucket_t;
+typedef struct text_t text_t;
 
 #define MAX_NUMBER_LOGGER_SINGKS (16)
-#define MAX_MESSAGE_SIZE (256)
+#define MAX_MESSAGE_SIZE (LOGGER_MAX_MESSAGE_SIZE)
+
+/* The size of a message holding length bytes of text */
+#define MESSAGE_SIZE(length) (offsetof(ipt_logger_message_t, message) + (length))
+
+/* Records in the rings are sized to their message, and aligned to 8 bytes */
+#define RECORD_ALIGN (8)
+#define RECORD_SIZE(length) ((sizeof(record_t) + MESSAGE_SIZE(length) + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1))
+
+/* Large enough for any message */
+#define MESSAGE_BUFFER_WORDS (LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1)
+
+/* Keeps the indexes written by the producer and the collector on different cache lines */
+#define RING_PAD (64)
+
+/* The default capacity of the shared queue is this share of the segment */
+#define DEFAULT_CAPACITY_SHARE (4)
+
+/* The default wait for room with IPT_LOGGER_BLOCK, and the pause between two looks */
+#define DEFAULT_MAX_WAIT_NS (1000000ULL)
+#define BLOCK_PAUSE_US (50)
+
+/* The states of a drop counter or a rate bucket, claimed by a producer and named before it is ready */
+enum
+{
+	SLOT_FREE = 0,
+	SLOT_CLAIMED,
+	SLOT_READY
+};
+
+/**
+ * @struct ring_t
+ *
+ * @brief The ring of records written by one producer process and read by the collector.
+ *
+ * The records follow the header. The threads of the producer reserve their records by moving
+ * reserved, and publish them in the same order by moving the tail. The collector only writes
+ * the head, so none of them takes a lock.
+ */
+struct ring_t
+{
+	/**
+         * The process that owns the ring, 0 when the ring is free. The pid is in the low 32 bits, and
+         * the start time of the process in the high 32 bits.
+         */
+	uint64_t owner;
+	char pad0[RING_PAD - sizeof(uint64_t)];
+
+	/**
+         * The next record to be read.
+         */
+	size_t head;
+	char pad1[RING_PAD - sizeof(size_t)];
+
+	/**
+         * The next record to be published, and the next to be reserved.
+         */
+	size_t tail;
+	size_t reserved;
+	char pad2[RING_PAD - 2 * sizeof(size_t)];
+};
+
+/**
+ * @struct record_t
+ *
+ * @brief The header of a record in a ring, followed by the message. The head and the tail of
+ *        the ring count bytes. A record never wraps, the end of the ring is padded instead.
+ */
+struct record_t
+{
+	/**
+         * The size of the record, including the header.
+         */
+	unsigned int size;
+
+	/**
+         * 1 when the record holds a message, 0 when it pads the end of the ring.
+         */
+	unsigned int used;
+};
+
+/* The types of the arguments of a registered format */
+enum
+{
+	ARG_INT = 1,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_DOUBLE,
+	ARG_STRING,
+	ARG_POINTER
+};
+
+/* The longest conversion in a registered format, such as "%-08.3lld" */
+#define MAX_CONVERSION_SIZE (16)
+
+/* The characters between the '%' and the conversion */
+#define CONVERSION_FLAGS "-+ #'0123456789.hlLqjzt"
+
+/* A field of a structured message: the type, the length of the key with its null, and the length of the value */
+#define FIELD_HEADER_SIZE (4)
+
+/**
+ * @struct format_t
+ *
+ * @brief A format registered for binary messages, and the types of its arguments.
+ */
+struct format_t
+{
+	char fmt[LOGGER_MAX_FORMAT_SIZE];
+	unsigned char args[LOGGER_MAX_FORMAT_ARGS];
+	unsigned int num_args;
+};
+
+/**
+ * @struct drop_t
+ *
+ * @brief The messages dropped by an originator. A producer claims a free counter for its
+ *        originator, and names it before it is ready. The collector alone writes reported.
+ */
+struct drop_t
+{
+	unsigned int state;
+	char originator[32];
+	uint64_t dropped;
+	uint64_t reported;
+};
+
+/**
+ * @struct rate_limit_t
+ *
+ * @brief A token bucket limiting the messages of an originator in some categories. A bucket is
+ *        kept as the time at which it is full again, so a token is taken with one compare and
+ *        swap. The generation changes when the limit is removed, so its buckets are not reused.
+ */
+struct rate_limit_t
+{
+	unsigned int state;
+	unsigned int generation;
+
+	/**
+         * The originator, empty when each originator has a bucket of its own.
+         */
+	char originator[32];
+	ipt_log_category_mask_t category_mask;
+
+	/**
+         * The time between two tokens, and the burst as a time.
+         */
+	uint64_t interval_ns;
+	uint64_t tolerance_ns;
+
+	/**
+         * The bucket of the originator, or of the originators that found no bucket of their own.
+         */
+	uint64_t tat;
+};
+
+/**
+ * @struct rate_bucket_t
+ *
+ * @brief The bucket of an originator, for a limit without an originator.
+ */
+struct rate_bucket_t
+{
+	unsigned int state;
+	unsigned int limit;
+	unsigned int generation;
+	char originator[32];
+	uint64_t tat;
+};
 
 /**
  * @struct shared_data_t
@@ -37,6 +224,54 @@ struct shared_data_t
          * Semaphore
          */
 	sem_t sem;
+
+	/**
+         * The producer rings, and the size of each in bytes. There are no rings when num_rings is 0.
+         */
+	ipt_op_t rings;
+	unsigned int num_rings;
+	unsigned int ring_size;
+
+	/**
+         * The registered formats. A format is filled in before num_formats counts it, and never changes.
+         */
+	format_t formats[LOGGER_MAX_FORMATS];
+	unsigned int num_formats;
+
+	/**
+         * The clock the producers read, and the shared clock in nanoseconds since the epoch.
+         */
+	ipt_logger_clock_t clock;
+	uint64_t clock_ns;
+
+	/**
+         * The bytes the messages on the shared queue may take, 0 for no limit, and the bytes they take.
+         * The policy when they would take more, and the longest a producer waits for room.
+         */
+	size_t capacity;
+	size_t queued;
+	ipt_logger_overflow_t overflow;
+	uint64_t max_wait_ns;
+
+	/**
+         * The messages dropped by each originator, and by the originators that found no counter.
+         */
+	drop_t drops[LOGGER_MAX_DROP_ORIGINATORS];
+	drop_t drops_other;
+
+	/**
+         * How often the collector reports the drops, 0 for never, and when it last did, on the monotonic clock.
+         */
+	uint64_t report_interval_ns;
+	uint64_t last_report_ns;
+
+	/**
+         * The rate limits, the number that are set, and the buckets of the originators. The limits
+         * are set under the semaphore, and read without it.
+         */
+	rate_limit_t limits[LOGGER_MAX_RATE_LIMITS];
+	unsigned int num_limits;
+	rate_bucket_t buckets[LOGGER_MAX_RATE_BUCKETS];
 };
 
 /**
@@ -66,8 +301,236 @@ struct private_logger_t
          * Allocator used by the logger.
          */
 	ipt_allocator_t *alloc_ptr;
+
+	/**
+         * The ring claimed by this process, and the fork generation it was looked for in. Set
+         * under the claim lock, the generation last.
+         */
+	ring_t *ring;
+	unsigned int ring_generation;
+
+	/**
+         * The last second formatted by this process.
+         */
+	time_cache_t time_cache;
+
+	/**
+         * How the structured messages read by this process are rendered.
+         */
+	ipt_logger_field_format_t field_format;
+};
+
+/**
+ * @struct text_t
+ *
+ * @brief Text being rendered into a buffer. Once a piece does not fit, the rest are left out.
+ */
+struct text_t
+{
+	char *buf;
+	size_t size;
+	size_t len;
+	int full;
+};
+
+static ring_t *
+get_ring(shared_data_t *sd_ptr, unsigned int index)
+{
+	return (ring_t *)((char *)ipt_op_drf(&sd_ptr->rings) + index * (sizeof(ring_t) + sd_ptr->ring_size));
+}
+
+static record_t *
+ring_record(shared_data_t *sd_ptr, ring_t *ring, size_t pos)
+{
+	return (record_t *)((char *)(ring + 1) + (pos & (sd_ptr->ring_size - 1)));
+}
+
+static ipt_logger_message_t *
+record_message(record_t *record)
+{
+	return (ipt_logger_message_t *)(record + 1);
+}
+
+/*
+ * The owner of the rings claimed by this process, and the number of forks seen by it. The child of a
+ * fork starts a new generation, so the loggers it inherits look for a ring of their own.
+ */
+static uint64_t self_owner;
+static unsigned int fork_generation = 1;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+/* Serialises the threads that look for a ring, held across a fork so the child can take it */
+static pthread_mutex_t claim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+atfork_prepare(void)
+{
+	pthread_mutex_lock(&claim_lock);
+}
+
+static void
+atfork_parent(void)
+{
+	pthread_mutex_unlock(&claim_lock);
+}
+
+static void
+atfork_child(void)
+{
+	self_owner = 0;
+	fork_generation++;
+
+	pthread_mutex_unlock(&claim_lock);
+}
+
+static void
+atfork_init(void)
+{
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+/*
+ * The start time of a process, in clock ticks since boot, or 0 when it is not known.
+ */
+static uint64_t
+process_start(pid_t pid)
+{
+	unsigned long long start;
+	char path[32], buf[1024], *p;
+	FILE *fp;
+	int i;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+
+	if ( (fp = fopen(path, "r")) == NULL )
+	{
+		return 0;
+	}
+
+	p = fgets(buf, sizeof(buf), fp);
+	fclose(fp);
+
+	/* The name may hold spaces, the fields are counted from its end. The start time is the 22nd. */
+	if ( p == NULL || (p = strrchr(buf, ')')) == NULL )
+	{
+		return 0;
+	}
+
+	for ( i = 0; i < 20 && p != NULL; i++ )
+	{
+		p = strchr(p + 1, ' ');
+	}
+
+	return p != NULL && sscanf(p, "%llu", &start) == 1 ? start : 0;
+}
+
+static uint64_t
+owner_of(pid_t pid)
+{
+	return (uint64_t)(uint32_t)pid | (process_start(pid) & 0xffffffffULL) << 32;
+}
+
+/*
+ * Whether the owner of a ring is still running. The pid of an owner that has exited may have been
+ * given to a later process, which has another start time.
+ */
+static int
+owner_alive(uint64_t owner)
+{
+	pid_t pid = (pid_t)(uint32_t)owner;
+	uint64_t start;
+
+	if ( kill(pid, 0) < 0 && errno == ESRCH )
+	{
+		return 0;
+	}
+
+	/* Without the start times, the pid is all there is */
+	if ( (owner >> 32) == 0 || (start = process_start(pid)) == 0 )
+	{
+		return 1;
+	}
+
+	return (start & 0xffffffffULL) == owner >> 32;
+}
+
+/*
+ * Claim a ring for the process the first time it logs. A ring is free when it was never claimed,
+ * or when its owner has exited and the collector has read all of its records. A process that finds
+ * no free ring logs through the shared queue. The threads of the process share the ring.
+ */
+static ring_t *
+claim_ring(private_logger_t *this)
+{
+	unsigned int generation = __atomic_load_n(&fork_generation, __ATOMIC_RELAXED);
+	uint64_t self;
+	unsigned int i;
+
+	if ( __atomic_load_n(&this->ring_generation, __ATOMIC_ACQUIRE) == generation )
+	{
+		return this->ring;
+	}
+
+	pthread_once(&atfork_once, atfork_init);
+
+	pthread_mutex_lock(&claim_lock);
+
+	/* Another thread claimed it first */
+	if ( this->ring_generation == generation )
+	{
+		pthread_mutex_unlock(&claim_lock);
+		return this->ring;
+	}
+
+	if ( (self = self_owner) == 0 )
+	{
+		self = self_owner = owner_of(getpid());
+	}
+
+	this->ring = NULL;
+
+	for ( i = 0; i < this->sd_ptr->num_rings; i++ )
+	{
+		ring_t *ring = get_ring(this->sd_ptr, i);
+		uint64_t owner = __atomic_load_n(&ring->owner, __ATOMIC_ACQUIRE);
+
+		if ( owner != 0 && ( owner_alive(owner) ||
+		     __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail ) )
+		{
+			continue;
+		}
+
+		if ( __atomic_compare_exchange_n(&ring->owner, &owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) )
+		{
+			/* An owner that exited while it wrote a record left it reserved */
+			__atomic_store_n(&ring->reserved, ring->tail, __ATOMIC_RELAXED);
+
+			this->ring = ring;
+			break;
+		}
+	}
+
+	__atomic_store_n(&this->ring_generation, generation, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&claim_lock);
+
+	return this->ring;
+}
+
+/**
+ * @struct render_context_t
+ *
+ * @brief Hands formatted messages to the callback of a walk of the messages.
+ */
+struct render_context_t
+{
+	private_logger_t *this;
+	void (*func)(const ipt_logger_message_t *const, void *);
+	void *in_ptr;
 };
 
+static void render_each(const ipt_logger_message_t *const msg, void *in_ptr);
+
 static ipt_allocator_t* get_allocator(ipt_logger_t *this)
 {
    private_logger_t* ptr = (private_logger_t*)this;
@@ -83,176 +546,1704 @@ static ipt_allocator_t* get_allocator(ipt_logger_t *this)
 void
 ipt_logger_for_each(ipt_logger_t *this, void (*func)(const ipt_logger_message_t *const , void *), void *in_ptr)
 {
+	shared_data_t *sd_ptr = ((private_logger_t *)this)->sd_ptr;
+	render_context_t ctx = { (private_logger_t *)this, func, in_ptr };
+	record_t *record;
+	unsigned int i;
+	size_t pos;
+
         ipt_shared_queue_for_each(((private_logger_t *)this)->sq_ptr, 
-		 (void (*)(const ipt_shared_queue_node_t *const,void *)) func , in_ptr);
+		 (void (*)(const ipt_shared_queue_node_t *const,void *)) render_each , &ctx);
+
+	/* The records not read yet. A record may be overwritten while it is shown. */
+	for ( i = 0; i < sd_ptr->num_rings; i++ )
+	{
+		ring_t *ring = get_ring(sd_ptr, i);
+		size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+		for ( pos = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE); pos != tail; pos += record->size )
+		{
+			record = ring_record(sd_ptr, ring, pos);
+
+			if ( record->used )
+			{
+				render_each(record_message(record), &ctx);
+			}
+		}
+	}
 }
 
 static 
 int syslog_priority(private_logger_t *this, ipt_logger_message_t *msg)
 {
-	/* All Compiled Network messages are mapped to Facility 2 ( user-messages ) defined in RFC 3164 
-	 *
-	 * Return the highest severity.
-	 */
+	/* All Compiled Network messages are mapped to Facility 2 ( user-messages ) defined in RFC 3164 
+	 *
+	 * Return the highest severity.
+	 */
+
+	if ( msg->lmask & IPT_LEVEL_EMERG )
+	{
+		return 1 * 8 + 0;
+	}
+	else if ( msg->lmask & IPT_LEVEL_ALERT )
+	{
+		return 1 * 8 + 1;
+	}
+	else if ( msg->lmask & IPT_LEVEL_CRIT )
+	{
+		return 1 * 8 + 2;
+	}
+	else if ( msg->lmask & IPT_LEVEL_ERROR )
+	{
+		return 1 * 8 + 3;
+	}
+	else if ( msg->lmask & IPT_LEVEL_WARNING)
+	{
+		return 1 * 8 + 4;
+	}
+	else if ( msg->lmask & IPT_LEVEL_NOTICE)
+	{
+		return 1 * 8 + 5;
+	}
+	else if ( msg->lmask & IPT_LEVEL_INFO)
+	{
+		return 1 * 8 + 6;
+	}
+	else if ( msg->lmask & IPT_LEVEL_DEBUG )
+	{
+		return 1 * 8 + 7;
+	}
+
+	/* Return IPT_LEVEL_DEBUG if not match */
+	return 1 * 8 + 7;
+}
+
+static format_t *
+get_format(shared_data_t *sd_ptr, int format)
+{
+	if ( format <= 0 || (unsigned int)format > __atomic_load_n(&sd_ptr->num_formats, __ATOMIC_ACQUIRE) )
+	{
+		return NULL;
+	}
+
+	return &sd_ptr->formats[format - 1];
+}
+
+/*
+ * Find the type of argument taken by each conversion of the format.
+ */
+static int
+parse_format(format_t *f, const char *fmt)
+{
+	const char *p;
+
+	f->num_args = 0;
+
+	for ( p = fmt; (p = strchr(p, '%')) != NULL; p++ )
+	{
+		size_t n = strspn(p + 1, CONVERSION_FLAGS), k;
+		const char *c = p + 1 + n;
+		unsigned int longs = 0;
+		int type;
+
+		if ( *c == '%' && n == 0 )
+		{
+			p++;
+			continue;
+		}
+
+		if ( n + 2 >= MAX_CONVERSION_SIZE || f->num_args == LOGGER_MAX_FORMAT_ARGS || memchr(p + 1, 'L', n) )
+		{
+			return -1;
+		}
+
+		for ( k = 1; k <= n; k++ )
+		{
+			longs += p[k] == 'l';
+		}
+
+		switch ( *c )
+		{
+			case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+				if ( memchr(p + 1, 'z', n) || memchr(p + 1, 't', n) )
+					type = ARG_SIZE;
+				else if ( memchr(p + 1, 'j', n) || memchr(p + 1, 'q', n) || longs > 1 )
+					type = ARG_LLONG;
+				else if ( longs )
+					type = ARG_LONG;
+				else
+					type = ARG_INT;
+			break;
+
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+				type = ARG_DOUBLE;
+			break;
+
+			case 's':
+				type = longs ? 0 : ARG_STRING;
+			break;
+
+			case 'p':
+				type = ARG_POINTER;
+			break;
+
+			default:
+				type = 0;
+		}
+
+		if ( type == 0 )
+		{
+			return -1;
+		}
+
+		f->args[f->num_args++] = type;
+
+		p = c;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy the arguments of a binary message. Numbers take 8 bytes, and strings are copied with their
+ * null, truncated so the arguments that follow still fit. Returns the number of bytes used.
+ */
+static size_t
+encode_args(const format_t *f, char *buf, size_t size, va_list ap)
+{
+	size_t pos = 0, reserve = 0;
+	unsigned int i;
+
+	for ( i = 0; i < f->num_args; i++ )
+	{
+		reserve += f->args[i] == ARG_STRING ? 1 : sizeof(int64_t);
+	}
+
+	for ( i = 0; i < f->num_args; i++ )
+	{
+		int64_t value = 0;
+		double d;
+
+		switch ( f->args[i] )
+		{
+			case ARG_INT:     value = va_arg(ap, int); break;
+			case ARG_LONG:    value = va_arg(ap, long); break;
+			case ARG_LLONG:   value = va_arg(ap, long long); break;
+			case ARG_SIZE:    value = va_arg(ap, size_t); break;
+			case ARG_POINTER: value = (intptr_t)va_arg(ap, void *); break;
+
+			case ARG_DOUBLE:
+				d = va_arg(ap, double);
+				memcpy(&value, &d, sizeof(value));
+			break;
+
+			case ARG_STRING:
+			{
+				const char *str = va_arg(ap, const char *);
+				size_t len = str ? strlen(str) : 0;
+
+				reserve -= 1;
+
+				if ( len > size - pos - reserve - 1 )
+				{
+					len = size - pos - reserve - 1;
+				}
+
+				memcpy(buf + pos, str ? str : "", len);
+				buf[pos + len] = '\0';
+				pos += len + 1;
+				continue;
+			}
+		}
+
+		reserve -= sizeof(value);
+
+		memcpy(buf + pos, &value, sizeof(value));
+		pos += sizeof(value);
+	}
+
+	return pos;
+}
+
+/*
+ * Copy the fields of a structured message, each a header, the key and the value. Strings are
+ * copied with their null, and truncated to fit. The fields that do not fit at all are left out.
+ * Returns the number of bytes used.
+ */
+static size_t
+encode_fields(char *buf, size_t size, va_list ap)
+{
+	size_t pos = 0;
+	int type;
+
+	while ( (type = va_arg(ap, int)) != IPT_LOG_FIELD_END )
+	{
+		const char *key = va_arg(ap, const char *);
+		const char *value;
+		size_t key_len, value_len;
+		uint16_t len;
+		int64_t i;
+		double d;
+		uint64_t t;
+
+		switch ( type )
+		{
+			case IPT_LOG_FIELD_INT:
+				i = va_arg(ap, int64_t);
+				value = (const char *)&i;
+				value_len = sizeof(i);
+			break;
+
+			case IPT_LOG_FIELD_DOUBLE:
+				d = va_arg(ap, double);
+				value = (const char *)&d;
+				value_len = sizeof(d);
+			break;
+
+			case IPT_LOG_FIELD_TIME:
+				t = va_arg(ap, uint64_t);
+				value = (const char *)&t;
+				value_len = sizeof(t);
+			break;
+
+			case IPT_LOG_FIELD_STRING:
+				if ( (value = va_arg(ap, const char *)) == NULL )
+				{
+					value = "";
+				}
+
+				value_len = strlen(value) + 1;
+			break;
+
+			default:
+				/* The arguments that follow can not be read */
+				return pos;
+		}
+
+		key_len = strnlen(key ? key : "", LOGGER_MAX_FIELD_KEY_SIZE - 1) + 1;
+
+		if ( pos + FIELD_HEADER_SIZE + key_len + (type == IPT_LOG_FIELD_STRING ? 1 : value_len) > size )
+		{
+			continue;
+		}
+
+		if ( pos + FIELD_HEADER_SIZE + key_len + value_len > size )
+		{
+			value_len = size - pos - FIELD_HEADER_SIZE - key_len;
+		}
+
+		len = value_len;
+
+		buf[pos] = type;
+		buf[pos + 1] = key_len;
+		memcpy(buf + pos + 2, &len, sizeof(len));
+		pos += FIELD_HEADER_SIZE;
+
+		memcpy(buf + pos, key ? key : "", key_len - 1);
+		buf[pos + key_len - 1] = '\0';
+		pos += key_len;
+
+		memcpy(buf + pos, value, value_len);
+		pos += value_len;
+
+		if ( type == IPT_LOG_FIELD_STRING )
+		{
+			buf[pos - 1] = '\0';
+		}
+	}
+
+	return pos;
+}
+
+/*
+ * Format the arguments of a binary message, one conversion at a time.
+ */
+static void
+render_args(const format_t *f, const char *args, char *out, size_t size)
+{
+	const char *p = f->fmt;
+	size_t len = 0, pos = 0;
+	unsigned int i = 0;
+
+	while ( *p && len < size - 1 )
+	{
+		char spec[MAX_CONVERSION_SIZE];
+		size_t n;
+		int64_t value;
+		double d;
+		int r = 0;
+
+		if ( *p != '%' )
+		{
+			out[len++] = *p++;
+			continue;
+		}
+
+		n = strspn(p + 1, CONVERSION_FLAGS) + 2;
+
+		if ( p[1] == '%' )
+		{
+			out[len++] = '%';
+			p += 2;
+			continue;
+		}
+
+		memcpy(spec, p, n);
+		spec[n] = '\0';
+		p += n;
+
+		if ( f->args[i] == ARG_STRING )
+		{
+			r = snprintf(out + len, size - len, spec, args + pos);
+			pos += strlen(args + pos) + 1;
+			i++;
+		}
+		else
+		{
+			memcpy(&value, args + pos, sizeof(value));
+			pos += sizeof(value);
+
+			switch ( f->args[i++] )
+			{
+				case ARG_INT:     r = snprintf(out + len, size - len, spec, (int)value); break;
+				case ARG_LONG:    r = snprintf(out + len, size - len, spec, (long)value); break;
+				case ARG_LLONG:   r = snprintf(out + len, size - len, spec, (long long)value); break;
+				case ARG_SIZE:    r = snprintf(out + len, size - len, spec, (size_t)value); break;
+				case ARG_POINTER: r = snprintf(out + len, size - len, spec, (void *)(intptr_t)value); break;
+
+				case ARG_DOUBLE:
+					memcpy(&d, &value, sizeof(d));
+					r = snprintf(out + len, size - len, spec, d);
+				break;
+			}
+		}
+
+		if ( r > 0 )
+		{
+			len += (size_t)r < size - len ? (size_t)r : size - len - 1;
+		}
+	}
+
+	out[len] = '\0';
+}
+
+/*
+ * The time of a message, read from the clock the logger is set to.
+ */
+static uint64_t
+now(private_logger_t *this)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	switch ( __atomic_load_n(&this->sd_ptr->clock, __ATOMIC_RELAXED) )
+	{
+		case IPT_LOGGER_CLOCK_SHARED:
+			/* Until the clock is first updated */
+			if ( (ns = __atomic_load_n(&this->sd_ptr->clock_ns, __ATOMIC_RELAXED)) != 0 )
+			{
+				return ns;
+			}
+		break;
+
+		case IPT_LOGGER_CLOCK_COARSE:
+			clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+			return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+		case IPT_LOGGER_CLOCK_REALTIME:
+		break;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+ipt_logger_next_field(const ipt_logger_message_t *msg, size_t *pos, ipt_log_field_t *field)
+{
+	const char *p = msg->message + *pos;
+	size_t key_len;
+	uint16_t value_len;
+
+	if ( msg->format != LOGGER_FORMAT_FIELDS || *pos + FIELD_HEADER_SIZE > msg->length )
+	{
+		return 0;
+	}
+
+	key_len = (unsigned char)p[1];
+	memcpy(&value_len, p + 2, sizeof(value_len));
+
+	if ( key_len == 0 || value_len == 0 || *pos + FIELD_HEADER_SIZE + key_len + value_len > msg->length )
+	{
+		return 0;
+	}
+
+	field->type = (unsigned char)p[0];
+	field->key = p + FIELD_HEADER_SIZE;
+	p += FIELD_HEADER_SIZE + key_len;
+
+	switch ( field->type )
+	{
+		case IPT_LOG_FIELD_INT:
+		case IPT_LOG_FIELD_DOUBLE:
+		case IPT_LOG_FIELD_TIME:
+			if ( value_len != sizeof(int64_t) )
+			{
+				return 0;
+			}
+
+			memcpy(&field->value, p, sizeof(int64_t));
+		break;
+
+		case IPT_LOG_FIELD_STRING:
+			field->value.str.ptr = p;
+			field->value.str.len = value_len - 1;
+		break;
+
+		default:
+			return 0;
+	}
+
+	*pos += FIELD_HEADER_SIZE + key_len + value_len;
+
+	return 1;
+}
+
+static void
+put_text(text_t *t, const char *str, size_t len)
+{
+	/* Room is kept for the null */
+	if ( t->full || t->len + len >= t->size )
+	{
+		t->full = 1;
+		return;
+	}
+
+	memcpy(t->buf + t->len, str, len);
+	t->len += len;
+}
+
+/*
+ * Put a string in quotes, escaped as JSON.
+ */
+static void
+put_quoted(text_t *t, const char *str, size_t len)
+{
+	const char *run = str, *end = str + len;
+	char esc[8];
+
+	put_text(t, "\"", 1);
+
+	for ( ; str < end; str++ )
+	{
+		unsigned char c = *str;
+
+		if ( c >= 0x20 && c != '"' && c != '\\' )
+		{
+			continue;
+		}
+
+		put_text(t, run, str - run);
+		run = str + 1;
+
+		switch ( c )
+		{
+			case '"':  put_text(t, "\\\"", 2); break;
+			case '\\': put_text(t, "\\\\", 2); break;
+			case '\n': put_text(t, "\\n", 2); break;
+			case '\r': put_text(t, "\\r", 2); break;
+			case '\t': put_text(t, "\\t", 2); break;
+
+			default:
+				put_text(t, esc, snprintf(esc, sizeof(esc), "\\u%04x", c));
+		}
+	}
+
+	put_text(t, run, end - run);
+	put_text(t, "\"", 1);
+}
+
+/*
+ * Put the value of a field. A double takes the fewest digits that read back the same value.
+ */
+static void
+put_value(text_t *t, const ipt_log_field_t *field, ipt_logger_field_format_t format)
+{
+	const char *str;
+	char buf[64];
+	size_t len;
+	time_t sec;
+	struct tm tm;
+
+	switch ( field->type )
+	{
+		case IPT_LOG_FIELD_INT:
+			put_text(t, buf, snprintf(buf, sizeof(buf), "%lld", (long long)field->value.i));
+		break;
+
+		case IPT_LOG_FIELD_DOUBLE:
+			/* JSON has no such numbers */
+			if ( !isfinite(field->value.d) )
+			{
+				str = format == IPT_LOGGER_FIELDS_JSON ? "null" : isnan(field->value.d) ? "nan" : field->value.d < 0 ? "-inf" : "inf";
+				put_text(t, str, strlen(str));
+				break;
+			}
+
+			len = snprintf(buf, sizeof(buf), "%.15g", field->value.d);
+
+			if ( strtod(buf, NULL) != field->value.d )
+			{
+				len = snprintf(buf, sizeof(buf), "%.17g", field->value.d);
+			}
+
+			put_text(t, buf, len);
+		break;
+
+		case IPT_LOG_FIELD_TIME:
+			/* RFC 3339, in UTC */
+			sec = field->value.time / 1000000000ULL;
+			gmtime_r(&sec, &tm);
+
+			len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+			len += snprintf(buf + len, sizeof(buf) - len, ".%09uZ", (unsigned int)(field->value.time % 1000000000ULL));
+
+			if ( format == IPT_LOGGER_FIELDS_JSON )
+			{
+				put_quoted(t, buf, len);
+			}
+			else
+			{
+				put_text(t, buf, len);
+			}
+		break;
+
+		case IPT_LOG_FIELD_STRING:
+			if ( format == IPT_LOGGER_FIELDS_JSON || field->value.str.len == 0 || strpbrk(field->value.str.ptr, " \"=\\\n\r\t") != NULL )
+			{
+				put_quoted(t, field->value.str.ptr, field->value.str.len);
+			}
+			else
+			{
+				put_text(t, field->value.str.ptr, field->value.str.len);
+			}
+		break;
+
+		default:
+		break;
+	}
+}
+
+int
+ipt_logger_render_fields(const ipt_logger_message_t *msg, ipt_logger_field_format_t format, char *out, size_t size)
+{
+	/* Room is kept for the closing brace */
+	text_t t = { out, format == IPT_LOGGER_FIELDS_JSON ? size - 1 : size, 0, 0 };
+	ipt_log_field_t field;
+	size_t pos = 0, mark;
+	int n = 0;
+
+	if ( msg->format != LOGGER_FORMAT_FIELDS || (format != IPT_LOGGER_FIELDS_TEXT && format != IPT_LOGGER_FIELDS_JSON) || size < 3 )
+	{
+		return -1;
+	}
+
+	if ( format == IPT_LOGGER_FIELDS_JSON )
+	{
+		put_text(&t, "{", 1);
+	}
+
+	while ( ipt_logger_next_field(msg, &pos, &field) )
+	{
+		mark = t.len;
+
+		if ( n++ )
+		{
+			put_text(&t, format == IPT_LOGGER_FIELDS_JSON ? "," : " ", 1);
+		}
+
+		if ( format == IPT_LOGGER_FIELDS_JSON )
+		{
+			put_quoted(&t, field.key, strlen(field.key));
+			put_text(&t, ":", 1);
+		}
+		else
+		{
+			put_text(&t, field.key, strlen(field.key));
+			put_text(&t, "=", 1);
+		}
+
+		put_value(&t, &field, format);
+
+		/* The field is left out, and those after it */
+		if ( t.full )
+		{
+			t.len = mark;
+			break;
+		}
+	}
+
+	if ( format == IPT_LOGGER_FIELDS_JSON )
+	{
+		t.size = size;
+		t.full = 0;
+		put_text(&t, "}", 1);
+	}
+
+	out[t.len] = '\0';
+
+	return t.len;
+}
+
+/*
+ * Format the time, and the text of a binary message, into out, which holds LOGGER_MESSAGE_BUFFER_SIZE
+ * bytes and may be the message itself.
+ */
+static int
+render(private_logger_t *this, const ipt_logger_message_t *msg, ipt_logger_message_t *out)
+{
+	char message[LOGGER_MAX_MESSAGE_SIZE];
+	format_t *f;
+
+	if ( msg->format == 0 )
+	{
+		if ( out != msg )
+		{
+			memcpy(out, msg, MESSAGE_SIZE(msg->length));
+		}
+
+		if ( out->time[0] == '\0' )
+		{
+			format_time(&this->time_cache, out->timestamp, out->time, sizeof(out->time));
+		}
+
+		return 0;
+	}
+
+	if ( msg->format == LOGGER_FORMAT_FIELDS )
+	{
+		/* Handed out typed, only the time is formatted */
+		if ( this->field_format == IPT_LOGGER_FIELDS_RAW )
+		{
+			if ( out != msg )
+			{
+				memcpy(out, msg, MESSAGE_SIZE(msg->length));
+			}
+
+			format_time(&this->time_cache, out->timestamp, out->time, sizeof(out->time));
+
+			return 0;
+		}
+
+		ipt_logger_render_fields(msg, this->field_format, message, sizeof(message));
+	}
+	else
+	{
+		if ( (f = get_format(this->sd_ptr, msg->format)) == NULL )
+		{
+			return -1;
+		}
+
+		render_args(f, msg->message, message, sizeof(message));
+	}
+
+	if ( out != msg )
+	{
+		out->cmask = msg->cmask;
+		out->lmask = msg->lmask;
+		out->timestamp = msg->timestamp;
+		memcpy(out->originator, msg->originator, sizeof(out->originator));
+	}
+
+	out->format = 0;
+	out->length = strlen(message) + 1;
+	format_time(&this->time_cache, msg->timestamp, out->time, sizeof(out->time));
+	memcpy(out->message, message, out->length);
+
+	return 0;
+}
+
+/*
+ * Call the callback of the walk with the message, formatted when it is binary or has no time yet.
+ */
+static void
+render_each(const ipt_logger_message_t *const msg, void *in_ptr)
+{
+	render_context_t *ctx = in_ptr;
+	uint64_t out[MESSAGE_BUFFER_WORDS];
+
+	if ( msg->format == 0 && msg->time[0] != '\0' )
+	{
+		ctx->func(msg, ctx->in_ptr);
+	}
+	else if ( render(ctx->this, msg, (ipt_logger_message_t *)out) == 0 )
+	{
+		ctx->func((ipt_logger_message_t *)out, ctx->in_ptr);
+	}
+}
+
+/*
+ * Format the text of a message, or copy the arguments of a binary message or the fields of a
+ * structured message, into a buffer of MAX_MESSAGE_SIZE bytes. Returns the length, including
+ * the null of a text.
+ */
+static size_t
+format_text(char *text, const format_t *f, int format, const char *fmt, va_list ap)
+{
+	int n;
+
+	if ( format == LOGGER_FORMAT_FIELDS )
+	{
+		return encode_fields(text, MAX_MESSAGE_SIZE, ap);
+	}
+
+	if ( f )
+	{
+		return encode_args(f, text, MAX_MESSAGE_SIZE, ap);
+	}
+
+	if ( (n = vsnprintf(text, MAX_MESSAGE_SIZE, fmt, ap)) < 0 )
+	{
+		text[0] = '\0';
+		n = 0;
+	}
+
+	return (n < MAX_MESSAGE_SIZE ? n : MAX_MESSAGE_SIZE - 1) + 1;
+}
+
+/*
+ * Fill in a message sized for length bytes of text. Only the timestamp is recorded, the time is
+ * formatted by the reader.
+ */
+static void
+fill_message(private_logger_t *this, ipt_logger_message_t *ptr, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, int format, const char *text, size_t length)
+{
+	ptr->cmask = category_mask;
+	ptr->lmask = level_mask;
+	ptr->format = format;
+	ptr->length = length;
+	ptr->timestamp = now(this);
+	ptr->time[0] = '\0';
+
+	if ( originator != NULL )
+	{
+		strncpy(ptr->originator,originator,sizeof(ptr->originator));
+	}
+	else
+	{
+		strcpy(ptr->originator,"unknown");
+	}
+
+	ptr->originator[sizeof(ptr->originator) - 1] = '\0';
+
+	memcpy(ptr->message, text, length);
+}
+
+/*
+ * The masks are read without the semaphore, so a message that is filtered out costs two loads.
+ */
+static int
+is_enabled(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask)
+{
+	return (__atomic_load_n(&this->sd_ptr->category_mask, __ATOMIC_RELAXED) & category_mask) &&
+	       (__atomic_load_n(&this->sd_ptr->level_mask, __ATOMIC_RELAXED) & level_mask);
+}
+
+/*
+ * Count a message dropped by the originator. The counter of the originator is found, or claimed,
+ * without a lock.
+ */
+static void
+count_drop(shared_data_t *sd_ptr, const char *originator)
+{
+	const char *name = originator ? originator : "unknown";
+	unsigned int i, state;
+	drop_t *d;
+
+	for ( i = 0; i < LOGGER_MAX_DROP_ORIGINATORS; i++ )
+	{
+		d = &sd_ptr->drops[i];
+		state = __atomic_load_n(&d->state, __ATOMIC_ACQUIRE);
+
+		if ( state == SLOT_FREE && __atomic_compare_exchange_n(&d->state, &state, SLOT_CLAIMED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) )
+		{
+			strncpy(d->originator, name, sizeof(d->originator) - 1);
+			d->originator[sizeof(d->originator) - 1] = '\0';
+
+			__atomic_store_n(&d->state, SLOT_READY, __ATOMIC_RELEASE);
+
+			state = SLOT_READY;
+		}
+
+		/* A counter being named by another producer is passed over */
+		if ( state == SLOT_READY && strncmp(d->originator, name, sizeof(d->originator) - 1) == 0 )
+		{
+			__atomic_add_fetch(&d->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	__atomic_add_fetch(&sd_ptr->drops_other.dropped, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Free the buckets of the limits that were removed. Called with the semaphore held, so no limit
+ * is removed meanwhile.
+ */
+static void
+free_stale_buckets(shared_data_t *sd_ptr)
+{
+	rate_bucket_t *b;
+	unsigned int i;
+
+	for ( i = 0; i < LOGGER_MAX_RATE_BUCKETS; i++ )
+	{
+		b = &sd_ptr->buckets[i];
+
+		if ( __atomic_load_n(&b->state, __ATOMIC_SEQ_CST) == SLOT_READY &&
+		     b->generation != __atomic_load_n(&sd_ptr->limits[b->limit].generation, __ATOMIC_RELAXED) )
+		{
+			__atomic_store_n(&b->state, SLOT_FREE, __ATOMIC_RELEASE);
+		}
+	}
+}
+
+/*
+ * Find the bucket of the originator for a limit, or claim one. The originators that find no
+ * bucket share the bucket of the limit.
+ */
+static uint64_t *
+find_bucket(shared_data_t *sd_ptr, unsigned int limit, unsigned int generation, const char *name)
+{
+	unsigned int i, state;
+	rate_bucket_t *b;
+
+	for ( i = 0; i < LOGGER_MAX_RATE_BUCKETS; i++ )
+	{
+		b = &sd_ptr->buckets[i];
+		state = __atomic_load_n(&b->state, __ATOMIC_ACQUIRE);
+
+		if ( state == SLOT_FREE && __atomic_compare_exchange_n(&b->state, &state, SLOT_CLAIMED, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) )
+		{
+			b->limit = limit;
+			b->generation = generation;
+			b->tat = 0;
+			strncpy(b->originator, name, sizeof(b->originator) - 1);
+			b->originator[sizeof(b->originator) - 1] = '\0';
+
+			__atomic_store_n(&b->state, SLOT_READY, __ATOMIC_SEQ_CST);
+
+			/* The limit was removed while the bucket was named, unset_rate_limit may have passed it over */
+			if ( __atomic_load_n(&sd_ptr->limits[limit].generation, __ATOMIC_SEQ_CST) != generation )
+			{
+				sem_wait(&sd_ptr->sem);
+				free_stale_buckets(sd_ptr);
+				sem_post(&sd_ptr->sem);
+
+				break;
+			}
+
+			state = SLOT_READY;
+		}
+
+		if ( state == SLOT_READY && b->limit == limit && b->generation == generation &&
+		     strncmp(b->originator, name, sizeof(b->originator) - 1) == 0 )
+		{
+			return &b->tat;
+		}
+	}
+
+	return &sd_ptr->limits[limit].tat;
+}
+
+/*
+ * Take a token from a bucket. The bucket is empty while the time it is full again is more than
+ * the burst away.
+ */
+static int
+take_token(uint64_t *tat_ptr, uint64_t t, uint64_t interval_ns, uint64_t tolerance_ns)
+{
+	uint64_t tat = __atomic_load_n(tat_ptr, __ATOMIC_RELAXED);
+
+	do
+	{
+		if ( tat > t + tolerance_ns )
+		{
+			return 0;
+		}
+	}
+	while ( !__atomic_compare_exchange_n(tat_ptr, &tat, (tat > t ? tat : t) + interval_ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+	return 1;
+}
+
+/*
+ * Take a token from each rate limit the message matches. Costs one load when no limit is set.
+ * When a bucket is empty, the tokens taken from the others are given back.
+ */
+static int
+is_allowed(private_logger_t *this, ipt_log_category_mask_t category_mask, const char *originator)
+{
+	shared_data_t *sd_ptr = this->sd_ptr;
+	const char *name = originator ? originator : "unknown";
+	uint64_t *taken[LOGGER_MAX_RATE_LIMITS];
+	uint64_t intervals[LOGGER_MAX_RATE_LIMITS];
+	uint64_t t = 0, *tat, interval_ns;
+	unsigned int i, num_taken = 0;
+	rate_limit_t *l;
+
+	if ( __atomic_load_n(&sd_ptr->num_limits, __ATOMIC_ACQUIRE) == 0 )
+	{
+		return 1;
+	}
+
+	for ( i = 0; i < LOGGER_MAX_RATE_LIMITS; i++ )
+	{
+		l = &sd_ptr->limits[i];
+
+		if ( __atomic_load_n(&l->state, __ATOMIC_ACQUIRE) != SLOT_READY || !(l->category_mask & category_mask) )
+		{
+			continue;
+		}
+
+		if ( l->originator[0] != '\0' && strncmp(l->originator, name, sizeof(l->originator) - 1) != 0 )
+		{
+			continue;
+		}
+
+		if ( t == 0 )
+		{
+			t = monotonic_ns();
+		}
+
+		tat = l->originator[0] != '\0' ? &l->tat : find_bucket(sd_ptr, i, __atomic_load_n(&l->generation, __ATOMIC_RELAXED), name);
+		interval_ns = __atomic_load_n(&l->interval_ns, __ATOMIC_RELAXED);
+
+		if ( !take_token(tat, t, interval_ns, __atomic_load_n(&l->tolerance_ns, __ATOMIC_RELAXED)) )
+		{
+			while ( num_taken-- )
+			{
+				__atomic_sub_fetch(taken[num_taken], intervals[num_taken], __ATOMIC_RELAXED);
+			}
+
+			return 0;
+		}
+
+		taken[num_taken] = tat;
+		intervals[num_taken++] = interval_ns;
+	}
+
+	return 1;
+}
+
+/*
+ * Wait for a full ring to drain, until the deadline. Returns 0 when the deadline has passed.
+ */
+static int
+wait_for_room(uint64_t *deadline, uint64_t max_wait_ns)
+{
+	uint64_t t = monotonic_ns();
+
+	if ( *deadline == 0 )
+	{
+		*deadline = t + max_wait_ns;
+	}
+	else if ( t >= *deadline )
+	{
+		return 0;
+	}
+
+	usleep(BLOCK_PAUSE_US);
+
+	return 1;
+}
+
+/*
+ * Count size bytes against the capacity of the shared queue, applying the overflow policy when
+ * they do not fit. The bytes are counted before the message is allocated, so the producers can
+ * not overshoot the capacity together.
+ */
+static int
+make_room(private_logger_t *this, size_t size)
+{
+	shared_data_t *sd_ptr = this->sd_ptr;
+	ipt_time_value_t tv = { 0, 0 };
+	ipt_logger_message_t *msg_ptr;
+	uint64_t deadline = 0;
+	size_t capacity;
+
+	for (;;)
+	{
+		capacity = __atomic_load_n(&sd_ptr->capacity, __ATOMIC_RELAXED);
+
+		if ( __atomic_add_fetch(&sd_ptr->queued, size, __ATOMIC_RELAXED) <= capacity || capacity == 0 )
+		{
+			return 0;
+		}
+
+		__atomic_sub_fetch(&sd_ptr->queued, size, __ATOMIC_RELAXED);
+
+		switch ( __atomic_load_n(&sd_ptr->overflow, __ATOMIC_RELAXED) )
+		{
+			case IPT_LOGGER_DROP_OLDEST:
+				/* Taken like the collector does, and counted against its own originator */
+				if ( (msg_ptr = (ipt_logger_message_t *)this->sq_ptr->dequeue_timed(this->sq_ptr, &tv)) == NULL )
+				{
+					return -1;
+				}
+
+				__atomic_sub_fetch(&sd_ptr->queued, MESSAGE_SIZE(msg_ptr->length), __ATOMIC_RELAXED);
+
+				count_drop(sd_ptr, msg_ptr->originator);
+
+				this->alloc_ptr->free(this->alloc_ptr, msg_ptr);
+			break;
+
+			case IPT_LOGGER_BLOCK:
+				if ( !wait_for_room(&deadline, __atomic_load_n(&sd_ptr->max_wait_ns, __ATOMIC_RELAXED)) )
+				{
+					return -1;
+				}
+			break;
+
+			default:
+				return -1;
+		}
+	}
+}
+
+/*
+ * Reserve a record of size bytes in the ring, after padding the end of the ring when the record
+ * does not fit before it. The threads of the process reserve with a compare and swap. The record
+ * starts at start, and is published by moving the tail from start to end.
+ */
+static record_t *
+ring_reserve(shared_data_t *sd_ptr, ring_t *ring, size_t size, size_t *start, size_t *end)
+{
+	size_t pos = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+	size_t to_end, need;
+	record_t *record;
+
+	do
+	{
+		to_end = sd_ptr->ring_size - (pos & (sd_ptr->ring_size - 1));
+		need = size > to_end ? to_end + size : size;
+
+		/* The ring is full */
+		if ( pos + need - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > sd_ptr->ring_size )
+		{
+			return NULL;
+		}
+	} while ( !__atomic_compare_exchange_n(&ring->reserved, &pos, pos + need, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+	record = ring_record(sd_ptr, ring, pos);
+
+	if ( size > to_end )
+	{
+		record->size = to_end;
+		record->used = 0;
+
+		record = ring_record(sd_ptr, ring, pos + to_end);
+	}
+
+	record->size = size;
+	record->used = 1;
+
+	*start = pos;
+	*end = pos + need;
+
+	return record;
+}
+
+/*
+ * Write the message to the ring of the process. The records are published in the order they were
+ * reserved, a thread waits for the threads that reserved before it. This takes no lock and makes
+ * no system call unless another thread of the process is publishing.
+ */
+static int
+enqueue_ring(private_logger_t *this, ring_t *ring, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, const format_t *f, int format, const char *fmt, va_list ap)
+{
+	char text[MAX_MESSAGE_SIZE];
+	size_t length = format_text(text, f, format, fmt, ap);
+	uint64_t deadline = 0;
+	record_t *record;
+	size_t start, end;
+
+	while ( (record = ring_reserve(this->sd_ptr, ring, RECORD_SIZE(length), &start, &end)) == NULL )
+	{
+		if ( __atomic_load_n(&this->sd_ptr->overflow, __ATOMIC_RELAXED) != IPT_LOGGER_BLOCK ||
+		     !wait_for_room(&deadline, __atomic_load_n(&this->sd_ptr->max_wait_ns, __ATOMIC_RELAXED)) )
+		{
+			count_drop(this->sd_ptr, originator);
+			return -1;
+		}
+	}
+
+	fill_message(this, record_message(record), category_mask, level_mask, originator, format, text, length);
+
+	while ( __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != start )
+	{
+		sched_yield();
+	}
+
+	__atomic_store_n(&ring->tail, end, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * Log a text message, a binary message when f is the registered format, or a structured message
+ * when the format is LOGGER_FORMAT_FIELDS.
+ */
+static int 
+log_message(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, const format_t *f, int format, const char *fmt, va_list ap)
+{
+	char text[MAX_MESSAGE_SIZE];
+	ring_t *ring;
+	size_t length;
+
+	if ( this->sd_ptr->num_rings && (ring = claim_ring(this)) != NULL )
+	{
+		return enqueue_ring(this, ring, category_mask, level_mask, originator, f, format, fmt, ap);
+	}
+
+	length = format_text(text, f, format, fmt, ap);
+
+	if ( make_room(this, MESSAGE_SIZE(length)) < 0 )
+	{
+		count_drop(this->sd_ptr, originator);
+		return -1;
+	}
+
+	sem_wait(&this->sd_ptr->sem);
+
+	ipt_logger_message_t *ptr = this->alloc_ptr->malloc(this->alloc_ptr, MESSAGE_SIZE(length) );
+
+	if ( ptr == NULL )
+	{
+		sem_post(&this->sd_ptr->sem);
+		__atomic_sub_fetch(&this->sd_ptr->queued, MESSAGE_SIZE(length), __ATOMIC_RELAXED);
+		count_drop(this->sd_ptr, originator);
+		return -1;
+	}
+
+	memset(ptr,0,MESSAGE_SIZE(0));
+
+	fill_message(this, ptr, category_mask, level_mask, originator, format, text, length);
+
+	this->sq_ptr->enqueue(this->sq_ptr, (ipt_logger_node_t *)ptr);
+
+	sem_post(&this->sd_ptr->sem);
+
+	return 0;
+}	
+
+static int 
+enqueue(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, const char *fmt, ...)
+{
+	va_list ap;
+	int rtn;
+
+	if ( !is_enabled(this, category_mask, level_mask) )
+	{
+		return -1;
+	}
+
+	if ( !is_allowed(this, category_mask, originator) )
+	{
+		count_drop(this->sd_ptr, originator);
+		return -1;
+	}
+
+	va_start(ap,fmt);
+	rtn = log_message(this, category_mask, level_mask, originator, NULL, 0, fmt, ap);
+	va_end(ap);
+
+	return rtn;
+}
+
+static int 
+enqueue_binary(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, int format, ...)
+{
+	format_t *f;
+	va_list ap;
+	int rtn;
+
+	if ( !is_enabled(this, category_mask, level_mask) || (f = get_format(this->sd_ptr, format)) == NULL )
+	{
+		return -1;
+	}
+
+	if ( !is_allowed(this, category_mask, originator) )
+	{
+		count_drop(this->sd_ptr, originator);
+		return -1;
+	}
+
+	va_start(ap,format);
+	rtn = log_message(this, category_mask, level_mask, originator, f, format, NULL, ap);
+	va_end(ap);
+
+	return rtn;
+}
+
+static int 
+enqueue_fields(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, ...)
+{
+	va_list ap;
+	int rtn;
+
+	if ( !is_enabled(this, category_mask, level_mask) )
+	{
+		return -1;
+	}
+
+	if ( !is_allowed(this, category_mask, originator) )
+	{
+		count_drop(this->sd_ptr, originator);
+		return -1;
+	}
+
+	va_start(ap,originator);
+	rtn = log_message(this, category_mask, level_mask, originator, NULL, LOGGER_FORMAT_FIELDS, NULL, ap);
+	va_end(ap);
+
+	return rtn;
+}
+
+static int
+set_field_format(private_logger_t *this, ipt_logger_field_format_t format)
+{
+	if ( format != IPT_LOGGER_FIELDS_TEXT && format != IPT_LOGGER_FIELDS_JSON && format != IPT_LOGGER_FIELDS_RAW )
+	{
+		return -1;
+	}
+
+	this->field_format = format;
+
+	return 0;
+}
+
+static int
+register_format(private_logger_t *this, const char *fmt)
+{
+	unsigned int i;
+	format_t *f;
 
-	if ( msg->lmask & IPT_LEVEL_EMERG )
-	{
-		return 1 * 8 + 0;
-	}
-	else if ( msg->lmask & IPT_LEVEL_ALERT )
+	if ( fmt == NULL || strlen(fmt) + 1 > LOGGER_MAX_FORMAT_SIZE )
 	{
-		return 1 * 8 + 1;
+		return -1;
 	}
-	else if ( msg->lmask & IPT_LEVEL_CRIT )
+
+	sem_wait(&this->sd_ptr->sem);
+
+	for ( i = 0; i < this->sd_ptr->num_formats; i++ )
 	{
-		return 1 * 8 + 2;
+		if ( strcmp(this->sd_ptr->formats[i].fmt, fmt) == 0 )
+		{
+			sem_post(&this->sd_ptr->sem);
+			return i + 1;
+		}
 	}
-	else if ( msg->lmask & IPT_LEVEL_ERROR )
+
+	f = &this->sd_ptr->formats[i];
+
+	if ( i == LOGGER_MAX_FORMATS || parse_format(f, fmt) < 0 )
 	{
-		return 1 * 8 + 3;
+		sem_post(&this->sd_ptr->sem);
+		return -1;
 	}
-	else if ( msg->lmask & IPT_LEVEL_WARNING)
+
+	strcpy(f->fmt, fmt);
+
+	/* Readers find the format once it is complete */
+	__atomic_store_n(&this->sd_ptr->num_formats, i + 1, __ATOMIC_RELEASE);
+
+	sem_post(&this->sd_ptr->sem);
+
+	return i + 1;
+}
+
+/*
+ * Replace a binary message taken from the queue with its text. The message is returned as it is
+ * when it can not be formatted.
+ */
+static ipt_logger_message_t *
+render_dequeued(private_logger_t *this, ipt_logger_message_t *msg_ptr)
+{
+	uint64_t buf[MESSAGE_BUFFER_WORDS];
+	ipt_logger_message_t *out = (ipt_logger_message_t *)buf, *ptr;
+
+	if ( msg_ptr == NULL )
 	{
-		return 1 * 8 + 4;
+		return NULL;
 	}
-	else if ( msg->lmask & IPT_LEVEL_NOTICE)
+
+	/* Text, and fields handed out as they are, are formatted in place */
+	if ( msg_ptr->format == 0 || (msg_ptr->format == LOGGER_FORMAT_FIELDS && this->field_format == IPT_LOGGER_FIELDS_RAW) )
 	{
-		return 1 * 8 + 5;
+		render(this, msg_ptr, msg_ptr);
+
+		return msg_ptr;
 	}
-	else if ( msg->lmask & IPT_LEVEL_INFO)
+
+	if ( render(this, msg_ptr, out) < 0 )
 	{
-		return 1 * 8 + 6;
+		return msg_ptr;
 	}
-	else if ( msg->lmask & IPT_LEVEL_DEBUG )
+
+	if ( (ptr = this->alloc_ptr->malloc(this->alloc_ptr, MESSAGE_SIZE(out->length))) == NULL )
 	{
-		return 1 * 8 + 7;
+		return msg_ptr;
 	}
 
-	/* Return IPT_LEVEL_DEBUG if not match */
-	return 1 * 8 + 7;
+	memcpy(ptr, out, MESSAGE_SIZE(out->length));
+
+	this->alloc_ptr->free(this->alloc_ptr, msg_ptr);
+
+	return ptr;
 }
 
-static int 
-enqueue(private_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, const char *fmt, ...)
+/*
+ * Queue a warning with the number of messages dropped by the originator. The report is not
+ * bounded by the capacity, it takes the place of the messages it counts.
+ */
+static int
+queue_report(private_logger_t *this, const char *originator, uint64_t dropped)
 {
+	char text[64];
+	size_t length = snprintf(text, sizeof(text), "%llu messages dropped", (unsigned long long)dropped) + 1;
+	ipt_logger_message_t *ptr;
 
 	sem_wait(&this->sd_ptr->sem);
 
-	if ( !(this->sd_ptr->category_mask & category_mask)  || !(this->sd_ptr->level_mask & level_mask) )
+	if ( (ptr = this->alloc_ptr->malloc(this->alloc_ptr, MESSAGE_SIZE(length))) == NULL )
 	{
 		sem_post(&this->sd_ptr->sem);
 		return -1;
 	}
 
-	ipt_logger_message_t *ptr = this->alloc_ptr->malloc(this->alloc_ptr, sizeof(ipt_logger_message_t) );
-
-	if ( ptr == NULL )
-	{
-		sem_post(&this->sd_ptr->sem);
-		return -1;
-	}
+	memset(ptr,0,MESSAGE_SIZE(0));
 
-	memset(ptr,0,sizeof(ipt_logger_message_t));
+	fill_message(this, ptr, IPT_MODULE_ALL, IPT_LEVEL_WARNING, originator, 0, text, length);
 
-   	ptr->cmask = category_mask;
-   	ptr->lmask = level_mask;
+	__atomic_add_fetch(&this->sd_ptr->queued, MESSAGE_SIZE(length), __ATOMIC_RELAXED);
 
-   	struct timeval tv;
-   	struct tm *ptm;
+	this->sq_ptr->enqueue(this->sq_ptr, (ipt_logger_node_t *)ptr);
 
-   	gettimeofday(&tv,NULL);
+	sem_post(&this->sd_ptr->sem);
 
-   	ptm = localtime(&tv.tv_sec);
+	return 0;
+}
 
-   	strftime(ptr->time, sizeof(ptr->time), "%Y-%m-%d %H:%M:%S",ptm);
+static void
+report_drop(private_logger_t *this, drop_t *d, const char *originator)
+{
+	uint64_t dropped = __atomic_load_n(&d->dropped, __ATOMIC_RELAXED);
 
-   	if ( strlen(ptr->time) < 32 )
-   	{
-      		sprintf(ptr->time + strlen(ptr->time),":%lu",tv.tv_usec/1000);
-   	}
+	if ( dropped != d->reported && queue_report(this, originator, dropped - d->reported) == 0 )
+	{
+		d->reported = dropped;
+	}
+}
 
-	va_list ap;
-	va_start(ap,fmt);
-	unsigned int size = vsnprintf(ptr->message, MAX_MESSAGE_SIZE, fmt, ap);
-	va_end(ap);
+/*
+ * Called by the collector as it reads the logger. Reports the drops once the interval has passed.
+ */
+static void
+report_drops(private_logger_t *this)
+{
+	shared_data_t *sd_ptr = this->sd_ptr;
+	uint64_t interval = __atomic_load_n(&sd_ptr->report_interval_ns, __ATOMIC_RELAXED);
+	uint64_t t;
+	unsigned int i;
 
-	ptr->message[MAX_MESSAGE_SIZE -1] = '\0';
+	if ( interval == 0 || (t = monotonic_ns()) - sd_ptr->last_report_ns < interval )
+	{
+		return;
+	}
 
-   	if ( originator != NULL )
-   	{
-         	strncpy(ptr->originator,originator,32);
-   	}
-   	else
-   	{
-      		strcpy(ptr->originator,"unknown");
-   	}
+	sd_ptr->last_report_ns = t;
 
-   	ptr->originator[31] = '\0';
+	for ( i = 0; i < LOGGER_MAX_DROP_ORIGINATORS; i++ )
+	{
+		if ( __atomic_load_n(&sd_ptr->drops[i].state, __ATOMIC_ACQUIRE) == SLOT_READY )
+		{
+			report_drop(this, &sd_ptr->drops[i], sd_ptr->drops[i].originator);
+		}
+	}
 
-	this->sq_ptr->enqueue(this->sq_ptr, (ipt_logger_node_t *)ptr);
+	report_drop(this, &sd_ptr->drops_other, "logger");
+}
 
-	sem_post(&this->sd_ptr->sem);
+/*
+ * A message taken from the queue no longer counts against the capacity.
+ */
+static ipt_logger_message_t *
+take_dequeued(private_logger_t *this, ipt_logger_message_t *msg_ptr)
+{
+	if ( msg_ptr )
+	{
+		__atomic_sub_fetch(&this->sd_ptr->queued, MESSAGE_SIZE(msg_ptr->length), __ATOMIC_RELAXED);
+	}
 
-	return 0;
-}	
+	return render_dequeued(this, msg_ptr);
+}
 
 static ipt_logger_message_t *
 dequeue_timed(private_logger_t *this, ipt_time_value_t *tv)
 {
-	return (ipt_logger_message_t *)this->sq_ptr->dequeue_timed(this->sq_ptr, tv);
+	report_drops(this);
+
+	return take_dequeued(this, (ipt_logger_message_t *)this->sq_ptr->dequeue_timed(this->sq_ptr, tv));
 }
 
 static ipt_logger_message_t *
 dequeue(private_logger_t *this)
 {
-	return (ipt_logger_message_t *) this->sq_ptr->dequeue(this->sq_ptr);
+	report_drops(this);
+
+	return take_dequeued(this, (ipt_logger_message_t *) this->sq_ptr->dequeue(this->sq_ptr));
 }
 
 static int
 get_category_mask(private_logger_t *this)
 {
-	return this->sd_ptr->category_mask;
+	return __atomic_load_n(&this->sd_ptr->category_mask, __ATOMIC_RELAXED);
 }
 
 
 static int
 get_level_mask(private_logger_t *this)
 {
-	return this->sd_ptr->level_mask;
+	return __atomic_load_n(&this->sd_ptr->level_mask, __ATOMIC_RELAXED);
 }
 
 static int
 is_category_set(private_logger_t *this, ipt_log_category_mask_t mask)
 {
-	return this->sd_ptr->category_mask & mask;
+	return (__atomic_load_n(&this->sd_ptr->category_mask, __ATOMIC_RELAXED) & mask) != 0;
 }
 
 static int
 is_level_set(private_logger_t *this, ipt_log_level_mask_t mask)
 {
-	return this->sd_ptr->level_mask & mask;
+	return (__atomic_load_n(&this->sd_ptr->level_mask, __ATOMIC_RELAXED) & mask) != 0;
 }
 
 static void 
 set_category(private_logger_t *this, ipt_log_category_mask_t mask)
 {
-	this->sd_ptr->category_mask |= mask;	
+	__atomic_fetch_or(&this->sd_ptr->category_mask, mask, __ATOMIC_RELAXED);
 }
 
 static void
 set_level(private_logger_t *this, ipt_log_level_mask_t mask)
 {
-	this->sd_ptr->level_mask |= mask;
+	__atomic_fetch_or(&this->sd_ptr->level_mask, mask, __ATOMIC_RELAXED);
 }
 static void
 unset_category(private_logger_t *this, ipt_log_category_mask_t mask)
 {
-	this->sd_ptr->category_mask & ~mask;
+	__atomic_fetch_and(&this->sd_ptr->category_mask, ~mask, __ATOMIC_RELAXED);
 }
 static void
 unset_level(private_logger_t *this, ipt_log_level_mask_t mask)
 {
-	this->sd_ptr->level_mask & ~ mask;
+	__atomic_fetch_and(&this->sd_ptr->level_mask, ~mask, __ATOMIC_RELAXED);
+}
+
+static int
+set_clock(private_logger_t *this, ipt_logger_clock_t clock)
+{
+	if ( clock != IPT_LOGGER_CLOCK_REALTIME && clock != IPT_LOGGER_CLOCK_COARSE && clock != IPT_LOGGER_CLOCK_SHARED )
+	{
+		return -1;
+	}
+
+	__atomic_store_n(&this->sd_ptr->clock, clock, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static void
+update_clock(private_logger_t *this)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	__atomic_store_n(&this->sd_ptr->clock_ns, (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec, __ATOMIC_RELAXED);
+}
+
+static int
+set_overflow(private_logger_t *this, ipt_logger_overflow_t policy, size_t capacity, const ipt_time_value_t *max_wait)
+{
+	if ( policy != IPT_LOGGER_DROP_NEWEST && policy != IPT_LOGGER_DROP_OLDEST && policy != IPT_LOGGER_BLOCK )
+	{
+		return -1;
+	}
+
+	if ( max_wait && (max_wait->tv_sec < 0 || max_wait->tv_usec < 0) )
+	{
+		return -1;
+	}
+
+	__atomic_store_n(&this->sd_ptr->max_wait_ns, max_wait ? (uint64_t)max_wait->tv_sec * 1000000000ULL + max_wait->tv_usec * 1000ULL : DEFAULT_MAX_WAIT_NS, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->sd_ptr->capacity, capacity, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->sd_ptr->overflow, policy, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int
+set_drop_report(private_logger_t *this, const ipt_time_value_t *interval)
+{
+	if ( interval && (interval->tv_sec < 0 || interval->tv_usec < 0) )
+	{
+		return -1;
+	}
+
+	__atomic_store_n(&this->sd_ptr->report_interval_ns, interval ? (uint64_t)interval->tv_sec * 1000000000ULL + interval->tv_usec * 1000ULL : 0, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/*
+ * The limit set for the originator and the categories, NULL when there is none. Called with the semaphore.
+ */
+static rate_limit_t *
+find_limit(shared_data_t *sd_ptr, const char *originator, ipt_log_category_mask_t category_mask)
+{
+	unsigned int i;
+	rate_limit_t *l;
+
+	for ( i = 0; i < LOGGER_MAX_RATE_LIMITS; i++ )
+	{
+		l = &sd_ptr->limits[i];
+
+		if ( l->state == SLOT_READY && l->category_mask == category_mask &&
+		     strncmp(l->originator, originator ? originator : "", sizeof(l->originator) - 1) == 0 )
+		{
+			return l;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+set_rate_limit(private_logger_t *this, const char *originator, ipt_log_category_mask_t category_mask, unsigned int rate, unsigned int burst)
+{
+	uint64_t interval_ns;
+	unsigned int i;
+	rate_limit_t *l;
+
+	if ( rate == 0 || burst == 0 || category_mask == 0 || (originator && originator[0] == '\0') )
+	{
+		return -1;
+	}
+
+	interval_ns = 1000000000ULL / rate;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (l = find_limit(this->sd_ptr, originator, category_mask)) != NULL )
+	{
+		__atomic_store_n(&l->interval_ns, interval_ns, __ATOMIC_RELAXED);
+		__atomic_store_n(&l->tolerance_ns, (burst - 1) * interval_ns, __ATOMIC_RELAXED);
+
+		/* Full again at the new rate */
+		__atomic_store_n(&l->tat, 0, __ATOMIC_RELAXED);
+
+		for ( i = 0; i < LOGGER_MAX_RATE_BUCKETS; i++ )
+		{
+			if ( this->sd_ptr->buckets[i].limit == (unsigned int)(l - this->sd_ptr->limits) )
+			{
+				__atomic_store_n(&this->sd_ptr->buckets[i].tat, 0, __ATOMIC_RELAXED);
+			}
+		}
+
+		sem_post(&this->sd_ptr->sem);
+		return 0;
+	}
+
+	for ( i = 0; i < LOGGER_MAX_RATE_LIMITS && this->sd_ptr->limits[i].state != SLOT_FREE; i++ );
+
+	if ( i == LOGGER_MAX_RATE_LIMITS )
+	{
+		sem_post(&this->sd_ptr->sem);
+		return -1;
+	}
+
+	l = &this->sd_ptr->limits[i];
+
+	strncpy(l->originator, originator ? originator : "", sizeof(l->originator) - 1);
+	l->originator[sizeof(l->originator) - 1] = '\0';
+	l->category_mask = category_mask;
+	l->interval_ns = interval_ns;
+	l->tolerance_ns = (burst - 1) * interval_ns;
+	l->tat = 0;
+
+	/* The producers find the limit once it is complete */
+	__atomic_store_n(&l->state, SLOT_READY, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&this->sd_ptr->num_limits, 1, __ATOMIC_RELEASE);
+
+	sem_post(&this->sd_ptr->sem);
+
+	return 0;
+}
+
+static int
+unset_rate_limit(private_logger_t *this, const char *originator, ipt_log_category_mask_t category_mask)
+{
+	rate_limit_t *l;
+
+	sem_wait(&this->sd_ptr->sem);
+
+	if ( (l = find_limit(this->sd_ptr, originator, category_mask)) == NULL )
+	{
+		sem_post(&this->sd_ptr->sem);
+		return -1;
+	}
+
+	__atomic_store_n(&l->state, SLOT_FREE, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&l->generation, 1, __ATOMIC_SEQ_CST);
+	__atomic_sub_fetch(&this->sd_ptr->num_limits, 1, __ATOMIC_RELEASE);
+
+	/* Release the buckets of the originators. A bucket still being named is released by its producer. */
+	free_stale_buckets(this->sd_ptr);
+
+	sem_post(&this->sd_ptr->sem);
+
+	return 0;
+}
+
+static uint64_t
+get_dropped(private_logger_t *this, const char *originator)
+{
+	uint64_t dropped = 0;
+	unsigned int i;
+	drop_t *d;
+
+	for ( i = 0; i < LOGGER_MAX_DROP_ORIGINATORS; i++ )
+	{
+		d = &this->sd_ptr->drops[i];
+
+		if ( __atomic_load_n(&d->state, __ATOMIC_ACQUIRE) == SLOT_READY &&
+		     (originator == NULL || strncmp(d->originator, originator, sizeof(d->originator) - 1) == 0) )
+		{
+			dropped += __atomic_load_n(&d->dropped, __ATOMIC_RELAXED);
+		}
+	}
+
+	if ( originator == NULL || strcmp(originator, "logger") == 0 )
+	{
+		dropped += __atomic_load_n(&this->sd_ptr->drops_other.dropped, __ATOMIC_RELAXED);
+	}
+
+	return dropped;
 }
 
 static int
@@ -266,6 +2257,72 @@ private_free(private_logger_t *this, void *ptr)
 {
 	this->alloc_ptr->free(this->alloc_ptr, ptr);
 }
+
+static int
+drain(private_logger_t *this, void (*func)(const ipt_logger_message_t *const, void *), void *in_ptr)
+{
+	render_context_t ctx = { this, func, in_ptr };
+	ipt_time_value_t tv = { 0, 0 };
+	ipt_logger_message_t *msg_ptr;
+	record_t *record;
+	unsigned int i;
+	int count = 0;
+
+	for ( i = 0; i < this->sd_ptr->num_rings; i++ )
+	{
+		ring_t *ring = get_ring(this->sd_ptr, i);
+		size_t head = ring->head;
+		size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+		if ( head == tail )
+		{
+			continue;
+		}
+
+		for ( ; head != tail; head += record->size )
+		{
+			record = ring_record(this->sd_ptr, ring, head);
+
+			if ( record->used )
+			{
+				ipt_logger_message_t *ptr = record_message(record);
+
+				/* The collector owns the record until the head moves past it */
+				if ( ptr->format == 0 )
+				{
+					render(this, ptr, ptr);
+				}
+
+				render_each(ptr, &ctx);
+				count++;
+			}
+		}
+
+		/* Hand all the records back to the producer at once */
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+	}
+
+	report_drops(this);
+
+	/* The processes that log through the shared queue */
+	while ( (msg_ptr = dequeue_timed(this, &tv)) != NULL )
+	{
+		func(msg_ptr, in_ptr);
+
+		this->alloc_ptr->free(this->alloc_ptr, msg_ptr);
+
+		count++;
+	}
+
+	return count;
+}
+
+int
+ipt_logger_format_message(ipt_logger_t *this, const ipt_logger_message_t *msg, ipt_logger_message_t *out)
+{
+	return render((private_logger_t *)this, msg, out);
+}
+
 void
 ipt_logger_dump_message(ipt_logger_message_t *msg)
 {
@@ -274,12 +2331,24 @@ ipt_logger_dump_message(ipt_logger_message_t *msg)
 	fprintf(stdout,"%s %s %s\n",msg->time, msg->originator, msg->message);
 }
 ipt_logger_t *ipt_logger_create(const char *name, ipt_allocator_t *alloc_ptr)
+{
+	return ipt_logger_create_with_rings(name, alloc_ptr, 0, 0);
+}
+
+ipt_logger_t *ipt_logger_create_with_rings(const char *name, ipt_allocator_t *alloc_ptr, unsigned int num_rings, unsigned int ring_size)
 {
 
 	if ( alloc_ptr == NULL || name == NULL || strlen(name) + 1 > 256 )
 	{
 		return NULL;
 	}
+
+	/* The indexes are masked, so the size is a power of 2, and holds at least two of the largest records */
+	if ( num_rings && ( ring_size < 2 * RECORD_SIZE(MAX_MESSAGE_SIZE) || (ring_size & (ring_size - 1)) ) )
+	{
+		return NULL;
+	}
+
 	private_logger_t *this = malloc(sizeof(private_logger_t));
 	if ( this == NULL )
 	{
@@ -287,6 +2356,11 @@ ipt_logger_t *ipt_logger_create(const char *name, ipt_allocator_t *alloc_ptr)
 	}
 
 	this->alloc_ptr = alloc_ptr;
+	this->ring = NULL;
+	this->ring_generation = 0;
+	this->time_cache.sec = (time_t)-1;
+	this->field_format = IPT_LOGGER_FIELDS_TEXT;
+
 	if ( (this->sd_ptr = (shared_data_t *)alloc_ptr->malloc(alloc_ptr,sizeof(shared_data_t))) == NULL )
 	{
 		free(this);
@@ -294,10 +2368,40 @@ ipt_logger_t *ipt_logger_create(const char *name, ipt_allocator_t *alloc_ptr)
 	}
 	memset(this->sd_ptr, 0, sizeof(shared_data_t));
 
+	this->sd_ptr->capacity = alloc_ptr->get_size(alloc_ptr) / DEFAULT_CAPACITY_SHARE;
+	this->sd_ptr->overflow = IPT_LOGGER_DROP_NEWEST;
+	this->sd_ptr->max_wait_ns = DEFAULT_MAX_WAIT_NS;
+	this->sd_ptr->report_interval_ns = LOGGER_DROP_REPORT_INTERVAL * 1000000000ULL;
+	this->sd_ptr->last_report_ns = monotonic_ns();
+
+	if ( num_rings )
+	{
+		size_t size = num_rings * (sizeof(ring_t) + ring_size);
+		void *rings;
+
+		if ( (rings = alloc_ptr->malloc(alloc_ptr, size)) == NULL )
+		{
+			alloc_ptr->free(alloc_ptr,this->sd_ptr);
+			free(this);
+			return NULL;
+		}
+
+		memset(rings, 0, size);
+
+		ipt_op_set(&this->sd_ptr->rings, rings);
+		this->sd_ptr->num_rings = num_rings;
+		this->sd_ptr->ring_size = ring_size;
+	}
+
 	if ( alloc_ptr->register_object(alloc_ptr, name, this->sd_ptr) < 0 )
    	{
-      		free(this);
+		if ( num_rings )
+		{
+			alloc_ptr->free(alloc_ptr, ipt_op_drf(&this->sd_ptr->rings));
+		}
+
       		alloc_ptr->free(alloc_ptr,this->sd_ptr);
+      		free(this);
       		return NULL;
    	}
 
@@ -318,18 +2422,34 @@ ipt_logger_t *ipt_logger_create(const char *name, ipt_allocator_t *alloc_ptr)
 		return NULL;
 	}
 
-	this->public.enqueue = (int (*)(ipt_logger_t *this, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, const char *fmt, ...)) enqueue;
-	this->public.dequeue = (ipt_logger_message_t * (*)(ipt_logger_t *this)) dequeue;
+	this->public.enqueue            = (int (*)(ipt_logger_t *this, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, const char *fmt, ...)) enqueue;
+	this->public.dequeue            = (ipt_logger_message_t * (*)(ipt_logger_t *this)) dequeue;
 	this->public.dequeue_timed      = (ipt_logger_message_t *(*)(ipt_logger_t *this, ipt_time_value_t *)) dequeue_timed;
-	this->public.is_category_set = (int (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) is_category_set;
-	this->public.is_level_set = (int (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) is_level_set;
-	this->public.set_category = (void (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) set_category;
-	this->public.set_level = (void (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) set_level;
-	this->public.unset_category = (void (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) unset_category;
-	this->public.unset_level = (void (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) unset_level;
-	this->public.get_fd      = (int (*)(ipt_logger_t *this)) get_fd;
-	this->public.free    = (void (*)(ipt_logger_t *this, void *)) private_free;
-   	this->public.get_allocator = (ipt_allocator_t* (*)(ipt_logger_t*))get_allocator;
+	this->public.is_category_set    = (int (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) is_category_set;
+	this->public.is_level_set       = (int (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) is_level_set;
+	this->public.set_category       = (void (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) set_category;
+	this->public.get_category_mask  = (enum ipt_log_category_mask_t (*)(ipt_logger_t *this)) get_category_mask;
+	this->public.get_level_mask     = (enum ipt_log_level_mask_t (*)(ipt_logger_t *this))  get_level_mask;
+	this->public.set_level          = (void (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) set_level;
+	this->public.unset_category     = (void (*)(ipt_logger_t *this, enum ipt_log_category_mask_t)) unset_category;
+	this->public.unset_level        = (void (*)(ipt_logger_t *this, enum ipt_log_level_mask_t)) unset_level;
+	this->public.get_fd             = (int (*)(ipt_logger_t *this)) get_fd;
+	this->public.syslog_priority    = (int (*)(ipt_logger_t *this, ipt_logger_message_t *)) syslog_priority;
+	this->public.free               = (void (*)(ipt_logger_t *this, void *)) private_free;
+	this->public.drain              = (int (*)(ipt_logger_t *, void (*)(const ipt_logger_message_t *const, void *), void *)) drain;
+	this->public.register_format    = (int (*)(ipt_logger_t *, const char *)) register_format;
+	this->public.is_enabled         = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t)) is_enabled;
+	this->public.set_clock          = (int (*)(ipt_logger_t *, ipt_logger_clock_t)) set_clock;
+	this->public.update_clock       = (void (*)(ipt_logger_t *)) update_clock;
+	this->public.enqueue_binary     = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, int, ...)) enqueue_binary;
+	this->public.set_overflow       = (int (*)(ipt_logger_t *, ipt_logger_overflow_t, size_t, const ipt_time_value_t *)) set_overflow;
+	this->public.set_drop_report    = (int (*)(ipt_logger_t *, const ipt_time_value_t *)) set_drop_report;
+	this->public.get_dropped        = (uint64_t (*)(ipt_logger_t *, const char *)) get_dropped;
+	this->public.set_rate_limit     = (int (*)(ipt_logger_t *, const char *, ipt_log_category_mask_t, unsigned int, unsigned int)) set_rate_limit;
+	this->public.unset_rate_limit   = (int (*)(ipt_logger_t *, const char *, ipt_log_category_mask_t)) unset_rate_limit;
+	this->public.enqueue_fields     = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, ...)) enqueue_fields;
+	this->public.set_field_format   = (int (*)(ipt_logger_t *, ipt_logger_field_format_t)) set_field_format;
+   	this->public.get_allocator      = (ipt_allocator_t* (*)(ipt_logger_t*))get_allocator;
 
 	return (ipt_logger_t *) this;
 }
@@ -352,6 +2472,10 @@ ipt_logger_t *ipt_logger_attach(const char *name, ipt_allocator_t *alloc_ptr)
 
 
 	this->alloc_ptr = alloc_ptr;
+	this->ring = NULL;
+	this->ring_generation = 0;
+	this->time_cache.sec = (time_t)-1;
+	this->field_format = IPT_LOGGER_FIELDS_TEXT;
 	
 	if ( (this->sd_ptr = alloc_ptr->find_registered_object(alloc_ptr,name)) == NULL )
 	{
@@ -382,6 +2506,19 @@ ipt_logger_t *ipt_logger_attach(const char *name, ipt_allocator_t *alloc_ptr)
 	this->public.get_fd             = (int (*)(ipt_logger_t *this)) get_fd;
 	this->public.syslog_priority    = (int (*)(ipt_logger_t *this, ipt_logger_message_t *)) syslog_priority;
 	this->public.free               = (void (*)(ipt_logger_t *this, void *)) private_free;
+	this->public.drain              = (int (*)(ipt_logger_t *, void (*)(const ipt_logger_message_t *const, void *), void *)) drain;
+	this->public.register_format    = (int (*)(ipt_logger_t *, const char *)) register_format;
+	this->public.is_enabled         = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t)) is_enabled;
+	this->public.set_clock          = (int (*)(ipt_logger_t *, ipt_logger_clock_t)) set_clock;
+	this->public.update_clock       = (void (*)(ipt_logger_t *)) update_clock;
+	this->public.enqueue_binary     = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, int, ...)) enqueue_binary;
+	this->public.set_overflow       = (int (*)(ipt_logger_t *, ipt_logger_overflow_t, size_t, const ipt_time_value_t *)) set_overflow;
+	this->public.set_drop_report    = (int (*)(ipt_logger_t *, const ipt_time_value_t *)) set_drop_report;
+	this->public.get_dropped        = (uint64_t (*)(ipt_logger_t *, const char *)) get_dropped;
+	this->public.set_rate_limit     = (int (*)(ipt_logger_t *, const char *, ipt_log_category_mask_t, unsigned int, unsigned int)) set_rate_limit;
+	this->public.unset_rate_limit   = (int (*)(ipt_logger_t *, const char *, ipt_log_category_mask_t)) unset_rate_limit;
+	this->public.enqueue_fields     = (int (*)(ipt_logger_t *, ipt_log_category_mask_t, ipt_log_level_mask_t, const char *, ...)) enqueue_fields;
+	this->public.set_field_format   = (int (*)(ipt_logger_t *, ipt_logger_field_format_t)) set_field_format;
    
    	this->public.get_allocator = (ipt_allocator_t* (*)(ipt_logger_t*))get_allocator;
 	
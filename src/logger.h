@@ -1,16 +1,50 @@
 #ifndef __IPCTOOLS_LOGGER_H__
 #define __IPCTOOLS_LOGGER_H__
 
+#include <stdint.h>
 #include "allocator_shm.h"
 #include "shared_queue.h"
 
-#define LOGGER_MAX_MESSAGE_SIZE (256)
+/** The longest message, including the terminating null. Longer messages are truncated. */
+#define LOGGER_MAX_MESSAGE_SIZE (4096)
+
+/** The number of formats that can be registered with a logger */
+#define LOGGER_MAX_FORMATS (128)
+
+/** The longest format, including the terminating null */
+#define LOGGER_MAX_FORMAT_SIZE (128)
+
+/** The most arguments a registered format may take */
+#define LOGGER_MAX_FORMAT_ARGS (16)
+
+/** The number of originators whose dropped messages are counted apart */
+#define LOGGER_MAX_DROP_ORIGINATORS (64)
+
+/** The default interval, in seconds, at which the dropped messages are reported */
+#define LOGGER_DROP_REPORT_INTERVAL (10)
+
+/** The number of rate limits that can be set on a logger */
+#define LOGGER_MAX_RATE_LIMITS (16)
+
+/** The number of originators the rate limits without an originator keep apart */
+#define LOGGER_MAX_RATE_BUCKETS (128)
+
+/** The format of a structured message, whose fields are recorded with enqueue_fields */
+#define LOGGER_FORMAT_FIELDS (-1)
+
+/** The longest key of a field, including the terminating null. Longer keys are truncated. */
+#define LOGGER_MAX_FIELD_KEY_SIZE (64)
 
 typedef ipt_shared_queue_node_t ipt_logger_node_t;
 typedef struct ipt_logger_t ipt_logger_t;
 typedef struct ipt_logger_message_t ipt_logger_message_t;
 typedef enum ipt_log_category_mask_t ipt_log_category_mask_t;
 typedef enum ipt_log_level_mask_t ipt_log_level_mask_t;
+typedef enum ipt_logger_clock_t ipt_logger_clock_t;
+typedef enum ipt_logger_overflow_t ipt_logger_overflow_t;
+typedef enum ipt_log_field_type_t ipt_log_field_type_t;
+typedef enum ipt_logger_field_format_t ipt_logger_field_format_t;
+typedef struct ipt_log_field_t ipt_log_field_t;
 
 enum ipt_log_category_mask_t
 {
@@ -36,6 +70,109 @@ enum ipt_log_level_mask_t
 	IPT_LEVEL_ALL      = 0xffffffff 
 };
 
+/**
+ * The clocks the time of a message can be read from.
+ */
+enum ipt_logger_clock_t
+{
+	/** The system clock. */
+	IPT_LOGGER_CLOCK_REALTIME = 0,
+
+	/** The system clock, as of the last tick of the kernel. Cheaper, to a few milliseconds. */
+	IPT_LOGGER_CLOCK_COARSE   = 1,
+
+	/** A clock in the shared data, set by update_clock. A single load. */
+	IPT_LOGGER_CLOCK_SHARED   = 2
+};
+
+/**
+ * What a producer does when the logger is full.
+ */
+enum ipt_logger_overflow_t
+{
+	/** Drop the message being logged. */
+	IPT_LOGGER_DROP_NEWEST = 0,
+
+	/** Drop the oldest messages on the shared queue to make room. A full ring drops the newest. */
+	IPT_LOGGER_DROP_OLDEST = 1,
+
+	/** Wait for the collector to make room, and drop the message when it does not in time. */
+	IPT_LOGGER_BLOCK       = 2
+};
+
+/**
+ * The types of the fields of a structured message.
+ */
+enum ipt_log_field_type_t
+{
+	/** Ends the fields passed to enqueue_fields. */
+	IPT_LOG_FIELD_END    = 0,
+
+	/** A signed 64 bit integer. */
+	IPT_LOG_FIELD_INT    = 1,
+
+	/** A double. */
+	IPT_LOG_FIELD_DOUBLE = 2,
+
+	/** A string, copied with its terminating null. */
+	IPT_LOG_FIELD_STRING = 3,
+
+	/** A time in nanoseconds since the epoch, as a uint64_t. */
+	IPT_LOG_FIELD_TIME   = 4
+};
+
+/**
+ * How the process reading the logger is handed the structured messages.
+ */
+enum ipt_logger_field_format_t
+{
+	/** As text, "key=value key=value". Strings are quoted when they hold spaces, quotes or '='. */
+	IPT_LOGGER_FIELDS_TEXT = 0,
+
+	/** As a JSON object. */
+	IPT_LOGGER_FIELDS_JSON = 1,
+
+	/** As they were recorded, with the format LOGGER_FORMAT_FIELDS. Read with ipt_logger_next_field. */
+	IPT_LOGGER_FIELDS_RAW  = 2
+};
+
+/**
+ * @struct ipt_log_field_t
+ *
+ * @brief A field of a structured message, read with ipt_logger_next_field. The key and a string
+ *        point into the message.
+ */
+struct ipt_log_field_t
+{
+	ipt_log_field_type_t type;
+
+	/** the key, null terminated */
+	const char *key;
+
+	union
+	{
+		int64_t i;
+		double d;
+		uint64_t time;
+
+		/** null terminated, len does not count the null */
+		struct
+		{
+			const char *ptr;
+			size_t len;
+		} str;
+	} value;
+};
+
+/**
+ * The arguments of a field passed to enqueue_fields.
+ */
+#define IPT_FIELD_INT(key, value)    IPT_LOG_FIELD_INT, (const char *)(key), (int64_t)(value)
+#define IPT_FIELD_DOUBLE(key, value) IPT_LOG_FIELD_DOUBLE, (const char *)(key), (double)(value)
+#define IPT_FIELD_STRING(key, value) IPT_LOG_FIELD_STRING, (const char *)(key), (const char *)(value)
+#define IPT_FIELD_TIME(key, value)   IPT_LOG_FIELD_TIME, (const char *)(key), (uint64_t)(value)
+#define IPT_FIELD_END                IPT_LOG_FIELD_END
+
 /**
  * @struct ipt_logger_message_t
  *
@@ -72,13 +209,29 @@ struct ipt_logger_message_t
     */
    ipt_log_level_mask_t lmask;
 
+   /**
+    * The registered format of a binary message, 0 when the message is text, or
+    * LOGGER_FORMAT_FIELDS when it is structured.
+    *
+    * A binary message holds the arguments of the format in place of the text, and
+    * no time string. The logger formats it when it is read. A structured message
+    * holds its fields, each a type, the lengths of the key and the value, the key and
+    * the value. It is rendered as the reader asks, see set_field_format.
+    */
+   int format;
+
+   /**
+    * Time at which the message was generated, in nanoseconds since the epoch.
+    */
+   uint64_t timestamp;
+
    /**
     * Name of process that originated message
     */
    char originator[32];
 
    /**
-    * Time at which the message was generated.
+    * Time at which the message was generated, formatted from the timestamp when the message is read.
     *
     * where the format is * [RFC 3164]:[milliseconds]
     *
@@ -89,11 +242,19 @@ struct ipt_logger_message_t
    char time[32];
 
    /**
-    * Message generated by the process.
+    * The number of bytes in message, including the terminating null of a text.
     */
-   char message[LOGGER_MAX_MESSAGE_SIZE];
+   unsigned int length;
+
+   /**
+    * Message generated by the process. The message is allocated to fit it.
+    */
+   char message[];
 };
 
+/** The size of a buffer that holds any message */
+#define LOGGER_MESSAGE_BUFFER_SIZE (sizeof(ipt_logger_message_t) + LOGGER_MAX_MESSAGE_SIZE)
+
 /**
  * @struct ipt_logger_t
  *
@@ -170,6 +331,19 @@ struct ipt_logger_t
          */
 	int (*is_level_set)(ipt_logger_t *this, enum ipt_log_level_mask_t level);
 
+       /**
+         * Check whether a message of the category and level would be logged. The masks are read
+         * without locking, so this is cheap enough to guard every message. Use IPT_LOG.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] category The category of the message.
+         * @param[in] level The level of the message.
+         *
+         * @retval 0 The message is filtered out.
+         * @retval 1 The message is logged.
+         */
+	int (*is_enabled)(ipt_logger_t *this, ipt_log_category_mask_t category, ipt_log_level_mask_t level);
+
        /**
          * Get the category mask.
          *
@@ -224,6 +398,97 @@ struct ipt_logger_t
          */
 	void (*unset_level)(ipt_logger_t *this, enum ipt_log_level_mask_t level);
 
+       /**
+         * Select the clock the time of the messages is read from, for all the processes.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] clock The clock.
+         *
+         * @retval 0 Succeeded.
+         * @retval -1 Not a clock.
+         */
+	int (*set_clock)(ipt_logger_t *this, ipt_logger_clock_t clock);
+
+       /**
+         * Set the shared clock to the time of the system clock. Called periodically by one process,
+         * from a timer of the collector for instance, when the logger uses IPT_LOGGER_CLOCK_SHARED.
+         * The messages carry the time of the last update, and the system clock until the first.
+         *
+         * @param[in] this The this pointer.
+         */
+	void (*update_clock)(ipt_logger_t *this);
+
+       /**
+         * Bound the memory the messages on the shared queue take from the allocator, for all the
+         * processes, so a log storm does not starve the other users of the segment. The default
+         * capacity is a quarter of the segment, and the newest message is dropped when it is full.
+         * The rings are bounded by their size, and follow the same policy.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] policy What a producer does when the logger is full.
+         * @param[in] capacity The bytes the queued messages may take, 0 for no limit.
+         * @param[in] max_wait The longest a producer waits with IPT_LOGGER_BLOCK, NULL for the default of 1 millisecond.
+         *
+         * @retval 0 Succeeded.
+         * @retval -1 Not a policy.
+         */
+	int (*set_overflow)(ipt_logger_t *this, ipt_logger_overflow_t policy, size_t capacity, const ipt_time_value_t *max_wait);
+
+       /**
+         * Set how often the dropped messages are reported. The process reading the logger adds a
+         * warning "N messages dropped" from each originator that dropped messages since the last
+         * report, read with the other messages. Every LOGGER_DROP_REPORT_INTERVAL seconds by default.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] interval The interval, NULL to stop the reports.
+         *
+         * @retval 0 Succeeded.
+         * @retval -1 Not an interval.
+         */
+	int (*set_drop_report)(ipt_logger_t *this, const ipt_time_value_t *interval);
+
+       /**
+         * Get the number of messages dropped by an originator. The originators past the first
+         * LOGGER_MAX_DROP_ORIGINATORS are counted together, under "logger".
+         *
+         * @param[in] this The this pointer.
+         * @param[in] originator The originator, NULL for all of them.
+         *
+         * @retval uint64_t The number of messages dropped.
+         */
+	uint64_t (*get_dropped)(ipt_logger_t *this, const char *originator);
+
+       /**
+         * Limit the rate of the messages of an originator in some categories, for all the processes.
+         * Each limit is a token bucket that holds burst messages and refills at rate messages a
+         * second. A message takes a token from every limit it matches, before it is formatted, and
+         * is dropped and counted as dropped when one of them is empty. The tokens it took from the
+         * others are then given back. The producers take the tokens without a lock. Setting a limit
+         * again for the same originator and categories changes its rate, and fills its bucket.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] originator The originator, NULL limits each originator on its own.
+         * @param[in] category_mask The categories the limit applies to.
+         * @param[in] rate The messages a second.
+         * @param[in] burst The messages that may be logged at once, at least 1.
+         *
+         * @retval 0 Succeeded.
+         * @retval -1 Not a rate, or there is no room for the limit.
+         */
+	int (*set_rate_limit)(ipt_logger_t *this, const char *originator, ipt_log_category_mask_t category_mask, unsigned int rate, unsigned int burst);
+
+       /**
+         * Remove a rate limit.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] originator The originator the limit was set for, or NULL.
+         * @param[in] category_mask The categories the limit was set for.
+         *
+         * @retval 0 Succeeded.
+         * @retval -1 There is no such limit.
+         */
+	int (*unset_rate_limit)(ipt_logger_t *this, const char *originator, ipt_log_category_mask_t category_mask);
+
        /**
          * Get the file descriptor of the named pipe used to listen for enqueue events.
          *
@@ -251,6 +516,78 @@ struct ipt_logger_t
          */ 
 	int (*syslog_priority)(ipt_logger_t *this, ipt_logger_message_t *msg);
 
+       /**
+         *  Read the messages written to the producer rings, and the messages on the shared queue.
+         *  The records are handed back to the producers once the callback returns, so the
+         *  callback must copy what it keeps. Only one process may drain the logger at a time.
+         *  The rings have no doorbell, the collector polls them, from a timer for instance.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] func The callback that will be called with each message.
+         * @param[in] in_ptr Pointer to object that will be passed through to the callback.
+         *
+         * @retval int The number of messages read.
+         */ 
+	int (*drain)(ipt_logger_t *this, void (*func)(const ipt_logger_message_t *const, void *), void *in_ptr);
+
+       /**
+         *  Register a format for binary messages. Registering the same format again returns the
+         *  same id, in any process. The format may use the conversions of printf taking an
+         *  integer, a double, a string or a pointer, without '*' for the width or precision.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] fmt The format.
+         *
+         * @retval >0 The id of the format.
+         * @retval -1 Failed, the format is not supported or there is no room for it.
+         */ 
+	int (*register_format)(ipt_logger_t *this, const char *fmt);
+
+       /**
+         * Enqueue a binary log message. The arguments and the time are recorded as they are, and
+         * the message is formatted by the process reading it. Strings are copied, and truncated
+         * when the arguments do not fit in a message. Use IPT_LOG_BINARY.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] category_mask The category of the message. 
+         * @param[in] level_mask The level of the message. 
+         * @param[in] originator The originator of the message. 
+         * @param[in] format The id of a registered format, followed by its arguments. 
+         *
+         * @retval 0 Succeeded. 
+         * @retval -1 Failed.
+         */
+	int (*enqueue_binary)(ipt_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, int format, ...);
+
+       /**
+         * Enqueue a structured message. The fields are recorded as they are, typed, and rendered
+         * by the process reading them. Strings are truncated, and the last fields dropped, when
+         * they do not fit in a message. Use IPT_LOG_FIELDS.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] category_mask The category of the message. 
+         * @param[in] level_mask The level of the message. 
+         * @param[in] originator The originator of the message. 
+         * @param[in] ... The fields, IPT_FIELD_INT, IPT_FIELD_DOUBLE, IPT_FIELD_STRING or IPT_FIELD_TIME,
+         *                followed by IPT_FIELD_END.
+         *
+         * @retval 0 Succeeded. 
+         * @retval -1 Failed.
+         */
+	int (*enqueue_fields)(ipt_logger_t *this, ipt_log_category_mask_t category_mask, ipt_log_level_mask_t level_mask, const char *originator, ...);
+
+       /**
+         * Set how the structured messages read by this process are rendered, by dequeue, drain,
+         * ipt_logger_for_each and ipt_logger_format_message. Text by default.
+         *
+         * @param[in] this The this pointer.
+         * @param[in] format IPT_LOGGER_FIELDS_TEXT, IPT_LOGGER_FIELDS_JSON or IPT_LOGGER_FIELDS_RAW.
+         *
+         * @retval 0 Succeeded. 
+         * @retval -1 The format is not valid.
+         */
+	int (*set_field_format)(ipt_logger_t *this, ipt_logger_field_format_t format);
+
 };
 
 /**
@@ -264,6 +601,28 @@ struct ipt_logger_t
   */
 ipt_logger_t *ipt_logger_create(const char *name, ipt_allocator_t *alloc_ptr);
 
+/**
+  * Logger constructor. Each process that logs claims one of the rings the first time it logs, and
+  * writes its messages to the ring without locking or allocating. The threads of the process share
+  * its ring: each reserves its record with a compare and swap, and the records are published in the
+  * order they were reserved, so a thread may wait for a thread of the same process that reserved
+  * before it. The records in the rings take the size of their message, rounded up to 8 bytes. The
+  * messages are read with drain.
+  * A ring is released once its process has exited and its messages were read. The processes that
+  * find no free ring log through the shared queue. A full ring is handled by the overflow policy,
+  * see set_overflow.
+  *
+  * @param[in] name The name of the logger. The logger will be registered with the allocator under this name.
+  * @param[in] alloc_ptr The allocator to be used by the logger.
+  * @param[in] num_rings The number of producer rings.
+  * @param[in] ring_size The size of each ring in bytes, a power of 2 that holds at least two messages
+  *                      of LOGGER_MAX_MESSAGE_SIZE bytes.
+  *
+  * @retval NULL Failed.
+  * @retval !NULL Succeeded. 
+  */
+ipt_logger_t *ipt_logger_create_with_rings(const char *name, ipt_allocator_t *alloc_ptr, unsigned int num_rings, unsigned int ring_size);
+
 /**
   * Logger constructor
   *
@@ -287,6 +646,85 @@ ipt_logger_t * ipt_logger_attach(const char *name, ipt_allocator_t *alloc_ptr);
   */
 void ipt_logger_for_each(ipt_logger_t *this, void (*func)(const ipt_logger_message_t * const, void *), void *in_ptr);
 
+/**
+  * Format a binary message, from a process attached to the logger. Text messages are copied.
+  * The messages read from the logger are already formatted, this is for records kept as they
+  * were written.
+  *
+  * @param[in] this The this pointer.
+  * @param[in] msg The message.
+  * @param[out] out The formatted message, LOGGER_MESSAGE_BUFFER_SIZE bytes. May be msg when
+  *                 msg is as large.
+  *
+  * @retval 0 Succeeded.
+  * @retval -1 The format of the message is not registered.
+  */
+int ipt_logger_format_message(ipt_logger_t *this, const ipt_logger_message_t *msg, ipt_logger_message_t *out);
+
+/**
+  * Read the next field of a structured message.
+  *
+  * @param[in] msg The message, with the format LOGGER_FORMAT_FIELDS.
+  * @param[in,out] pos The offset of the field in the message, 0 for the first.
+  * @param[out] field The field.
+  *
+  * @retval 1 A field was read.
+  * @retval 0 There are no more fields, or the message is not structured.
+  */
+int ipt_logger_next_field(const ipt_logger_message_t *msg, size_t *pos, ipt_log_field_t *field);
+
+/**
+  * Render the fields of a structured message. A field that does not fit is left out, so
+  * the JSON is always complete.
+  *
+  * @param[in] msg The message, with the format LOGGER_FORMAT_FIELDS.
+  * @param[in] format IPT_LOGGER_FIELDS_TEXT or IPT_LOGGER_FIELDS_JSON.
+  * @param[out] out The text.
+  * @param[in] size The size of out.
+  *
+  * @retval >=0 The length of the text.
+  * @retval -1 The message is not structured, or the format is not valid.
+  */
+int ipt_logger_render_fields(const ipt_logger_message_t *msg, ipt_logger_field_format_t format, char *out, size_t size);
+
+/**
+  * Enqueue a log message. The arguments are not evaluated when the category or level is filtered out.
+  */
+#define IPT_LOG(logger, category, level, originator, fmt, ...)                                              \
+	do                                                                                                  \
+	{                                                                                                   \
+		if ( (logger)->is_enabled((logger), (category), (level)) )                                  \
+			(logger)->enqueue((logger), (category), (level), (originator), fmt, ##__VA_ARGS__); \
+	} while ( 0 )
+
+/**
+  * Enqueue a binary log message. The format is registered the first time the line logs, so each
+  * line must always log to the same logger. The arguments are not evaluated when the category or
+  * level is filtered out.
+  */
+#define IPT_LOG_BINARY(logger, category, level, originator, fmt, ...)                                       \
+	do                                                                                                  \
+	{                                                                                                   \
+		static int __ipt_format = 0;                                                                \
+		if ( (logger)->is_enabled((logger), (category), (level)) )                                  \
+		{                                                                                           \
+			if ( __ipt_format == 0 ) __ipt_format = (logger)->register_format((logger), fmt);   \
+			(logger)->enqueue_binary((logger), (category), (level), (originator), __ipt_format, ##__VA_ARGS__); \
+		}                                                                                           \
+	} while ( 0 )
+
+/**
+  * Enqueue a structured message. The fields are not evaluated when the category or level is filtered out.
+  *
+  *  IPT_LOG_FIELDS(logger, IPT_MODULE_ALL, IPT_LEVEL_INFO, "server", IPT_FIELD_STRING("event", "accept"), IPT_FIELD_INT("fd", fd));
+  */
+#define IPT_LOG_FIELDS(logger, category, level, originator, ...)                                            \
+	do                                                                                                  \
+	{                                                                                                   \
+		if ( (logger)->is_enabled((logger), (category), (level)) )                                  \
+			(logger)->enqueue_fields((logger), (category), (level), (originator), __VA_ARGS__, IPT_FIELD_END); \
+	} while ( 0 )
+
 /**
   * Dump the log messages.
   *
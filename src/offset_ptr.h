@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * typedef for struct ipt_op_t
@@ -55,4 +56,190 @@ ipt_sub_offset(char *ptr, ptrdiff_t offset)
 }
 
 
+/**
+ * typedef for struct ipt_cop_t
+ */
+typedef struct ipt_cop_t ipt_cop_t;
+
+/**
+ * The alignment, in bytes, of every address stored in a compact offset pointer. This matches the 
+ * alignment of the blocks returned by the allocators.
+ */
+#define IPT_COP_ALIGN (sizeof(ptrdiff_t))
+
+/**
+ * The largest segment that can be addressed using compact offset pointers. The offset is signed, so
+ * any two addresses in the segment must be less than 2^31 * IPT_COP_ALIGN bytes apart.
+ */
+#define IPT_COP_MAX_SEGMENT ((size_t)INT32_MAX * IPT_COP_ALIGN)
+
+/**
+ * @struct ipt_cop_t
+ *
+ * @brief Compact (32 bit) version of ipt_op_t.
+ *
+ * The offset is scaled by IPT_COP_ALIGN and measured from the aligned address containing the 
+ * pointer itself, so two of them fit in the space of a single ipt_op_t. The address stored must 
+ * be aligned on IPT_COP_ALIGN bytes.
+ */
+struct ipt_cop_t
+{
+	/**
+         * Offset in units of IPT_COP_ALIGN.
+         */
+	int32_t offset;
+};
+
+static inline char *
+ipt_cop_base(ipt_cop_t *this)
+{
+	return (char *)((uintptr_t)this & ~(uintptr_t)(IPT_COP_ALIGN - 1));
+}
+
+static inline void
+ipt_cop_set(ipt_cop_t *this, void *ptr)
+{
+	this->offset = (int32_t)((ipt_cop_base(this) - (char *)ptr) / (ptrdiff_t)IPT_COP_ALIGN);
+}
+
+static inline void * 
+ipt_cop_drf(ipt_cop_t *this)
+{
+	return ipt_cop_base(this) - (ptrdiff_t)this->offset * (ptrdiff_t)IPT_COP_ALIGN;
+} 
+
+static inline  ptrdiff_t 
+ipt_cop_offset(ipt_cop_t *this)
+{
+	return (ptrdiff_t)this->offset * (ptrdiff_t)IPT_COP_ALIGN;
+}
+
+/**
+ * typedef for struct ipt_top_t
+ */
+typedef struct ipt_top_t ipt_top_t;
+
+/**
+ * typedef for a snapshot of a tagged offset pointer.
+ */
+typedef uint64_t ipt_top_val_t;
+
+/**
+ * @struct ipt_top_t
+ *
+ * @brief Tagged offset pointer used to build lock-free structures in shared memory.
+ *
+ * The low 32 bits hold a compact offset ( see ipt_cop_t ) from the tagged pointer to the
+ * item, and the high 32 bits hold a generation counter that is incremented by every
+ * update. A compare-and-swap against a stale snapshot fails even when the same item has 
+ * been put back in the meantime ( ABA ).
+ *
+ * The item must be aligned on IPT_COP_ALIGN bytes and within IPT_COP_MAX_SEGMENT bytes. An
+ * offset of zero is used as NULL, so a tagged pointer can not point to itself.
+ */
+struct ipt_top_t
+{
+	/**
+	 * Offset and tag, updated atomically.
+	 */
+	volatile ipt_top_val_t value;
+};
+
+static inline ipt_top_val_t
+ipt_top_make(ipt_top_t *this, void *ptr, uint32_t tag)
+{
+	uint32_t offset = ptr ? (uint32_t)(int32_t)(((char *)this - (char *)ptr) / (ptrdiff_t)IPT_COP_ALIGN) : 0;
+
+	return ((ipt_top_val_t)tag << 32) | offset;
+}
+
+/**
+ * Take a snapshot of the tagged pointer.
+ */
+static inline ipt_top_val_t
+ipt_top_load(ipt_top_t *this)
+{
+	return __atomic_load_n(&this->value, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * The item referenced by a snapshot of this tagged pointer.
+ */
+static inline void *
+ipt_top_ptr(ipt_top_t *this, ipt_top_val_t val)
+{
+	int32_t offset = (int32_t)(uint32_t)val;
+
+	return offset ? (char *)this - (ptrdiff_t)offset * (ptrdiff_t)IPT_COP_ALIGN : NULL;
+}
+
+/**
+ * The generation counter of a snapshot.
+ */
+static inline uint32_t
+ipt_top_tag(ipt_top_val_t val)
+{
+	return (uint32_t)(val >> 32);
+}
+
+/**
+ * Initialize the tagged pointer. This is not atomic, and is only used before the 
+ * tagged pointer is shared.
+ */
+static inline void
+ipt_top_init(ipt_top_t *this, void *ptr)
+{
+	this->value = ipt_top_make(this, ptr, 0);
+}
+
+/**
+ * Atomically point at a new item, and bump the generation counter.
+ */
+static inline void
+ipt_top_set(ipt_top_t *this, void *ptr)
+{
+	ipt_top_val_t val = ipt_top_load(this);
+
+	while ( !__atomic_compare_exchange_n(&this->value, &val, ipt_top_make(this, ptr, ipt_top_tag(val) + 1),
+					     0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+	{
+	}
+}
+
+/**
+ * Atomically replace the snapshot with a new item and the next generation.
+ *
+ * @param[in]     this     The tagged pointer.
+ * @param[in,out] expected The snapshot previously loaded. Refreshed when the swap fails.
+ * @param[in]     ptr      The new item, or NULL.
+ *
+ * @retval 1 The tagged pointer was updated.
+ * @retval 0 The tagged pointer changed since the snapshot was taken.
+ */
+static inline int
+ipt_top_cas(ipt_top_t *this, ipt_top_val_t *expected, void *ptr)
+{
+	return __atomic_compare_exchange_n(&this->value, expected, ipt_top_make(this, ptr, ipt_top_tag(*expected) + 1),
+					   0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * The link type used by the nodes of the allocators, and the shared lists and queues. 
+ *
+ * Defining IPT_COMPACT_OFFSETS ( ./configure --enable-compact-offsets ) selects ipt_cop_t, which 
+ * shrinks the allocator node from 24 to 16 bytes and the list node from 16 to 8 bytes on 64 bit
+ * platforms. The allocators then refuse segments larger than IPT_COP_MAX_SEGMENT, and items added 
+ * to shared lists must be aligned on IPT_COP_ALIGN bytes. Applications must be built with the
+ * same setting as the library.
+ */
+#ifdef IPT_COMPACT_OFFSETS
+typedef ipt_cop_t ipt_link_t;
+#define ipt_link_set ipt_cop_set
+#define ipt_link_drf ipt_cop_drf
+#else
+typedef ipt_op_t ipt_link_t;
+#define ipt_link_set ipt_op_set
+#define ipt_link_drf ipt_op_drf
+#endif
+
 #endif
@@ -7,16 +7,54 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <time.h>
+#include <stdint.h>
 
 #define _XOPEN_SOURCE 600
 #include <sys/select.h>
 #include <sys/signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
 #include "reactor.h"
 #include "support.h"
 
 #define TIMER_SKEW (100) /* microseconds */
-#define MAX_NUMBER_EHS (16)
-#define MAX_NUMBER_TMS (16)
+#define INITIAL_NUMBER_EHS (16) /* initial size of the handle table, doubled as needed */
+#define INITIAL_NUMBER_TMS (16) /* initial number of buckets in the timer map, doubled as needed */
+#define MAX_NUMBER_EVENTS (64) /* events returned by a single epoll_wait */
+
+/*
+ * Timers are kept in a hierarchical timing wheel. Level 0 has a slot per tick, and each slot of
+ * a higher level covers all the slots of the level below it. A timer is placed in the lowest level
+ * that covers its expiration, and moves down a level when the wheel reaches its slot. Scheduling
+ * and cancelling are O(1). The node keeps the exact expiration, so the tick only groups the timers.
+ */
+#define WHEEL_TICK   (1000000) /* nanoseconds per tick */
+#define WHEEL_BITS   (6)
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS (4)       /* 2^24 ticks, about 4.6 hours. Later timers wait in the last slot. */
+
+#define NOTIFY_QUEUE_SIZE (4096) /* pending notifications, must be a power of two */
+#define NOTIFY_BATCH      (64)   /* notifications taken from the queue and coalesced at once */
+
+#define WORK_BUDGET (1000000) /* nanoseconds of posted work and idle callbacks per pass, by default */
+#define INITIAL_NUMBER_IDLE (4) /* initial number of idle callbacks, doubled as needed */
+
+#define URING_ENTRIES (256) /* submission queue entries, the completion queue is twice as large */
+#define URING_POLL    (1)   /* user data of the poll on the epoll descriptor, never a completion node */
+
+/** The masks that require the handle to be monitored */
+#define IO_MASK (EVENT_HANDLER_READ_MASK | EVENT_HANDLER_WRITE_MASK | EVENT_HANDLER_EXCEPT_MASK)
 
 /**
  * typedef for private reactor structure
@@ -33,6 +71,41 @@ typedef struct notify_handler_t notify_handler_t;
  */
 typedef struct notify_msg_t notify_msg_t;
 
+/**
+ * typdef for a cell of the notification queue.
+ */
+typedef struct notify_cell_t notify_cell_t;
+
+/**
+ * typdef for the handlers of the reactor's signalfd and timerfd.
+ */
+typedef struct fd_handler_t fd_handler_t;
+
+/**
+ * typdef for an operation submitted to the reactor.
+ */
+typedef struct completion_node_t completion_node_t;
+
+/**
+ * typdef for the handler that completes the operations of a handle when io_uring is not used.
+ */
+typedef struct completion_handler_t completion_handler_t;
+
+/**
+ * typdef for the io_uring instance of the reactor.
+ */
+typedef struct uring_t uring_t;
+
+/**
+ * typdef for work posted to the reactor.
+ */
+typedef struct work_node_t work_node_t;
+
+/**
+ * typdef for a callback run when the reactor is idle.
+ */
+typedef struct idle_node_t idle_node_t;
+
 /**
  * typdef for event node used to manage list of events.
  */
@@ -104,6 +177,26 @@ struct timer_node_t
 	 * Ascynchronous callback token
          */
 	const void * act;
+
+	/**
+	 * Next timer in the same slot of the wheel.
+	 */
+	timer_node_t *next;
+
+	/**
+	 * The pointer that points to this timer, used to unlink it from its slot.
+	 */
+	timer_node_t **pprev;
+
+	/**
+	 * Level of the wheel holding the timer, -1 once the timer has expired.
+	 */
+	int level;
+
+	/**
+	 * Next timer in the same bucket of the handler to timer map.
+	 */
+	timer_node_t *hash_next;
 };
 
 /**
@@ -124,6 +217,46 @@ struct event_node_t
 
 	/** if this element is in use */
 	int in_use;
+
+	/** index in the handle table, -1 if the handler has no handle */
+	ipt_handle_t handle;
+
+	/** duration of the upcalls, allocated on the first upcall when statistics are collected */
+	ipt_reactor_histogram_t *stats;
+
+	/** set for the reactor's own handlers, which time the upcalls they make */
+	int internal;
+};
+
+/**
+ * @struct work_node_t
+ *
+ * @brief Work posted to the reactor, or a free node when it is on the free list.
+ */
+struct work_node_t
+{
+	/** the work */
+	ipt_reactor_work_t fn;
+
+	/** argument of the work */
+	void *arg;
+
+	/** next work in the queue, or next free node */
+	work_node_t *next;
+};
+
+/**
+ * @struct idle_node_t
+ *
+ * @brief A callback run when the reactor is idle.
+ */
+struct idle_node_t
+{
+	/** the callback, NULL once it is removed */
+	ipt_reactor_idle_t fn;
+
+	/** argument of the callback */
+	void *arg;
 };
 
 /**
@@ -140,21 +273,182 @@ struct notify_msg_t
 	ipt_event_handler_mask_t mask;
 };
 
+/**
+ * @struct notify_cell_t
+ *
+ * @brief A cell of the notification queue. The sequence tells the producers and the reactor
+ * whose turn it is to use the cell ( bounded MPMC queue by D. Vyukov, with a single consumer ).
+ */
+struct notify_cell_t
+{
+	/** sequence number of the cell */
+	volatile size_t seq;
+
+	/** the notification */
+	notify_msg_t msg;
+};
+
 /**
  * @struct notify_handler_t
  *
- * @brief Private notify structure.
+ * @brief Private notify structure. Any thread may enqueue a notification. The eventfd is only
+ * written when the reactor is waiting for events, and only once until the reactor reads it.
  */
 struct notify_handler_t
 {
 	/** event hander */
 	ipt_event_handler_t eh;
 
-	/** notification handers */
-	int notify_fds[2];
+	/** eventfd used to wake the reactor */
+	int notify_fd;
+
+	/** private reactor */
+	private_reactor_t *reactor;
+
+	/** set while the reactor waits for events */
+	volatile int sleeping;
+
+	/** set once the eventfd was written, until the reactor reads it */
+	volatile int wake_pending;
+
+	/** keeps the producers' counter off the cache line of the flags */
+	char pad0[64];
+
+	/** next cell to enqueue, shared by the producers */
+	volatile size_t tail;
+
+	/** keeps the reactor's counter off the cache line of the producers' counter */
+	char pad1[64];
+
+	/** next cell to dequeue, only used by the reactor */
+	size_t head;
+
+	/** the queue */
+	notify_cell_t cells[NOTIFY_QUEUE_SIZE];
+};
+
+/**
+ * @struct fd_handler_t
+ *
+ * @brief Private handler of a descriptor owned by the reactor ( signalfd or timerfd ).
+ */
+struct fd_handler_t
+{
+	/** event hander */
+	ipt_event_handler_t eh;
+
+	/** the descriptor, -1 when the option is not used */
+	int fd;
+
+	/** private reactor */
+	private_reactor_t *reactor;
+};
+
+/**
+ * @struct completion_node_t
+ *
+ * @brief A read, write or accept submitted to the reactor, until its completion is dispatched.
+ */
+struct completion_node_t
+{
+	/** event handler called with the completion */
+	ipt_event_handler_t *eh_ptr;
+
+	/** EVENT_HANDLER_READ_MASK, EVENT_HANDLER_WRITE_MASK or EVENT_HANDLER_ACCEPT_MASK */
+	ipt_event_handler_mask_t mask;
+
+	/** handle of the operation */
+	ipt_handle_t handle;
+
+	/** buffer and its length, unused by an accept */
+	void *buf;
+	size_t len;
+
+	/** asynchronous completion token */
+	const void *act;
+
+	/** the reactor's list of submitted operations */
+	completion_node_t *next;
+	completion_node_t **pprev;
+
+	/** next operation waiting for the same handle and direction */
+	completion_node_t *queue_next;
+};
+
+/**
+ * @struct completion_handler_t
+ *
+ * @brief Completes the operations of a handle when it is ready, in the order they were submitted.
+ * Registered with the reactor while any operation is waiting.
+ */
+struct completion_handler_t
+{
+	/** event hander */
+	ipt_event_handler_t eh;
 
 	/** private reactor */
 	private_reactor_t *reactor;
+
+	/** the handle */
+	ipt_handle_t handle;
+
+	/** reads and accepts, completed when the handle is readable */
+	completion_node_t *input;
+	completion_node_t **input_tail;
+
+	/** writes, completed when the handle is writable */
+	completion_node_t *output;
+	completion_node_t **output_tail;
+
+	/** the reactor's list of completion handlers */
+	completion_handler_t *next;
+	completion_handler_t **pprev;
+};
+
+/**
+ * @struct uring_t
+ *
+ * @brief The rings shared with the kernel, and the buffers and handles registered with it.
+ */
+struct uring_t
+{
+	/** io_uring descriptor, -1 when the reactor does not use io_uring */
+	int fd;
+
+	/** the mapping of the submission and completion rings */
+	void *ring_ptr;
+	size_t ring_len;
+
+	/** submission ring */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+
+	/** submission queue entries */
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+
+	/** entries prepared, but not made visible to the kernel yet, end here */
+	unsigned int tail;
+
+	/** completion ring */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/** set while the poll on the epoll descriptor is submitted */
+	int poll_armed;
+
+	/** registered buffers */
+	struct iovec *bufs;
+	unsigned int num_bufs;
+
+	/** registered handles, indexed by their position in the kernel's table */
+	ipt_handle_t *files;
+	unsigned int num_files;
 };
 
 /** 
@@ -167,15 +461,39 @@ struct private_reactor_t
 	/** public interface */
 	ipt_reactor_t public;
 
-	/** fixed size array of event handers. */
-	event_node_t ehs[MAX_NUMBER_EHS];
+	/** event handlers indexed by handle. Grown when a larger handle is registered. */
+	event_node_t **ehs;
+
+	/** number of entries in the handle table */
+	unsigned int ehs_size;
+
+	/** event handlers indexed by signal number */
+	event_node_t *sigs[_NSIG];
+
+	/** slots of the timing wheel */
+	timer_node_t *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
 
-	/** fixed size array of timers */
-	timer_node_t tms[MAX_NUMBER_TMS];
+	/** number of timers in each level of the wheel */
+	unsigned int wheel_count[WHEEL_LEVELS];
 
-	/** number of active handers */
+	/** the tick the wheel has been advanced to */
+	uint64_t wheel_tick;
+
+	/** the timer being dispatched, it is freed after the upcall returns */
+	timer_node_t *firing;
+
+	/** timers hashed by event handler, used to find the timer to remove */
+	timer_node_t **tms;
+
+	/** number of buckets in the timer map, always a power of two */
+	unsigned int tms_size;
+
+	/** number of active handers, the reactor's own are not counted. It is read from other threads. */
 	unsigned int active_handlers;
 
+	/** number of handlers registered for signals */
+	unsigned int active_signals;
+
 	/** number of active timers */
 	unsigned int active_timers;
 
@@ -188,518 +506,2900 @@ struct private_reactor_t
 	/** active signal mask */
 	sigset_t sigset;
 
-};
+	/** epoll descriptor, -1 when the reactor uses select */
+	int epoll_fd;
 
-static int
-notify_get_handle(notify_handler_t *this)
-{
-	return this->notify_fds[0];
-}
+	/** events returned by epoll */
+	struct epoll_event events[MAX_NUMBER_EVENTS];
 
-static int
-notify_handle_input(notify_handler_t *this, ipt_handle_t h)
+	/** signalfd handler, delivers the registered signals when IPT_REACTOR_SIGNALFD is used */
+	fd_handler_t signal_handler;
+
+	/** signals read from the signalfd */
+	sigset_t signal_mask;
+
+	/** timerfd handler, dispatches the timers when IPT_REACTOR_TIMERFD is used */
+	fd_handler_t timer_handler;
+
+	/** absolute expiration the timerfd is armed with, zero when disarmed */
+	struct timespec timer_armed;
+
+	/** io_uring, used when IPT_REACTOR_URING is given and the kernel supports it */
+	uring_t uring;
+
+	/** submitted operations */
+	completion_node_t *completions;
+
+	/** handlers completing the operations when io_uring is not used */
+	completion_handler_t *completion_handlers;
+
+	/** the ipt_reactor_flags_t of the implementation */
+	unsigned int flags;
+
+	/** posted work, in the order it was posted */
+	work_node_t *work_head;
+	work_node_t *work_tail;
+
+	/** nodes of work that has run, reused by the next post */
+	work_node_t *work_free;
+
+	/** idle callbacks */
+	idle_node_t *idle;
+
+	/** number of idle callbacks, and the size of the array */
+	unsigned int num_idle;
+	unsigned int idle_size;
+
+	/** the callback the next idle pass starts with */
+	unsigned int idle_next;
+
+	/** set when an idle callback has more work, or did not fit in the budget */
+	int idle_pending;
+
+	/** set while the idle callbacks run, removed callbacks are then compacted afterwards */
+	int idling;
+
+	/** nanoseconds of posted work and idle callbacks per pass */
+	uint64_t budget_ns;
+
+	/** statistics, NULL when they are not collected */
+	ipt_reactor_stats_t *stats;
+
+	/** statistics kept by the reactor until they are published */
+	ipt_reactor_stats_t local_stats;
+
+	/** allocator and name of the published statistics */
+	ipt_allocator_t *stats_alloc;
+	char *stats_name;
+};
+
+static void
+stats_record(ipt_reactor_histogram_t *h, uint64_t ns)
 {
+	uint64_t us = ns / 1000;
 
-	struct notify_msg_t msg;
-	int bytes_transferred;
+	int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
 
-	ipt_time_value_t tv = { 1,0 };
+	h->count++;
+	h->total_ns += ns;
 
-	if ( recv_n(h,&msg,sizeof(msg), &bytes_transferred,&tv) < 0)
+	if ( ns > h->max_ns )
 	{
-		printf("Catastrophic error! could not read notify queue \n");
-		return 0;
+		h->max_ns = ns;
 	}
 
-	if ( msg.eh_ptr->handle_input(msg.eh_ptr, h) < 0 )
+	h->buckets[bucket < IPT_REACTOR_STATS_BUCKETS ? bucket : IPT_REACTOR_STATS_BUCKETS - 1]++;
+}
+
+/*
+ * The start of an upcall, zero when statistics are not collected.
+ */
+static uint64_t
+stats_begin(private_reactor_t *this)
+{
+	return this->stats ? monotonic_ns() : 0;
+}
+
+/*
+ * Record the time spent waiting for events.
+ */
+static void
+stats_wait(private_reactor_t *this, uint64_t start)
+{
+	if ( start && this->stats )
 	{
-		msg.eh_ptr->handle_close(msg.eh_ptr, ((ipt_event_handler_t *)this)->get_handle(msg.eh_ptr),EVENT_HANDLER_READ_MASK);
+		this->stats->wait_ns += monotonic_ns() - start;
 	}
-
-	return 0;
 }
 
-static struct timespec 
-get_expire_time(private_reactor_t *this, struct timespec current_time)
+/*
+ * Record an upcall. The node is that of the handler, if it is still registered. The handler 
+ * replaces the one with the shortest longest upcall among the slowest when it took longer.
+ */
+static void
+stats_dispatch(private_reactor_t *this, ipt_event_handler_t *eh_ptr, event_node_t *n_ptr, uint64_t start)
 {
+	ipt_reactor_stats_t *stats = this->stats;
+
+	ipt_reactor_handler_stats_t *slot = NULL;
+
+	uint64_t ns;
+
 	int i;
 
-   int found = 0;
+	if ( start == 0 || stats == NULL )
+	{
+		return;
+	}
 
-   struct timespec def = {0xffffff, 0xffffff };
-   struct timespec tmp = def;
+	ns = monotonic_ns() - start;
 
-	for (i=0; i < MAX_NUMBER_TMS; i ++)
+	stats_record(&stats->dispatch, ns);
+
+	if ( n_ptr && n_ptr->eh_ptr == eh_ptr && ( n_ptr->stats || (n_ptr->stats = calloc(1, sizeof(ipt_reactor_histogram_t))) ) )
 	{
-		if ( !this->tms[i].in_use ) continue;
+		stats_record(n_ptr->stats, ns);
+	}
 
-		if ( this->tms[i].expire_time.tv_sec < tmp.tv_sec )
+	for ( i = 0; i < IPT_REACTOR_STATS_HANDLERS; i++ )
+	{
+		if ( stats->slowest[i].dispatch.count && stats->slowest[i].handler == (uintptr_t)eh_ptr )
 		{
-			tmp = this->tms[i].expire_time;
+			stats_record(&stats->slowest[i].dispatch, ns);
+			return;
 		}
-		else if ( this->tms[i].expire_time.tv_sec == tmp.tv_sec && this->tms[i].expire_time.tv_nsec < tmp.tv_nsec)
+
+		if ( slot == NULL || stats->slowest[i].dispatch.max_ns < slot->dispatch.max_ns )
 		{
-			tmp = this->tms[i].expire_time;
+			slot = &stats->slowest[i];
 		}
 	}
 
-   /* Return default value if no matches found */
-   if (timespec_compare(tmp,def) == 0 )
-   {
-      return tmp;
-   }
+	if ( ns > slot->dispatch.max_ns )
+	{
+		memset(slot, 0, sizeof(ipt_reactor_handler_stats_t));
 
-   /* Return the time left on the timer or zero, whichever is greater */
-   return timespec_max(timespec_diff(tmp,current_time), timespec_zero);
+		slot->handler = (uintptr_t)eh_ptr;
+		slot->handle = n_ptr && n_ptr->eh_ptr == eh_ptr ? n_ptr->handle : -1;
+
+		stats_record(&slot->dispatch, ns);
+	}
 }
 
-static ipt_handle_t 
-find_max_handle(private_reactor_t *this)
+static int
+notify_get_handle(notify_handler_t *this)
 {
-	int i;
-	ipt_handle_t max_handle = 0;
-
-	for ( i=0; i < MAX_NUMBER_EHS; i ++ )
-	{
-		if ( !this->ehs[i].in_use ) continue;
-
-		/* We must have a read or write fd */
-		if (    (this->ehs[i].mask & EVENT_HANDLER_READ_MASK || this->ehs[i].mask & EVENT_HANDLER_WRITE_MASK  ) &&
-			 this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr) > max_handle )
-		{
-			max_handle = this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr);
-		}
-	}
-	
-	return max_handle;
+	return this->notify_fd;
 }
 
-static void 
-load_masks(private_reactor_t *this, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds)
+/*
+ * The eventfd only wakes the reactor, the queue is drained on every pass of the loop. 
+ * wake_pending is cleared after the read, so a producer that still saw it set has its
+ * notification drained on this pass.
+ */
+static int
+notify_handle_input(notify_handler_t *this, ipt_handle_t h)
 {
-	int i;
+	uint64_t value;
 
-	for ( i = 0; i < MAX_NUMBER_EHS; i ++)
+	if ( read(h, &value, sizeof(value)) < 0 && errno != EAGAIN )
 	{
-		if ( !this->ehs[i].in_use ) continue;
-
-		if ( this->ehs[i].mask & EVENT_HANDLER_READ_MASK) 
-		{
-			FD_SET(this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr), read_fds);
-		}	
-
-		if ( this->ehs[i].mask & EVENT_HANDLER_WRITE_MASK) 
-		{
-			FD_SET(this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr), write_fds);
-		}	
-
-		if ( this->ehs[i].mask & EVENT_HANDLER_EXCEPT_MASK) 
-		{
-			FD_SET(this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr), except_fds);
-		}	
+		printf("Catastrophic error! could not read notify queue \n");
 	}
 
-	return;
+	__atomic_store_n(&this->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	return 0;
 }
 
-static int 
-dispatch_timers(private_reactor_t *this, struct timespec current_time)
+static void
+notify_init(notify_handler_t *this)
 {
-	int i;
-	int num_dispatched=0;
-	struct timespec tp;
+	size_t i;
 
-	for ( i = 0; i < MAX_NUMBER_TMS; i++)
+	for ( i = 0; i < NOTIFY_QUEUE_SIZE; i++ )
 	{
-		if ( !this->tms[i].in_use ) continue;
-
-		if ( timespec_compare(timespec_diff(this->tms[i].expire_time, current_time), timespec_zero) < 0  || timespec_diff(this->tms[i].expire_time,current_time).tv_nsec < 1000000) 
-      		{
-         		ipt_time_value_t tmp = { current_time.tv_sec, current_time.tv_nsec/1000};
-			num_dispatched++;
-			if ( this->tms[i].eh_ptr->handle_timeout(this->tms[i].eh_ptr, &tmp, this->tms[i].act) < 0 )
-			{
-				if ( this->tms[i].eh_ptr->handle_close )
-					this->tms[i].eh_ptr->handle_close(this->tms[i].eh_ptr, this->tms[i].eh_ptr->get_handle(this->tms[i].eh_ptr), EVENT_HANDLER_TIMER_MASK);
-				memset(&this->tms[i],0, sizeof(timer_node_t));
-			}
-
-			if ( this->tms[i].interval_time.tv_sec != 0 || this->tms[i].interval_time.tv_nsec != 0 )
-			{
-            			struct timespec it = this->tms[i].interval_time;
-            			struct timespec tp;
-            			clock_gettime(CLOCK_MONOTONIC,&tp);
-				this->tms[i].expire_time.tv_sec = tp.tv_sec + it.tv_sec + (it.tv_nsec + tp.tv_nsec ) /1000000000;
-				this->tms[i].expire_time.tv_nsec = (it.tv_nsec + tp.tv_nsec) % 1000000000;
-			}
-			else
-			{
-				memset(&this->tms[i],0, sizeof(timer_node_t));;
-			}
-		}
+		this->cells[i].seq = i;
 	}
 
-	return num_dispatched;
+	this->head = 0;
+	this->tail = 0;
 }
 
-static int 
-dispatch_handlers(private_reactor_t *this, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds, sigset_t *sigset)
+static int
+notify_enqueue(notify_handler_t *this, const notify_msg_t *msg)
 {
-	int i;
+	size_t pos = __atomic_load_n(&this->tail, __ATOMIC_RELAXED);
 
-	int num_dispatched = 0;
-
-	/* check to see if any signals are pending */
-	sigset_t tmp;
+	notify_cell_t *cell;
 
-	for ( i = 0; i < MAX_NUMBER_EHS; i++)
+	for (;;)
 	{
-		if ( !this->ehs[i].in_use ) continue;
+		intptr_t dif;
 
-		if ( this->ehs[i].mask & EVENT_HANDLER_READ_MASK && FD_ISSET(this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr), read_fds)) 
-		{
-			/* Handle the input */
-			num_dispatched++;
-			if ( this->ehs[i].eh_ptr->handle_input(this->ehs[i].eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr)) < 0)
-			{
-				if ( this->ehs[i].eh_ptr->handle_close )
-					this->ehs[i].eh_ptr->handle_close(this->ehs[i].eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr),EVENT_HANDLER_READ_MASK);
+		cell = &this->cells[pos & (NOTIFY_QUEUE_SIZE - 1)];
 
-				this->ehs[i].in_use = 0;
-			}
-		}
+		dif = (intptr_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
 
-		if ( this->ehs[i].mask & EVENT_HANDLER_WRITE_MASK && FD_ISSET(this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr), write_fds)) 
+		if ( dif == 0 )
 		{
-			/* Handle the output */
-			num_dispatched++;
-			if ( this->ehs[i].eh_ptr->handle_output(this->ehs[i].eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr)) < 0)
-			{
-				if ( this->ehs[i].eh_ptr->handle_close )
-					this->ehs[i].eh_ptr->handle_close(this->ehs[i].eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr),EVENT_HANDLER_WRITE_MASK);
-
-				this->ehs[i].in_use = 0;
-			}
+			if ( __atomic_compare_exchange_n(&this->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) ) break;
 		}
-
-		if ( this->ehs[i].mask & EVENT_HANDLER_SIGNAL_MASK && sigismember(sigset,this->ehs[i].signum) )
+		else if ( dif < 0 )
 		{
-			/* Handle the signal */
-			num_dispatched++;
-			if ( this->ehs[i].eh_ptr->handle_signal(this->ehs[i].eh_ptr, this->ehs[i].signum) < 0 )
-			{
-				if ( this->ehs[i].eh_ptr->handle_close )
-					this->ehs[i].eh_ptr->handle_close(this->ehs[i].eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr),EVENT_HANDLER_SIGNAL_MASK);
-
-				memset(&this->ehs[i], 0, sizeof(event_node_t));
-			}
+			/* Full */
+			return -1;
+		}
+		else
+		{
+			pos = __atomic_load_n(&this->tail, __ATOMIC_RELAXED);
 		}
 	}
-	return num_dispatched;
+
+	cell->msg = *msg;
+
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
 }
 
 static int
-remove_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+notify_dequeue(notify_handler_t *this, notify_msg_t *msg)
 {
-	int i;
+	notify_cell_t *cell = &this->cells[this->head & (NOTIFY_QUEUE_SIZE - 1)];
+
+	if ( (intptr_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t)(this->head + 1) < 0 )
+	{
+		/* Empty */
+		return -1;
+	}
+
+	*msg = cell->msg;
+
+	__atomic_store_n(&cell->seq, this->head + NOTIFY_QUEUE_SIZE, __ATOMIC_RELEASE);
+
+	this->head++;
+
+	return 0;
+}
+
+static int
+notify_is_empty(notify_handler_t *this)
+{
+	notify_cell_t *cell = &this->cells[this->head & (NOTIFY_QUEUE_SIZE - 1)];
+
+	return (intptr_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (intptr_t)(this->head + 1) < 0;
+}
+
+/*
+ * Wake the reactor if it is waiting for events. The sleeping flag and the queue are checked
+ * in opposite orders by the producer and the reactor, with full barriers in between, so at 
+ * least one of them sees the other.
+ */
+static void
+notify_wake(notify_handler_t *this)
+{
+	uint64_t one = 1;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if ( __atomic_load_n(&this->sleeping, __ATOMIC_SEQ_CST) && !__atomic_exchange_n(&this->wake_pending, 1, __ATOMIC_SEQ_CST) )
+	{
+		if ( write(this->notify_fd, &one, sizeof(one)) < 0 )
+		{
+			__atomic_store_n(&this->wake_pending, 0, __ATOMIC_SEQ_CST);
+		}
+	}
+}
+
+/*
+ * Dispatch the queued notifications in batches. Notifications for the same handler within a 
+ * batch are coalesced into one upcall with the combined mask. Only the notifications queued 
+ * when the drain started are dispatched, so producers can not keep the reactor here.
+ */
+static int
+notify_drain(notify_handler_t *this)
+{
+	notify_msg_t batch[NOTIFY_BATCH];
+
+	size_t end = __atomic_load_n(&this->tail, __ATOMIC_ACQUIRE);
+
+	ipt_reactor_stats_t *stats = this->reactor->stats;
+
+	int num_dispatched = 0;
+
+	if ( stats )
+	{
+		stats->notify_depth = end - this->head;
+		stats->notifications += stats->notify_depth;
+
+		if ( stats->notify_depth > stats->notify_depth_max )
+		{
+			stats->notify_depth_max = stats->notify_depth;
+		}
+	}
+
+	int i, j, n;
 
-	for(i=0; i < MAX_NUMBER_EHS; i++ )
+	while ( (intptr_t)(end - this->head) > 0 )
 	{
-		if ( this->ehs[i].in_use && this->ehs[i].eh_ptr == eh_ptr) 
+		for ( n = 0; n < NOTIFY_BATCH && (intptr_t)(end - this->head) > 0 && notify_dequeue(this, &batch[n]) == 0; )
+		{
+			/* Coalesce */
+			for ( j = 0; j < n && batch[j].eh_ptr != batch[n].eh_ptr; j++ );
+
+			if ( j < n )
+			{
+				batch[j].mask |= batch[n].mask;
+			}
+			else
+			{
+				n++;
+			}
+		}
+
+		/* A producer claimed a cell but has not filled it yet */
+		if ( n == 0 )
+		{
+			break;
+		}
+
+		for ( i = 0; i < n; i++ )
 		{
-			if (!( mask & EVENT_HANDLER_DONT_CALL_MASK) )
+			ipt_event_handler_t *eh_ptr = batch[i].eh_ptr;
+
+			ipt_handle_t h = eh_ptr->get_handle ? eh_ptr->get_handle(eh_ptr) : -1;
+
+			uint64_t start = stats_begin(this->reactor);
+
+			int rtn = 0;
+
+			num_dispatched++;
+
+			if ( batch[i].mask & EVENT_HANDLER_WRITE_MASK )
 			{
-				this->ehs[i].eh_ptr->handle_close(eh_ptr, this->ehs[i].eh_ptr->get_handle(this->ehs[i].eh_ptr),this->ehs[i].mask);
+				rtn = eh_ptr->handle_output(eh_ptr, h);
 			}
 
-			if ( mask & EVENT_HANDLER_SIGNAL_MASK )
+			if ( rtn >= 0 && ( batch[i].mask & EVENT_HANDLER_READ_MASK || !(batch[i].mask & EVENT_HANDLER_WRITE_MASK) ) )
 			{
-				/* Restore the default behavior */
-				//sigaction(this->ehs[i].signum,&__sigaction_dfl,0);
+				rtn = eh_ptr->handle_input(eh_ptr, h);
 			}
 
-			memset(&this->ehs[i],0,sizeof(event_node_t)) ;
+			if ( rtn < 0 && eh_ptr->handle_close )
+			{
+				eh_ptr->handle_close(eh_ptr, h, batch[i].mask);
+			}
 
-			return 0;
-		}	
+			stats_dispatch(this->reactor, eh_ptr, NULL, start);
+		}
+	}
+
+	return num_dispatched;
+}
+
+static uint32_t
+epoll_events(ipt_event_handler_mask_t mask)
+{
+	uint32_t events = 0;
+
+	if ( mask & EVENT_HANDLER_READ_MASK )
+	{
+		events |= EPOLLIN;
+	}
+
+	if ( mask & EVENT_HANDLER_WRITE_MASK )
+	{
+		events |= EPOLLOUT;
+	}
+
+	if ( mask & EVENT_HANDLER_EXCEPT_MASK )
+	{
+		events |= EPOLLPRI;
+	}
+
+	if ( mask & EVENT_HANDLER_EDGE_TRIGGERED_MASK )
+	{
+		events |= EPOLLET;
+	}
+
+	return events;
+}
+
+/*
+ * Keep the kernel's interest list in step with the mask of the event node. 
+ */
+static int
+epoll_update(private_reactor_t *this, event_node_t *n_ptr, ipt_event_handler_mask_t old_mask)
+{
+	struct epoll_event ev;
+	int op;
+
+	if ( this->epoll_fd < 0 )
+	{
+		return 0;
+	}
+
+	if ( !(old_mask & IO_MASK) && !(n_ptr->mask & IO_MASK) )
+	{
+		return 0;
+	}
+
+	if ( !(n_ptr->mask & IO_MASK) || !n_ptr->in_use )
+	{
+		op = EPOLL_CTL_DEL;
+	}
+	else
+	{
+		op = old_mask & IO_MASK ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+
+	ev.events = epoll_events(n_ptr->mask);
+	ev.data.fd = n_ptr->handle;
+
+	return epoll_ctl(this->epoll_fd, op, n_ptr->handle, &ev);
+}
+
+/*
+ * Remove the event node from the handle and signal tables and free it. The handle is removed from epoll first.
+ */
+static void
+release_node(private_reactor_t *this, event_node_t *n_ptr)
+{
+	ipt_event_handler_mask_t old_mask = n_ptr->mask;
+
+	n_ptr->in_use = 0;
+
+	epoll_update(this, n_ptr, old_mask);
+
+	if ( n_ptr->handle >= 0 && this->ehs[n_ptr->handle] == n_ptr )
+	{
+		this->ehs[n_ptr->handle] = NULL;
+	}
+
+	if ( n_ptr->signum > 0 && this->sigs[n_ptr->signum] == n_ptr )
+	{
+		this->sigs[n_ptr->signum] = NULL;
+		this->active_signals--;
+	}
+
+	if ( !n_ptr->internal )
+	{
+		__atomic_sub_fetch(&this->active_handlers, 1, __ATOMIC_RELAXED);
 	}
+
+	free(n_ptr->stats);
+	free(n_ptr);
+}
+
+/*
+ * Wait for events with a timespec timeout. epoll_pwait2 is used when the kernel supports it, 
+ * otherwise the timeout is rounded up to milliseconds so timers never fire early.
+ */
+static int
+epoll_wait_timespec(private_reactor_t *this, const struct timespec *ts, const sigset_t *sigmask)
+{
+	long ms;
+
+#ifdef __NR_epoll_pwait2
+	int rtn = syscall(__NR_epoll_pwait2, this->epoll_fd, this->events, MAX_NUMBER_EVENTS, ts, sigmask, _NSIG / 8);
+
+	if ( rtn >= 0 || errno != ENOSYS )
+	{
+		return rtn;
+	}
+#endif
+
+	ms = ts->tv_sec > INT_MAX / 1000 - 1 ? INT_MAX : ts->tv_sec * 1000 + (ts->tv_nsec + 999999) / 1000000;
+
+	return epoll_pwait(this->epoll_fd, this->events, MAX_NUMBER_EVENTS, (int)ms, sigmask);
+}
+
+/*
+ * Set up the rings. Waiting with a timeout and signal mask in one call needs IORING_FEAT_EXT_ARG.
+ */
+static int
+uring_setup(uring_t *ring)
+{
+	struct io_uring_params params;
+
+	char *ptr;
+
+	memset(&params, 0, sizeof(params));
+
+	if ( (ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params)) < 0 )
+	{
+		return -1;
+	}
+
+	if ( !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) )
+	{
+		close(ring->fd);
+		ring->fd = -1;
+		return -1;
+	}
+
+	ring->ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+
+	if ( ring->ring_len < params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) )
+	{
+		ring->ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	}
+
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->ring_ptr = mmap(NULL, ring->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+	ring->sqes     = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+
+	if ( ring->ring_ptr == MAP_FAILED || ring->sqes == MAP_FAILED )
+	{
+		if ( ring->ring_ptr != MAP_FAILED ) munmap(ring->ring_ptr, ring->ring_len);
+		if ( ring->sqes != MAP_FAILED ) munmap(ring->sqes, ring->sqes_len);
+
+		close(ring->fd);
+		ring->fd = -1;
+		return -1;
+	}
+
+	ptr = ring->ring_ptr;
+
+	ring->sq_head    = (unsigned int *)(ptr + params.sq_off.head);
+	ring->sq_tail    = (unsigned int *)(ptr + params.sq_off.tail);
+	ring->sq_mask    = (unsigned int *)(ptr + params.sq_off.ring_mask);
+	ring->sq_array   = (unsigned int *)(ptr + params.sq_off.array);
+	ring->sq_entries = params.sq_entries;
+	ring->tail       = *ring->sq_tail;
+
+	ring->cq_head = (unsigned int *)(ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned int *)(ptr + params.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(ptr + params.cq_off.ring_mask);
+	ring->cqes    = (struct io_uring_cqe *)(ptr + params.cq_off.cqes);
+
+	return 0;
+}
+
+/*
+ * Close the rings. The kernel cancels the operations still in flight.
+ */
+static void
+uring_release(uring_t *ring)
+{
+	if ( ring->fd < 0 )
+	{
+		return;
+	}
+
+	munmap(ring->sqes, ring->sqes_len);
+	munmap(ring->ring_ptr, ring->ring_len);
+
+	close(ring->fd);
+	ring->fd = -1;
+
+	free(ring->bufs);
+	free(ring->files);
+}
+
+/*
+ * Submit the prepared entries, and wait for min_complete completions until the timeout, NULL waits forever.
+ */
+static int
+uring_enter(uring_t *ring, unsigned int min_complete, const struct timespec *ts, const sigset_t *sigmask)
+{
+	struct io_uring_getevents_arg arg;
+
+	struct __kernel_timespec kts;
+
+	unsigned int to_submit;
+
+	memset(&arg, 0, sizeof(arg));
+
+	arg.sigmask    = (uintptr_t)sigmask;
+	arg.sigmask_sz = _NSIG / 8;
+
+	if ( ts )
+	{
+		kts.tv_sec  = ts->tv_sec;
+		kts.tv_nsec = ts->tv_nsec;
+
+		arg.ts = (uintptr_t)&kts;
+	}
+
+	__atomic_store_n(ring->sq_tail, ring->tail, __ATOMIC_RELEASE);
+
+	to_submit = ring->tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	return syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, 
+	               IORING_ENTER_EXT_ARG | ( min_complete ? IORING_ENTER_GETEVENTS : 0 ), &arg, sizeof(arg));
+}
+
+/*
+ * Get a cleared submission queue entry. A full queue is submitted first.
+ */
+static struct io_uring_sqe *
+uring_get_sqe(uring_t *ring)
+{
+	struct io_uring_sqe *sqe;
+
+	unsigned int index;
+
+	if ( ring->tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries &&
+	    ( uring_enter(ring, 0, NULL, NULL) < 0 || ring->tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries ) )
+	{
+		return NULL;
+	}
+
+	index = ring->tail & *ring->sq_mask;
+
+	sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	ring->sq_array[index] = index;
+	ring->tail++;
+
+	return sqe;
+}
+
+/*
+ * The registered buffer holding the whole range, or -1.
+ */
+static int
+uring_find_buffer(uring_t *ring, const void *buf, size_t len)
+{
+	unsigned int i;
+
+	for ( i = 0; i < ring->num_bufs; i++ )
+	{
+		const char *base = ring->bufs[i].iov_base;
+
+		if ( (const char *)buf >= base && (const char *)buf + len <= base + ring->bufs[i].iov_len )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * The position of a registered handle, or -1.
+ */
+static int
+uring_find_file(uring_t *ring, ipt_handle_t handle)
+{
+	unsigned int i;
+
+	for ( i = 0; i < ring->num_files; i++ )
+	{
+		if ( ring->files[i] == handle )
+		{
+			return i;
+		}
+	}
+
 	return -1;
 }
 
+/*
+ * Prepare the submission of an operation. It is sent to the kernel by the next pass of the event loop.
+ */
 static int
-run_event_loop(private_reactor_t *this, const ipt_time_value_t *tv)
+uring_prepare(uring_t *ring, completion_node_t *c_ptr)
 {
-	ipt_handle_t max_handle;
-	int rtn;
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
 
-	max_handle = find_max_handle(this);
+	int index;
 
-	/* Load the Masks */	
-	fd_set read_fds, write_fds, except_fds;
+	if ( sqe == NULL )
+	{
+		return -1;
+	}
 
-	FD_ZERO(&read_fds);
-	FD_ZERO(&write_fds);
-	FD_ZERO(&except_fds);
+	sqe->fd = c_ptr->handle;
+	sqe->user_data = (uintptr_t)c_ptr;
 
-	load_masks(this, &read_fds, &write_fds, &except_fds);
+	if ( (index = uring_find_file(ring, c_ptr->handle)) >= 0 )
+	{
+		sqe->fd = index;
+		sqe->flags |= IOSQE_FIXED_FILE;
+	}
 
-   	struct timespec current_time;
+	if ( c_ptr->mask == EVENT_HANDLER_ACCEPT_MASK )
+	{
+		sqe->opcode = IORING_OP_ACCEPT;
+		return 0;
+	}
+
+	/* The current position of the file, the offset is ignored by pipes and sockets */
+	sqe->off  = (uint64_t)-1;
+	sqe->addr = (uintptr_t)c_ptr->buf;
+	sqe->len  = c_ptr->len > UINT_MAX ? UINT_MAX : c_ptr->len;
+
+	if ( (index = uring_find_buffer(ring, c_ptr->buf, sqe->len)) >= 0 )
+	{
+		sqe->opcode = c_ptr->mask == EVENT_HANDLER_WRITE_MASK ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->buf_index = index;
+	}
+	else
+	{
+		sqe->opcode = c_ptr->mask == EVENT_HANDLER_WRITE_MASK ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+
+	return 0;
+}
+
+static completion_node_t *
+completion_create(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask, ipt_handle_t handle, void *buf, size_t len, const void *act)
+{
+	completion_node_t *c_ptr = calloc(1, sizeof(completion_node_t));
+
+	if ( c_ptr == NULL )
+	{
+		return NULL;
+	}
+
+	c_ptr->eh_ptr = eh_ptr;
+	c_ptr->mask   = mask;
+	c_ptr->handle = handle;
+	c_ptr->buf    = buf;
+	c_ptr->len    = len;
+	c_ptr->act    = act;
+
+	if ( (c_ptr->next = this->completions) != NULL )
+	{
+		c_ptr->next->pprev = &c_ptr->next;
+	}
+
+	c_ptr->pprev = &this->completions;
+	this->completions = c_ptr;
+
+	return c_ptr;
+}
+
+static void
+completion_release(private_reactor_t *this, completion_node_t *c_ptr)
+{
+	if ( (*c_ptr->pprev = c_ptr->next) != NULL )
+	{
+		c_ptr->next->pprev = c_ptr->pprev;
+	}
+
+	free(c_ptr);
+}
+
+/*
+ * Release the operation, then call the handler with its result. The handler may submit the next operation.
+ */
+static int
+dispatch_completion(private_reactor_t *this, completion_node_t *c_ptr, ssize_t result)
+{
+	ipt_event_handler_t *eh_ptr = c_ptr->eh_ptr;
+
+	ipt_event_handler_mask_t mask = c_ptr->mask;
+
+	ipt_handle_t handle = c_ptr->handle;
+
+	void *buf = c_ptr->buf;
+
+	const void *act = c_ptr->act;
+
+	uint64_t start = stats_begin(this);
+
+	completion_release(this, c_ptr);
+
+	if ( eh_ptr->handle_completion(eh_ptr, handle, mask, result, buf, act) < 0 && eh_ptr->handle_close )
+	{
+		eh_ptr->handle_close(eh_ptr, handle, mask);
+	}
+
+	stats_dispatch(this, eh_ptr, NULL, start);
+
+	return 1;
+}
+
+/*
+ * Find the node of a handle, or NULL if the handle is not registered.
+ */
+static event_node_t *
+find_event_node_by_handle(private_reactor_t *this, ipt_handle_t handle)
+{
+	if ( handle < 0 || (unsigned int)handle >= this->ehs_size )
+	{
+		return NULL;
+	}
+
+	return this->ehs[handle];
+}
+
+/*
+ * Grow the handle table so the handle can be used as an index.
+ */
+static int
+grow_handle_table(private_reactor_t *this, ipt_handle_t handle)
+{
+	unsigned int size = this->ehs_size ? this->ehs_size : INITIAL_NUMBER_EHS;
+	event_node_t **ehs;
+
+	while ( size <= (unsigned int)handle )
+	{
+		size *= 2;
+	}
+
+	if ( size == this->ehs_size )
+	{
+		return 0;
+	}
+
+	if ( (ehs = realloc(this->ehs, size * sizeof(event_node_t *))) == NULL )
+	{
+		return -1;
+	}
+
+	memset(&ehs[this->ehs_size], 0, (size - this->ehs_size) * sizeof(event_node_t *));
+
+	this->ehs = ehs;
+	this->ehs_size = size;
+
+	return 0;
+}
+
+static unsigned int
+timer_hash(private_reactor_t *this, ipt_event_handler_t *eh_ptr)
+{
+	uintptr_t key = (uintptr_t) eh_ptr;
+
+	return (unsigned int)( (key >> 4) ^ (key >> 12) ) & (this->tms_size - 1);
+}
+
+/*
+ * Double the number of buckets in the handler to timer map and rehash the timers.
+ */
+static int
+grow_timer_map(private_reactor_t *this)
+{
+	unsigned int size = this->tms_size ? this->tms_size * 2 : INITIAL_NUMBER_TMS;
+	timer_node_t **tms = calloc(size, sizeof(timer_node_t *));
+	timer_node_t **old_tms = this->tms;
+	timer_node_t *t_ptr;
+	unsigned int old_size = this->tms_size;
+	unsigned int i, j;
+
+	if ( tms == NULL )
+	{
+		return -1;
+	}
+
+	this->tms = tms;
+	this->tms_size = size;
+
+	for ( i = 0; i < old_size; i++ )
+	{
+		while ( (t_ptr = old_tms[i]) != NULL )
+		{
+			old_tms[i] = t_ptr->hash_next;
+
+			j = timer_hash(this, t_ptr->eh_ptr);
+
+			t_ptr->hash_next = tms[j];
+			tms[j] = t_ptr;
+		}
+	}
+
+	free(old_tms);
+
+	return 0;
+}
+
+static uint64_t
+timespec_to_tick(struct timespec ts)
+{
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec) / WHEEL_TICK;
+}
+
+static void
+wheel_link(timer_node_t **head, timer_node_t *t_ptr)
+{
+	t_ptr->next = *head;
+
+	if ( *head )
+	{
+		(*head)->pprev = &t_ptr->next;
+	}
+
+	*head = t_ptr;
+	t_ptr->pprev = head;
+}
+
+static void
+wheel_unlink(private_reactor_t *this, timer_node_t *t_ptr)
+{
+	if ( t_ptr->pprev == NULL )
+	{
+		return;
+	}
+
+	*t_ptr->pprev = t_ptr->next;
+
+	if ( t_ptr->next )
+	{
+		t_ptr->next->pprev = t_ptr->pprev;
+	}
+
+	if ( t_ptr->level >= 0 )
+	{
+		this->wheel_count[t_ptr->level]--;
+	}
+
+	t_ptr->next = NULL;
+	t_ptr->pprev = NULL;
+}
+
+/*
+ * Place the timer in the lowest level of the wheel that covers its expiration. 
+ */
+static void
+wheel_add(private_reactor_t *this, timer_node_t *t_ptr)
+{
+	uint64_t tick = timespec_to_tick(t_ptr->expire_time);
+	uint64_t delta;
+	int level;
+
+	/* Expired timers go in the current slot */
+	if ( tick < this->wheel_tick )
+	{
+		tick = this->wheel_tick;
+	}
+
+	delta = tick - this->wheel_tick;
+
+	for ( level = 0; level < WHEEL_LEVELS - 1; level++ )
+	{
+		if ( delta < (uint64_t)1 << (WHEEL_BITS * (level + 1)) ) break;
+	}
+
+	/* Past the end of the wheel. Wait in the last slot and be placed again when it is reached. */
+	if ( delta >= (uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS) )
+	{
+		tick = this->wheel_tick + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+
+	t_ptr->level = level;
+
+	this->wheel_count[level]++;
+
+	wheel_link(&this->wheel[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK], t_ptr);
+}
+
+/*
+ * Move the timers of the current slot of a level down to the levels below.
+ */
+static void
+wheel_cascade(private_reactor_t *this, int level)
+{
+	timer_node_t **head = &this->wheel[level][(this->wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	timer_node_t *t_ptr;
+
+	while ( (t_ptr = *head) != NULL )
+	{
+		wheel_unlink(this, t_ptr);
+		wheel_add(this, t_ptr);
+	}
+}
+
+/*
+ * Move the timers of the current slot of level 0 that expire before the limit to the expired list.
+ */
+static void
+wheel_collect(private_reactor_t *this, struct timespec limit, timer_node_t **expired)
+{
+	timer_node_t *t_ptr, *next;
+
+	for ( t_ptr = this->wheel[0][this->wheel_tick & WHEEL_MASK]; t_ptr != NULL; t_ptr = next )
+	{
+		next = t_ptr->next;
+
+		if ( timespec_compare(t_ptr->expire_time, limit) <= 0 )
+		{
+			wheel_unlink(this, t_ptr);
+
+			t_ptr->level = -1;
+
+			wheel_link(expired, t_ptr);
+		}
+	}
+}
+
+/*
+ * Advance the wheel to the tick, cascading the higher levels on the way, and collect the expired timers.
+ */
+static void
+wheel_advance(private_reactor_t *this, uint64_t tick, struct timespec limit, timer_node_t **expired)
+{
+	int level;
+
+	if ( this->active_timers == 0 )
+	{
+		this->wheel_tick = tick > this->wheel_tick ? tick : this->wheel_tick;
+		return;
+	}
+
+	/* The current slot may hold timers that had not expired the last time */
+	wheel_collect(this, limit, expired);
+
+	while ( this->wheel_tick < tick )
+	{
+		/* Skip to the end of level 0 when it is empty */
+		if ( this->wheel_count[0] == 0 )
+		{
+			this->wheel_tick = (this->wheel_tick | WHEEL_MASK) < tick ? (this->wheel_tick | WHEEL_MASK) : tick - 1;
+		}
+
+		this->wheel_tick++;
+
+		/* Cascade from the highest level that wrapped */
+		for ( level = 1; level < WHEEL_LEVELS; level++ )
+		{
+			if ( this->wheel_tick & (((uint64_t)1 << (WHEEL_BITS * level)) - 1) ) break;
+		}
+
+		while ( --level > 0 )
+		{
+			wheel_cascade(this, level);
+		}
+
+		wheel_collect(this, limit, expired);
+	}
+}
+
+/*
+ * Remove the timer from the wheel and the handler to timer map. The timer being dispatched
+ * is freed after its upcall returns.
+ */
+static void
+release_timer(private_reactor_t *this, timer_node_t *t_ptr)
+{
+	timer_node_t **pp = &this->tms[timer_hash(this, t_ptr->eh_ptr)];
+
+	while ( *pp != t_ptr )
+	{
+		pp = &(*pp)->hash_next;
+	}
+
+	*pp = t_ptr->hash_next;
+
+	wheel_unlink(this, t_ptr);
+
+	t_ptr->in_use = 0;
+
+	this->active_timers--;
+
+	if ( t_ptr != this->firing )
+	{
+		free(t_ptr);
+	}
+}
+
+/*
+ * Find the expiration of the first timer. The earliest slot of each level holds the first 
+ * timers of that level, so only those slots are searched. Returns -1 if there are no timers.
+ */
+static int
+get_first_expiration(private_reactor_t *this, struct timespec *first)
+{
+	timer_node_t *t_ptr;
+
+	int level, i, found = 0;
+
+	for ( level = 0; level < WHEEL_LEVELS; level++ )
+	{
+		uint64_t start = level ? (this->wheel_tick >> (WHEEL_BITS * level)) + 1 : this->wheel_tick;
+
+		if ( this->wheel_count[level] == 0 ) continue;
+
+		for ( i = 0; i < WHEEL_SLOTS; i++ )
+		{
+			if ( (t_ptr = this->wheel[level][(start + i) & WHEEL_MASK]) == NULL ) continue;
+
+			for ( ; t_ptr != NULL; t_ptr = t_ptr->next )
+			{
+				if ( !found++ || timespec_compare(t_ptr->expire_time, *first) < 0 )
+				{
+					*first = t_ptr->expire_time;
+				}
+			}
+
+			break;
+		}
+	}
+
+	return found ? 0 : -1;
+}
+
+/*
+ * The time left until the first timer expires.
+ */
+static struct timespec 
+get_expire_time(private_reactor_t *this, struct timespec current_time)
+{
+   struct timespec def = {0xffffff, 0xffffff };
+   struct timespec tmp;
+
+   /* Return default value if no matches found */
+   if ( get_first_expiration(this, &tmp) < 0 )
+   {
+      return def;
+   }
+
+   /* Return the time left on the timer or zero, whichever is greater */
+   return timespec_max(timespec_diff(tmp,current_time), timespec_zero);
+}
+
+static ipt_handle_t 
+find_max_handle(private_reactor_t *this)
+{
+	int i;
+
+	for ( i = (int)this->ehs_size - 1; i > 0; i-- )
+	{
+		/* We must have a read or write fd */
+		if ( this->ehs[i] && this->ehs[i]->mask & (EVENT_HANDLER_READ_MASK | EVENT_HANDLER_WRITE_MASK) )
+		{
+			return i;
+		}
+	}
+	
+	return 0;
+}
+
+static void 
+load_masks(private_reactor_t *this, ipt_handle_t max_handle, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds)
+{
+	int i;
+
+	for ( i = 0; i <= max_handle && (unsigned int)i < this->ehs_size; i ++)
+	{
+		if ( this->ehs[i] == NULL ) continue;
+
+		if ( this->ehs[i]->mask & EVENT_HANDLER_READ_MASK) 
+		{
+			FD_SET(i, read_fds);
+		}	
+
+		if ( this->ehs[i]->mask & EVENT_HANDLER_WRITE_MASK) 
+		{
+			FD_SET(i, write_fds);
+		}	
+
+		if ( this->ehs[i]->mask & EVENT_HANDLER_EXCEPT_MASK) 
+		{
+			FD_SET(i, except_fds);
+		}	
+	}
+
+	return;
+}
+
+static int 
+dispatch_timers(private_reactor_t *this, struct timespec current_time)
+{
+	timer_node_t *expired = NULL, *t_ptr;
+	struct timespec limit = current_time;
+	int num_dispatched=0;
+
+	/* Timers within the skew are treated as expired */
+	limit.tv_nsec += TIMER_SKEW * 1000;
+
+	if ( limit.tv_nsec >= 1000000000 )
+	{
+		limit.tv_sec++;
+		limit.tv_nsec -= 1000000000;
+	}
+
+	wheel_advance(this, timespec_to_tick(current_time), limit, &expired);
+
+	/* An upcall may remove any of the expired timers, so always take the head */
+	while ( (t_ptr = expired) != NULL )
+	{
+         	ipt_time_value_t tmp = { current_time.tv_sec, current_time.tv_nsec/1000};
+
+		ipt_event_handler_t *eh_ptr = t_ptr->eh_ptr;
+
+		uint64_t start = stats_begin(this);
+
+		wheel_unlink(this, t_ptr);
+
+		this->firing = t_ptr;
+
+		if ( start )
+		{
+			uint64_t expire = (uint64_t)t_ptr->expire_time.tv_sec * 1000000000 + t_ptr->expire_time.tv_nsec;
+
+			/* Timers within the skew may fire early */
+			stats_record(&this->stats->timer_lateness, start > expire ? start - expire : 0);
+		}
+
+		num_dispatched++;
+		if ( t_ptr->eh_ptr->handle_timeout(t_ptr->eh_ptr, &tmp, t_ptr->act) < 0 )
+		{
+			if ( t_ptr->in_use && t_ptr->eh_ptr->handle_close )
+				t_ptr->eh_ptr->handle_close(t_ptr->eh_ptr, t_ptr->eh_ptr->get_handle(t_ptr->eh_ptr), EVENT_HANDLER_TIMER_MASK);
+
+			if ( t_ptr->in_use )
+				release_timer(this, t_ptr);
+		}
+		else if ( t_ptr->in_use && ( t_ptr->interval_time.tv_sec != 0 || t_ptr->interval_time.tv_nsec != 0 ) )
+		{
+			struct timespec it = t_ptr->interval_time;
+
+			/* Keep the period, unless the timer fell a whole interval behind */
+			t_ptr->expire_time.tv_sec += it.tv_sec + (t_ptr->expire_time.tv_nsec + it.tv_nsec) / 1000000000;
+			t_ptr->expire_time.tv_nsec = (t_ptr->expire_time.tv_nsec + it.tv_nsec) % 1000000000;
+
+			if ( timespec_compare(t_ptr->expire_time, current_time) <= 0 )
+			{
+				t_ptr->expire_time.tv_sec = current_time.tv_sec + it.tv_sec + (current_time.tv_nsec + it.tv_nsec) / 1000000000;
+				t_ptr->expire_time.tv_nsec = (current_time.tv_nsec + it.tv_nsec) % 1000000000;
+			}
+
+			wheel_add(this, t_ptr);
+		}
+		else if ( t_ptr->in_use )
+		{
+			release_timer(this, t_ptr);
+		}
+
+		this->firing = NULL;
+
+		stats_dispatch(this, eh_ptr, NULL, start);
+
+		/* Removed during the upcall */
+		if ( !t_ptr->in_use )
+		{
+			free(t_ptr);
+		}
+	}
+
+	return num_dispatched;
+}
+
+/*
+ * Dispatch a ready handle. The node is looked up again after each upcall, since the 
+ * handler may have removed itself or registered another handler for the same handle.
+ */
+static int
+dispatch_io(private_reactor_t *this, ipt_handle_t handle, int readable, int writable)
+{
+	event_node_t *n_ptr = find_event_node_by_handle(this, handle);
+
+	ipt_event_handler_t *eh_ptr;
+
+	uint64_t start;
+
+	int num_dispatched = 0;
+
+	if ( n_ptr == NULL )
+	{
+		return 0;
+	}
+
+	eh_ptr = n_ptr->eh_ptr;
+
+	/* The reactor's own descriptors dispatch and time their own upcalls */
+	start = n_ptr->internal ? 0 : stats_begin(this);
+
+	if ( n_ptr->mask & EVENT_HANDLER_READ_MASK && readable )
+	{
+		/* Handle the input */
+		num_dispatched++;
+		if ( eh_ptr->handle_input(eh_ptr, handle) < 0)
+		{
+			/* Remove the handle from the reactor before the handler closes it */
+			if ( (n_ptr = find_event_node_by_handle(this, handle)) && n_ptr->eh_ptr == eh_ptr )
+				release_node(this, n_ptr);
+
+			if ( eh_ptr->handle_close )
+				eh_ptr->handle_close(eh_ptr, handle, EVENT_HANDLER_READ_MASK);
+		}
+
+		stats_dispatch(this, eh_ptr, find_event_node_by_handle(this, handle), start);
+
+		start = start ? monotonic_ns() : 0;
+	}
+
+	n_ptr = find_event_node_by_handle(this, handle);
+
+	if ( n_ptr && n_ptr->eh_ptr == eh_ptr && n_ptr->mask & EVENT_HANDLER_WRITE_MASK && writable )
+	{
+		/* Handle the output */
+		num_dispatched++;
+		if ( eh_ptr->handle_output(eh_ptr, handle) < 0)
+		{
+			/* Remove the handle from the reactor before the handler closes it */
+			if ( (n_ptr = find_event_node_by_handle(this, handle)) && n_ptr->eh_ptr == eh_ptr )
+				release_node(this, n_ptr);
+
+			if ( eh_ptr->handle_close )
+				eh_ptr->handle_close(eh_ptr, handle, EVENT_HANDLER_WRITE_MASK);
+		}
+
+		stats_dispatch(this, eh_ptr, find_event_node_by_handle(this, handle), start);
+	}
+
+	return num_dispatched;
+}
+
+/*
+ * Dispatch the events returned by epoll. Only the ready handlers are visited.
+ */
+static int 
+dispatch_events(private_reactor_t *this, int num_events)
+{
+	int i;
+
+	int num_dispatched = 0;
+
+	for ( i = 0; i < num_events; i++ )
+	{
+		uint32_t events = this->events[i].events;
+
+		num_dispatched += dispatch_io(this, this->events[i].data.fd,
+				events & (EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLERR),
+				events & (EPOLLOUT | EPOLLHUP | EPOLLERR));
+	}
+
+	return num_dispatched;
+}
+
+static int 
+dispatch_handlers(private_reactor_t *this, ipt_handle_t max_handle, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds)
+{
+	int i;
+
+	int num_dispatched = 0;
+
+	for ( i = 0; i <= max_handle && (unsigned int)i < this->ehs_size; i++)
+	{
+		if ( this->ehs[i] == NULL ) continue;
+
+		num_dispatched += dispatch_io(this, i, FD_ISSET(i, read_fds), FD_ISSET(i, write_fds));
+	}
+
+	return num_dispatched;
+}
+
+static int 
+dispatch_signal(private_reactor_t *this, int signum)
+{
+	event_node_t *n_ptr = this->sigs[signum];
+
+	ipt_event_handler_t *eh_ptr;
+
+	uint64_t start;
+
+	if ( n_ptr == NULL || !(n_ptr->mask & EVENT_HANDLER_SIGNAL_MASK) )
+	{
+		return 0;
+	}
+
+	eh_ptr = n_ptr->eh_ptr;
+
+	start = stats_begin(this);
+
+	/* Handle the signal */
+	if ( eh_ptr->handle_signal(eh_ptr, signum) < 0 )
+	{
+		if ( eh_ptr->handle_close )
+			eh_ptr->handle_close(eh_ptr, eh_ptr->get_handle(eh_ptr),EVENT_HANDLER_SIGNAL_MASK);
+
+		if ( this->sigs[signum] == n_ptr )
+			release_node(this, n_ptr);
+	}
+
+	stats_dispatch(this, eh_ptr, this->sigs[signum], start);
+
+	return 1;
+}
+
+static int 
+dispatch_signals(private_reactor_t *this, sigset_t *sigset)
+{
+	int i;
+
+	int num_dispatched = 0;
+
+	for ( i = 1; i < _NSIG && this->active_signals; i++)
+	{
+		if ( sigismember(sigset,i) )
+		{
+			num_dispatched += dispatch_signal(this, i);
+		}
+	}
+	return num_dispatched;
+}
+
+static int
+fd_get_handle(fd_handler_t *this)
+{
+	return this->fd;
+}
+
+/*
+ * Read the queued signals from the signalfd. The signals stay blocked, so none are lost 
+ * between the passes of the event loop.
+ */
+static int
+signal_fd_handle_input(fd_handler_t *this, ipt_handle_t h)
+{
+	struct signalfd_siginfo info[8];
+
+	ssize_t n;
+
+	int i;
+
+	while ( (n = read(h, info, sizeof(info))) > 0 )
+	{
+		for ( i = 0; i < n / (ssize_t)sizeof(struct signalfd_siginfo); i++ )
+		{
+			if ( info[i].ssi_signo > 0 && info[i].ssi_signo < _NSIG )
+			{
+				dispatch_signal(this->reactor, info[i].ssi_signo);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Arm the timerfd with the expiration of the first timer. The descriptor is only changed 
+ * when the first timer changes.
+ */
+static int
+timer_fd_arm(private_reactor_t *this)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+
+	/* Zero disarms the timer */
+	if ( get_first_expiration(this, &its.it_value) < 0 )
+	{
+		its.it_value = timespec_zero;
+	}
+
+	if ( timespec_compare(its.it_value, this->timer_armed) == 0 )
+	{
+		return 0;
+	}
+
+	this->timer_armed = its.it_value;
+
+	return timerfd_settime(this->timer_handler.fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int
+timer_fd_handle_input(fd_handler_t *this, ipt_handle_t h)
+{
+	uint64_t expirations;
+
+	struct timespec current_time;
+
+	if ( read(h, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN )
+	{
+		return 0;
+	}
+
+	/* The timerfd is disarmed once it has expired */
+	this->reactor->timer_armed = timespec_zero;
+
+   	clock_gettime(CLOCK_MONOTONIC,&current_time);
+
+	dispatch_timers(this->reactor, current_time);
+
+	return 0;
+}
+
+/*
+ * Find the node of an event handler. Handlers with a handle are found in the handle table, 
+ * the others can only be registered for a signal.
+ */
+static event_node_t * 
+find_event_node_by_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr)
+{
+	event_node_t *n_ptr;
+
+	int i;
+
+	if ( eh_ptr->get_handle && (n_ptr = find_event_node_by_handle(this, eh_ptr->get_handle(eh_ptr))) && n_ptr->eh_ptr == eh_ptr )
+	{
+		return n_ptr;
+	}
+
+	for ( i = 1; i < _NSIG && this->active_signals; i++ )
+	{
+		if ( this->sigs[i] && this->sigs[i]->eh_ptr == eh_ptr )
+		{
+			return this->sigs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int
+remove_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+{
+	event_node_t *n_ptr = find_event_node_by_handler(this, eh_ptr);
+
+	ipt_event_handler_mask_t old_mask;
+
+	if ( n_ptr == NULL )
+	{
+		return -1;
+	}
+
+	old_mask = n_ptr->mask;
+
+	if ( mask & EVENT_HANDLER_SIGNAL_MASK )
+	{
+		/* Restore the default behavior */
+		//sigaction(n_ptr->signum,&__sigaction_dfl,0);
+	}
+
+	/* Remove the handle from the reactor before the handler closes it */
+	release_node(this, n_ptr);
+
+	if (!( mask & EVENT_HANDLER_DONT_CALL_MASK) )
+	{
+		eh_ptr->handle_close(eh_ptr, eh_ptr->get_handle(eh_ptr), old_mask);
+	}
+
+	return 0;
+}
+
+static int
+dispatch_expired_timers(private_reactor_t *this)
+{
+   	struct timespec current_time;
+
+	/* The timerfd handler dispatches the timers */
+	if ( this->timer_handler.fd >= 0 )
+	{
+		return 0;
+	}
+
+   	clock_gettime(CLOCK_MONOTONIC,&current_time);
+
+	return dispatch_timers(this, current_time);
+}
+
+static int
+wait_select(private_reactor_t *this, struct timespec *time_value, sigset_t *sigmask)
+{
+	ipt_handle_t max_handle;
+	uint64_t start;
+	int rtn;
+
+	max_handle = find_max_handle(this);
+
+	/* Load the Masks */	
+	fd_set read_fds, write_fds, except_fds;
+
+	FD_ZERO(&read_fds);
+	FD_ZERO(&write_fds);
+	FD_ZERO(&except_fds);
+
+	load_masks(this, max_handle, &read_fds, &write_fds, &except_fds);
+
+	start = stats_begin(this);
+
+	rtn = pselect(max_handle + 1, &read_fds, &write_fds, &except_fds, time_value, sigmask);
+
+	stats_wait(this, start);
+
+	/* If the rtn <= 0, then make sure the read/write 
+	 * descriptors are cleared. This will occur when a signal is received during select
+	 */
+	if ( rtn < 0 )
+	{
+		FD_ZERO(&read_fds);
+		FD_ZERO(&write_fds);
+	}
+
+	/* Failure */
+	if ( rtn < 0  && errno != EINTR) 
+	{
+		return -1;
+	}
+
+	/* Dispatch timers */
+	rtn = dispatch_expired_timers(this);
+
+	/* Dispatch the descriptors */
+	return rtn + dispatch_handlers(this, max_handle, &read_fds, &write_fds, &except_fds);
+}
+
+static int
+wait_epoll(private_reactor_t *this, struct timespec *time_value, sigset_t *sigmask)
+{
+	uint64_t start = stats_begin(this);
+
+	int rtn;
+
+	rtn = epoll_wait_timespec(this, time_value, sigmask);
+
+	stats_wait(this, start);
+
+	/* Failure */
+	if ( rtn < 0  && errno != EINTR) 
+	{
+		return -1;
+	}
+
+	/* Interrupted by a signal */
+	if ( rtn < 0 )
+	{
+		rtn = 0;
+	}
+
+	/* Dispatch the timers, then the ready descriptors */
+	return dispatch_expired_timers(this) + dispatch_events(this, rtn);
+}
+
+/*
+ * Submit the prepared operations and wait for their completions. The readiness of the handlers is
+ * reported by a poll on the epoll descriptor, so both are waited for in the same call.
+ */
+static int
+wait_uring(private_reactor_t *this, struct timespec *time_value, sigset_t *sigmask)
+{
+	uring_t *ring = &this->uring;
+
+	struct io_uring_sqe *sqe;
+
+	unsigned int head, tail;
+
+	uint64_t start;
+
+	int rtn, ready = 0, num_dispatched = 0;
+
+	if ( !ring->poll_armed )
+	{
+		if ( (sqe = uring_get_sqe(ring)) == NULL )
+		{
+			return -1;
+		}
+
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = this->epoll_fd;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = URING_POLL;
+
+		ring->poll_armed = 1;
+	}
+
+	start = stats_begin(this);
+
+	rtn = uring_enter(ring, 1, time_value, sigmask);
+
+	stats_wait(this, start);
+
+	/* Failure. The timeout and signals are not. */
+	if ( rtn < 0 && errno != EINTR && errno != ETIME && errno != EBUSY )
+	{
+		return -1;
+	}
+
+	/* Only take the completions that are here now */
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+	num_dispatched += dispatch_expired_timers(this);
+
+	for ( ; head != tail; head++ )
+	{
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+		uint64_t user_data = cqe->user_data;
+
+		int res = cqe->res;
+
+		/* Return the entry before the upcall */
+		__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+		if ( user_data == URING_POLL )
+		{
+			ring->poll_armed = 0;
+			ready = 1;
+			continue;
+		}
+
+		num_dispatched += dispatch_completion(this, (completion_node_t *)(uintptr_t)user_data, res);
+	}
+
+	if ( ready && (rtn = epoll_wait_timespec(this, &timespec_zero, NULL)) > 0 )
+	{
+		num_dispatched += dispatch_events(this, rtn);
+	}
+
+	return num_dispatched;
+}
+
+/*
+ * Compact the idle callbacks removed while they ran.
+ */
+static void
+idle_compact(private_reactor_t *this)
+{
+	unsigned int i, j;
+
+	for ( i = 0, j = 0; i < this->num_idle; i++ )
+	{
+		if ( this->idle[i].fn )
+		{
+			this->idle[j++] = this->idle[i];
+		}
+	}
+
+	if ( j != this->num_idle )
+	{
+		this->num_idle = j;
+		this->idle_next = 0;
+	}
+}
+
+/*
+ * Run the posted work, then the idle callbacks once the queue is empty, until the budget of the
+ * pass is spent. Work posted by the work waits for the next pass, so work that keeps posting 
+ * itself does not keep the loop from the handles.
+ */
+static int
+run_work(private_reactor_t *this)
+{
+	work_node_t *w_ptr, *last = this->work_tail;
+
+	ipt_reactor_work_t work;
+
+	ipt_reactor_idle_t idle;
+
+	void *arg;
+
+	uint64_t start, before, now;
+
+	unsigned int i, k, n;
+
+	int rtn, num_run = 0;
+
+	if ( this->work_head == NULL && this->num_idle == 0 )
+	{
+		return 0;
+	}
+
+	start = now = monotonic_ns();
+
+	while ( (w_ptr = this->work_head) != NULL )
+	{
+		if ( (this->work_head = w_ptr->next) == NULL )
+		{
+			this->work_tail = NULL;
+		}
+
+		work = w_ptr->fn;
+		arg = w_ptr->arg;
+
+		/* The node may be reused by the work */
+		w_ptr->next = this->work_free;
+		this->work_free = w_ptr;
+
+		before = now;
+
+		work(arg);
+
+		now = monotonic_ns();
+
+		if ( this->stats )
+		{
+			stats_record(&this->stats->dispatch, now - before);
+		}
+
+		num_run++;
+
+		if ( w_ptr == last || now - start >= this->budget_ns )
+		{
+			break;
+		}
+	}
+
+	if ( this->work_head || this->num_idle == 0 )
+	{
+		return num_run;
+	}
+
+	/* Not idle until the next pass */
+	if ( num_run && now - start >= this->budget_ns )
+	{
+		this->idle_pending = 1;
+		return num_run;
+	}
+
+	this->idle_pending = 0;
+	this->idling = 1;
+
+	/* Callbacks registered by the callbacks wait for the next pass */
+	for ( i = 0, n = this->num_idle; i < n; i++ )
+	{
+		k = this->idle_next;
+
+		this->idle_next = (k + 1) % n;
+
+		if ( (idle = this->idle[k].fn) == NULL )
+		{
+			continue;
+		}
+
+		before = now;
+
+		rtn = idle(this->idle[k].arg);
+
+		now = monotonic_ns();
+
+		if ( this->stats )
+		{
+			stats_record(&this->stats->dispatch, now - before);
+		}
+
+		if ( rtn > 0 )
+		{
+			this->idle_pending = 1;
+		}
+		else if ( rtn < 0 )
+		{
+			this->idle[k].fn = NULL;
+		}
+
+		if ( i + 1 < n && now - start >= this->budget_ns )
+		{
+			this->idle_pending = 1;
+			break;
+		}
+	}
+
+	this->idling = 0;
+
+	idle_compact(this);
+
+	return num_run;
+}
+
+static int
+run_event_loop(private_reactor_t *this, const ipt_time_value_t *tv)
+{
+	int rtn;
+
+   	struct timespec current_time;
+
+   	struct timespec time_value = ipt_time_value_to_timespec(*tv);
+
+	sigset_t tmp, *sigmask = NULL;
+
+	if ( this->stats )
+	{
+		this->stats->iterations++;
+	}
+
+	/* Timers are either delivered by the timerfd, or bound the wait */
+	if ( this->timer_handler.fd >= 0 )
+	{
+		if ( timer_fd_arm(this) < 0 )
+		{
+			return -1;
+		}
+	}
+	else
+	{
+   		clock_gettime(CLOCK_MONOTONIC,&current_time);
+
+   		time_value = timespec_min(get_expire_time(this,current_time),time_value);
+	}
+
+	errno = 0;
+
+	/* Do not block registered signals in select loop. The signalfd needs them blocked. */
+	if ( this->signal_handler.fd < 0 )
+	{
+		sigfillset(&tmp);
+
+		int i;
+		for ( i = 1; i <= 31; i++ )
+		{
+			if ( sigismember(&this->sigset, i) )
+			{
+				sigdelset(&tmp,i);
+			}
+		}
+
+		sigmask = &tmp;
+	}
+
+	/* Producers only write the eventfd while the reactor sleeps. Do not sleep on queued notifications. */
+	__atomic_store_n(&this->notify_handler.sleeping, 1, __ATOMIC_SEQ_CST);
+
+	if ( !notify_is_empty(&this->notify_handler) )
+	{
+		time_value = timespec_zero;
+	}
+
+	/* Nor on posted work, or idle callbacks with more to do */
+	if ( this->work_head || this->idle_pending )
+	{
+		time_value = timespec_zero;
+	}
+
+	if ( this->uring.fd >= 0 )
+	{
+		rtn = wait_uring(this, &time_value, sigmask);
+	}
+	else if ( this->epoll_fd >= 0 )
+	{
+		rtn = wait_epoll(this, &time_value, sigmask);
+	}
+	else
+	{
+		rtn = wait_select(this, &time_value, sigmask);
+	}
+
+	__atomic_store_n(&this->notify_handler.sleeping, 0, __ATOMIC_SEQ_CST);
+
+	if ( rtn < 0 )
+	{
+		return -1;
+	}
+
+	/* Dispatch the notifications */
+	rtn += notify_drain(&this->notify_handler);
+
+	/* The signalfd handler dispatched the signals */
+	if ( this->signal_handler.fd < 0 )
+	{
+		/* Dispatch the signals */
+		rtn += dispatch_signals(this, &__pending_sigset);
+
+		/* Reset the modules pending sigset */
+		sigemptyset(&__pending_sigset);
+	}
+
+	/* Run the work the upcalls deferred */
+	rtn += run_work(this);
+
+	return rtn;
+}
+
+static void
+destroy(ipt_reactor_t *this)
+{
+	private_reactor_t *r_ptr = (private_reactor_t *)this;
+
+	timer_node_t *t_ptr;
+
+	unsigned int i;
+
+	if ( this ) 
+	{
+		for ( i = 0; i < r_ptr->ehs_size; i++ )
+		{
+			if ( r_ptr->ehs[i] == NULL ) continue;
+
+			if ( r_ptr->ehs[i]->signum > 0 )
+			{
+				r_ptr->sigs[r_ptr->ehs[i]->signum] = NULL;
+			}
+
+			free(r_ptr->ehs[i]->stats);
+			free(r_ptr->ehs[i]);
+		}
+
+		for ( i = 1; i < _NSIG; i++ )
+		{
+			if ( r_ptr->sigs[i] ) free(r_ptr->sigs[i]->stats);
+			free(r_ptr->sigs[i]);
+		}
+
+		for ( i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++ )
+		{
+			while ( (t_ptr = r_ptr->wheel[i / WHEEL_SLOTS][i % WHEEL_SLOTS]) != NULL )
+			{
+				r_ptr->wheel[i / WHEEL_SLOTS][i % WHEEL_SLOTS] = t_ptr->next;
+				free(t_ptr);
+			}
+		}
+
+		if ( r_ptr->stats_alloc )
+		{
+			r_ptr->stats_alloc->deregister_object(r_ptr->stats_alloc, r_ptr->stats_name);
+			r_ptr->stats_alloc->free(r_ptr->stats_alloc, r_ptr->stats);
+
+			free(r_ptr->stats_name);
+		}
+
+		while ( r_ptr->work_head )
+		{
+			work_node_t *w_ptr = r_ptr->work_head;
+
+			r_ptr->work_head = w_ptr->next;
+
+			free(w_ptr);
+		}
+
+		while ( r_ptr->work_free )
+		{
+			work_node_t *w_ptr = r_ptr->work_free;
+
+			r_ptr->work_free = w_ptr->next;
+
+			free(w_ptr);
+		}
+
+		free(r_ptr->idle);
+
+		/* Cancel the operations in flight before their nodes are freed */
+		uring_release(&r_ptr->uring);
+
+		while ( r_ptr->completions )
+		{
+			completion_release(r_ptr, r_ptr->completions);
+		}
+
+		while ( r_ptr->completion_handlers )
+		{
+			completion_handler_t *ch_ptr = r_ptr->completion_handlers;
+
+			r_ptr->completion_handlers = ch_ptr->next;
+
+			free(ch_ptr);
+		}
+
+		free(r_ptr->ehs);
+		free(r_ptr->tms);
+
+		if ( r_ptr->signal_handler.fd >= 0 )
+		{
+			close(r_ptr->signal_handler.fd);
+		}
+
+		if ( r_ptr->notify_handler.notify_fd >= 0 )
+		{
+			close(r_ptr->notify_handler.notify_fd);
+		}
+
+		if ( r_ptr->timer_handler.fd >= 0 )
+		{
+			close(r_ptr->timer_handler.fd);
+		}
+
+		if ( r_ptr->epoll_fd >= 0 )
+		{
+			close(r_ptr->epoll_fd);
+		}
+
+		free(this);
+	}
+
+	return;
+}
+
+static int
+register_sig_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, int signum)
+{
+	event_node_t *n_ptr;
+
+	if ( signum <= 0 || signum >= _NSIG )
+	{
+		return -1;
+	}
+
+	n_ptr = find_event_node_by_handler(this, eh_ptr );
+
+	/* only allow a single handler per signum */
+	if ( this->sigs[signum] && this->sigs[signum] != n_ptr )
+	{
+		return -1;
+	}
+
+	/* if handler does not exist, create it. */
+	if ( n_ptr == NULL )
+	{
+		if ( (n_ptr = calloc(1, sizeof(event_node_t))) == NULL )
+		{
+			return -1;
+		}
+
+		n_ptr->eh_ptr = eh_ptr;
+		n_ptr->in_use = 1;
+		n_ptr->handle = -1;
+
+		__atomic_add_fetch(&this->active_handlers, 1, __ATOMIC_RELAXED);
+	}
+
+	/* A handler is registered for a single signal */
+	if ( n_ptr->signum > 0 && this->sigs[n_ptr->signum] == n_ptr )
+	{
+		this->sigs[n_ptr->signum] = NULL;
+		this->active_signals--;
+	}
+
+	n_ptr->mask |= EVENT_HANDLER_SIGNAL_MASK;
+	n_ptr->signum = signum;
+
+	this->sigs[signum] = n_ptr;
+	this->active_signals++;
+
+	/* Queue the signal for the signalfd. It must stay blocked for that. */
+	if ( this->signal_handler.fd >= 0 )
+	{
+		sigaddset(&this->signal_mask, signum);
+
+		sigprocmask(SIG_BLOCK, &this->signal_mask, NULL);
+
+		return signalfd(this->signal_handler.fd, &this->signal_mask, 0) < 0 ? -1 : 0;
+	}
+
+	/* add to base sigset. These are signals blocked outside select. Essentially during handler upcalls. */
+	sigaddset(&this->sigset,signum);
+
+	sigprocmask(SIG_BLOCK,&this->sigset,NULL);
+
+	return sigaction(signum,&this->act,NULL) ;
+}
+
+/*
+ * Register a handler, internal is set for the reactor's own handlers. Those are not counted in the number of handlers.
+ */
+static int
+add_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask, int internal)
+{
+	event_node_t *n_ptr, *h_ptr;
+
+	ipt_event_handler_mask_t old_mask = 0;
+
+	ipt_handle_t handle = -1, old_handle = -1;
+
+	n_ptr = find_event_node_by_handler(this,eh_ptr);
+
+	/* The handle is the index of the handler */
+	if ( n_ptr == NULL || mask & IO_MASK )
+	{
+		handle = eh_ptr->get_handle ? eh_ptr->get_handle(eh_ptr) : -1;
+
+		/* select can not monitor handles past FD_SETSIZE */
+		if ( handle < 0 || ( this->epoll_fd < 0 && handle >= FD_SETSIZE ) )
+		{
+			return -1;
+		}
+
+		/* only allow a single handler per handle */
+		if ( (h_ptr = find_event_node_by_handle(this, handle)) && h_ptr != n_ptr )
+		{
+			return -1;
+		}
+
+		/* The handle changed while the handler was registered */
+		if ( n_ptr && n_ptr->handle >= 0 && n_ptr->handle != handle )
+		{
+			return -1;
+		}
+
+		if ( grow_handle_table(this, handle) < 0 )
+		{
+			return -1;
+		}
+	}
+
+	if ( n_ptr == NULL )
+	{
+		if ( (n_ptr = calloc(1, sizeof(event_node_t))) == NULL )
+		{
+			return -1;
+		}
+
+		n_ptr->eh_ptr = eh_ptr;
+		n_ptr->in_use = 1;
+		n_ptr->handle = -1;
+		n_ptr->internal = internal;
+
+		if ( !internal )
+		{
+			__atomic_add_fetch(&this->active_handlers, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	old_mask = n_ptr->mask;
+	old_handle = n_ptr->handle;
+
+	if ( handle >= 0 )
+	{
+		n_ptr->handle = handle;
+		this->ehs[handle] = n_ptr;
+	}
+
+	n_ptr->mask |= mask;
+
+	if ( epoll_update(this, n_ptr, old_mask) < 0 )
+	{
+		n_ptr->mask = old_mask;
+
+		if ( old_mask == 0 )
+		{
+			release_node(this, n_ptr);
+		}
+		else if ( old_handle < 0 )
+		{
+			this->ehs[handle] = NULL;
+			n_ptr->handle = -1;
+		}
+
+		return -1;
+	}
+
+	return 0;	
+}
+
+static int
+register_handler (private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+{
+	return add_handler(this, eh_ptr, mask, 0);
+}
+
+/*
+ * Register a handler of the reactor itself.
+ */
+static int
+register_internal_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+{
+	return add_handler(this, eh_ptr, mask, 1);
+}
+
+static int
+completion_get_handle(completion_handler_t *this)
+{
+	return this->handle;
+}
+
+/*
+ * Keep the mask of the completion handler in step with its queues. The handler is removed
+ * and freed once both are empty.
+ */
+static int
+completion_handler_update(private_reactor_t *this, completion_handler_t *ch_ptr)
+{
+	event_node_t *n_ptr = find_event_node_by_handle(this, ch_ptr->handle);
+
+	ipt_event_handler_mask_t old_mask;
+
+	if ( n_ptr == NULL || n_ptr->eh_ptr != &ch_ptr->eh )
+	{
+		return -1;
+	}
+
+	if ( ch_ptr->input == NULL && ch_ptr->output == NULL )
+	{
+		release_node(this, n_ptr);
+
+		if ( (*ch_ptr->pprev = ch_ptr->next) != NULL )
+		{
+			ch_ptr->next->pprev = ch_ptr->pprev;
+		}
+
+		free(ch_ptr);
+
+		return 0;
+	}
+
+	old_mask = n_ptr->mask;
+
+	n_ptr->mask = ( ch_ptr->input ? EVENT_HANDLER_READ_MASK : 0 ) | ( ch_ptr->output ? EVENT_HANDLER_WRITE_MASK : 0 );
+
+	if ( n_ptr->mask != old_mask && epoll_update(this, n_ptr, old_mask) < 0 )
+	{
+		n_ptr->mask = old_mask;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Complete the first operation of a queue with the result of the system call. Nothing is
+ * completed when the handle was not ready after all.
+ */
+static int
+completion_handler_dispatch(completion_handler_t *this, completion_node_t **queue, completion_node_t ***tail, ssize_t result)
+{
+	completion_node_t *c_ptr = *queue;
+
+	if ( result < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+	{
+		return 0;
+	}
+
+	if ( (*queue = c_ptr->queue_next) == NULL )
+	{
+		*tail = queue;
+	}
+
+	dispatch_completion(this->reactor, c_ptr, result < 0 ? -errno : result);
+
+	completion_handler_update(this->reactor, this);
+
+	return 0;
+}
+
+static int
+completion_handle_input(completion_handler_t *this, ipt_handle_t h)
+{
+	completion_node_t *c_ptr = this->input;
+
+	if ( c_ptr == NULL )
+	{
+		return 0;
+	}
+
+	if ( c_ptr->mask == EVENT_HANDLER_ACCEPT_MASK )
+	{
+		return completion_handler_dispatch(this, &this->input, &this->input_tail, accept(h, NULL, NULL));
+	}
+
+	return completion_handler_dispatch(this, &this->input, &this->input_tail, read(h, c_ptr->buf, c_ptr->len));
+}
+
+static int
+completion_handle_output(completion_handler_t *this, ipt_handle_t h)
+{
+	completion_node_t *c_ptr = this->output;
+
+	if ( c_ptr == NULL )
+	{
+		return 0;
+	}
+
+	return completion_handler_dispatch(this, &this->output, &this->output_tail, write(h, c_ptr->buf, c_ptr->len));
+}
+
+/*
+ * Find the completion handler of a handle, or register a new one. A handle registered 
+ * with another handler can not be used.
+ */
+static completion_handler_t *
+completion_handler_get(private_reactor_t *this, ipt_handle_t handle, ipt_event_handler_mask_t mask)
+{
+	event_node_t *n_ptr = find_event_node_by_handle(this, handle);
+
+	completion_handler_t *ch_ptr;
+
+	if ( n_ptr )
+	{
+		return n_ptr->eh_ptr->get_handle == (int (*)(ipt_event_handler_t *)) completion_get_handle ? (completion_handler_t *)n_ptr->eh_ptr : NULL;
+	}
+
+	if ( (ch_ptr = calloc(1, sizeof(completion_handler_t))) == NULL )
+	{
+		return NULL;
+	}
+
+	ch_ptr->reactor = this;
+	ch_ptr->handle = handle;
+	ch_ptr->input_tail = &ch_ptr->input;
+	ch_ptr->output_tail = &ch_ptr->output;
+
+	ch_ptr->eh.handle_input  = (int (*)(ipt_event_handler_t *, ipt_handle_t)) completion_handle_input;
+	ch_ptr->eh.handle_output = (int (*)(ipt_event_handler_t *, ipt_handle_t)) completion_handle_output;
+	ch_ptr->eh.get_handle    = (int (*)(ipt_event_handler_t *)) completion_get_handle;
+
+	if ( register_internal_handler(this, &ch_ptr->eh, mask) < 0 )
+	{
+		free(ch_ptr);
+		return NULL;
+	}
+
+	if ( (ch_ptr->next = this->completion_handlers) != NULL )
+	{
+		ch_ptr->next->pprev = &ch_ptr->next;
+	}
+
+	ch_ptr->pprev = &this->completion_handlers;
+	this->completion_handlers = ch_ptr;
+
+	return ch_ptr;
+}
+
+/*
+ * Submit an operation to io_uring, or queue it until the handle is ready.
+ */
+static int
+submit(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask, ipt_handle_t handle, void *buf, size_t len, const void *act)
+{
+	ipt_event_handler_mask_t io_mask = mask == EVENT_HANDLER_WRITE_MASK ? EVENT_HANDLER_WRITE_MASK : EVENT_HANDLER_READ_MASK;
+
+	completion_handler_t *ch_ptr = NULL;
+
+	completion_node_t *c_ptr;
+
+	if ( eh_ptr == NULL || eh_ptr->handle_completion == NULL || handle < 0 )
+	{
+		return -1;
+	}
+
+	if ( this->uring.fd < 0 && (ch_ptr = completion_handler_get(this, handle, io_mask)) == NULL )
+	{
+		return -1;
+	}
+
+	if ( (c_ptr = completion_create(this, eh_ptr, mask, handle, buf, len, act)) == NULL )
+	{
+		if ( ch_ptr ) completion_handler_update(this, ch_ptr);
+		return -1;
+	}
+
+	if ( ch_ptr == NULL )
+	{
+		if ( uring_prepare(&this->uring, c_ptr) < 0 )
+		{
+			completion_release(this, c_ptr);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if ( io_mask == EVENT_HANDLER_WRITE_MASK )
+	{
+		*ch_ptr->output_tail = c_ptr;
+		ch_ptr->output_tail = &c_ptr->queue_next;
+	}
+	else
+	{
+		*ch_ptr->input_tail = c_ptr;
+		ch_ptr->input_tail = &c_ptr->queue_next;
+	}
+
+	return completion_handler_update(this, ch_ptr);
+}
+
+static int
+submit_read(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t handle, void *buf, size_t len, const void *act)
+{
+	return submit(this, eh_ptr, EVENT_HANDLER_READ_MASK, handle, buf, len, act);
+}
+
+static int
+submit_write(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t handle, const void *buf, size_t len, const void *act)
+{
+	return submit(this, eh_ptr, EVENT_HANDLER_WRITE_MASK, handle, (void *)buf, len, act);
+}
+
+static int
+submit_accept(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t handle, const void *act)
+{
+	return submit(this, eh_ptr, EVENT_HANDLER_ACCEPT_MASK, handle, NULL, 0, act);
+}
+
+static int
+register_buffers(private_reactor_t *this, const struct iovec *iov, unsigned int nr)
+{
+	uring_t *ring = &this->uring;
+
+	struct iovec *bufs;
+
+	if ( ring->fd < 0 )
+	{
+		return 0;
+	}
+
+	if ( ring->num_bufs )
+	{
+		syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+		free(ring->bufs);
+
+		ring->bufs = NULL;
+		ring->num_bufs = 0;
+	}
+
+	if ( nr == 0 )
+	{
+		return 0;
+	}
+
+	if ( (bufs = malloc(nr * sizeof(struct iovec))) == NULL )
+	{
+		return -1;
+	}
+
+	memcpy(bufs, iov, nr * sizeof(struct iovec));
+
+	if ( syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, bufs, nr) < 0 )
+	{
+		free(bufs);
+		return -1;
+	}
+
+	ring->bufs = bufs;
+	ring->num_bufs = nr;
+
+	return 0;
+}
+
+static int
+register_files(private_reactor_t *this, const ipt_handle_t *handles, unsigned int nr)
+{
+	uring_t *ring = &this->uring;
+
+	ipt_handle_t *files;
+
+	if ( ring->fd < 0 )
+	{
+		return 0;
+	}
+
+	if ( ring->num_files )
+	{
+		syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_FILES, NULL, 0);
+
+		free(ring->files);
+
+		ring->files = NULL;
+		ring->num_files = 0;
+	}
+
+	if ( nr == 0 )
+	{
+		return 0;
+	}
+
+	if ( (files = malloc(nr * sizeof(ipt_handle_t))) == NULL )
+	{
+		return -1;
+	}
+
+	memcpy(files, handles, nr * sizeof(ipt_handle_t));
+
+	if ( syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, files, nr) < 0 )
+	{
+		free(files);
+		return -1;
+	}
+
+	ring->files = files;
+	ring->num_files = nr;
+
+	return 0;
+}
+
+static unsigned int
+get_flags(private_reactor_t *this)
+{
+	return this->flags;
+}
+
+static int
+get_stats(private_reactor_t *this, ipt_reactor_stats_t *stats)
+{
+	if ( this->stats == NULL )
+	{
+		return -1;
+	}
 
-   	clock_gettime(CLOCK_MONOTONIC,&current_time);
+	memcpy(stats, this->stats, sizeof(ipt_reactor_stats_t));
 
-   	struct timespec  time_value = timespec_min(get_expire_time(this,current_time),ipt_time_value_to_timespec(*tv));
+	return 0;
+}
 
-	errno = 0;
+static int
+get_handler_stats(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_reactor_histogram_t *stats)
+{
+	event_node_t *n_ptr;
 
-	/* Do not block registered signals in select loop. */
+	int i;
 
-	sigset_t tmp;
+	if ( this->stats == NULL || (n_ptr = find_event_node_by_handler(this, eh_ptr)) == NULL )
+	{
+		return -1;
+	}
 
-	sigfillset(&tmp);
+	if ( n_ptr->stats )
+	{
+		memcpy(stats, n_ptr->stats, sizeof(ipt_reactor_histogram_t));
+		return 0;
+	}
 
-	int i;
-	for ( i = 1; i <= 31; i++ )
+	/* Not dispatched through its handle or signal, but it may be among the slowest */
+	for ( i = 0; i < IPT_REACTOR_STATS_HANDLERS; i++ )
 	{
-		if ( sigismember(&this->sigset, i) )
+		if ( this->stats->slowest[i].dispatch.count && this->stats->slowest[i].handler == (uintptr_t)eh_ptr )
 		{
-			sigdelset(&tmp,i);
+			memcpy(stats, &this->stats->slowest[i].dispatch, sizeof(ipt_reactor_histogram_t));
+			return 0;
 		}
 	}
 
-	rtn = pselect(max_handle + 1, &read_fds, &write_fds, &except_fds, &time_value, &tmp);
+	memset(stats, 0, sizeof(ipt_reactor_histogram_t));
 
-	/* If the rtn <= 0, then make sure the read/write 
-	 * descriptors are cleared. This will occur when a signal is received during select
-	 */
-	if ( rtn < 0 )
+	return 0;
+}
+
+static int
+publish_stats(private_reactor_t *this, ipt_allocator_t *alloc_ptr, const char *name)
+{
+	ipt_reactor_stats_t *stats;
+
+	if ( this->stats == NULL || this->stats_alloc || name == NULL )
 	{
-		FD_ZERO(&read_fds);
-		FD_ZERO(&read_fds);
+		return -1;
 	}
 
-	/* Failure */
-	if ( rtn < 0  && errno != EINTR) 
+	if ( (stats = alloc_ptr->malloc(alloc_ptr, sizeof(ipt_reactor_stats_t))) == NULL )
 	{
 		return -1;
 	}
 
-   	clock_gettime(CLOCK_MONOTONIC,&current_time);
-
-	int num_dispatched_handlers = 0;
+	memcpy(stats, this->stats, sizeof(ipt_reactor_stats_t));
 
-	/* Dispatch timers */
-	num_dispatched_handlers += dispatch_timers(this, current_time);
+	if ( (this->stats_name = strdup(name)) == NULL || alloc_ptr->register_object(alloc_ptr, name, stats) < 0 )
+	{
+		free(this->stats_name);
+		this->stats_name = NULL;
 
-	/* Dispatch the descriptors */
-	num_dispatched_handlers += dispatch_handlers(this,&read_fds, &write_fds, &except_fds, &__pending_sigset);
+		alloc_ptr->free(alloc_ptr, stats);
+		return -1;
+	}
 
-	/* Reset the modules pending sigset */
-	sigemptyset(&__pending_sigset);
+	this->stats_alloc = alloc_ptr;
+	this->stats = stats;
 
-	return num_dispatched_handlers;
+	return 0;
 }
 
-static void
-destroy(ipt_reactor_t *this)
+static int
+remove_timer(private_reactor_t *this, ipt_event_handler_t *eh_ptr)
 {
-	if ( this ) 
+	timer_node_t *t_ptr;
+
+	if ( this->tms_size == 0 )
 	{
-		free(this);
+		return -1;
 	}
 
-	return;
-}
-
-static event_node_t * 
-find_event_node_by_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr)
-{
-
-	int i;
-
-        for(i=0; i < MAX_NUMBER_EHS; i++ )
-        {
-                if ( this->ehs[i].in_use && eh_ptr == this->ehs[i].eh_ptr )
-                {
-			return &this->ehs[i];
+	for ( t_ptr = this->tms[timer_hash(this, eh_ptr)]; t_ptr != NULL; t_ptr = t_ptr->hash_next )
+	{
+		if ( t_ptr->eh_ptr == eh_ptr )
+		{
+			release_timer(this, t_ptr);
+			return 0;
 		}
 	}
 
-	return NULL;
+	return -1;
 }
 
-static event_node_t * 
-find_event_node_by_signum(private_reactor_t *this, int signum)
+static int
+schedule_timer(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_time_value_t *one_shot, ipt_time_value_t *interval, const void *act)
 {
+	timer_node_t *t_ptr;
 
-	int i;
+	unsigned int i;
 
-        for(i=0; i < MAX_NUMBER_EHS; i++ )
-        {
-                if ( this->ehs[i].in_use && signum == this->ehs[i].signum )
-                {
-			return &this->ehs[i];
-		}
+	if ( one_shot == NULL && interval == NULL )
+	{
+		return -1;
 	}
 
-	return NULL;
-}
+   	/* Convert time value to timespec and correct */
 
-static event_node_t * 
-get_next_available_handler(private_reactor_t *this)
-{
-	int i;
+	struct timespec tp;
 
-	/* Register new event handler */
-        for(i=0; i < MAX_NUMBER_EHS; i++ )
-        {
-                if ( !this->ehs[i].in_use )
-                {
-			return &this->ehs[i];
-		}
+	if ( clock_gettime(CLOCK_MONOTONIC, &tp) < 0 ) 
+	{
+		return -1;
 	}
 
-	return NULL;
-}
+   struct timespec os = timespec_zero;
+   struct timespec it = timespec_zero;
 
-static int
-register_sig_handler(private_reactor_t *this, ipt_event_handler_t *eh_ptr, int signum)
-{
-	event_node_t *n_ptr;
+   if ( one_shot != NULL )
+   {
+      os = ipt_time_value_to_timespec(*one_shot);
+   }
+
+   if ( interval != NULL )
+   {
+      it = ipt_time_value_to_timespec(*interval);
+   }
 
-	/* if handler exists, update it. */
-	if ( ( n_ptr = find_event_node_by_handler(this, eh_ptr )) )
+	/* Keep the chains of the map short */
+	if ( this->active_timers >= this->tms_size && grow_timer_map(this) < 0 )
 	{
-		n_ptr->mask |= EVENT_HANDLER_SIGNAL_MASK;
-		n_ptr->signum = signum;
-		return 0;
+		return -1;
 	}
 
-	/* only allow a single handler per signum */
-	if ( find_event_node_by_signum(this,signum) )
+	if ( (t_ptr = calloc(1, sizeof(timer_node_t))) == NULL )
 	{
 		return -1;
 	}
 
-	/* find a new handler */
-	n_ptr = get_next_available_handler(this);
+	t_ptr->eh_ptr = eh_ptr;
+	t_ptr->in_use = 1;
+	t_ptr->act = act;
 
-	if ( n_ptr == NULL )
+        /* Load the one_shot first if it is not null */
+	if ( one_shot != NULL )
 	{
-		return -1;
+		t_ptr->expire_time.tv_sec = tp.tv_sec + os.tv_sec + (os.tv_nsec + tp.tv_nsec) / 1000000000;
+		t_ptr->expire_time.tv_nsec = (os.tv_nsec + tp.tv_nsec) % 1000000000;
+	}
+	else if ( interval != NULL )
+	{
+		t_ptr->expire_time.tv_sec = tp.tv_sec + it.tv_sec + (it.tv_nsec + tp.tv_nsec ) /1000000000;
+		t_ptr->expire_time.tv_nsec = (it.tv_nsec + tp.tv_nsec) % 1000000000;
+	}
+	
+	if ( interval != NULL )
+	{
+		t_ptr->interval_time = it;
 	}
 
-	n_ptr->eh_ptr = eh_ptr;
-	n_ptr->in_use = 1;
-	n_ptr->mask = EVENT_HANDLER_SIGNAL_MASK;
-	n_ptr->signum = signum;
+	wheel_add(this, t_ptr);
 
-	/* add to base sigset. These are signals blocked outside select. Essentially during handler upcalls. */
-	sigaddset(&this->sigset,signum);
+	/* Add to the handler to timer map */
+	i = timer_hash(this, eh_ptr);
 
-	sigprocmask(SIG_BLOCK,&this->sigset,NULL);
+	t_ptr->hash_next = this->tms[i];
+	this->tms[i] = t_ptr;
 
-	return sigaction(signum,&this->act,NULL) ;
+	this->active_timers++;
+
+	return 0;
 }
 
 static int
-register_handler (private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+notify(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask, ipt_time_value_t *tv)
 {
-	int i;
 
-	event_node_t *n_ptr;
+	struct notify_msg_t msg = { eh_ptr, mask };
+
+	struct timespec deadline, now;
 
-	if ((n_ptr = find_event_node_by_handler(this,eh_ptr) ) )
+	if ( notify_enqueue(&this->notify_handler, &msg) == 0 )
 	{
-		n_ptr->mask |= mask;
+		notify_wake(&this->notify_handler);
 		return 0;
 	}
 
-	n_ptr = get_next_available_handler(this);
-
-	if ( n_ptr == NULL )
+	/* The queue is full. Wait up to tv for the reactor to drain it. */
+	if ( tv != NULL )
 	{
-		return -1;
-	}
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
 
-	n_ptr->eh_ptr = eh_ptr;
-	n_ptr->in_use = 1;
-	n_ptr->mask  = mask;
+		deadline.tv_sec += tv->tv_sec + (deadline.tv_nsec + tv->tv_usec * 1000) / 1000000000;
+		deadline.tv_nsec = (deadline.tv_nsec + tv->tv_usec * 1000) % 1000000000;
+	}
 
-	return 0;	
-}
+	do
+	{
+		notify_wake(&this->notify_handler);
 
-static int
-remove_timer(private_reactor_t *this, ipt_event_handler_t *eh_ptr)
-{
-	int i;
+		sched_yield();
 
-	for ( i = 0; i < MAX_NUMBER_TMS; i++)
-	{
-		if ( this->tms[i].in_use && this->tms[i].eh_ptr == eh_ptr)
+		if ( notify_enqueue(&this->notify_handler, &msg) == 0 )
 		{
-			memset(&this->tms[i], 0, sizeof(timer_node_t));
+			notify_wake(&this->notify_handler);
 			return 0;
 		}
-	}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+	} while ( tv == NULL || timespec_compare(now, deadline) < 0 );
+
+	errno = EAGAIN;
 
 	return -1;
 }
 
 static int
-schedule_timer(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_time_value_t *one_shot, ipt_time_value_t *interval, const void *act)
+post(private_reactor_t *this, ipt_reactor_work_t fn, void *arg)
 {
-	int i;
+	work_node_t *w_ptr;
 
-	if ( this->active_timers > MAX_NUMBER_TMS  || ( one_shot == NULL && interval == NULL ))
+	if ( fn == NULL )
 	{
 		return -1;
 	}
 
-   	/* Convert time value to timespec and correct */
+	if ( (w_ptr = this->work_free) != NULL )
+	{
+		this->work_free = w_ptr->next;
+	}
+	else if ( (w_ptr = malloc(sizeof(work_node_t))) == NULL )
+	{
+		return -1;
+	}
 
-	struct timespec tp;
+	w_ptr->fn = fn;
+	w_ptr->arg = arg;
+	w_ptr->next = NULL;
 
-	if ( clock_gettime(CLOCK_MONOTONIC, &tp) < 0 ) 
+	if ( this->work_tail )
+	{
+		this->work_tail->next = w_ptr;
+	}
+	else
+	{
+		this->work_head = w_ptr;
+	}
+
+	this->work_tail = w_ptr;
+
+	return 0;
+}
+
+static int
+on_idle(private_reactor_t *this, ipt_reactor_idle_t fn, void *arg)
+{
+	unsigned int i;
+
+	if ( fn == NULL )
 	{
 		return -1;
 	}
 
-   struct timespec os = timespec_zero;
-   struct timespec it = timespec_zero;
+	for ( i = 0; i < this->num_idle; i++ )
+	{
+		if ( this->idle[i].fn == fn && this->idle[i].arg == arg )
+		{
+			return -1;
+		}
+	}
 
-   if ( one_shot != NULL )
-   {
-      os = ipt_time_value_to_timespec(*one_shot);
-   }
+	if ( this->num_idle == this->idle_size )
+	{
+		unsigned int size = this->idle_size ? this->idle_size * 2 : INITIAL_NUMBER_IDLE;
 
-   if ( interval != NULL )
-   {
-      it = ipt_time_value_to_timespec(*interval);
-   }
+		idle_node_t *idle = realloc(this->idle, size * sizeof(idle_node_t));
+
+		if ( idle == NULL )
+		{
+			return -1;
+		}
+
+		this->idle = idle;
+		this->idle_size = size;
+	}
+
+	this->idle[this->num_idle].fn = fn;
+	this->idle[this->num_idle].arg = arg;
+	this->num_idle++;
+
+	/* Give it a pass before the loop waits */
+	this->idle_pending = 1;
+
+	return 0;
+}
 
-	for ( i = 0; i < MAX_NUMBER_TMS; i++)
+static int
+remove_idle(private_reactor_t *this, ipt_reactor_idle_t fn, void *arg)
+{
+	unsigned int i;
+
+	for ( i = 0; i < this->num_idle; i++ )
 	{
-		if ( !this->tms[i].in_use )
+		if ( this->idle[i].fn == fn && this->idle[i].arg == arg && fn != NULL )
 		{
-			this->tms[i].eh_ptr = eh_ptr;
-			this->tms[i].in_use = 1;
-			this->tms[i].act = act;
+			this->idle[i].fn = NULL;
 
-         		/* Load the one_shot first if it is not null */
-			if ( one_shot != NULL )
-			{
-				this->tms[i].expire_time.tv_sec = tp.tv_sec + os.tv_sec + (os.tv_nsec + tp.tv_nsec) / 1000000000;
-				this->tms[i].expire_time.tv_nsec = (os.tv_nsec + tp.tv_nsec) % 1000000000;
-			}
-			else if ( interval != NULL )
-			{
-				this->tms[i].expire_time.tv_sec = tp.tv_sec + it.tv_sec + (it.tv_nsec + tp.tv_nsec ) /1000000000;
-				this->tms[i].expire_time.tv_nsec = (it.tv_nsec + tp.tv_nsec) % 1000000000;
-			}
-			
-			if ( interval != NULL )
+			/* The running callbacks are compacted once they are done */
+			if ( !this->idling )
 			{
-				this->tms[i].interval_time = it;
+				idle_compact(this);
 			}
 
 			return 0;
@@ -710,28 +3410,48 @@ schedule_timer(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_time_va
 }
 
 static int
-notify(private_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask, ipt_time_value_t *tv)
+set_budget(private_reactor_t *this, const ipt_time_value_t *budget)
 {
-
-	struct notify_msg_t msg = { eh_ptr, mask };
-
-	unsigned int bytes_transferred;	
-
-	if ( send_n(this->notify_handler.notify_fds[1], &msg, sizeof(msg), &bytes_transferred, tv ) < 0 )
+	if ( budget == NULL || budget->tv_sec < 0 || budget->tv_usec < 0 || budget->tv_usec >= 1000000 )
 	{
 		return -1;
 	}
 
+	this->budget_ns = (uint64_t)budget->tv_sec * 1000000000 + (uint64_t)budget->tv_usec * 1000;
+
 	return 0;
 }
 
+static unsigned int
+num_handlers(private_reactor_t *this)
+{
+	return __atomic_load_n(&this->active_handlers, __ATOMIC_RELAXED);
+}
+
+/*
+ * Register the handler of a descriptor owned by the reactor.
+ */
+static int
+fd_handler_init(private_reactor_t *this, fd_handler_t *fh_ptr, int (*handle_input)(fd_handler_t *, ipt_handle_t))
+{
+	fh_ptr->reactor = this;
+
+	fh_ptr->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t)) handle_input;
+	fh_ptr->eh.get_handle = (int (*)(ipt_event_handler_t *)) fd_get_handle;
+
+	return register_internal_handler(this, (ipt_event_handler_t *)fh_ptr, EVENT_HANDLER_READ_MASK);
+}
+
 ipt_reactor_t * ipt_reactor_create(void)
+{
+	return ipt_reactor_create_with_flags(IPT_REACTOR_SELECT);
+}
+
+ipt_reactor_t * ipt_reactor_create_with_flags(unsigned int flags)
 {
 
 	private_reactor_t *this = malloc(sizeof(private_reactor_t));	
 
-	memset( (char *) this, 0 , sizeof ( private_reactor_t ) );
-
 	int i;
 	
 	if ( this == NULL )
@@ -739,16 +3459,56 @@ ipt_reactor_t * ipt_reactor_create(void)
 		return NULL;
 	}
 
-	/* Create notification pipe */
-	if ( pipe(this->notify_handler.notify_fds) < 0 )
+	memset( (char *) this, 0 , sizeof ( private_reactor_t ) );
+
+	this->epoll_fd = -1;
+	this->uring.fd = -1;
+	this->notify_handler.notify_fd = -1;
+	this->signal_handler.fd = -1;
+	this->timer_handler.fd = -1;
+
+	/* Start the wheel at the current time */
+	{
+		struct timespec tp;
+
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+
+		this->wheel_tick = timespec_to_tick(tp);
+	}
+
+	/* io_uring waits on epoll for the readiness of the handlers. Fall back when it is not available. */
+	if ( flags & IPT_REACTOR_URING )
+	{
+		flags = uring_setup(&this->uring) == 0 ? flags | IPT_REACTOR_EPOLL : flags & ~IPT_REACTOR_URING;
+	}
+
+	if ( flags & IPT_REACTOR_EPOLL && (this->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 )
 	{
+		uring_release(&this->uring);
 		free(this);
 		return NULL;
 	}
 
+	this->flags = flags;
+	this->budget_ns = WORK_BUDGET;
+
+	if ( flags & IPT_REACTOR_STATS )
+	{
+		this->stats = &this->local_stats;
+	}
+
+	/* Create notification pipe */
+	if ( (this->notify_handler.notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 )
+	{
+		destroy((ipt_reactor_t *)this);
+		return NULL;
+	}
+
 	/* Create notification handler */
 	this->notify_handler.reactor = this;
 
+	notify_init(&this->notify_handler);
+
 	this->notify_handler.eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t)) notify_handle_input;
 	this->notify_handler.eh.get_handle = (int (*)(ipt_event_handler_t *)) notify_get_handle;
 
@@ -760,24 +3520,65 @@ ipt_reactor_t * ipt_reactor_create(void)
 	this->public.schedule_timer       = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, const ipt_time_value_t *, const ipt_time_value_t *,const void *)) schedule_timer;
 	this->public.destroy              = (void (*)(ipt_reactor_t *this)) destroy;
 	this->public.notify               = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, ipt_event_handler_mask_t , ipt_time_value_t *)) notify;
-
-	if ( this->public.register_handler((ipt_reactor_t *)this, (ipt_event_handler_t *)&this->notify_handler, EVENT_HANDLER_READ_MASK) < 0 )
+	this->public.post                 = (int (*)(ipt_reactor_t *, ipt_reactor_work_t, void *)) post;
+	this->public.on_idle              = (int (*)(ipt_reactor_t *, ipt_reactor_idle_t, void *)) on_idle;
+	this->public.remove_idle          = (int (*)(ipt_reactor_t *, ipt_reactor_idle_t, void *)) remove_idle;
+	this->public.set_budget           = (int (*)(ipt_reactor_t *, const ipt_time_value_t *)) set_budget;
+	this->public.num_handlers         = (unsigned int (*)(ipt_reactor_t *)) num_handlers;
+	this->public.submit_read          = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, ipt_handle_t, void *, size_t, const void *)) submit_read;
+	this->public.submit_write         = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, ipt_handle_t, const void *, size_t, const void *)) submit_write;
+	this->public.submit_accept        = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, ipt_handle_t, const void *)) submit_accept;
+	this->public.register_buffers     = (int (*)(ipt_reactor_t *, const struct iovec *, unsigned int)) register_buffers;
+	this->public.register_files       = (int (*)(ipt_reactor_t *, const ipt_handle_t *, unsigned int)) register_files;
+	this->public.get_flags            = (unsigned int (*)(ipt_reactor_t *)) get_flags;
+	this->public.get_stats            = (int (*)(ipt_reactor_t *, ipt_reactor_stats_t *)) get_stats;
+	this->public.get_handler_stats    = (int (*)(ipt_reactor_t *, ipt_event_handler_t *, ipt_reactor_histogram_t *)) get_handler_stats;
+	this->public.publish_stats        = (int (*)(ipt_reactor_t *, ipt_allocator_t *, const char *)) publish_stats;
+
+	if ( register_internal_handler(this, (ipt_event_handler_t *)&this->notify_handler, EVENT_HANDLER_READ_MASK) < 0 )
 	{
-		free (this);
+		destroy((ipt_reactor_t *)this);
 		return NULL;
 	}
 
-	this->active_handlers = 0;
+	/* Signals and timers delivered through descriptors */
+	if ( flags & IPT_REACTOR_SIGNALFD )
+	{
+		sigemptyset(&this->signal_mask);
 
-	/* Fil sigset. Block all signals */
-	sigfillset(&this->sigset);
+		if ( (this->signal_handler.fd = signalfd(-1, &this->signal_mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+		      fd_handler_init(this, &this->signal_handler, signal_fd_handle_input) < 0 )
+		{
+			destroy((ipt_reactor_t *)this);
+			return NULL;
+		}
+	}
+
+	if ( flags & IPT_REACTOR_TIMERFD )
+	{
+		if ( (this->timer_handler.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+		      fd_handler_init(this, &this->timer_handler, timer_fd_handle_input) < 0 )
+		{
+			destroy((ipt_reactor_t *)this);
+			return NULL;
+		}
+	}
 
-	sigprocmask(SIG_BLOCK,&this->sigset,NULL);
-	 
 	memset (&this->act, 0, sizeof(this->act));
 
 	this->act.sa_handler = signal_handler;
 
+	/* The signalfd only blocks the registered signals */
+	if ( this->signal_handler.fd >= 0 )
+	{
+		return (ipt_reactor_t *) this;
+	}
+
+	/* Fil sigset. Block all signals */
+	sigfillset(&this->sigset);
+
+	sigprocmask(SIG_BLOCK,&this->sigset,NULL);
+	 
 	return (ipt_reactor_t *) this;
 }
 
@@ -1,7 +1,10 @@
 #ifndef __IPCTOOLS_REACTOR_H__
 #define __IPCTOOLS_REACTOR_H__
 
+#include <sys/uio.h>
+
 #include "event_handler.h"
+#include "allocator.h"
 
 /**
  * \defgroup Reactor The components used to support asynchronous, Inversion of Control programming.
@@ -15,6 +18,118 @@
  */
 typedef struct ipt_reactor_t ipt_reactor_t;
 
+/**
+ * The number of buckets of a histogram. Bucket 0 counts durations under a microsecond, bucket i
+ * those under 2^i microseconds, and the last bucket the rest.
+ */
+#define IPT_REACTOR_STATS_BUCKETS (20)
+
+/**
+ * The number of handlers with the longest upcalls kept in the statistics.
+ */
+#define IPT_REACTOR_STATS_HANDLERS (8)
+
+/**
+ * typdef for a histogram of durations.
+ */
+typedef struct ipt_reactor_histogram_t ipt_reactor_histogram_t;
+
+/**
+ * @struct ipt_reactor_histogram_t
+ *
+ * @brief A histogram of durations, in nanoseconds.
+ */
+struct ipt_reactor_histogram_t
+{
+	/** number of durations recorded */
+	unsigned long long count;
+
+	/** sum of the durations */
+	unsigned long long total_ns;
+
+	/** longest duration */
+	unsigned long long max_ns;
+
+	/** durations by power of two microseconds */
+	unsigned long long buckets[IPT_REACTOR_STATS_BUCKETS];
+};
+
+/**
+ * typdef for the statistics of a handler.
+ */
+typedef struct ipt_reactor_handler_stats_t ipt_reactor_handler_stats_t;
+
+/**
+ * @struct ipt_reactor_handler_stats_t
+ *
+ * @brief The upcalls of a handler.
+ */
+struct ipt_reactor_handler_stats_t
+{
+	/** address of the event handler in the reactor's process */
+	unsigned long long handler;
+
+	/** handle the handler was registered with, -1 if none */
+	ipt_handle_t handle;
+
+	/** duration of the upcalls */
+	ipt_reactor_histogram_t dispatch;
+};
+
+/**
+ * typdef for the statistics of a reactor.
+ */
+typedef struct ipt_reactor_stats_t ipt_reactor_stats_t;
+
+/**
+ * @struct ipt_reactor_stats_t
+ *
+ * @brief Statistics of a reactor, collected when the reactor is created with IPT_REACTOR_STATS.
+ * The reactor's own descriptors are not counted as handlers.
+ */
+struct ipt_reactor_stats_t
+{
+	/** passes of the event loop */
+	unsigned long long iterations;
+
+	/** time spent waiting for events */
+	unsigned long long wait_ns;
+
+	/** duration of all the upcalls, I/O, timers, signals, notifications and completions */
+	ipt_reactor_histogram_t dispatch;
+
+	/** time from the expiration of a timer to its upcall */
+	ipt_reactor_histogram_t timer_lateness;
+
+	/** notifications taken from the queue */
+	unsigned long long notifications;
+
+	/** depth of the notification queue at the last pass, and the deepest seen */
+	unsigned long long notify_depth;
+	unsigned long long notify_depth_max;
+
+	/** the handlers with the longest upcalls, empty entries have a count of zero */
+	ipt_reactor_handler_stats_t slowest[IPT_REACTOR_STATS_HANDLERS];
+};
+
+/**
+ * Work posted to the reactor with post.
+ *
+ * @param[in] arg The argument it was posted with.
+ */
+typedef void (*ipt_reactor_work_t)(void *arg);
+
+/**
+ * A callback run when the reactor is idle, registered with on_idle.
+ *
+ * @param[in] arg The argument it was registered with.
+ *
+ * @retval >0 There is more work, the reactor does not wait for events before calling it again.
+ * @retval 0  There is no more work until the next time the reactor is idle.
+ * @retval <0 Remove the callback.
+ */
+typedef int (*ipt_reactor_idle_t)(void *arg);
+
 /** 
  * The reactor structure.
  */
@@ -26,7 +141,7 @@ struct ipt_reactor_t
          * @param[in] this The reactor's this pointer.
          * @param[in] tv  The time to stay in the reactor waiting for an event.
          *
-         * @retval >=0 The number of events dispatched.
+         * @retval >=0 The number of events dispatched, and of posted work run.
          * @retval -1  The reactor failed.
          */
 	int (*run_event_loop)(ipt_reactor_t *this, struct timeval *tv);
@@ -34,6 +149,9 @@ struct ipt_reactor_t
         /**
          * Register an event handler with the reactor.
          *
+         * Handlers are indexed by the handle returned by get_handle, so a handle can only 
+         * have one handler, and the handle must not change while the handler is registered.
+         *
          * @param[in] this The reactor's this pointer.
          * @param[in] eh_ptr The event handler that will be dispatched  
          * @param[in] mask The event mask tells the reactor which events to associate with the handler.  
@@ -95,16 +213,209 @@ struct ipt_reactor_t
         /**
          * Register a notification with the reactor.
          *
+         * Any thread may notify the reactor. The notification is queued without locks, and the 
+         * reactor is only woken when it is waiting for events. Notifications for the same handler
+         * that are still queued may be coalesced into a single upcall with the combined mask.
+         *
          * @param[in] this The reactor's this pointer.
          * @param[in] eh_ptr The event handler that will be dispatched
          * @param[in] mask The mask is used to indicate which event will be notified.
-         * @param[in] tv The tv is used to indicate when the notification will occur.
+         * @param[in] tv The longest time to wait when the queue is full, NULL waits until there is room.
          *
          * @retval 0 Removal succeeded.
          * @retval -1 Removal failed.
          */
 	int (*notify)(ipt_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask,ipt_time_value_t *tv);
 
+        /**
+         * Post work to run after the upcalls of this pass of the event loop. The work runs in the
+         * order it was posted, within the time budget of the pass. The rest waits for the next pass, 
+         * which does not wait for events, so handles are checked between batches of work. Work posted
+         * by the work runs on the next pass. Only the thread running the event loop may post, other 
+         * threads use notify. Work still posted when the reactor is destroyed is not run.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] fn The work.
+         * @param[in] arg This will be passed to the work.
+         *
+         * @retval 0 The work was posted.
+         * @retval -1 The work could not be posted.
+         */
+	int (*post)(ipt_reactor_t *this, ipt_reactor_work_t fn, void *arg);
+
+        /**
+         * Register a callback to run when the reactor is idle, that is once all the posted work has run
+         * and the pass still has time left in its budget. The callbacks run in turn, and those that do 
+         * not fit in the budget run first on the next idle pass. Use it to batch work, such as flushing 
+         * output, once per pass instead of in each upcall. Only the thread running the event loop may 
+         * register callbacks.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] fn The callback.
+         * @param[in] arg This will be passed to the callback.
+         *
+         * @retval 0 The callback was registered.
+         * @retval -1 The callback is already registered, or could not be registered.
+         */
+	int (*on_idle)(ipt_reactor_t *this, ipt_reactor_idle_t fn, void *arg);
+
+        /**
+         * Remove a callback registered with on_idle. It may be removed from a callback.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] fn The callback.
+         * @param[in] arg The argument it was registered with.
+         *
+         * @retval 0 The callback was removed.
+         * @retval -1 The callback is not registered.
+         */
+	int (*remove_idle)(ipt_reactor_t *this, ipt_reactor_idle_t fn, void *arg);
+
+        /**
+         * Set the time each pass of the event loop may spend running posted work and idle callbacks.
+         * At least one piece of work runs on each pass. The default is a millisecond.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] budget The time.
+         *
+         * @retval 0 The budget was set.
+         * @retval -1 The budget is not valid.
+         */
+	int (*set_budget)(ipt_reactor_t *this, const ipt_time_value_t *budget);
+
+        /**
+         * The number of handlers registered with the reactor, not counting the reactor's own. It may 
+         * be read from any thread, in which case it is only a snapshot.
+         *
+         * @param[in] this The reactor's this pointer.
+         *
+         * @return The number of registered handlers.
+         */
+	unsigned int (*num_handlers)(ipt_reactor_t *this);
+
+        /**
+         * Submit a read into the buffer. The handler's handle_completion is called with the result
+         * once the read has completed. Submissions are batched, and sent to the kernel by the next
+         * pass of the event loop. The handler and the buffer must stay valid until then.
+         *
+         * The io_uring reactor reads with the kernel. The other reactors wait until the handle is
+         * readable and read it, so the handle may not have another handler registered.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] eh_ptr The event handler that will be called with the completion.
+         * @param[in] h The handle to read.
+         * @param[in] buf The buffer to read into.
+         * @param[in] len The size of the buffer.
+         * @param[in] act This will be passed to the handle_completion method of the event handler.
+         *
+         * @retval 0 The read was submitted.
+         * @retval -1 The read could not be submitted.
+         */
+	int (*submit_read)(ipt_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t h, void *buf, size_t len, const void *act);
+
+        /**
+         * Submit a write of the buffer. Otherwise the same as submit_read.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] eh_ptr The event handler that will be called with the completion.
+         * @param[in] h The handle to write.
+         * @param[in] buf The buffer to write.
+         * @param[in] len The number of bytes to write.
+         * @param[in] act This will be passed to the handle_completion method of the event handler.
+         *
+         * @retval 0 The write was submitted.
+         * @retval -1 The write could not be submitted.
+         */
+	int (*submit_write)(ipt_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t h, const void *buf, size_t len, const void *act);
+
+        /**
+         * Submit an accept on a listening handle. The accepted handle is the result of the completion.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] eh_ptr The event handler that will be called with the completion.
+         * @param[in] h The listening handle.
+         * @param[in] act This will be passed to the handle_completion method of the event handler.
+         *
+         * @retval 0 The accept was submitted.
+         * @retval -1 The accept could not be submitted.
+         */
+	int (*submit_accept)(ipt_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_handle_t h, const void *act);
+
+        /**
+         * Register buffers with the kernel. Reads and writes that fall within one of them skip mapping
+         * the buffer on each operation. Replaces the buffers registered before, and an empty list
+         * releases them. The other reactors accept the buffers and ignore them.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] iov The buffers.
+         * @param[in] nr The number of buffers.
+         *
+         * @retval 0 Registration succeeded.
+         * @retval -1 Registration failed.
+         */
+	int (*register_buffers)(ipt_reactor_t *this, const struct iovec *iov, unsigned int nr);
+
+        /**
+         * Register handles with the kernel. Operations on them skip looking up the file on each
+         * operation. Replaces the handles registered before, and an empty list releases them.
+         * The other reactors accept the handles and ignore them.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] handles The handles.
+         * @param[in] nr The number of handles.
+         *
+         * @retval 0 Registration succeeded.
+         * @retval -1 Registration failed.
+         */
+	int (*register_files)(ipt_reactor_t *this, const ipt_handle_t *handles, unsigned int nr);
+
+        /**
+         * The ipt_reactor_flags_t of the implementation in use. These differ from the flags the reactor
+         * was created with when io_uring is not available.
+         *
+         * @param[in] this The reactor's this pointer.
+         *
+         * @return The flags.
+         */
+	unsigned int (*get_flags)(ipt_reactor_t *this);
+
+        /**
+         * Copy the statistics of the reactor.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[out] stats The statistics.
+         *
+         * @retval 0 The statistics were copied.
+         * @retval -1 The reactor does not collect statistics.
+         */
+	int (*get_stats)(ipt_reactor_t *this, ipt_reactor_stats_t *stats);
+
+        /**
+         * Copy the duration of the upcalls of a registered handler.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] eh_ptr The event handler.
+         * @param[out] stats The durations.
+         *
+         * @retval 0 The durations were copied.
+         * @retval -1 The handler is not registered, or the reactor does not collect statistics.
+         */
+	int (*get_handler_stats)(ipt_reactor_t *this, ipt_event_handler_t *eh_ptr, ipt_reactor_histogram_t *stats);
+
+        /**
+         * Keep the statistics in a block allocated from the allocator, and register the block with the name.
+         * With a shared memory allocator, another process finds the block with find_registered_object 
+         * and reads it while the reactor runs. The block is released when the reactor is destroyed.
+         *
+         * @param[in] this The reactor's this pointer.
+         * @param[in] alloc_ptr The allocator.
+         * @param[in] name The name the block is registered with.
+         *
+         * @retval 0 The statistics are published.
+         * @retval -1 The reactor does not collect statistics, already published them, or the block could not be registered.
+         */
+	int (*publish_stats)(ipt_reactor_t *this, ipt_allocator_t *alloc_ptr, const char *name);
+
         /**
          * Destroy the reactor. All memory will be cleaned up.
          *
@@ -123,5 +434,61 @@ struct ipt_reactor_t
  */
 ipt_reactor_t * ipt_reactor_create(void);
 
+/**
+ * Flags used to select the implementation of the reactor.
+ */
+enum ipt_reactor_flags_t
+{
+	/**
+	 * Demultiplex with pselect. The descriptors are limited to FD_SETSIZE.
+	 */
+	IPT_REACTOR_SELECT = 0,
+
+	/**
+	 * Demultiplex with epoll. Handlers stay registered with the kernel, and each loop only 
+	 * visits the handlers that are ready. Handlers registered with EVENT_HANDLER_EDGE_TRIGGERED_MASK
+	 * are only dispatched when new data arrives, so they must drain the handle.
+	 */
+	IPT_REACTOR_EPOLL  = 1<<0,
+
+	/**
+	 * Deliver the registered signals through a signalfd. Only the registered signals are blocked,
+	 * and they stay blocked, so a signal raised between passes of the event loop is never lost.
+	 * The reactor does not install a signal handler or use process wide state, so several of
+	 * these reactors can be used in a process. A signal must only be registered with one of
+	 * them, and must be blocked in every thread of the process.
+	 */
+	IPT_REACTOR_SIGNALFD = 1<<1,
+
+	/**
+	 * Dispatch the timers from a timerfd armed with the first expiration. The time value passed
+	 * to run_event_loop is then only the longest time to wait for any event.
+	 */
+	IPT_REACTOR_TIMERFD  = 1<<2,
+
+	/**
+	 * Submit reads, writes and accepts through io_uring, in batches, and wait for their completions
+	 * together with the readiness of the registered handlers, which are kept in epoll. When io_uring
+	 * is not available the reactor falls back to epoll if IPT_REACTOR_EPOLL is also given, otherwise
+	 * to select, and the submitted operations are completed when their handles are ready.
+	 */
+	IPT_REACTOR_URING    = 1<<3,
+
+	/**
+	 * Collect the statistics of the event loop. Each upcall is timed, so this costs two reads of the clock per upcall.
+	 */
+	IPT_REACTOR_STATS    = 1<<4
+};
+
+/**
+ * Create a reactor using the implementation selected by the flags.
+ *
+ * @param[in] flags A combination of ipt_reactor_flags_t.
+ *
+ * @retval !NULL the pointer to the new reactor.
+ * @retval NULL  The constructor failed.
+ */
+ipt_reactor_t * ipt_reactor_create_with_flags(unsigned int flags);
+
 /** @} */
 #endif
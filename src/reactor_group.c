@@ -0,0 +1,399 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "reactor_group.h"
+
+#define LOOP_WAIT (1) /* seconds an idle loop waits before checking the stop flag */
+
+typedef struct private_reactor_group_t private_reactor_group_t;
+
+/*
+ * An event loop of the group.
+ */
+typedef struct loop_t
+{
+	ipt_reactor_t *reactor;
+
+	pthread_t thread;
+
+	int cpu;
+
+	volatile int stop;
+
+	/* Registrations queued for this loop, but not completed yet */
+	volatile unsigned int pending;
+
+	/* Notified to wake the loop when it is stopped */
+	ipt_event_handler_t wake_handler;
+
+} loop_t;
+
+/*
+ * A registration passed to another loop through its notification queue. It is allocated by
+ * the caller and freed by the loop once the handler is registered.
+ */
+typedef struct register_request_t
+{
+	ipt_event_handler_t eh;
+
+	loop_t *loop;
+
+	ipt_event_handler_t *eh_ptr;
+
+	ipt_event_handler_mask_t mask;
+
+} register_request_t;
+
+struct private_reactor_group_t
+{
+	ipt_reactor_group_t public;
+
+	enum ipt_reactor_group_policy_t policy;
+
+	unsigned int num_loops;
+
+	loop_t *loops;
+
+	unsigned int next;
+
+	int running;
+};
+
+static int
+wake_handle_input(ipt_event_handler_t *eh_ptr, ipt_handle_t h)
+{
+	return 0;
+}
+
+static int
+request_handle_input(register_request_t *this, ipt_handle_t h)
+{
+	ipt_reactor_t *reactor = this->loop->reactor;
+
+	if ( reactor->register_handler(reactor, this->eh_ptr, this->mask) < 0 && this->eh_ptr->handle_close )
+	{
+		ipt_handle_t handle = this->eh_ptr->get_handle ? this->eh_ptr->get_handle(this->eh_ptr) : -1;
+
+		this->eh_ptr->handle_close(this->eh_ptr, handle, this->mask);
+	}
+
+	__atomic_sub_fetch(&this->loop->pending, 1, __ATOMIC_RELAXED);
+
+	free(this);
+
+	return 0;
+}
+
+static void *
+loop_run(loop_t *loop)
+{
+	struct timeval tv;
+
+	if ( loop->cpu >= 0 )
+	{
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(loop->cpu, &set);
+
+		/* The loop still runs if it cannot be pinned */
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	while ( !__atomic_load_n(&loop->stop, __ATOMIC_ACQUIRE) )
+	{
+		tv.tv_sec = LOOP_WAIT; tv.tv_usec = 0;
+
+		if ( loop->reactor->run_event_loop(loop->reactor, &tv) < 0 )
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static loop_t *
+select_loop(private_reactor_group_t *this)
+{
+	unsigned int i, load, best_load = 0;
+
+	loop_t *best = NULL;
+
+	if ( this->policy == IPT_REACTOR_GROUP_ROUND_ROBIN )
+	{
+		return &this->loops[__atomic_fetch_add(&this->next, 1, __ATOMIC_RELAXED) % this->num_loops];
+	}
+
+	for ( i = 0; i < this->num_loops; i++ )
+	{
+		loop_t *loop = &this->loops[i];
+
+		load = loop->reactor->num_handlers(loop->reactor) + __atomic_load_n(&loop->pending, __ATOMIC_RELAXED);
+
+		if ( best == NULL || load < best_load )
+		{
+			best = loop;
+			best_load = load;
+		}
+	}
+
+	return best;
+}
+
+static unsigned int
+size(private_reactor_group_t *this)
+{
+	return this->num_loops;
+}
+
+static ipt_reactor_t *
+get_reactor(private_reactor_group_t *this, unsigned int index)
+{
+	if ( index >= this->num_loops )
+	{
+		return NULL;
+	}
+
+	return this->loops[index].reactor;
+}
+
+static ipt_reactor_t *
+next_reactor(private_reactor_group_t *this)
+{
+	return select_loop(this)->reactor;
+}
+
+static int
+register_handler(private_reactor_group_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask)
+{
+	loop_t *loop = select_loop(this);
+
+	register_request_t *req;
+
+	/* The loop's own thread, or nobody else is using the reactor */
+	if ( !__atomic_load_n(&this->running, __ATOMIC_ACQUIRE) || pthread_equal(pthread_self(), loop->thread) )
+	{
+		return loop->reactor->register_handler(loop->reactor, eh_ptr, mask);
+	}
+
+	if ( (req = calloc(1, sizeof(register_request_t))) == NULL )
+	{
+		return -1;
+	}
+
+	req->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t)) request_handle_input;
+	req->loop   = loop;
+	req->eh_ptr = eh_ptr;
+	req->mask   = mask;
+
+	__atomic_add_fetch(&loop->pending, 1, __ATOMIC_RELAXED);
+
+	if ( loop->reactor->notify(loop->reactor, &req->eh, EVENT_HANDLER_READ_MASK, NULL) < 0 )
+	{
+		__atomic_sub_fetch(&loop->pending, 1, __ATOMIC_RELAXED);
+		free(req);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Stop and join the first num_loops loops, then complete anything left in their queues.
+ */
+static void
+stop_loops(private_reactor_group_t *this, unsigned int num_loops)
+{
+	struct timeval tv;
+
+	unsigned int i;
+
+	for ( i = 0; i < num_loops; i++ )
+	{
+		loop_t *loop = &this->loops[i];
+
+		__atomic_store_n(&loop->stop, 1, __ATOMIC_RELEASE);
+
+		loop->reactor->notify(loop->reactor, &loop->wake_handler, EVENT_HANDLER_READ_MASK, NULL);
+	}
+
+	for ( i = 0; i < num_loops; i++ )
+	{
+		pthread_join(this->loops[i].thread, NULL);
+	}
+
+	__atomic_store_n(&this->running, 0, __ATOMIC_RELEASE);
+
+	/* The reactors belong to this thread again */
+	for ( i = 0; i < num_loops; i++ )
+	{
+		loop_t *loop = &this->loops[i];
+
+		while ( __atomic_load_n(&loop->pending, __ATOMIC_ACQUIRE) > 0 )
+		{
+			tv.tv_sec = 0; tv.tv_usec = 0;
+
+			if ( loop->reactor->run_event_loop(loop->reactor, &tv) < 0 )
+			{
+				break;
+			}
+		}
+
+		memset(&loop->thread, 0, sizeof(pthread_t));
+	}
+}
+
+static int
+start(private_reactor_group_t *this)
+{
+	unsigned int i;
+
+	if ( this->running )
+	{
+		return -1;
+	}
+
+	/* Registrations from the loops are marshalled from here on */
+	__atomic_store_n(&this->running, 1, __ATOMIC_RELEASE);
+
+	for ( i = 0; i < this->num_loops; i++ )
+	{
+		loop_t *loop = &this->loops[i];
+
+		loop->stop = 0;
+
+		if ( pthread_create(&loop->thread, NULL, (void *(*)(void *)) loop_run, loop) != 0 )
+		{
+			stop_loops(this, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+stop(private_reactor_group_t *this)
+{
+	if ( !this->running )
+	{
+		return -1;
+	}
+
+	stop_loops(this, this->num_loops);
+
+	return 0;
+}
+
+static void
+destroy(private_reactor_group_t *this)
+{
+	unsigned int i;
+
+	if ( this->running )
+	{
+		stop_loops(this, this->num_loops);
+	}
+
+	for ( i = 0; i < this->num_loops; i++ )
+	{
+		if ( this->loops[i].reactor )
+		{
+			this->loops[i].reactor->destroy(this->loops[i].reactor);
+		}
+	}
+
+	free(this->loops);
+	free(this);
+}
+
+/*
+ * Give the loops the cores this process may run on, in turn.
+ */
+static void
+assign_cpus(private_reactor_group_t *this)
+{
+	cpu_set_t set;
+
+	unsigned int i;
+
+	int cpu = -1, count;
+
+	if ( sched_getaffinity(0, sizeof(set), &set) < 0 || (count = CPU_COUNT(&set)) <= 1 )
+	{
+		for ( i = 0; i < this->num_loops; i++ )
+		{
+			this->loops[i].cpu = -1;
+		}
+
+		return;
+	}
+
+	for ( i = 0; i < this->num_loops; i++ )
+	{
+		do
+		{
+			cpu = (cpu + 1) % CPU_SETSIZE;
+		} while ( !CPU_ISSET(cpu, &set) );
+
+		this->loops[i].cpu = cpu;
+	}
+}
+
+ipt_reactor_group_t * ipt_reactor_group_create(unsigned int num_loops, unsigned int flags, enum ipt_reactor_group_policy_t policy)
+{
+	private_reactor_group_t *this;
+
+	unsigned int i;
+
+	if ( num_loops == 0 )
+	{
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		num_loops = n > 0 ? (unsigned int)n : 1;
+	}
+
+	if ( (this = calloc(1, sizeof(private_reactor_group_t))) == NULL )
+	{
+		return NULL;
+	}
+
+	if ( (this->loops = calloc(num_loops, sizeof(loop_t))) == NULL )
+	{
+		free(this);
+		return NULL;
+	}
+
+	this->num_loops = num_loops;
+	this->policy = policy;
+
+	for ( i = 0; i < num_loops; i++ )
+	{
+		this->loops[i].wake_handler.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t)) wake_handle_input;
+
+		if ( (this->loops[i].reactor = ipt_reactor_create_with_flags(flags)) == NULL )
+		{
+			destroy(this);
+			return NULL;
+		}
+	}
+
+	assign_cpus(this);
+
+	this->public.start            = (int (*)(ipt_reactor_group_t *)) start;
+	this->public.stop             = (int (*)(ipt_reactor_group_t *)) stop;
+	this->public.size             = (unsigned int (*)(ipt_reactor_group_t *)) size;
+	this->public.get_reactor      = (ipt_reactor_t *(*)(ipt_reactor_group_t *, unsigned int)) get_reactor;
+	this->public.next_reactor     = (ipt_reactor_t *(*)(ipt_reactor_group_t *)) next_reactor;
+	this->public.register_handler = (int (*)(ipt_reactor_group_t *, ipt_event_handler_t *, ipt_event_handler_mask_t)) register_handler;
+	this->public.destroy          = (void (*)(ipt_reactor_group_t *)) destroy;
+
+	return &this->public;
+}
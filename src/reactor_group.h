@@ -0,0 +1,129 @@
+#ifndef __IPCTOOLS_REACTOR_GROUP_H__
+#define __IPCTOOLS_REACTOR_GROUP_H__
+
+#include "reactor.h"
+
+/**
+ * \addtogroup Reactor
+ * @{
+ */
+
+/**
+ * typdef for the reactor group structure
+ */
+typedef struct ipt_reactor_group_t ipt_reactor_group_t;
+
+/**
+ * Policies used to pick the event loop of a new handler.
+ */
+enum ipt_reactor_group_policy_t
+{
+	/**
+	 * Take the event loops in turn.
+	 */
+	IPT_REACTOR_GROUP_ROUND_ROBIN = 0,
+
+	/**
+	 * Take the event loop with the fewest registered handlers, counting the registrations
+	 * that are still on their way to the loop.
+	 */
+	IPT_REACTOR_GROUP_LEAST_LOADED
+};
+
+/**
+ * A group of reactors, each run by its own thread pinned to a core.
+ *
+ * Every event loop has its own handles, timers and notification queue, so the loops share
+ * nothing while they run. A handler is owned by the loop it is registered with, and that loop's
+ * reactor must only be used from the loop's thread, except for notify, which any thread may use.
+ */
+struct ipt_reactor_group_t
+{
+        /**
+         * Start a thread for each event loop.
+         *
+         * @param[in] this The group's this pointer.
+         *
+         * @retval 0 The event loops are running.
+         * @retval -1 A thread could not be started. The loops that were started are stopped.
+         */
+	int (*start)(ipt_reactor_group_t *this);
+
+        /**
+         * Stop the event loops and wait for their threads to exit. Registrations that were still
+         * queued are completed before returning. Must not be called from one of the event loops.
+         *
+         * @param[in] this The group's this pointer.
+         *
+         * @retval 0 The event loops are stopped.
+         * @retval -1 The group was not running.
+         */
+	int (*stop)(ipt_reactor_group_t *this);
+
+        /**
+         * The number of event loops in the group.
+         *
+         * @param[in] this The group's this pointer.
+         *
+         * @return The number of event loops.
+         */
+	unsigned int (*size)(ipt_reactor_group_t *this);
+
+        /**
+         * Get the reactor of an event loop.
+         *
+         * @param[in] this The group's this pointer.
+         * @param[in] index The index of the event loop.
+         *
+         * @retval !NULL The reactor.
+         * @retval NULL The index is out of range.
+         */
+	ipt_reactor_t *(*get_reactor)(ipt_reactor_group_t *this, unsigned int index);
+
+        /**
+         * Get the reactor that the policy picks for the next handler.
+         *
+         * @param[in] this The group's this pointer.
+         *
+         * @return The reactor.
+         */
+	ipt_reactor_t *(*next_reactor)(ipt_reactor_group_t *this);
+
+        /**
+         * Register an event handler with the event loop picked by the policy.
+         *
+         * When the group is running and the caller is not the loop's thread, the registration is
+         * passed to the loop through its notification queue and completed on the loop's thread.
+         * If it then fails, handle_close is called with the mask, so the handler can release the handle.
+         *
+         * @param[in] this The group's this pointer.
+         * @param[in] eh_ptr The event handler that will be dispatched.
+         * @param[in] mask The event mask tells the reactor which events to associate with the handler.
+         *
+         * @retval 0 Registration succeeded or was queued.
+         * @retval -1 Registration failed.
+         */
+	int (*register_handler)(ipt_reactor_group_t *this, ipt_event_handler_t *eh_ptr, ipt_event_handler_mask_t mask);
+
+        /**
+         * Destroy the group. The event loops are stopped if they are running, and the reactors destroyed.
+         *
+         * @param[in] this The group's this pointer.
+         */
+	void (*destroy)(ipt_reactor_group_t *this);
+};
+
+/**
+ * Create a group of reactors. The event loops are not started.
+ *
+ * @param[in] num_loops The number of event loops. Zero uses one loop per online core.
+ * @param[in] flags A combination of ipt_reactor_flags_t used to create each reactor.
+ * @param[in] policy The ipt_reactor_group_policy_t used to pick the loop of a new handler.
+ *
+ * @retval !NULL the pointer to the new group.
+ * @retval NULL  The constructor failed.
+ */
+ipt_reactor_group_t * ipt_reactor_group_create(unsigned int num_loops, unsigned int flags, enum ipt_reactor_group_policy_t policy);
+
+/** @} */
+#endif
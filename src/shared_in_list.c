@@ -2,6 +2,7 @@
 #include <semaphore.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sched.h>
 #include "logger.h"
 typedef struct private_shared_in_list_t private_shared_in_list_t;
 
@@ -16,27 +17,32 @@ struct shared_data
 	/**
  	 * Offset to the head of list.
          */
-	ipt_op_t head;
+	ipt_link_t head;
 
 	/**
          * Offset to the tail of list.
          */
-	ipt_op_t tail;
+	ipt_link_t tail;
 
 	/**
  	 * Number of entries
          */
 	size_t count;
 
+	/**
+	 * Sequence count used by the optimistic readers. Odd while a writer is modifying the list.
+	 */
+	volatile unsigned int seq;
+
 	/**
  	 * Semaphore
          */
 	sem_t sem;
 
 	/**
-	 * Used as null pointer.
+	 * Used as null pointer. Aligned so that it can be stored in a compact offset pointer.
          */
-	char __null__;
+	char __null__ __attribute__ ((aligned (IPT_COP_ALIGN)));
 };
 
 /**
@@ -75,27 +81,79 @@ count(private_shared_in_list_t *this)
 {
 	return this->sd_ptr->count;
 }
+/*
+ * Writers hold the semaphore, and bump the sequence count before and after modifying the links.
+ */
+static inline void
+write_begin(struct shared_data *sd_ptr)
+{
+	__atomic_store_n(&sd_ptr->seq, sd_ptr->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+write_end(struct shared_data *sd_ptr)
+{
+	__atomic_store_n(&sd_ptr->seq, sd_ptr->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Readers never block the writers. They wait for an even sequence count, and check it has
+ * not changed before trusting anything read from the list.
+ */
+static inline unsigned int
+read_begin(struct shared_data *sd_ptr)
+{
+	unsigned int seq;
+
+	while ( (seq = __atomic_load_n(&sd_ptr->seq, __ATOMIC_ACQUIRE)) & 1 )
+	{
+		sched_yield();
+	}
+
+	return seq;
+}
+
+static inline int
+read_retry(struct shared_data *sd_ptr, unsigned int seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&sd_ptr->seq, __ATOMIC_RELAXED) != seq;
+}
+
 static void 
 private_remove(private_shared_in_list_t *this, ipt_shared_in_list_node_t *n_ptr)
 {
 
 	sem_wait(&this->sd_ptr->sem);
 
-	if ( ipt_op_drf(&this->sd_ptr->head) == n_ptr )
+	write_begin(this->sd_ptr);
+
+	if ( ipt_link_drf(&this->sd_ptr->head) == n_ptr )
 	{
-		ipt_op_set(&this->sd_ptr->head, ipt_op_drf(&n_ptr->next));
+		ipt_link_set(&this->sd_ptr->head, ipt_link_drf(&n_ptr->next));
 	}
 
-	if ( ipt_op_drf(&this->sd_ptr->tail) == n_ptr )
+	if ( ipt_link_drf(&this->sd_ptr->tail) == n_ptr )
 	{
-		ipt_op_set(&this->sd_ptr->tail, ipt_op_drf(&n_ptr->prev));
+		ipt_link_set(&this->sd_ptr->tail, ipt_link_drf(&n_ptr->prev));
 	}
 
-	ipt_op_set(&((struct ipt_shared_in_list_node_t *)ipt_op_drf(&n_ptr->prev))->next, ipt_op_drf(&n_ptr->next));
-	ipt_op_set(&((struct ipt_shared_in_list_node_t *)ipt_op_drf(&n_ptr->next))->prev, ipt_op_drf(&n_ptr->prev));
+	if ( ipt_link_drf(&n_ptr->prev) != &this->sd_ptr->__null__ )
+	{
+		ipt_link_set(&((struct ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->prev))->next, ipt_link_drf(&n_ptr->next));
+	}
+
+	if ( ipt_link_drf(&n_ptr->next) != &this->sd_ptr->__null__ )
+	{
+		ipt_link_set(&((struct ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->next))->prev, ipt_link_drf(&n_ptr->prev));
+	}
 
 	this->sd_ptr->count--;
 
+	write_end(this->sd_ptr);
+
 	sem_post(&this->sd_ptr->sem);
 
 	return ;
@@ -104,19 +162,19 @@ private_remove(private_shared_in_list_t *this, ipt_shared_in_list_node_t *n_ptr)
 
 static ipt_shared_in_list_node_t * head ( private_shared_in_list_t *this)
 {
-	return  ipt_op_drf(&this->sd_ptr->head) == &this->sd_ptr->__null__ ? NULL : ipt_op_drf(&this->sd_ptr->head);
+	return  ipt_link_drf(&this->sd_ptr->head) == &this->sd_ptr->__null__ ? NULL : ipt_link_drf(&this->sd_ptr->head);
 }
 
 static ipt_shared_in_list_node_t * tail ( private_shared_in_list_t *this)
 {
-	return  ipt_op_drf(&this->sd_ptr->tail) == &this->sd_ptr->__null__ ? NULL : ipt_op_drf(&this->sd_ptr->tail);
+	return  ipt_link_drf(&this->sd_ptr->tail) == &this->sd_ptr->__null__ ? NULL : ipt_link_drf(&this->sd_ptr->tail);
 }
 
 static ipt_shared_in_list_node_t * next(private_shared_in_list_t *this, ipt_shared_in_list_node_t *n_ptr)
 {
 	if ( n_ptr == NULL ) return NULL;
 
-	return ipt_op_drf(&n_ptr->next) == &this->sd_ptr->__null__ ? NULL : ipt_op_drf(&n_ptr->next);
+	return ipt_link_drf(&n_ptr->next) == &this->sd_ptr->__null__ ? NULL : ipt_link_drf(&n_ptr->next);
 } 
 
 static void add_head(private_shared_in_list_t *this, ipt_shared_in_list_node_t *n_ptr)
@@ -124,25 +182,28 @@ static void add_head(private_shared_in_list_t *this, ipt_shared_in_list_node_t *
 
 	sem_wait(&this->sd_ptr->sem);
 
-	if ( ipt_op_drf(&this->sd_ptr->head) == ipt_op_drf(&this->sd_ptr->head))
+	write_begin(this->sd_ptr);
+
+	if ( ipt_link_drf(&this->sd_ptr->head) == &this->sd_ptr->__null__ )
 	{
-		ipt_op_set(&this->sd_ptr->head, n_ptr);
-		ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-		ipt_op_set(&n_ptr->next, &this->sd_ptr->__null__);
+		ipt_link_set(&this->sd_ptr->head, n_ptr);
+		ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+		ipt_link_set(&n_ptr->next, &this->sd_ptr->__null__);
 	}
 	else
 	{
-		ipt_op_set(&((struct ipt_shared_in_list_node_t *)ipt_op_drf(&this->sd_ptr->head))->prev, n_ptr);
-		ipt_op_set(&n_ptr->next,ipt_op_drf(&this->sd_ptr->head));
-		ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-		ipt_op_set(&this->sd_ptr->head,n_ptr);
+		ipt_link_set(&((struct ipt_shared_in_list_node_t *)ipt_link_drf(&this->sd_ptr->head))->prev, n_ptr);
+		ipt_link_set(&n_ptr->next,ipt_link_drf(&this->sd_ptr->head));
+		ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+		ipt_link_set(&this->sd_ptr->head,n_ptr);
 	}
 
-	if ( ipt_op_drf(&this->sd_ptr->tail) == ipt_op_drf(&this->sd_ptr->tail ))
+	if ( ipt_link_drf(&this->sd_ptr->tail) == &this->sd_ptr->__null__ )
 	{
-		ipt_op_set(&this->sd_ptr->tail, n_ptr);
+		ipt_link_set(&this->sd_ptr->tail, n_ptr);
 	}
 	this->sd_ptr->count++;
+	write_end(this->sd_ptr);
 	sem_post(&this->sd_ptr->sem);
 	return;
 	
@@ -151,25 +212,28 @@ static void add_tail(private_shared_in_list_t *this, ipt_shared_in_list_node_t *
 {
 	sem_wait(&this->sd_ptr->sem);
 
-	if ( ipt_op_drf(&this->sd_ptr->tail) == &this->sd_ptr->__null__ )
+	write_begin(this->sd_ptr);
+
+	if ( ipt_link_drf(&this->sd_ptr->tail) == &this->sd_ptr->__null__ )
 	{
-		ipt_op_set(&this->sd_ptr->tail, n_ptr);
-		ipt_op_set(&n_ptr->prev, &this->sd_ptr->__null__);
-		ipt_op_set(&n_ptr->next, &this->sd_ptr->__null__);
+		ipt_link_set(&this->sd_ptr->tail, n_ptr);
+		ipt_link_set(&n_ptr->prev, &this->sd_ptr->__null__);
+		ipt_link_set(&n_ptr->next, &this->sd_ptr->__null__);
 	}
 	else
 	{
-		ipt_op_set(&((struct ipt_shared_in_list_node_t *)ipt_op_drf(&this->sd_ptr->tail))->next, n_ptr);
-		ipt_op_set(&n_ptr->next,&this->sd_ptr->__null__);
-		ipt_op_set(&n_ptr->prev, ipt_op_drf(&this->sd_ptr->tail));
-		ipt_op_set(&this->sd_ptr->tail,n_ptr);
+		ipt_link_set(&((struct ipt_shared_in_list_node_t *)ipt_link_drf(&this->sd_ptr->tail))->next, n_ptr);
+		ipt_link_set(&n_ptr->next,&this->sd_ptr->__null__);
+		ipt_link_set(&n_ptr->prev, ipt_link_drf(&this->sd_ptr->tail));
+		ipt_link_set(&this->sd_ptr->tail,n_ptr);
 	}
 
-	if ( ipt_op_drf(&this->sd_ptr->head) == &this->sd_ptr->__null__)
+	if ( ipt_link_drf(&this->sd_ptr->head) == &this->sd_ptr->__null__)
 	{
-		ipt_op_set(&this->sd_ptr->head, n_ptr);
+		ipt_link_set(&this->sd_ptr->head, n_ptr);
 	}
 	this->sd_ptr->count++;
+	write_end(this->sd_ptr);
 	sem_post(&this->sd_ptr->sem);
 	return;
 }
@@ -221,8 +285,8 @@ ipt_shared_in_list_t *ipt_shared_in_list_create(const char *name, ipt_allocator_
 		return NULL;
 	}
 
-	ipt_op_set(&this->sd_ptr->head,&this->sd_ptr->__null__);
-	ipt_op_set(&this->sd_ptr->tail,&this->sd_ptr->__null__);
+	ipt_link_set(&this->sd_ptr->head,&this->sd_ptr->__null__);
+	ipt_link_set(&this->sd_ptr->tail,&this->sd_ptr->__null__);
 
 	this->public.add_tail = (void (*)(ipt_shared_in_list_t *,ipt_shared_in_list_node_t *)) add_tail;
 	this->public.add_head = (void (*)(ipt_shared_in_list_t *, ipt_shared_in_list_node_t *)) add_head;
@@ -305,9 +369,9 @@ ipt_shared_in_list_find(ipt_shared_in_list_t *this, int (*compare)(ipt_shared_in
 	struct ipt_shared_in_list_node_t *n_ptr;
 
 
-	for ( 	n_ptr  = (ipt_shared_in_list_node_t *)ipt_op_drf(&_this->sd_ptr->head);
+	for ( 	n_ptr  = (ipt_shared_in_list_node_t *)ipt_link_drf(&_this->sd_ptr->head);
 		n_ptr != (ipt_shared_in_list_node_t *)&_this->sd_ptr->__null__;
-		n_ptr  = (ipt_shared_in_list_node_t *)ipt_op_drf(&n_ptr->next) )
+		n_ptr  = (ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->next) )
 	{
 
 		if ( (*compare)(n_ptr, in_ptr) == 0 )
@@ -327,12 +391,102 @@ ipt_shared_in_list_for_each(ipt_shared_in_list_t *this, void (*functor)(const ip
 
 	struct ipt_shared_in_list_node_t *n_ptr;
 
-	for ( 	n_ptr  = (ipt_shared_in_list_node_t *)ipt_op_drf(&_this->sd_ptr->head);
+	for ( 	n_ptr  = (ipt_shared_in_list_node_t *)ipt_link_drf(&_this->sd_ptr->head);
 		n_ptr != (ipt_shared_in_list_node_t *)&_this->sd_ptr->__null__;
-		n_ptr  = (ipt_shared_in_list_node_t *)ipt_op_drf(&n_ptr->next) )
+		n_ptr  = (ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->next) )
 	{
 		(*functor)(n_ptr, in_ptr);
 	}
 
 	return;
 }
+
+size_t
+ipt_shared_in_list_snapshot(ipt_shared_in_list_t *this, void *buf, size_t item_size, size_t max_items)
+{
+	private_shared_in_list_t *_this = (private_shared_in_list_t *) this;
+
+	struct ipt_shared_in_list_node_t *n_ptr;
+
+	unsigned int seq;
+
+	size_t count;
+
+retry:
+	seq = read_begin(_this->sd_ptr);
+
+	count = 0;
+
+	n_ptr = (ipt_shared_in_list_node_t *)ipt_link_drf(&_this->sd_ptr->head);
+
+	while ( count < max_items )
+	{
+		/* The link must be validated before it is followed */
+		if ( read_retry(_this->sd_ptr, seq) )
+		{
+			goto retry;
+		}
+
+		if ( n_ptr == (ipt_shared_in_list_node_t *)&_this->sd_ptr->__null__ )
+		{
+			break;
+		}
+
+		memcpy((char *)buf + count * item_size, n_ptr, item_size);
+
+		count++;
+
+		n_ptr = (ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->next);
+	}
+
+	/* The copies are only consistent if no writer ran during the walk */
+	if ( read_retry(_this->sd_ptr, seq) )
+	{
+		goto retry;
+	}
+
+	return count;
+}
+
+int
+ipt_shared_in_list_find_copy(ipt_shared_in_list_t *this, int (*compare)(ipt_shared_in_list_node_t *, void *in_ptr), void *in_ptr, void *buf, size_t item_size)
+{
+	private_shared_in_list_t *_this = (private_shared_in_list_t *) this;
+
+	struct ipt_shared_in_list_node_t *n_ptr;
+
+	unsigned int seq;
+
+retry:
+	seq = read_begin(_this->sd_ptr);
+
+	n_ptr = (ipt_shared_in_list_node_t *)ipt_link_drf(&_this->sd_ptr->head);
+
+	while ( 1 )
+	{
+		if ( read_retry(_this->sd_ptr, seq) )
+		{
+			goto retry;
+		}
+
+		if ( n_ptr == (ipt_shared_in_list_node_t *)&_this->sd_ptr->__null__ )
+		{
+			return -1;
+		}
+
+		memcpy(buf, n_ptr, item_size);
+
+		/* The copy must be consistent before the callback sees it */
+		if ( read_retry(_this->sd_ptr, seq) )
+		{
+			goto retry;
+		}
+
+		if ( (*compare)((ipt_shared_in_list_node_t *)buf, in_ptr) == 0 )
+		{
+			return 0;
+		}
+
+		n_ptr = (ipt_shared_in_list_node_t *)ipt_link_drf(&n_ptr->next);
+	}
+}
@@ -29,13 +29,16 @@ typedef struct ipt_shared_in_list_node_t ipt_shared_in_list_node_t;
  *    ipt_shared_in_list_node_t node;
  *    data
  * };
+ *
+ * When built with IPT_COMPACT_OFFSETS the node shrinks to 8 bytes, and the items
+ * must be aligned on IPT_COP_ALIGN bytes ( as returned by the allocators ).
  */
 struct ipt_shared_in_list_node_t
 {
 	/** previous pointer */
-	ipt_op_t prev;
+	ipt_link_t prev;
 	/** next pointer */
-	ipt_op_t next;
+	ipt_link_t next;
 };
 
 /**
@@ -186,5 +189,40 @@ ipt_shared_in_list_node_t * ipt_shared_in_list_find(ipt_shared_in_list_t *this,
  */
 void ipt_shared_in_list_for_each(ipt_shared_in_list_t *this, void (*func)(const ipt_shared_in_list_node_t *const, void *), void *in_ptr);
 
+/**
+ * Copy the entries of the list without blocking the writers.
+ *
+ * The list is walked optimistically, and the walk is restarted whenever a writer modifies
+ * the list at the same time. The copies are a consistent snapshot of the list, and can be
+ * examined without holding any lock. An entry removed during the walk may still be read,
+ * so the entries must be allocated from the list's allocator.
+ *
+ * @param[in]  this      The this pointer.
+ * @param[out] buf       The buffer receiving the copies.
+ * @param[in]  item_size The size of each entry, including the node.
+ * @param[in]  max_items The number of entries that fit in the buffer.
+ *
+ * @retval size_t The number of entries copied.
+ */
+size_t ipt_shared_in_list_snapshot(ipt_shared_in_list_t *this, void *buf, size_t item_size, size_t max_items);
+
+/**
+ * Find an entry in the shared list without blocking the writers.
+ *
+ * Each entry is copied to the buffer, and the callback is applied to the copy once it is known
+ * to be consistent. The callback may see the same entry more than once when a writer races with
+ * the walk.
+ *
+ * @param[in]  this      The this pointer.
+ * @param[in]  func      A callback returning 0 on a match.
+ * @param[in]  in_ptr    A pointer to an object that will be passed through to the callback.
+ * @param[out] buf       The buffer receiving the copy of the entry.
+ * @param[in]  item_size The size of the entry, including the node.
+ *
+ * @retval 0  The entry was found and copied to the buffer.
+ * @retval -1 No entry matched.
+ */
+int ipt_shared_in_list_find_copy(ipt_shared_in_list_t *this, int (*func)(ipt_shared_in_list_node_t *, void *), void *in_ptr, void *buf, size_t item_size);
+
 
 #endif
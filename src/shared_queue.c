@@ -189,6 +189,12 @@ ipt_shared_queue_for_each(ipt_shared_queue_t *this, void (*func)(const ipt_share
 	sem_post(&((private_shared_queue_t*)this)->sd_ptr->sem);
 }
 
+size_t
+ipt_shared_queue_snapshot(ipt_shared_queue_t *this, void *buf, size_t item_size, size_t max_items)
+{
+	return ipt_shared_in_list_snapshot(((private_shared_queue_t *)this)->sl_ptr, buf, item_size, max_items);
+}
+
 void ipt_shared_queue_destroy(ipt_shared_queue_t *this)
 {
 	char tmp[256];
@@ -139,5 +139,18 @@ void ipt_shared_queue_destroy(ipt_shared_queue_t *this);
  */
 void ipt_shared_queue_for_each(ipt_shared_queue_t *this, void (*func)(const ipt_shared_queue_node_t *const , void *), void *in_ptr);
 
+/**
+ * Copy the items in the queue without blocking the producers or consumers. 
+ * See ipt_shared_in_list_snapshot.
+ *
+ * @param[in]  this      The this pointer.
+ * @param[out] buf       The buffer receiving the copies.
+ * @param[in]  item_size The size of each item, including the node.
+ * @param[in]  max_items The number of items that fit in the buffer.
+ *
+ * @retval size_t The number of items copied.
+ */
+size_t ipt_shared_queue_snapshot(ipt_shared_queue_t *this, void *buf, size_t item_size, size_t max_items);
+
 
 #endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -111,6 +112,47 @@ ipt_time_value_to_timespec(ipt_time_value_t tv)
    return tmp;
 }
 
+/*
+ * The monotonic clock in nanoseconds.
+ */
+uint64_t
+monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Format the time of a message as "YYYY-MM-DD HH:MM:SS:mmm" in local time. The calendar conversion
+ * is done once a second, and only the milliseconds are added to the second kept in the cache.
+ */
+void
+format_time(time_cache_t *cache, uint64_t timestamp, char *buf, size_t size)
+{
+	time_t sec = timestamp / 1000000000ULL;
+
+	if ( sec != cache->sec )
+	{
+		struct tm tm;
+
+		/* Unlike localtime, does not look for a change of time zone on each call */
+		localtime_r(&sec, &tm);
+
+		cache->len = strftime(cache->time, sizeof(cache->time), "%Y-%m-%d %H:%M:%S", &tm);
+		cache->sec = sec;
+	}
+
+	if ( cache->len < size )
+	{
+		memcpy(buf, cache->time, cache->len);
+
+		snprintf(buf + cache->len, size - cache->len, ":%lu", (unsigned long)(timestamp % 1000000000ULL / 1000000));
+	}
+}
+
 int
 record_and_set_non_blocking_mode (ipt_handle_t handle, int *val)
 {
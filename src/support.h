@@ -1,8 +1,23 @@
 #ifndef __IPCTOOLS_SUPPORT_H__
 #define __IPCTOOLS_SUPPORT_H__
 
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
 #include "event_handler.h"
 
+/**
+ * The last second formatted by format_time, kept by the caller.
+ */
+typedef struct time_cache_t
+{
+	time_t sec;
+	char time[32];
+	size_t len;
+} time_cache_t;
+
+#define TIME_CACHE_INITIALIZER { (time_t)-1, "", 0 }
+
 int handle_is_write_ready(ipt_handle_t h, ipt_time_value_t *tv);
 
 int handle_is_read_ready(ipt_handle_t h, ipt_time_value_t *tv);
@@ -23,4 +38,8 @@ struct timespec timespec_diff(struct timespec a, struct timespec b);
 
 struct timespec ipt_time_value_to_timespec(ipt_time_value_t tv);
 
+uint64_t monotonic_ns(void);
+
+void format_time(time_cache_t *cache, uint64_t timestamp, char *buf, size_t size);
+
 #endif
@@ -0,0 +1,518 @@
+/*
+ * Allocator benchmark.
+ *
+ * Each workload forks N worker processes that attach to the same allocator and time every
+ * malloc and free. The parent merges the samples and reports the aggregate throughput and
+ * the p50/p99/p999 latency of a single operation.
+ *
+ * Workloads:
+ *
+ *   random    : Random block sizes, random interleaving of malloc and free.
+ *   fixed     : Same as random with a single block size.
+ *   prodcons  : Half of the workers allocate blocks and pass them to a peer that frees them.
+ *   fragment  : Workers keep many blocks alive and free every other one, leaving holes in
+ *               the free list that the first fit search must walk.
+ *
+ * usage: allocator_bench [-b shm|malloc] [-p processes] [-n operations] [-s segment size] [workload ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "allocator_shm.h"
+#include "allocator_malloc.h"
+#include "config.h"
+
+#define DEFAULT_PROCESSES    (4)
+#define DEFAULT_OPERATIONS   (100000)
+#define DEFAULT_SEGMENT_SIZE (16 * 1024 * 1024)
+
+#define NUM_SLOTS      (64)
+#define NUM_FRAG_SLOTS (512)
+#define FIXED_SIZE     (64)
+#define MAX_SIZE       (1024)
+#define RING_SIZE      (1024)
+
+enum backend { BACKEND_SHM, BACKEND_MALLOC };
+
+/*
+ * Single producer/single consumer ring used to hand blocks to a peer process. The blocks are
+ * passed as offsets from the start of the segment since each process attaches it at its own address.
+ */
+struct ring
+{
+	volatile size_t head;
+	volatile size_t tail;
+	size_t slot[RING_SIZE];
+};
+
+/* Per worker results, stored in memory shared with the parent. */
+struct result
+{
+	size_t ops;
+	size_t failures;
+	uint32_t *samples;
+};
+
+struct bench
+{
+	enum backend backend;
+	unsigned int processes;
+	size_t operations;
+	size_t segment_size;
+	ipt_allocator_t *alloc_ptr;
+	struct result *results;
+	uint32_t *samples;
+	struct ring *rings;
+};
+
+typedef void (*workload_fn_t)(struct bench *, ipt_allocator_t *, unsigned int);
+
+static inline uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+record(struct result *r, uint64_t start)
+{
+	uint64_t ns = now_ns() - start;
+
+	r->samples[r->ops++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static void *
+timed_malloc(ipt_allocator_t *alloc_ptr, struct result *r, size_t size)
+{
+	uint64_t start = now_ns();
+	void *ptr = alloc_ptr->malloc(alloc_ptr, size);
+
+	if ( ptr == NULL )
+	{
+		r->failures++;
+		return NULL;
+	}
+
+	record(r, start);
+
+	return ptr;
+}
+
+static void
+timed_free(ipt_allocator_t *alloc_ptr, struct result *r, void *ptr)
+{
+	uint64_t start = now_ns();
+
+	alloc_ptr->free(alloc_ptr, ptr);
+
+	record(r, start);
+}
+
+/*
+ * Randomly allocate into or free from a small window of live blocks.
+ */
+static void
+run_window(struct bench *b, ipt_allocator_t *alloc_ptr, unsigned int id, int fixed)
+{
+	struct result *r = &b->results[id];
+	void *slots[NUM_SLOTS] = { 0 };
+	unsigned int seed = getpid();
+	unsigned int i;
+
+	while ( r->ops + r->failures < b->operations )
+	{
+		i = rand_r(&seed) % NUM_SLOTS;
+
+		if ( slots[i] == NULL )
+		{
+			slots[i] = timed_malloc(alloc_ptr, r, fixed ? FIXED_SIZE : 1 + rand_r(&seed) % MAX_SIZE);
+		}
+		else
+		{
+			timed_free(alloc_ptr, r, slots[i]);
+			slots[i] = NULL;
+		}
+	}
+
+	for ( i = 0; i < NUM_SLOTS; i++ )
+	{
+		if ( slots[i] )
+		{
+			alloc_ptr->free(alloc_ptr, slots[i]);
+		}
+	}
+}
+
+static void
+run_random(struct bench *b, ipt_allocator_t *alloc_ptr, unsigned int id)
+{
+	run_window(b, alloc_ptr, id, 0);
+}
+
+static void
+run_fixed(struct bench *b, ipt_allocator_t *alloc_ptr, unsigned int id)
+{
+	run_window(b, alloc_ptr, id, 1);
+}
+
+/*
+ * Even workers produce, odd workers consume what their peer produced.
+ */
+static void
+run_prodcons(struct bench *b, ipt_allocator_t *alloc_ptr, unsigned int id)
+{
+	struct result *r = &b->results[id];
+	struct ring *ring = &b->rings[id / 2];
+	char *base = (char *)alloc_ptr->get_shared_ptr(alloc_ptr);
+	unsigned int seed = getpid();
+	size_t count = b->operations;
+	size_t head, tail;
+	void *ptr;
+
+	if ( id % 2 == 0 )
+	{
+		while ( count )
+		{
+			if ( (ptr = timed_malloc(alloc_ptr, r, 1 + rand_r(&seed) % MAX_SIZE)) == NULL )
+			{
+				sched_yield();
+				continue;
+			}
+
+			head = ring->head;
+
+			while ( head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SIZE )
+			{
+				sched_yield();
+			}
+
+			ring->slot[head % RING_SIZE] = (char *)ptr - base;
+			__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+			count--;
+		}
+	}
+	else
+	{
+		while ( count )
+		{
+			tail = ring->tail;
+
+			if ( __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail )
+			{
+				sched_yield();
+				continue;
+			}
+
+			timed_free(alloc_ptr, r, base + ring->slot[tail % RING_SIZE]);
+			__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+			count--;
+		}
+	}
+}
+
+/*
+ * Fill a large window with small and large blocks, then free every other block. The
+ * holes left behind are too small for the large requests that follow.
+ */
+static void
+run_fragment(struct bench *b, ipt_allocator_t *alloc_ptr, unsigned int id)
+{
+	struct result *r = &b->results[id];
+	void *slots[NUM_FRAG_SLOTS] = { 0 };
+	unsigned int seed = getpid();
+	unsigned int i;
+
+	while ( r->ops + r->failures < b->operations )
+	{
+		for ( i = 0; i < NUM_FRAG_SLOTS && r->ops + r->failures < b->operations; i++ )
+		{
+			if ( slots[i] == NULL )
+			{
+				slots[i] = timed_malloc(alloc_ptr, r, i % 2 ? 512 + rand_r(&seed) % 512 : 8 + rand_r(&seed) % 64);
+			}
+		}
+
+		for ( i = 0; i < NUM_FRAG_SLOTS && r->ops + r->failures < b->operations; i += 2 )
+		{
+			if ( slots[i] )
+			{
+				timed_free(alloc_ptr, r, slots[i]);
+				slots[i] = NULL;
+			}
+		}
+
+		/* Age the large blocks as well so the pattern keeps moving through the segment */
+		i = 1 + 2 * (rand_r(&seed) % (NUM_FRAG_SLOTS / 2));
+
+		if ( i < NUM_FRAG_SLOTS && slots[i] && r->ops + r->failures < b->operations )
+		{
+			timed_free(alloc_ptr, r, slots[i]);
+			slots[i] = NULL;
+		}
+	}
+
+	for ( i = 0; i < NUM_FRAG_SLOTS; i++ )
+	{
+		if ( slots[i] )
+		{
+			alloc_ptr->free(alloc_ptr, slots[i]);
+		}
+	}
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t
+percentile(uint32_t *sorted, size_t n, double p)
+{
+	return n ? sorted[(size_t)(p * (n - 1))] : 0;
+}
+
+static int
+run_workload(struct bench *b, const char *name, workload_fn_t fn, unsigned int processes)
+{
+	ipt_allocator_t *alloc_ptr;
+	size_t bytes, ops = 0, failures = 0;
+	uint64_t start, elapsed;
+	unsigned int i;
+	int pfd[2];
+	int status, rc = 0;
+	char c;
+
+	memset(b->results, 0, sizeof(struct result) * b->processes);
+	memset(b->rings, 0, sizeof(struct ring) * ((b->processes + 1) / 2));
+
+	bytes = b->alloc_ptr->bytes_allocated(b->alloc_ptr);
+
+	if ( pipe(pfd) < 0 )
+	{
+		perror("pipe");
+		return -1;
+	}
+
+	fflush(stdout);
+
+	for ( i = 0; i < processes; i++ )
+	{
+		b->results[i].samples = b->samples + i * b->operations;
+
+		if ( fork() == 0 )
+		{
+			close(pfd[1]);
+
+			alloc_ptr = b->backend == BACKEND_SHM ? ipt_allocator_shm_attach(IPT_TEST_ALLOCATOR_SHM_KEY) : b->alloc_ptr;
+
+			if ( alloc_ptr == NULL )
+			{
+				exit(1);
+			}
+
+			/* Wait for the parent to start all workers at once */
+			read(pfd[0], &c, 1);
+
+			fn(b, alloc_ptr, i);
+
+			exit(0);
+		}
+	}
+
+	close(pfd[0]);
+
+	start = now_ns();
+
+	close(pfd[1]);
+
+	for ( i = 0; i < processes; i++ )
+	{
+		wait(&status);
+
+		if ( !WIFEXITED(status) || WEXITSTATUS(status) != 0 )
+		{
+			rc = -1;
+		}
+	}
+
+	elapsed = now_ns() - start;
+
+	if ( rc < 0 )
+	{
+		printf("%-10s worker failed\n", name);
+		return -1;
+	}
+
+	/* Merge the samples into one contiguous array */
+	for ( i = 0; i < processes; i++ )
+	{
+		memmove(b->samples + ops, b->results[i].samples, b->results[i].ops * sizeof(uint32_t));
+		ops += b->results[i].ops;
+		failures += b->results[i].failures;
+	}
+
+	qsort(b->samples, ops, sizeof(uint32_t), compare_samples);
+
+	printf("%-10s procs %2u ops %9zu ops/sec %11.0f p50 %6u ns p99 %6u ns p999 %7u ns failures %zu\n",
+		name, processes, ops, ops / (elapsed / 1e9),
+		percentile(b->samples, ops, 0.50),
+		percentile(b->samples, ops, 0.99),
+		percentile(b->samples, ops, 0.999),
+		failures);
+
+	/* The workers return everything they allocate */
+	if ( b->backend == BACKEND_SHM && b->alloc_ptr->bytes_allocated(b->alloc_ptr) != bytes )
+	{
+		printf("%-10s leaked %zu bytes\n", name, b->alloc_ptr->bytes_allocated(b->alloc_ptr) - bytes);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+usage(const char *prog)
+{
+	printf("usage: %s [-b shm|malloc] [-p processes] [-n operations] [-s segment size] [random|fixed|prodcons|fragment ...]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b;
+	struct
+	{
+		const char *name;
+		workload_fn_t fn;
+	} workloads[] = {
+		{ "random",   run_random },
+		{ "fixed",    run_fixed },
+		{ "prodcons", run_prodcons },
+		{ "fragment", run_fragment },
+	};
+	unsigned int i, nworkloads = sizeof(workloads) / sizeof(workloads[0]);
+	unsigned int processes;
+	int opt, j, rc = 0;
+
+	memset(&b, 0, sizeof(b));
+	b.backend = BACKEND_SHM;
+	b.processes = DEFAULT_PROCESSES;
+	b.operations = DEFAULT_OPERATIONS;
+	b.segment_size = DEFAULT_SEGMENT_SIZE;
+
+	while ( (opt = getopt(argc, argv, "b:p:n:s:h")) != -1 )
+	{
+		switch ( opt )
+		{
+		case 'b':
+			if ( !strcmp(optarg, "malloc") )
+			{
+				b.backend = BACKEND_MALLOC;
+			}
+			else if ( strcmp(optarg, "shm") )
+			{
+				usage(argv[0]);
+				return -1;
+			}
+			break;
+		case 'p':
+			b.processes = atoi(optarg);
+			break;
+		case 'n':
+			b.operations = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			b.segment_size = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if ( b.processes == 0 || b.operations == 0 )
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	/* The heap allocator is private to each process, so each worker gets its own copy. */
+	b.alloc_ptr = b.backend == BACKEND_SHM ?
+			ipt_allocator_shm_create(b.segment_size, IPT_TEST_ALLOCATOR_SHM_KEY) :
+			ipt_allocator_malloc_create(b.segment_size);
+
+	if ( b.alloc_ptr == NULL )
+	{
+		printf("Failed to create allocator.\n");
+		return -1;
+	}
+
+	/* The results and rings are shared with the workers, but not part of the measured segment */
+	b.results = mmap(NULL, sizeof(struct result) * b.processes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	b.samples = mmap(NULL, sizeof(uint32_t) * b.processes * b.operations, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	b.rings = mmap(NULL, sizeof(struct ring) * ((b.processes + 1) / 2), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if ( b.results == MAP_FAILED || b.samples == MAP_FAILED || b.rings == MAP_FAILED )
+	{
+		perror("mmap");
+		return -1;
+	}
+
+	printf("backend %s segment %zu bytes operations per process %zu\n",
+		b.backend == BACKEND_SHM ? "shm" : "malloc", b.segment_size, b.operations);
+
+	for ( i = 0; i < nworkloads; i++ )
+	{
+		/* Run the selected workloads, or all of them */
+		for ( j = optind; j < argc && strcmp(argv[j], workloads[i].name); j++ )
+		{
+		}
+
+		if ( optind < argc && j == argc )
+		{
+			continue;
+		}
+
+		processes = b.processes;
+
+		if ( workloads[i].fn == run_prodcons )
+		{
+			/* Blocks must be freed by a different process, which needs a shared segment */
+			if ( b.backend != BACKEND_SHM )
+			{
+				printf("%-10s skipped, requires the shm backend\n", workloads[i].name);
+				continue;
+			}
+
+			/* Workers are paired */
+			processes = processes < 2 ? 2 : processes & ~1U;
+
+			if ( processes > b.processes )
+			{
+				printf("%-10s skipped, requires at least 2 processes\n", workloads[i].name);
+				continue;
+			}
+		}
+
+		if ( run_workload(&b, workloads[i].name, workloads[i].fn, processes) < 0 )
+		{
+			rc = -1;
+		}
+	}
+
+	return rc;
+}
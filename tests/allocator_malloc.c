@@ -337,6 +337,75 @@ struct dmy_data arr[5] = { {NULL,11}, {NULL,17}, {NULL,2}, {NULL,6}, {NULL,341}
 	assert( alloc_ptr->free_blocks(alloc_ptr) == 1);
 }
 
+/*
+ * Fragment the allocator with movable blocks and verify the compactor slides them
+ * together so that a large block can be allocated again.
+ */
+void test_10(ipt_allocator_t *alloc_ptr)
+{
+ipt_allocator_handle_t h[4];
+size_t before;
+char *ptr;
+int i;
+
+	assert( alloc_ptr->enable_relocation(alloc_ptr, 4) == 0 );
+
+	/* relocation can only be enabled once */
+	assert( alloc_ptr->enable_relocation(alloc_ptr, 4) == -1 );
+
+	before = alloc_ptr->blocks_allocated(alloc_ptr);
+
+	for ( i = 0; i < 4; i++ )
+	{
+		assert( (h[i] = alloc_ptr->malloc_movable(alloc_ptr, 100)) != IPT_ALLOCATOR_INVALID_HANDLE );
+
+		assert( (ptr = alloc_ptr->pin(alloc_ptr, h[i])) );
+		memset(ptr, 'a' + i, 100);
+		alloc_ptr->unpin(alloc_ptr, h[i]);
+	}
+
+	/* The table is full */
+	assert( alloc_ptr->malloc_movable(alloc_ptr, 8) == IPT_ALLOCATOR_INVALID_HANDLE );
+
+	/* Punch holes between the movable blocks */
+	alloc_ptr->free_movable(alloc_ptr, h[0]);
+	alloc_ptr->free_movable(alloc_ptr, h[2]);
+
+	assert( alloc_ptr->free_blocks(alloc_ptr) == 3 );
+	assert( alloc_ptr->malloc(alloc_ptr, 500) == NULL );
+
+	/* A pinned block is never moved */
+	alloc_ptr->pin(alloc_ptr, h[1]);
+	alloc_ptr->pin(alloc_ptr, h[3]);
+	assert( alloc_ptr->compact(alloc_ptr, BLOCK_SIZE) == 0 );
+	alloc_ptr->unpin(alloc_ptr, h[1]);
+	alloc_ptr->unpin(alloc_ptr, h[3]);
+
+	/* Each slice is bounded by the budget, but always makes progress */
+	assert( alloc_ptr->compact(alloc_ptr, 1) > 0 );
+	assert( alloc_ptr->free_blocks(alloc_ptr) == 2 );
+	assert( alloc_ptr->compact(alloc_ptr, 1) > 0 );
+	assert( alloc_ptr->free_blocks(alloc_ptr) == 1 );
+	assert( alloc_ptr->compact(alloc_ptr, BLOCK_SIZE) == 0 );
+
+	/* The content follows the block */
+	for ( i = 1; i < 4; i += 2 )
+	{
+		assert( (ptr = alloc_ptr->pin(alloc_ptr, h[i])) );
+		assert( ptr[0] == 'a' + i && ptr[99] == 'a' + i );
+		alloc_ptr->unpin(alloc_ptr, h[i]);
+	}
+
+	assert( (ptr = alloc_ptr->malloc(alloc_ptr, 500)) );
+
+	alloc_ptr->free(alloc_ptr, ptr);
+	alloc_ptr->free_movable(alloc_ptr, h[1]);
+	alloc_ptr->free_movable(alloc_ptr, h[3]);
+
+	assert( alloc_ptr->pin(alloc_ptr, h[1]) == NULL );
+	assert( alloc_ptr->blocks_allocated(alloc_ptr) == before );
+}
+
 int main( int argc, char *argv[])
 {
 	unsigned int i;
@@ -362,6 +431,7 @@ int main( int argc, char *argv[])
 	//test_8(alloc_ptr);
 
 	test_9(alloc_ptr);
+	test_10(alloc_ptr);
 
  	printf(" %s completed successfully\n", argv[0]);
 
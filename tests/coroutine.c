@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "coroutine.h"
+#include "allocator_shm.h"
+#include "config.h"
+
+#define NUMBER_OF_MESSAGES (50)
+#define MESSAGE_SIZE       (3000)
+#define TIMER_SKEW         (100) /* microseconds, the reactor may fire a timer this early */
+
+/*
+ * The server reads a length and a message, and echoes the message back until the client closes.
+ */
+struct server
+{
+	ipt_coroutine_t co;
+	int fd;
+	unsigned int len;
+	char buf[MESSAGE_SIZE];
+	int echoed;
+	int finished;
+};
+
+static int
+server_run(ipt_coroutine_t *co)
+{
+	struct server *s = (struct server *)co;
+
+	IPT_CO_BEGIN(co);
+
+	for (;;)
+	{
+		IPT_CO_AWAIT(co, ipt_coroutine_read_n(co, s->fd, &s->len, sizeof(s->len), NULL));
+
+		if ( co->result != sizeof(s->len) )
+		{
+			break;
+		}
+
+		assert ( s->len <= MESSAGE_SIZE );
+
+		IPT_CO_AWAIT(co, ipt_coroutine_read_n(co, s->fd, s->buf, s->len, NULL));
+
+		assert ( co->result == s->len );
+
+		IPT_CO_AWAIT(co, ipt_coroutine_write_n(co, s->fd, s->buf, s->len, NULL));
+
+		assert ( co->result == s->len );
+
+		s->echoed++;
+	}
+
+	/* The end of the input */
+	assert ( co->result == 0 );
+
+	IPT_CO_END(co);
+}
+
+static void
+server_done(ipt_coroutine_t *co)
+{
+	((struct server *)co)->finished = 1;
+}
+
+/*
+ * The client sends messages of growing sizes, larger than the socket buffer, with a pause after
+ * some of them, and checks each echo.
+ */
+struct client
+{
+	ipt_coroutine_t co;
+	int fd;
+	int i;
+	unsigned int len;
+	char out[MESSAGE_SIZE];
+	char in[MESSAGE_SIZE];
+	int checked;
+};
+
+static int
+client_run(ipt_coroutine_t *co)
+{
+	struct client *c = (struct client *)co;
+	ipt_time_value_t pause = { 0, 1000 };
+
+	IPT_CO_BEGIN(co);
+
+	for ( c->i = 0; c->i < NUMBER_OF_MESSAGES; c->i++ )
+	{
+		c->len = 1 + c->i * (MESSAGE_SIZE - 1) / (NUMBER_OF_MESSAGES - 1);
+
+		memset(c->out, 'a' + c->i % 26, c->len);
+
+		IPT_CO_AWAIT(co, ipt_coroutine_write_n(co, c->fd, &c->len, sizeof(c->len), NULL));
+		IPT_CO_AWAIT(co, ipt_coroutine_write_n(co, c->fd, c->out, c->len, NULL));
+
+		assert ( co->result == c->len );
+
+		IPT_CO_AWAIT(co, ipt_coroutine_read_n(co, c->fd, c->in, c->len, NULL));
+
+		assert ( co->result == c->len && memcmp(c->in, c->out, c->len) == 0 );
+
+		c->checked++;
+
+		if ( c->i % 10 == 0 )
+		{
+			IPT_CO_AWAIT(co, ipt_coroutine_sleep(co, &pause));
+		}
+	}
+
+	shutdown(c->fd, SHUT_WR);
+
+	IPT_CO_END(co);
+}
+
+static void
+run_until(ipt_reactor_t *reactor, int *done)
+{
+	ipt_time_value_t tv;
+	int i;
+
+	for ( i = 0; i < 10000 && !*done; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+	}
+
+	assert ( *done );
+}
+
+/*
+ * A client and a server written as sequential code share the reactor.
+ */
+static void
+test_1(ipt_reactor_t *reactor)
+{
+	struct server s;
+	struct client c;
+	int sv[2], sndbuf = 4096;
+
+	assert ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+	/* Small buffers, so the messages are written in pieces */
+	assert ( setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == 0 );
+	assert ( setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == 0 );
+	assert ( fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0 && fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0 );
+
+	memset(&s, 0, sizeof(s));
+	memset(&c, 0, sizeof(c));
+
+	ipt_coroutine_init(&s.co, reactor, server_run);
+	ipt_coroutine_init(&c.co, reactor, client_run);
+
+	s.fd = sv[0];
+	s.co.done = server_done;
+	c.fd = sv[1];
+
+	assert ( ipt_coroutine_start(&s.co) == 0 );
+	assert ( ipt_coroutine_start(&s.co) < 0 );
+	assert ( ipt_coroutine_start(&c.co) == 0 );
+
+	run_until(reactor, &s.finished);
+
+	assert ( c.co.line < 0 && c.checked == NUMBER_OF_MESSAGES && s.echoed == NUMBER_OF_MESSAGES );
+
+	/* Both removed themselves from the reactor */
+	assert ( reactor->num_handlers(reactor) == 0 );
+
+	close(sv[0]);
+	close(sv[1]);
+}
+
+/*
+ * Reads time out, sleeps last as long as asked, and yields interleave.
+ */
+struct sleeper
+{
+	ipt_coroutine_t co;
+	int fd;
+	char c;
+	struct timeval start;
+	long elapsed;
+	int finished;
+};
+
+static int
+sleeper_run(ipt_coroutine_t *co)
+{
+	struct sleeper *s = (struct sleeper *)co;
+	ipt_time_value_t timeout = { 0, 20000 };
+	struct timeval now;
+
+	IPT_CO_BEGIN(co);
+
+	gettimeofday(&s->start, NULL);
+
+	IPT_CO_AWAIT(co, ipt_coroutine_read(co, s->fd, &s->c, 1, &timeout));
+
+	assert ( co->result == -ETIMEDOUT );
+
+	IPT_CO_AWAIT(co, ipt_coroutine_sleep(co, &timeout));
+
+	assert ( co->result == 0 );
+
+	gettimeofday(&now, NULL);
+
+	s->elapsed = (now.tv_sec - s->start.tv_sec) * 1000000 + now.tv_usec - s->start.tv_usec;
+
+	/* The data arrives before the timeout */
+	timeout.tv_sec = 5;
+
+	IPT_CO_AWAIT(co, ipt_coroutine_read(co, s->fd, &s->c, 1, &timeout));
+
+	assert ( co->result == 1 && s->c == 'x' );
+
+	/* Not an operation */
+	assert ( ipt_coroutine_read(co, -1, &s->c, 1, NULL) < 0 && co->result == -EINVAL );
+
+	s->finished = 1;
+
+	IPT_CO_END(co);
+}
+
+struct yielder
+{
+	ipt_coroutine_t co;
+	char *trace;
+	char id;
+	int i;
+};
+
+static int
+yielder_run(ipt_coroutine_t *co)
+{
+	struct yielder *y = (struct yielder *)co;
+
+	IPT_CO_BEGIN(co);
+
+	for ( y->i = 0; y->i < 3; y->i++ )
+	{
+		strncat(y->trace, &y->id, 1);
+
+		IPT_CO_YIELD(co);
+	}
+
+	IPT_CO_END(co);
+}
+
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	struct sleeper s;
+	struct yielder y[2];
+	char trace[16] = "";
+	ipt_time_value_t tv = { 0, 1000 };
+	int pfd[2], i, found = 0;
+
+	assert ( pipe(pfd) == 0 );
+
+	memset(&s, 0, sizeof(s));
+
+	ipt_coroutine_init(&s.co, reactor, sleeper_run);
+	s.fd = pfd[0];
+
+	assert ( ipt_coroutine_start(&s.co) == 0 );
+
+	while ( s.elapsed == 0 )
+	{
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+	}
+
+	assert ( s.elapsed >= 40000 - 2 * TIMER_SKEW );
+
+	assert ( write(pfd[1], "x", 1) == 1 );
+
+	run_until(reactor, &s.finished);
+
+	assert ( s.co.line < 0 && reactor->num_handlers(reactor) == 0 );
+
+	close(pfd[0]);
+	close(pfd[1]);
+
+	/* Two coroutines take turns */
+	for ( i = 0; i < 2; i++ )
+	{
+		memset(&y[i], 0, sizeof(struct yielder));
+
+		ipt_coroutine_init(&y[i].co, reactor, yielder_run);
+
+		y[i].trace = trace;
+		y[i].id = 'a' + i;
+
+		assert ( ipt_coroutine_start(&y[i].co) == 0 );
+	}
+
+	while ( y[0].co.line >= 0 || y[1].co.line >= 0 )
+	{
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+
+		assert ( found++ < 10 );
+	}
+
+	assert ( strcmp(trace, "ababab") == 0 );
+}
+
+/*
+ * Items are taken from a shared queue as they are enqueued, and a dequeue times out on an empty queue.
+ */
+struct message
+{
+	ipt_shared_queue_node_t node;
+	int value;
+};
+
+struct consumer
+{
+	ipt_coroutine_t co;
+	ipt_shared_queue_t *sq_ptr;
+	ipt_allocator_t *alloc_ptr;
+	int sum;
+	int count;
+	int finished;
+};
+
+static int
+consumer_run(ipt_coroutine_t *co)
+{
+	struct consumer *c = (struct consumer *)co;
+	ipt_time_value_t timeout = { 0, 50000 };
+
+	IPT_CO_BEGIN(co);
+
+	for (;;)
+	{
+		IPT_CO_AWAIT(co, ipt_coroutine_dequeue(co, c->sq_ptr, &timeout));
+
+		if ( co->result < 0 )
+		{
+			break;
+		}
+
+		c->sum += ((struct message *)co->node)->value;
+		c->count++;
+
+		c->alloc_ptr->free(c->alloc_ptr, co->node);
+	}
+
+	assert ( co->result == -ETIMEDOUT );
+
+	c->finished = 1;
+
+	IPT_CO_END(co);
+}
+
+static void
+test_3(ipt_reactor_t *reactor)
+{
+	ipt_allocator_t *alloc_ptr = ipt_allocator_shm_create(1024 * 1024, IPT_TEST_ALLOCATOR_SHM_KEY);
+	ipt_shared_queue_t *sq_ptr;
+	ipt_time_value_t tv = { 0, 1000 };
+	struct consumer c;
+	int i;
+
+	assert ( alloc_ptr != NULL );
+	assert ( (sq_ptr = ipt_shared_queue_create("coroutine_queue", alloc_ptr)) != NULL );
+
+	memset(&c, 0, sizeof(c));
+
+	ipt_coroutine_init(&c.co, reactor, consumer_run);
+
+	c.sq_ptr = sq_ptr;
+	c.alloc_ptr = alloc_ptr;
+
+	assert ( ipt_coroutine_start(&c.co) == 0 );
+
+	for ( i = 1; i <= 10; i++ )
+	{
+		struct message *m = alloc_ptr->malloc(alloc_ptr, sizeof(struct message));
+
+		assert ( m != NULL );
+
+		m->value = i;
+
+		sq_ptr->enqueue(sq_ptr, &m->node);
+
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+	}
+
+	run_until(reactor, &c.finished);
+
+	assert ( c.count == 10 && c.sum == 55 );
+
+	ipt_shared_queue_destroy(sq_ptr);
+
+	alloc_ptr->destroy(alloc_ptr);
+}
+
+int main(int argc , char *argv[])
+{
+	unsigned int flags[] = { IPT_REACTOR_SELECT, IPT_REACTOR_EPOLL, IPT_REACTOR_EPOLL | IPT_REACTOR_TIMERFD };
+	unsigned int i;
+
+	for ( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ )
+	{
+		ipt_reactor_t *reactor = ipt_reactor_create_with_flags(flags[i]);
+
+		assert ( reactor != NULL );
+
+		test_1(reactor);
+
+		test_2(reactor);
+
+		test_3(reactor);
+
+		reactor->destroy(reactor);
+	}
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
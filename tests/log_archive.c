@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "log_sink.h"
+#include "log_archive.h"
+#include "allocator_shm.h"
+#include "config.h"
+
+#define NUMBER_OF_MESSAGES (20000)
+#define MAX_SIZE           (128 * 1024)
+#define PATH               "/tmp/log_archive.log"
+
+ipt_allocator_t *alloc_ptr;
+
+/* What a query read */
+typedef struct
+{
+	int count;
+	int next;
+	int first;
+	const char *originator;
+	ipt_log_level_mask_t level_mask;
+	uint64_t from_ns;
+	uint64_t to_ns;
+} result_t;
+
+static void
+remove_files()
+{
+	char path[64];
+	int i;
+
+	unlink(PATH);
+
+	for ( i = 1; i <= 20; i++ )
+	{
+		sprintf(path, "%s.%d", PATH, i);
+		unlink(path);
+	}
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Check each message matches the query, and follows the one before.
+ */
+static void
+check_message(const ipt_logger_message_t *const msg, void *in_ptr)
+{
+	result_t *result = in_ptr;
+	int seq;
+
+	assert ( sscanf(msg->message, "message %d", &seq) == 1 );
+	assert ( msg->length == strlen(msg->message) + 1 );
+	assert ( strlen(msg->time) > 19 );
+
+	if ( result->next >= 0 )
+	{
+		assert ( seq > result->next - 1 );
+	}
+
+	if ( result->count == 0 )
+	{
+		result->first = seq;
+	}
+
+	if ( result->originator )
+	{
+		assert ( strcmp(msg->originator, result->originator) == 0 );
+	}
+
+	if ( result->level_mask )
+	{
+		assert ( msg->lmask & result->level_mask );
+	}
+
+	assert ( msg->timestamp >= result->from_ns && (result->to_ns == 0 || msg->timestamp <= result->to_ns) );
+
+	result->next = seq + 1;
+	result->count++;
+}
+
+static int
+query(const char *path, const ipt_log_archive_query_t *q, result_t *result)
+{
+	memset(result, 0, sizeof(*result));
+
+	if ( q )
+	{
+		result->originator = q->originator;
+		result->level_mask = q->level_mask;
+		result->from_ns = q->from_ns;
+		result->to_ns = q->to_ns;
+	}
+
+	return ipt_log_archive_query(path, q, check_message, result);
+}
+
+/*
+ * Three originators log at three levels, the timestamps are kept for the time queries.
+ */
+static void
+produce(ipt_logger_t *lg_ptr, ipt_log_sink_t *sink, int from, int count, uint64_t *timestamps)
+{
+	static const char *originators[] = { "alpha", "beta", "gamma" };
+	ipt_log_level_mask_t levels[] = { IPT_LEVEL_INFO, IPT_LEVEL_DEBUG, IPT_LEVEL_ERROR };
+	int seq;
+
+	for ( seq = from; seq < from + count; seq++ )
+	{
+		if ( timestamps )
+		{
+			timestamps[seq - from] = now_ns();
+		}
+
+		/* The rare error comes from gamma only */
+		assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, (seq % 1000) == 999 ? levels[2] : levels[seq % 2],
+		                         seq % 1000 == 999 ? originators[2] : originators[seq % 2], "message %d %s", seq, "with some text that compresses") == 0 );
+
+		if ( seq % 500 == 499 )
+		{
+			assert ( sink->drain(sink) >= 0 );
+		}
+	}
+
+	assert ( sink->drain(sink) >= 0 );
+}
+
+/*
+ * The sink writes an archive in chunks, which is read back by time, level and originator.
+ */
+static void
+test_1(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	uint64_t *timestamps = malloc(NUMBER_OF_MESSAGES * sizeof(uint64_t));
+	ipt_log_sink_stats_t stats;
+	ipt_log_archive_query_t q;
+	ipt_log_sink_t *sink;
+	result_t result;
+	struct stat st;
+
+	remove_files();
+
+	assert ( timestamps != NULL );
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+
+	produce(lg_ptr, sink, 0, NUMBER_OF_MESSAGES, timestamps);
+
+	sink->get_stats(sink, &stats);
+
+	/* The last chunk waits to be filled */
+	assert ( stats.messages == NUMBER_OF_MESSAGES && stats.errors == 0 && stats.writes > 10 );
+
+	sink->destroy(sink);
+
+	/* Compressed, the chunks are much smaller than the lines */
+	assert ( stat(PATH, &st) == 0 );
+	assert ( (flags & IPT_LOG_SINK_COMPRESS) ? st.st_size < NUMBER_OF_MESSAGES * 40 : st.st_size > NUMBER_OF_MESSAGES * 60 );
+
+	assert ( query(PATH, NULL, &result) == NUMBER_OF_MESSAGES && result.first == 0 && result.next == NUMBER_OF_MESSAGES );
+
+	/* A range of time, in the middle */
+	memset(&q, 0, sizeof(q));
+	q.from_ns = timestamps[5000];
+	q.to_ns = timestamps[5099];
+
+	/* Stamped after the times were taken */
+	assert ( query(PATH, &q, &result) >= 99 && result.first == 5000 && result.next >= 5099 );
+
+	/* The errors, from one originator */
+	memset(&q, 0, sizeof(q));
+	q.level_mask = IPT_LEVEL_ERROR;
+
+	assert ( query(PATH, &q, &result) == NUMBER_OF_MESSAGES / 1000 && result.first == 999 );
+
+	q.level_mask = 0;
+	q.originator = "gamma";
+
+	assert ( query(PATH, &q, &result) == NUMBER_OF_MESSAGES / 1000 );
+
+	q.originator = "beta";
+
+	assert ( query(PATH, &q, &result) == NUMBER_OF_MESSAGES / 2 - NUMBER_OF_MESSAGES / 1000 && result.first == 1 );
+
+	q.originator = "nobody";
+
+	assert ( query(PATH, &q, &result) == 0 );
+
+	/* Appended to, after the index */
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+
+	produce(lg_ptr, sink, NUMBER_OF_MESSAGES, 100, NULL);
+
+	sink->destroy(sink);
+
+	assert ( query(PATH, NULL, &result) == NUMBER_OF_MESSAGES + 100 && result.next == NUMBER_OF_MESSAGES + 100 );
+
+	/* Not an archive */
+	assert ( ipt_log_archive_query("/tmp/log_archive_missing.log", NULL, check_message, &result) < 0 );
+
+	free(timestamps);
+}
+
+/*
+ * An archive that was not closed has no index, its chunks are found from their headers. A
+ * chunk cut short is dropped, and written over when the archive is appended to.
+ */
+static void
+test_2(unsigned int flags)
+{
+	ipt_logger_message_t *msg = malloc(LOGGER_MESSAGE_BUFFER_SIZE);
+	ipt_log_archive_t *archive;
+	ipt_log_archive_query_t q;
+	result_t result;
+	struct stat st;
+	int fd, i, chunks = 0;
+
+	remove_files();
+
+	assert ( msg != NULL );
+	assert ( (fd = open(PATH, O_CREAT | O_RDWR, 0644)) >= 0 );
+	assert ( (archive = ipt_log_archive_create(fd, flags)) != NULL );
+
+	memset(msg, 0, sizeof(*msg));
+	strcpy(msg->originator, "writer");
+
+	for ( i = 0; i < 5000; i++ )
+	{
+		msg->timestamp = 1000000000ULL * (i + 1);
+		msg->lmask = IPT_LEVEL_INFO;
+		msg->cmask = IPT_MODULE_ALL;
+		msg->length = sprintf(msg->message, "message %d", i) + 1;
+
+		assert ( (chunks += archive->append(archive, msg)) >= 0 );
+	}
+
+	assert ( chunks > 1 );
+	assert ( archive->flush(archive) == 1 && archive->flush(archive) == 0 );
+
+	/* Left open, as after a crash */
+	assert ( query(PATH, NULL, &result) == 5000 && result.next == 5000 );
+
+	/* Seconds 100 to 199 */
+	memset(&q, 0, sizeof(q));
+	q.from_ns = 100 * 1000000000ULL;
+	q.to_ns = 199 * 1000000000ULL;
+
+	assert ( query(PATH, &q, &result) == 100 && result.first == 99 );
+
+	/* Half a chunk header written */
+	assert ( fstat(fd, &st) == 0 );
+	assert ( pwrite(fd, &st, sizeof(ipt_log_archive_chunk_t) / 2, st.st_size) == sizeof(ipt_log_archive_chunk_t) / 2 );
+
+	assert ( query(PATH, NULL, &result) == 5000 );
+
+	/* Closed first, the index is not written */
+	close(fd);
+	archive->destroy(archive);
+
+	assert ( (fd = open(PATH, O_RDWR)) >= 0 );
+	assert ( (archive = ipt_log_archive_create(fd, flags)) != NULL );
+
+	msg->length = sprintf(msg->message, "message %d", 5000) + 1;
+
+	assert ( archive->append(archive, msg) == 0 );
+
+	archive->destroy(archive);
+	close(fd);
+
+	assert ( query(PATH, NULL, &result) == 5001 && result.next == 5001 );
+
+	/* Not an archive */
+	assert ( (fd = open(PATH, O_RDWR | O_TRUNC)) >= 0 );
+	assert ( write(fd, "not an archive\n", 15) == 15 );
+	assert ( ipt_log_archive_create(fd, flags) == NULL );
+	assert ( ipt_log_archive_query(PATH, NULL, check_message, &result) < 0 );
+
+	close(fd);
+
+	free(msg);
+}
+
+/*
+ * The archive is rotated before it grows past the largest size.
+ */
+static void
+test_3(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	ipt_log_sink_stats_t stats;
+	ipt_log_sink_t *sink;
+	result_t result;
+	char path[64];
+	int i, total = 0;
+	struct stat st;
+
+	remove_files();
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+	assert ( sink->set_rotation(sink, MAX_SIZE, NULL, 20) == 0 );
+
+	produce(lg_ptr, sink, 0, NUMBER_OF_MESSAGES, NULL);
+
+	sink->get_stats(sink, &stats);
+
+	assert ( stats.rotations > 0 && stats.errors == 0 );
+
+	sink->destroy(sink);
+
+	for ( i = stats.rotations; i >= 0; i-- )
+	{
+		if ( i )
+		{
+			sprintf(path, "%s.%d", PATH, i);
+		}
+		else
+		{
+			strcpy(path, PATH);
+		}
+
+		/* The chunks fit, the index follows them */
+		assert ( stat(path, &st) == 0 && st.st_size <= MAX_SIZE + 1024 );
+
+		assert ( query(path, NULL, &result) > 0 && result.first == total );
+
+		total += result.count;
+	}
+
+	assert ( total == NUMBER_OF_MESSAGES );
+}
+
+/*
+ * A chunk that is not full is written once its records have waited the chunk age, and is read
+ * while the sink still has the archive open.
+ */
+static void
+test_4(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	ipt_time_value_t age = { 0, 20000 };
+	ipt_log_sink_stats_t stats;
+	ipt_log_sink_t *sink;
+	result_t result;
+	int i;
+
+	remove_files();
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+	assert ( sink->set_chunk_age(sink, &age) == 0 );
+
+	for ( i = 0; i < 10; i++ )
+	{
+		assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "alpha", "message %d", i) == 0 );
+	}
+
+	/* The age is counted from this drain */
+	assert ( sink->drain(sink) == 10 );
+
+	sink->get_stats(sink, &stats);
+
+	assert ( stats.writes == 0 && query(PATH, NULL, &result) == 0 );
+
+	usleep(2 * age.tv_usec);
+
+	assert ( sink->drain(sink) == 0 );
+
+	sink->get_stats(sink, &stats);
+
+	assert ( stats.writes == 1 && query(PATH, NULL, &result) == 10 && result.next == 10 );
+
+	sink->destroy(sink);
+}
+
+/*
+ * An archive needs a file, and can not be mapped. Only an archive has chunks.
+ */
+static void
+test_5(ipt_logger_t *lg_ptr)
+{
+	ipt_time_value_t age = { 1, 0 };
+	ipt_log_sink_t *sink;
+
+	assert ( ipt_log_sink_create(lg_ptr, NULL, IPT_LOG_SINK_ARCHIVE) == NULL );
+	assert ( ipt_log_sink_create(lg_ptr, PATH, IPT_LOG_SINK_ARCHIVE | IPT_LOG_SINK_MMAP) == NULL );
+
+	remove_files();
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, IPT_LOG_SINK_WRITEV)) != NULL );
+	assert ( sink->set_chunk_age(sink, &age) < 0 );
+
+	sink->destroy(sink);
+
+	assert ( ipt_log_archive_originator_bits("alpha") == ipt_log_archive_originator_bits("alpha") );
+	assert ( ipt_log_archive_originator_bits("alpha") != ipt_log_archive_originator_bits("beta") );
+}
+
+int main(int argc , char *argv[])
+{
+	unsigned int flags[] = { IPT_LOG_SINK_ARCHIVE, IPT_LOG_SINK_ARCHIVE | IPT_LOG_SINK_COMPRESS };
+	ipt_logger_t *lg_ptr;
+	unsigned int i;
+
+	alloc_ptr = ipt_allocator_shm_create(10*1024*1024, IPT_TEST_ALLOCATOR_SHM_KEY);
+
+	assert ( alloc_ptr != NULL );
+
+	lg_ptr = ipt_logger_create("log_archive", alloc_ptr);
+
+	assert ( lg_ptr != NULL );
+
+	lg_ptr->set_category(lg_ptr, IPT_MODULE_ALL);
+	lg_ptr->set_level(lg_ptr, IPT_LEVEL_ALL);
+
+	for ( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ )
+	{
+#ifndef IPT_HAVE_ZLIB
+		if ( flags[i] & IPT_LOG_SINK_COMPRESS )
+		{
+			assert ( ipt_log_sink_create(lg_ptr, PATH, flags[i]) == NULL );
+			continue;
+		}
+#endif
+		test_1(lg_ptr, flags[i]);
+
+		test_2((flags[i] & IPT_LOG_SINK_COMPRESS) ? IPT_LOG_ARCHIVE_COMPRESS : 0);
+
+		test_3(lg_ptr, flags[i]);
+
+		test_4(lg_ptr, flags[i]);
+	}
+
+	test_5(lg_ptr);
+
+	remove_files();
+
+	alloc_ptr->destroy(alloc_ptr);
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
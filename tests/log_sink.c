@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "log_sink.h"
+#include "reactor.h"
+#include "allocator_shm.h"
+#include "config.h"
+
+#define NUMBER_OF_MESSAGES (5000)
+#define RING_SIZE          (16 * 1024)
+#define MAX_SIZE           (64 * 1024)
+#define MAX_FILES          (3)
+#define PATH               "/tmp/log_sink.log"
+
+ipt_allocator_t *alloc_ptr;
+
+static void
+remove_files()
+{
+	char path[64];
+	int i;
+
+	unlink(PATH);
+
+	for ( i = 1; i <= 10; i++ )
+	{
+		sprintf(path, "%s.%d", PATH, i);
+		unlink(path);
+	}
+}
+
+/*
+ * Check the lines of a file are in sequence from *next, and return the size of the file.
+ * Returns -1 when there is no file.
+ */
+static long
+check_file(const char *path, int *next)
+{
+	char line[256], *ptr;
+	struct stat st;
+	FILE *fp;
+	int seq;
+
+	if ( (fp = fopen(path, "r")) == NULL )
+	{
+		return -1;
+	}
+
+	while ( fgets(line, sizeof(line), fp) != NULL )
+	{
+		/* time originator message */
+		assert ( line[strlen(line) - 1] == '\n' );
+		assert ( (ptr = strstr(line, " producer message ")) != NULL );
+		assert ( sscanf(ptr, " producer message %d", &seq) == 1 );
+
+		if ( *next >= 0 )
+		{
+			assert ( seq == *next );
+		}
+
+		*next = seq + 1;
+	}
+
+	fclose(fp);
+
+	assert ( stat(path, &st) == 0 );
+
+	return st.st_size;
+}
+
+static void
+produce(ipt_logger_t *lg_ptr, int count)
+{
+	int seq = 0;
+
+	while ( seq < count )
+	{
+		/* Full until the sink catches up */
+		if ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer", "message %d %s", seq, "padding the line out to a hundred bytes or so") == 0 )
+		{
+			seq++;
+		}
+	}
+}
+
+static void
+drain_all(ipt_log_sink_t *sink, ipt_log_sink_stats_t *stats, int count)
+{
+	int status;
+
+	do
+	{
+		assert ( sink->drain(sink) >= 0 );
+
+		sink->get_stats(sink, stats);
+	}
+	while ( stats->messages < count );
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	assert ( sink->drain(sink) == 0 );
+}
+
+/*
+ * A producer process logs to its ring while the sink writes the lines to the file.
+ */
+static void
+test_1(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	ipt_log_sink_t *sink;
+	ipt_log_sink_stats_t stats;
+	int i, next = 0;
+
+	remove_files();
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+
+	if ( fork() == 0 )
+	{
+		produce(lg_ptr, NUMBER_OF_MESSAGES);
+		exit(0);
+	}
+
+	drain_all(sink, &stats, NUMBER_OF_MESSAGES);
+
+	assert ( stats.messages == NUMBER_OF_MESSAGES && stats.errors == 0 && stats.rotations == 0 );
+
+	sink->destroy(sink);
+
+	/* The mapped file is cut to the lines written */
+	assert ( check_file(PATH, &next) == stats.bytes && next == NUMBER_OF_MESSAGES );
+
+	/* Appended to, a batch at a time */
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+
+	for ( i = 0; i < 50; i++ )
+	{
+		assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer", "message %d", NUMBER_OF_MESSAGES + i) == 0 );
+	}
+
+	assert ( sink->drain(sink) == 50 );
+
+	/* One writev, or the first mapping of the file */
+	sink->get_stats(sink, &stats);
+
+	assert ( stats.messages == 50 && stats.writes == 1 );
+
+	sink->destroy(sink);
+
+	next = 0;
+
+	assert ( check_file(PATH, &next) > 0 && next == NUMBER_OF_MESSAGES + 50 );
+}
+
+/*
+ * The file is rotated before it grows past the largest size, and the oldest files are removed.
+ */
+static void
+test_2(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	ipt_log_sink_t *sink;
+	ipt_log_sink_stats_t stats;
+	char path[64];
+	long size;
+	int i, next = -1;
+
+	remove_files();
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+
+	assert ( sink->set_rotation(sink, MAX_SIZE, NULL, 0) < 0 );
+	assert ( sink->set_rotation(sink, 100, NULL, MAX_FILES) < 0 );
+	assert ( sink->set_rotation(sink, MAX_SIZE, NULL, MAX_FILES) == 0 );
+
+	if ( fork() == 0 )
+	{
+		produce(lg_ptr, NUMBER_OF_MESSAGES);
+		exit(0);
+	}
+
+	drain_all(sink, &stats, NUMBER_OF_MESSAGES);
+
+	/* About 100 bytes a line */
+	assert ( stats.rotations >= NUMBER_OF_MESSAGES * 100 / MAX_SIZE - 1 && stats.errors == 0 );
+
+	sink->destroy(sink);
+
+	sprintf(path, "%s.%d", PATH, MAX_FILES + 1);
+
+	assert ( check_file(path, &next) < 0 );
+
+	/* Oldest first, each follows on from the one before */
+	for ( i = MAX_FILES; i >= 0; i-- )
+	{
+		if ( i )
+		{
+			sprintf(path, "%s.%d", PATH, i);
+		}
+		else
+		{
+			strcpy(path, PATH);
+		}
+
+		assert ( (size = check_file(path, &next)) > 0 && size <= MAX_SIZE );
+	}
+
+	assert ( next == NUMBER_OF_MESSAGES );
+}
+
+/*
+ * The sink runs from a reactor timer, and rotates the file when it is too old.
+ */
+static void
+test_3(ipt_logger_t *lg_ptr, unsigned int flags)
+{
+	ipt_reactor_t *reactor = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL);
+	ipt_time_value_t interval = { 0, 10000 };
+	ipt_time_value_t max_age = { 0, 50000 };
+	ipt_time_value_t tv;
+	ipt_log_sink_t *sink;
+	ipt_log_sink_stats_t stats;
+	char path[64];
+	int i, next = 0;
+	long size;
+
+	remove_files();
+
+	assert ( reactor != NULL );
+	assert ( (sink = ipt_log_sink_create(lg_ptr, PATH, flags)) != NULL );
+	assert ( sink->set_rotation(sink, 0, &max_age, 10) == 0 );
+
+	assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)sink, &interval, &interval, NULL) == 0 );
+
+	for ( i = 0; i < 30; i++ )
+	{
+		assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer", "message %d", i) == 0 );
+
+		tv.tv_sec = 0; tv.tv_usec = 10000;
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+	}
+
+	assert ( reactor->remove_timer(reactor, (ipt_event_handler_t *)sink) == 0 );
+
+	assert ( sink->drain(sink) >= 0 );
+
+	sink->get_stats(sink, &stats);
+
+	/* About 300 milliseconds of messages */
+	assert ( stats.messages == 30 && stats.rotations >= 2 && stats.rotations <= 10 );
+
+	sink->destroy(sink);
+
+	/* No message lost across the rotations */
+	for ( i = stats.rotations; i >= 0; i-- )
+	{
+		if ( i )
+		{
+			sprintf(path, "%s.%d", PATH, i);
+		}
+		else
+		{
+			strcpy(path, PATH);
+		}
+
+		assert ( (size = check_file(path, &next)) >= 0 );
+	}
+
+	assert ( next == 30 );
+
+	reactor->destroy(reactor);
+}
+
+/*
+ * The standard output is written to, but can not be mapped or rotated.
+ */
+static void
+test_4(ipt_logger_t *lg_ptr)
+{
+	ipt_log_sink_t *sink;
+
+	assert ( ipt_log_sink_create(NULL, PATH, IPT_LOG_SINK_WRITEV) == NULL );
+	assert ( ipt_log_sink_create(lg_ptr, NULL, IPT_LOG_SINK_MMAP) == NULL );
+
+	assert ( (sink = ipt_log_sink_create(lg_ptr, NULL, IPT_LOG_SINK_WRITEV)) != NULL );
+
+	assert ( sink->set_rotation(sink, MAX_SIZE, NULL, MAX_FILES) < 0 );
+	assert ( sink->rotate(sink) < 0 );
+
+	assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer", "message %d", 0) == 0 );
+	assert ( sink->drain(sink) == 1 );
+
+	sink->destroy(sink);
+}
+
+int main(int argc , char *argv[])
+{
+	unsigned int flags[] = { IPT_LOG_SINK_WRITEV, IPT_LOG_SINK_MMAP };
+	ipt_logger_t *lg_ptr;
+	unsigned int i;
+
+	alloc_ptr = ipt_allocator_shm_create(10*1024*1024, IPT_TEST_ALLOCATOR_SHM_KEY);
+
+	assert ( alloc_ptr != NULL );
+
+	lg_ptr = ipt_logger_create_with_rings("log_sink", alloc_ptr, 1, RING_SIZE);
+
+	assert ( lg_ptr != NULL );
+
+	lg_ptr->set_category(lg_ptr, IPT_MODULE_ALL);
+	lg_ptr->set_level(lg_ptr, IPT_LEVEL_ALL);
+
+	for ( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ )
+	{
+		test_1(lg_ptr, flags[i]);
+
+		test_2(lg_ptr, flags[i]);
+
+		test_3(lg_ptr, flags[i]);
+	}
+
+	test_4(lg_ptr);
+
+	remove_files();
+
+	alloc_ptr->destroy(alloc_ptr);
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <string.h>
 #include <wait.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "logger.h"
 #include "allocator_shm.h"
@@ -156,6 +158,877 @@ test_2()
    	}
 }
 
+#define NUMBER_OF_PRODUCERS (3)
+#define NUMBER_OF_RINGS     (2)
+#define RING_SIZE           (16 * 1024)
+
+struct drained
+{
+	int count;
+	int next[NUMBER_OF_PRODUCERS];
+};
+
+static void
+check_message(const ipt_logger_message_t *const msg_ptr, void *in_ptr)
+{
+	struct drained *d = in_ptr;
+	int producer, seq;
+
+	assert ( sscanf(msg_ptr->originator, "producer %d", &producer) == 1 && producer < NUMBER_OF_PRODUCERS );
+	assert ( sscanf(msg_ptr->message, "message %d", &seq) == 1 );
+
+	/* In order for each producer */
+	assert ( seq == d->next[producer]++ );
+
+	d->count++;
+}
+
+/*
+ * More producers than rings. The producers that found a ring write to it while the collector
+ * drains, and the other producer logs through the shared queue.
+ */
+static void
+test_3()
+{
+	ipt_logger_t *rl_ptr = ipt_logger_create_with_rings("logger_rings", alloc_ptr, NUMBER_OF_RINGS, RING_SIZE);
+	struct drained d;
+	int i, status;
+
+	assert ( ipt_logger_create_with_rings("logger_bad", alloc_ptr, 1, 100) == NULL );
+
+	assert ( rl_ptr != NULL );
+
+	rl_ptr->set_category(rl_ptr, IPT_MODULE_ALL);
+	rl_ptr->set_level(rl_ptr, IPT_LEVEL_ALL);
+
+	memset(&d, 0, sizeof(d));
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			char originator[32];
+			int seq = 0;
+
+			sprintf(originator, "producer %d", i);
+
+			while ( seq < NUMBER_OF_MESSAGES )
+			{
+				/* Full until the collector catches up */
+				if ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, originator, "message %d", seq) == 0 )
+				{
+					seq++;
+				}
+			}
+
+			exit ( 0 );
+		}
+	}
+
+	while ( d.count < NUMBER_OF_PRODUCERS * NUMBER_OF_MESSAGES )
+	{
+		assert ( rl_ptr->drain(rl_ptr, check_message, &d) >= 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		wait(&status);
+
+		assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+	}
+
+	assert ( rl_ptr->drain(rl_ptr, check_message, &d) == 0 );
+
+	/* The rings of the producers that exited are free again */
+	d.next[0] = 0;
+
+	assert ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer 0", "message %d", 0) == 0 );
+	assert ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_DEBUG, "producer 0", "message %d", 1) == 0 );
+
+	assert ( rl_ptr->drain(rl_ptr, check_message, &d) == 2 && d.next[0] == 2 );
+
+	/* Written to the ring, the queue is empty */
+	ipt_time_value_t tv = { 0, 0 };
+
+	assert ( rl_ptr->dequeue_timed(rl_ptr, &tv) == NULL );
+}
+
+static void
+copy_message(const ipt_logger_message_t *const msg_ptr, void *in_ptr)
+{
+	memcpy(in_ptr, msg_ptr, sizeof(ipt_logger_message_t) + msg_ptr->length);
+}
+
+/*
+ * Binary messages are formatted when they are read, through a ring and through the shared queue.
+ */
+static void
+test_4()
+{
+	ipt_logger_t *bl_ptr = ipt_logger_create_with_rings("logger_binary", alloc_ptr, 1, RING_SIZE);
+	const char *fmt = "int %d long %-4ld size %zu long long %lld double %.2f string %s char %c %%";
+	ipt_shared_queue_t *sq_ptr;
+	uint64_t buf[2][LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf[0], *raw = (ipt_logger_message_t *)buf[1], *msg_ptr;
+	char expected[LOGGER_MAX_MESSAGE_SIZE];
+	char long_string[LOGGER_MAX_MESSAGE_SIZE + 100];
+	int format;
+
+	assert ( bl_ptr != NULL );
+
+	bl_ptr->set_category(bl_ptr, IPT_MODULE_ALL);
+	bl_ptr->set_level(bl_ptr, IPT_LEVEL_ALL);
+
+	assert ( (format = bl_ptr->register_format(bl_ptr, fmt)) > 0 );
+	assert ( bl_ptr->register_format(bl_ptr, fmt) == format );
+	assert ( bl_ptr->register_format(bl_ptr, "%s") == format + 1 );
+
+	/* Not supported */
+	assert ( bl_ptr->register_format(bl_ptr, "%n") < 0 );
+	assert ( bl_ptr->register_format(bl_ptr, "%*d") < 0 );
+	assert ( bl_ptr->register_format(bl_ptr, "%Lf") < 0 );
+	assert ( bl_ptr->register_format(bl_ptr, "%d %") < 0 );
+
+	assert ( bl_ptr->enqueue_binary(bl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "binary", 0, 1) < 0 );
+
+	assert ( bl_ptr->enqueue_binary(bl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "binary", format, -1, 2L, (size_t)3, 4LL, 5.5, "six", '7') == 0 );
+
+	assert ( bl_ptr->drain(bl_ptr, copy_message, msg) == 1 );
+
+	snprintf(expected, sizeof(expected), fmt, -1, 2L, (size_t)3, 4LL, 5.5, "six", '7');
+
+	assert ( msg->format == 0 && strcmp(msg->message, expected) == 0 );
+	assert ( strcmp(msg->originator, "binary") == 0 && msg->time[0] != '\0' && msg->timestamp > 0 );
+
+	/* The string is cut so the number after it still fits */
+	memset(long_string, 'x', sizeof(long_string) - 1);
+	long_string[sizeof(long_string) - 1] = '\0';
+
+	IPT_LOG_BINARY(bl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "binary", "%s %d", long_string, 42);
+
+	assert ( bl_ptr->drain(bl_ptr, copy_message, msg) == 1 );
+
+	assert ( strlen(msg->message) < LOGGER_MAX_MESSAGE_SIZE && strcmp(msg->message + strlen(msg->message) - 3, " 42") == 0 );
+
+	/* The record on the shared queue is formatted by the reader */
+	assert ( (format = lg_ptr->register_format(lg_ptr, "value %d")) > 0 );
+	assert ( lg_ptr->enqueue_binary(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "binary", format, 8) == 0 );
+
+	assert ( (sq_ptr = ipt_shared_queue_attach("logger_queue.sq", alloc_ptr)) != NULL );
+	assert ( (msg_ptr = (ipt_logger_message_t *)sq_ptr->dequeue(sq_ptr)) != NULL );
+
+	assert ( msg_ptr->format == format && msg_ptr->length == sizeof(int64_t) );
+	assert ( ipt_logger_format_message(lg_ptr, msg_ptr, msg) == 0 && strcmp(msg->message, "value 8") == 0 );
+
+	/* Formatted in place, in a buffer large enough */
+	memcpy(raw, msg_ptr, sizeof(ipt_logger_message_t) + msg_ptr->length);
+
+	assert ( ipt_logger_format_message(lg_ptr, raw, raw) == 0 && strcmp(raw->message, "value 8") == 0 );
+	assert ( strcmp(raw->time, msg->time) == 0 && raw->length == strlen("value 8") + 1 );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+}
+
+static int evaluated = 0;
+
+static int
+expensive(void)
+{
+	return ++evaluated;
+}
+
+/*
+ * Filtered messages are dropped before anything is evaluated, and the masks can be cleared.
+ */
+static void
+test_5()
+{
+	ipt_logger_t *fl_ptr = ipt_logger_create_with_rings("logger_filter", alloc_ptr, 1, RING_SIZE);
+	uint64_t buf[LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf;
+
+	assert ( fl_ptr != NULL );
+
+	/* Nothing is enabled yet */
+	assert ( fl_ptr->is_enabled(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_DEBUG) == 0 );
+
+	fl_ptr->set_category(fl_ptr, IPT_MODULE_FAULT | IPT_MODULE_MODULE);
+	fl_ptr->set_level(fl_ptr, IPT_LEVEL_ERROR | IPT_LEVEL_DEBUG);
+
+	assert ( fl_ptr->get_category_mask(fl_ptr) == (IPT_MODULE_FAULT | IPT_MODULE_MODULE) );
+	assert ( fl_ptr->is_enabled(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_DEBUG) == 1 );
+
+	fl_ptr->unset_level(fl_ptr, IPT_LEVEL_DEBUG);
+	fl_ptr->unset_category(fl_ptr, IPT_MODULE_MODULE);
+
+	assert ( fl_ptr->get_level_mask(fl_ptr) == IPT_LEVEL_ERROR && fl_ptr->is_level_set(fl_ptr, IPT_LEVEL_DEBUG) == 0 );
+	assert ( fl_ptr->is_category_set(fl_ptr, IPT_MODULE_MODULE) == 0 );
+
+	IPT_LOG(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_DEBUG, "filter", "debug %d", expensive());
+	IPT_LOG(fl_ptr, IPT_MODULE_MODULE, IPT_LEVEL_ERROR, "filter", "module %d", expensive());
+	IPT_LOG_BINARY(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_DEBUG, "filter", "binary %d", expensive());
+
+	assert ( evaluated == 0 );
+
+	assert ( fl_ptr->enqueue(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_DEBUG, "filter", "debug") < 0 );
+	assert ( fl_ptr->drain(fl_ptr, copy_message, msg) == 0 );
+
+	IPT_LOG(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_ERROR, "filter", "error %d", expensive());
+	IPT_LOG_BINARY(fl_ptr, IPT_MODULE_FAULT, IPT_LEVEL_ERROR, "filter", "binary %d", expensive());
+
+	assert ( evaluated == 2 );
+
+	assert ( fl_ptr->drain(fl_ptr, copy_message, msg) == 2 && strcmp(msg->message, "binary 2") == 0 );
+}
+
+/*
+ * Records take the size of their message. Short messages pack into the ring, and long messages are
+ * kept whole, across the end of the ring and through the shared queue.
+ */
+static void
+test_6()
+{
+	ipt_logger_t *vl_ptr = ipt_logger_create_with_rings("logger_sizes", alloc_ptr, 1, RING_SIZE);
+	uint64_t buf[LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf, *msg_ptr;
+	char long_message[3000];
+	int i, count = 0;
+
+	assert ( vl_ptr != NULL );
+
+	/* Too small for the longest message */
+	assert ( ipt_logger_create_with_rings("logger_small", alloc_ptr, 1, 1024) == NULL );
+
+	vl_ptr->set_category(vl_ptr, IPT_MODULE_ALL);
+	vl_ptr->set_level(vl_ptr, IPT_LEVEL_ALL);
+
+	while ( vl_ptr->enqueue(vl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "sizes", "short %d", count) == 0 )
+	{
+		count++;
+	}
+
+	/* Each record is far smaller than the longest message */
+	assert ( count > RING_SIZE / 256 );
+
+	assert ( vl_ptr->drain(vl_ptr, copy_message, msg) == count );
+
+	assert ( msg->length == strlen(msg->message) + 1 );
+
+	memset(long_message, 'y', sizeof(long_message) - 1);
+	long_message[sizeof(long_message) - 1] = '\0';
+
+	/* Several times around the ring */
+	for ( i = 0; i < 4 * RING_SIZE / (int)sizeof(long_message); i++ )
+	{
+		assert ( vl_ptr->enqueue(vl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "sizes", "%d %s", i, long_message) == 0 );
+
+		assert ( vl_ptr->drain(vl_ptr, copy_message, msg) == 1 );
+
+		assert ( atoi(msg->message) == i && strcmp(strchr(msg->message, ' ') + 1, long_message) == 0 );
+	}
+
+	/* Longer than the longest message */
+	for ( i = 0; i < 2; i++ )
+	{
+		vl_ptr->enqueue(vl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "sizes", "%s%s", long_message, long_message);
+	}
+
+	assert ( vl_ptr->drain(vl_ptr, copy_message, msg) == 2 );
+
+	assert ( msg->length == LOGGER_MAX_MESSAGE_SIZE && strlen(msg->message) == LOGGER_MAX_MESSAGE_SIZE - 1 );
+
+	/* The shared queue allocates what the message needs */
+	assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "sizes", "%s", long_message) == 0 );
+
+	assert ( (msg_ptr = lg_ptr->dequeue(lg_ptr)) != NULL );
+
+	assert ( msg_ptr->length == sizeof(long_message) && strcmp(msg_ptr->message, long_message) == 0 );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+}
+
+static uint64_t
+realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * The time string is formatted by the reader from the timestamp, which is read from the clock
+ * the logger is set to.
+ */
+static void
+test_7()
+{
+	ipt_logger_t *cl_ptr = ipt_logger_create_with_rings("logger_clock", alloc_ptr, 1, RING_SIZE);
+	uint64_t buf[LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf, *msg_ptr;
+	uint64_t before, shared;
+	char expected[64];
+	struct tm tm;
+	time_t sec;
+	size_t len;
+
+	assert ( cl_ptr != NULL );
+
+	cl_ptr->set_category(cl_ptr, IPT_MODULE_ALL);
+	cl_ptr->set_level(cl_ptr, IPT_LEVEL_ALL);
+
+	before = realtime_ns();
+
+	assert ( cl_ptr->enqueue(cl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "realtime") == 0 );
+	assert ( cl_ptr->drain(cl_ptr, copy_message, msg) == 1 );
+
+	assert ( msg->timestamp >= before && msg->timestamp <= realtime_ns() );
+
+	sec = msg->timestamp / 1000000000ULL;
+	localtime_r(&sec, &tm);
+	len = strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm);
+	sprintf(expected + len, ":%lu", (unsigned long)(msg->timestamp % 1000000000ULL / 1000000));
+
+	assert ( strcmp(msg->time, expected) == 0 );
+
+	/* The shared clock moves when it is updated */
+	assert ( cl_ptr->set_clock(cl_ptr, (ipt_logger_clock_t)7) < 0 );
+	assert ( cl_ptr->set_clock(cl_ptr, IPT_LOGGER_CLOCK_SHARED) == 0 );
+
+	cl_ptr->update_clock(cl_ptr);
+
+	assert ( cl_ptr->enqueue(cl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "shared") == 0 );
+	assert ( cl_ptr->drain(cl_ptr, copy_message, msg) == 1 );
+
+	shared = msg->timestamp;
+
+	usleep(2000);
+
+	assert ( cl_ptr->enqueue(cl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "shared") == 0 );
+	assert ( cl_ptr->drain(cl_ptr, copy_message, msg) == 1 && msg->timestamp == shared );
+
+	cl_ptr->update_clock(cl_ptr);
+
+	assert ( cl_ptr->enqueue(cl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "shared") == 0 );
+	assert ( cl_ptr->drain(cl_ptr, copy_message, msg) == 1 && msg->timestamp >= shared + 2000000 );
+
+	/* Within a few ticks of the system clock */
+	assert ( cl_ptr->set_clock(cl_ptr, IPT_LOGGER_CLOCK_COARSE) == 0 );
+
+	before = realtime_ns();
+
+	assert ( cl_ptr->enqueue(cl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "coarse") == 0 );
+	assert ( cl_ptr->drain(cl_ptr, copy_message, msg) == 1 );
+
+	assert ( msg->timestamp + 100000000ULL > before && msg->timestamp < realtime_ns() + 100000000ULL );
+
+	/* The time is filled in by the reader of the shared queue too */
+	assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "clock", "queued") == 0 );
+	assert ( (msg_ptr = lg_ptr->dequeue(lg_ptr)) != NULL );
+
+	assert ( msg_ptr->time[0] != '\0' && strchr(msg_ptr->time, ':') != NULL );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+}
+
+static long
+elapsed_us(struct timespec *start)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec - start->tv_sec) * 1000000 + (ts.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void
+count_drained(const ipt_logger_message_t *const msg_ptr, void *in_ptr)
+{
+	(*(int *)in_ptr)++;
+}
+
+/*
+ * Take the messages from the queue, and return the number of the first and the last in *first
+ * and *last. Counts the reports of dropped messages in *reported.
+ */
+static int
+take_all(ipt_logger_t *ol_ptr, int *first, int *last, uint64_t *reported)
+{
+	ipt_time_value_t tv = { 0, 0 };
+	ipt_logger_message_t *msg_ptr;
+	unsigned long long n;
+	int count = 0, seq;
+
+	while ( (msg_ptr = ol_ptr->dequeue_timed(ol_ptr, &tv)) != NULL )
+	{
+		if ( sscanf(msg_ptr->message, "%llu messages dropped", &n) == 1 )
+		{
+			assert ( strcmp(msg_ptr->originator, "storm") == 0 && msg_ptr->lmask == IPT_LEVEL_WARNING );
+
+			*reported += n;
+		}
+		else
+		{
+			assert ( sscanf(msg_ptr->message, "message %d", &seq) == 1 );
+
+			if ( count++ == 0 )
+			{
+				*first = seq;
+			}
+
+			*last = seq;
+		}
+
+		ol_ptr->free(ol_ptr, msg_ptr);
+	}
+
+	return count;
+}
+
+/*
+ * The queue is bounded, the newest or the oldest messages are dropped, or the producer waits
+ * for room. The drops are counted for each originator, and reported by the reader.
+ */
+static void
+test_8()
+{
+	ipt_logger_t *ol_ptr = ipt_logger_create("logger_overflow", alloc_ptr);
+	ipt_logger_t *rl_ptr = ipt_logger_create_with_rings("logger_overflow_rings", alloc_ptr, 1, RING_SIZE);
+	ipt_time_value_t max_wait = { 0, 2000 };
+	ipt_time_value_t interval = { 0, 1000 };
+	uint64_t reported = 0;
+	size_t allocated;
+	struct timespec start;
+	int i, first, last, count, status;
+
+	assert ( ol_ptr != NULL && rl_ptr != NULL );
+
+	allocated = alloc_ptr->bytes_allocated(alloc_ptr);
+
+	ol_ptr->set_category(ol_ptr, IPT_MODULE_ALL);
+	ol_ptr->set_level(ol_ptr, IPT_LEVEL_ALL);
+
+	assert ( ol_ptr->set_overflow(ol_ptr, (ipt_logger_overflow_t)7, 4096, NULL) < 0 );
+	assert ( ol_ptr->set_overflow(ol_ptr, IPT_LOGGER_DROP_NEWEST, 4096, NULL) == 0 );
+	assert ( ol_ptr->set_drop_report(ol_ptr, NULL) == 0 );
+
+	/* The newest are dropped, and take no memory */
+	for ( i = 0, count = 0; i < 100; i++ )
+	{
+		count += ol_ptr->enqueue(ol_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "storm", "message %03d", i) == 0;
+	}
+
+	assert ( count > 10 && count < 100 );
+	assert ( ol_ptr->get_dropped(ol_ptr, "storm") == 100 - count && ol_ptr->get_dropped(ol_ptr, NULL) == 100 - count );
+	assert ( ol_ptr->get_dropped(ol_ptr, "calm") == 0 );
+	assert ( alloc_ptr->bytes_allocated(alloc_ptr) - allocated <= 2 * 4096 );
+
+	assert ( take_all(ol_ptr, &first, &last, &reported) == count && first == 0 && last == count - 1 );
+
+	/* The oldest are dropped */
+	assert ( ol_ptr->set_overflow(ol_ptr, IPT_LOGGER_DROP_OLDEST, 4096, NULL) == 0 );
+
+	for ( i = 0; i < 100; i++ )
+	{
+		assert ( ol_ptr->enqueue(ol_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "storm", "message %03d", i) == 0 );
+	}
+
+	assert ( ol_ptr->get_dropped(ol_ptr, "storm") == 200 - 2 * count );
+
+	assert ( take_all(ol_ptr, &first, &last, &reported) == count && first == 100 - count && last == 99 );
+
+	/* The producer waits for room, and drops the message when none is made */
+	assert ( ol_ptr->set_overflow(ol_ptr, IPT_LOGGER_BLOCK, 4096, &max_wait) == 0 );
+
+	for ( i = 0; i < count; i++ )
+	{
+		assert ( ol_ptr->enqueue(ol_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "storm", "message %03d", i) == 0 );
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	assert ( ol_ptr->enqueue(ol_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "storm", "message %03d", count) < 0 );
+	assert ( elapsed_us(&start) >= 2000 );
+
+	if ( fork() == 0 )
+	{
+		ipt_time_value_t tv = { 1, 0 };
+		ipt_logger_message_t *msg_ptr;
+
+		usleep(5000);
+
+		exit ( (msg_ptr = ol_ptr->dequeue_timed(ol_ptr, &tv)) != NULL && strcmp(msg_ptr->message, "message 000") == 0 ? 0 : 1 );
+	}
+
+	max_wait.tv_sec = 1;
+
+	assert ( ol_ptr->set_overflow(ol_ptr, IPT_LOGGER_BLOCK, 4096, &max_wait) == 0 );
+	assert ( ol_ptr->enqueue(ol_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "storm", "message %03d", count) == 0 );
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	/* All the drops are reported once */
+	assert ( ol_ptr->set_drop_report(ol_ptr, &interval) == 0 );
+
+	usleep(2000);
+
+	assert ( take_all(ol_ptr, &first, &last, &reported) == count && first == 1 && last == count );
+	assert ( reported == ol_ptr->get_dropped(ol_ptr, NULL) && reported == 201 - 2 * count );
+
+	usleep(2000);
+
+	assert ( take_all(ol_ptr, &first, &last, &reported) == 0 && reported == 201 - 2 * count );
+
+	assert ( ol_ptr->set_overflow(ol_ptr, IPT_LOGGER_DROP_NEWEST, 0, NULL) == 0 );
+
+	/* A full ring drops the message, or waits */
+	rl_ptr->set_category(rl_ptr, IPT_MODULE_ALL);
+	rl_ptr->set_level(rl_ptr, IPT_LEVEL_ALL);
+
+	for ( i = 0; rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "ring", "message %d", i) == 0; i++ );
+
+	assert ( i > 10 && rl_ptr->get_dropped(rl_ptr, "ring") == 1 );
+
+	max_wait.tv_sec = 0;
+
+	assert ( rl_ptr->set_overflow(rl_ptr, IPT_LOGGER_BLOCK, 0, &max_wait) == 0 );
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	assert ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "ring", "message %d", i) < 0 );
+	assert ( elapsed_us(&start) >= 2000 && rl_ptr->get_dropped(rl_ptr, "ring") == 2 );
+
+	assert ( rl_ptr->drain(rl_ptr, count_drained, &count) == i );
+}
+
+static int
+log_burst(ipt_logger_t *ll_ptr, const char *originator, ipt_log_category_mask_t category_mask, int count)
+{
+	int i, logged = 0;
+
+	for ( i = 0; i < count; i++ )
+	{
+		logged += ll_ptr->enqueue(ll_ptr, category_mask, IPT_LEVEL_ALL, originator, "message %d", i) == 0;
+	}
+
+	return logged;
+}
+
+/*
+ * The rate limits take a token for each message, for one originator, or for each originator on
+ * its own, and are shared by the processes.
+ */
+static void
+test_9()
+{
+	ipt_logger_t *ll_ptr = ipt_logger_create("logger_rate", alloc_ptr);
+	ipt_time_value_t tv = { 0, 0 };
+	ipt_logger_message_t *msg_ptr;
+	int logged, status;
+
+	assert ( ll_ptr != NULL );
+
+	ll_ptr->set_category(ll_ptr, IPT_MODULE_ALL);
+	ll_ptr->set_level(ll_ptr, IPT_LEVEL_ALL);
+
+	assert ( ll_ptr->set_drop_report(ll_ptr, NULL) == 0 );
+
+	assert ( ll_ptr->set_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT, 0, 10) < 0 );
+	assert ( ll_ptr->set_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT, 100, 0) < 0 );
+	assert ( ll_ptr->set_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT, 100, 10) == 0 );
+
+	/* The burst, and maybe a token or two more while logging */
+	logged = log_burst(ll_ptr, "noisy", IPT_MODULE_FAULT, 50);
+
+	assert ( logged >= 10 && logged <= 12 );
+	assert ( ll_ptr->get_dropped(ll_ptr, "noisy") == 50 - logged );
+
+	/* Other originators and categories are not limited */
+	assert ( log_burst(ll_ptr, "quiet", IPT_MODULE_FAULT, 50) == 50 );
+	assert ( log_burst(ll_ptr, "noisy", IPT_MODULE_MODULE, 50) == 50 );
+
+	/* The bucket refills at the rate */
+	usleep(50000);
+
+	logged = log_burst(ll_ptr, "noisy", IPT_MODULE_FAULT, 20);
+
+	assert ( logged >= 5 && logged <= 8 );
+
+	/* Set again, the rate changes */
+	assert ( ll_ptr->set_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT, 1000000, 1000) == 0 );
+	assert ( log_burst(ll_ptr, "noisy", IPT_MODULE_FAULT, 100) == 100 );
+
+	assert ( ll_ptr->unset_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT) == 0 );
+	assert ( ll_ptr->unset_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT) < 0 );
+
+	/* Each originator has a bucket of its own, shared with the other processes */
+	assert ( ll_ptr->set_rate_limit(ll_ptr, NULL, IPT_MODULE_ALL, 1, 5) == 0 );
+
+	assert ( log_burst(ll_ptr, "a", IPT_MODULE_FAULT, 20) == 5 );
+	assert ( log_burst(ll_ptr, "b", IPT_MODULE_MODULE, 20) == 5 );
+
+	if ( fork() == 0 )
+	{
+		exit ( log_burst(ll_ptr, "a", IPT_MODULE_FAULT, 20) == 0 && log_burst(ll_ptr, "c", IPT_MODULE_FAULT, 20) == 5 ? 0 : 1 );
+	}
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	assert ( ll_ptr->unset_rate_limit(ll_ptr, NULL, IPT_MODULE_ALL) == 0 );
+	assert ( log_burst(ll_ptr, "a", IPT_MODULE_FAULT, 20) == 20 );
+
+	/* A message dropped by one limit takes no token from the others */
+	assert ( ll_ptr->set_rate_limit(ll_ptr, NULL, IPT_MODULE_FAULT, 1, 5) == 0 );
+	assert ( ll_ptr->set_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT, 1, 1) == 0 );
+
+	assert ( log_burst(ll_ptr, "noisy", IPT_MODULE_FAULT, 20) == 1 );
+	assert ( ll_ptr->unset_rate_limit(ll_ptr, "noisy", IPT_MODULE_FAULT) == 0 );
+
+	logged = log_burst(ll_ptr, "noisy", IPT_MODULE_FAULT, 20);
+
+	assert ( logged >= 4 && logged <= 5 );
+	assert ( ll_ptr->unset_rate_limit(ll_ptr, NULL, IPT_MODULE_FAULT) == 0 );
+
+	while ( (msg_ptr = ll_ptr->dequeue_timed(ll_ptr, &tv)) != NULL )
+	{
+		ll_ptr->free(ll_ptr, msg_ptr);
+	}
+}
+
+/*
+ * Structured messages keep their typed fields, and are rendered as text or JSON by the reader,
+ * through a ring and through the shared queue.
+ */
+static void
+test_10()
+{
+	ipt_logger_t *fl_ptr = ipt_logger_create_with_rings("logger_fields", alloc_ptr, 1, RING_SIZE);
+	uint64_t buf[LOGGER_MESSAGE_BUFFER_SIZE / sizeof(uint64_t) + 1];
+	ipt_logger_message_t *msg = (ipt_logger_message_t *)buf, *msg_ptr;
+	char long_value[LOGGER_MAX_MESSAGE_SIZE + 100];
+	char text[LOGGER_MAX_MESSAGE_SIZE];
+	ipt_log_field_t field;
+	size_t pos = 0;
+	int count;
+
+	assert ( fl_ptr != NULL );
+
+	fl_ptr->set_category(fl_ptr, IPT_MODULE_ALL);
+	fl_ptr->set_level(fl_ptr, IPT_LEVEL_ALL);
+
+	/* Typed, as they were logged */
+	assert ( fl_ptr->set_field_format(fl_ptr, (ipt_logger_field_format_t)7) < 0 );
+	assert ( fl_ptr->set_field_format(fl_ptr, IPT_LOGGER_FIELDS_RAW) == 0 );
+
+	IPT_LOG_FIELDS(fl_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "fields", IPT_FIELD_STRING("event", "accept"), IPT_FIELD_INT("fd", -12),
+	               IPT_FIELD_DOUBLE("load", 0.1), IPT_FIELD_TIME("at", 1500000000123456789ULL), IPT_FIELD_STRING("peer", "a \"b\"\n"));
+
+	assert ( fl_ptr->drain(fl_ptr, copy_message, msg) == 1 );
+
+	assert ( msg->format == LOGGER_FORMAT_FIELDS && msg->time[0] != '\0' );
+
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && field.type == IPT_LOG_FIELD_STRING );
+	assert ( strcmp(field.key, "event") == 0 && strcmp(field.value.str.ptr, "accept") == 0 && field.value.str.len == 6 );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && field.type == IPT_LOG_FIELD_INT && field.value.i == -12 );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && field.type == IPT_LOG_FIELD_DOUBLE && field.value.d == 0.1 );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && field.type == IPT_LOG_FIELD_TIME && field.value.time == 1500000000123456789ULL );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && strcmp(field.key, "peer") == 0 );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 0 );
+
+	assert ( ipt_logger_render_fields(msg, IPT_LOGGER_FIELDS_TEXT, text, sizeof(text)) > 0 );
+	assert ( strcmp(text, "event=accept fd=-12 load=0.1 at=2017-07-14T02:40:00.123456789Z peer=\"a \\\"b\\\"\\n\"") == 0 );
+
+	assert ( ipt_logger_render_fields(msg, IPT_LOGGER_FIELDS_JSON, text, sizeof(text)) > 0 );
+	assert ( strcmp(text, "{\"event\":\"accept\",\"fd\":-12,\"load\":0.1,\"at\":\"2017-07-14T02:40:00.123456789Z\",\"peer\":\"a \\\"b\\\"\\n\"}") == 0 );
+
+	/* The fields that do not fit are left out, the JSON is complete */
+	assert ( ipt_logger_render_fields(msg, IPT_LOGGER_FIELDS_JSON, text, 30) == 27 && strcmp(text, "{\"event\":\"accept\",\"fd\":-12}") == 0 );
+
+	/* Rendered by the reader */
+	assert ( fl_ptr->set_field_format(fl_ptr, IPT_LOGGER_FIELDS_JSON) == 0 );
+
+	assert ( fl_ptr->enqueue_fields(fl_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "fields", IPT_FIELD_INT("n", 1), IPT_FIELD_DOUBLE("inf", 1.0 / 0.0), IPT_FIELD_END) == 0 );
+	assert ( fl_ptr->drain(fl_ptr, copy_message, msg) == 1 );
+
+	assert ( msg->format == 0 && strcmp(msg->message, "{\"n\":1,\"inf\":null}") == 0 && msg->length == strlen(msg->message) + 1 );
+
+	/* Through the shared queue */
+	assert ( fl_ptr->set_field_format(fl_ptr, IPT_LOGGER_FIELDS_TEXT) == 0 );
+	assert ( lg_ptr->set_field_format(lg_ptr, IPT_LOGGER_FIELDS_TEXT) == 0 );
+
+	assert ( lg_ptr->enqueue_fields(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "fields", IPT_FIELD_STRING("empty", ""), IPT_FIELD_DOUBLE("third", 1.0 / 3), IPT_FIELD_END) == 0 );
+	assert ( (msg_ptr = lg_ptr->dequeue(lg_ptr)) != NULL );
+
+	assert ( msg_ptr->format == 0 && strcmp(msg_ptr->message, "empty=\"\" third=0.33333333333333331") == 0 );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+
+	assert ( lg_ptr->set_field_format(lg_ptr, IPT_LOGGER_FIELDS_RAW) == 0 );
+
+	assert ( lg_ptr->enqueue_fields(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "fields", IPT_FIELD_INT("n", 2), IPT_FIELD_END) == 0 );
+	assert ( (msg_ptr = lg_ptr->dequeue(lg_ptr)) != NULL );
+
+	pos = 0;
+
+	assert ( msg_ptr->format == LOGGER_FORMAT_FIELDS && msg_ptr->time[0] != '\0' );
+	assert ( ipt_logger_next_field(msg_ptr, &pos, &field) == 1 && field.value.i == 2 );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+
+	assert ( lg_ptr->set_field_format(lg_ptr, IPT_LOGGER_FIELDS_TEXT) == 0 );
+
+	/* A long string is cut short, and the fields after it that do not fit are left out */
+	memset(long_value, 'x', sizeof(long_value) - 1);
+	long_value[sizeof(long_value) - 1] = '\0';
+
+	assert ( fl_ptr->set_field_format(fl_ptr, IPT_LOGGER_FIELDS_RAW) == 0 );
+	assert ( fl_ptr->enqueue_fields(fl_ptr, IPT_MODULE_ALL, IPT_LEVEL_INFO, "fields", IPT_FIELD_STRING("long", long_value), IPT_FIELD_INT("after", 1), IPT_FIELD_END) == 0 );
+	assert ( fl_ptr->drain(fl_ptr, copy_message, msg) == 1 );
+
+	pos = 0;
+
+	assert ( msg->length == LOGGER_MAX_MESSAGE_SIZE );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 1 && field.value.str.len == LOGGER_MAX_MESSAGE_SIZE - 4 - 5 - 1 );
+	assert ( strlen(field.value.str.ptr) == field.value.str.len );
+	assert ( ipt_logger_next_field(msg, &pos, &field) == 0 );
+
+	/* Filtered out, the fields are not recorded */
+	fl_ptr->unset_level(fl_ptr, IPT_LEVEL_DEBUG);
+
+	count = 0;
+	IPT_LOG_FIELDS(fl_ptr, IPT_MODULE_ALL, IPT_LEVEL_DEBUG, "fields", IPT_FIELD_INT("count", ++count));
+
+	assert ( count == 0 && fl_ptr->drain(fl_ptr, copy_message, msg) == 0 );
+
+	/* Text is not structured */
+	assert ( lg_ptr->enqueue(lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "fields", "text") == 0 );
+	assert ( (msg_ptr = lg_ptr->dequeue(lg_ptr)) != NULL );
+
+	pos = 0;
+
+	assert ( ipt_logger_next_field(msg_ptr, &pos, &field) == 0 );
+	assert ( ipt_logger_render_fields(msg_ptr, IPT_LOGGER_FIELDS_JSON, text, sizeof(text)) < 0 );
+
+	lg_ptr->free(lg_ptr, msg_ptr);
+}
+
+/*
+ * The child of a fork does not write to the ring of its parent, it looks for a ring of its own.
+ */
+static void
+test_11()
+{
+	ipt_logger_t *rl_ptr = ipt_logger_create_with_rings("logger_fork", alloc_ptr, 1, RING_SIZE);
+	ipt_time_value_t tv = { 0, 0 };
+	ipt_logger_message_t *msg_ptr;
+	struct drained d;
+	int status;
+
+	assert ( rl_ptr != NULL );
+
+	rl_ptr->set_category(rl_ptr, IPT_MODULE_ALL);
+	rl_ptr->set_level(rl_ptr, IPT_LEVEL_ALL);
+
+	memset(&d, 0, sizeof(d));
+
+	/* The parent claims the only ring */
+	assert ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer 0", "message %d", 0) == 0 );
+
+	if ( fork() == 0 )
+	{
+		exit ( rl_ptr->enqueue(rl_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, "producer 1", "message %d", 0) == 0 ? 0 : 1 );
+	}
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	/* The parent owns the ring, so the child logged through the shared queue */
+	assert ( (msg_ptr = rl_ptr->dequeue_timed(rl_ptr, &tv)) != NULL );
+	assert ( strcmp(msg_ptr->originator, "producer 1") == 0 );
+
+	rl_ptr->free(rl_ptr, msg_ptr);
+
+	assert ( rl_ptr->drain(rl_ptr, check_message, &d) == 1 && d.next[0] == 1 );
+}
+
+struct thread_producer
+{
+	ipt_logger_t *lg_ptr;
+	int id;
+};
+
+static void *
+thread_produce(void *arg)
+{
+	struct thread_producer *tp = arg;
+	char originator[32];
+	int seq = 0;
+
+	sprintf(originator, "producer %d", tp->id);
+
+	while ( seq < NUMBER_OF_MESSAGES )
+	{
+		/* Full until the collector catches up */
+		if ( tp->lg_ptr->enqueue(tp->lg_ptr, IPT_MODULE_ALL, IPT_LEVEL_ALL, originator, "message %d", seq) == 0 )
+		{
+			seq++;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * The threads of a process share its ring. Each thread's messages are read whole and in order.
+ */
+static void
+test_12()
+{
+	ipt_logger_t *rl_ptr = ipt_logger_create_with_rings("logger_threads", alloc_ptr, 1, RING_SIZE);
+	struct thread_producer tp[NUMBER_OF_PRODUCERS];
+	pthread_t tid[NUMBER_OF_PRODUCERS];
+	ipt_time_value_t tv = { 0, 0 };
+	struct drained d;
+	int i;
+
+	assert ( rl_ptr != NULL );
+
+	rl_ptr->set_category(rl_ptr, IPT_MODULE_ALL);
+	rl_ptr->set_level(rl_ptr, IPT_LEVEL_ALL);
+
+	memset(&d, 0, sizeof(d));
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		tp[i].lg_ptr = rl_ptr;
+		tp[i].id = i;
+
+		assert ( pthread_create(&tid[i], NULL, thread_produce, &tp[i]) == 0 );
+	}
+
+	while ( d.count < NUMBER_OF_PRODUCERS * NUMBER_OF_MESSAGES )
+	{
+		assert ( rl_ptr->drain(rl_ptr, check_message, &d) >= 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		pthread_join(tid[i], NULL);
+
+		assert ( d.next[i] == NUMBER_OF_MESSAGES );
+	}
+
+	/* All of them went through the ring */
+	assert ( rl_ptr->drain(rl_ptr, check_message, &d) == 0 );
+	assert ( rl_ptr->dequeue_timed(rl_ptr, &tv) == NULL );
+}
+
 int main(int argc , char *argv[])
 {
 	alloc_ptr = ipt_allocator_shm_create(10*1024*1024, IPT_TEST_ALLOCATOR_SHM_KEY);
@@ -181,6 +1054,26 @@ int main(int argc , char *argv[])
 
 	//test_2();
 
+	test_3();
+
+	test_4();
+
+	test_5();
+
+	test_6();
+
+	test_7();
+
+	test_8();
+
+	test_9();
+
+	test_10();
+
+	test_11();
+
+	test_12();
+
 	alloc_ptr->destroy(alloc_ptr);	
 
 	printf("%s completed successfully.\n",argv[0]);
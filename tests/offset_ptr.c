@@ -9,6 +9,45 @@ struct bob
 	ipt_op_t ptr;
 };
 
+struct compact_bob
+{
+	ipt_cop_t prev;
+	ipt_cop_t next;
+	size_t size;
+};
+
+/*
+ * Compact offsets are scaled, and measured from the aligned address of the pointer
+ * so they work for pointers that are not aligned themselves.
+ */
+static void
+test_compact(void)
+{
+	struct compact_bob arr[4];
+
+	assert ( sizeof(ipt_cop_t) == 4 );
+	assert ( sizeof(struct compact_bob) == sizeof(ipt_cop_t) * 2 + sizeof(size_t) );
+
+	/* Forward and backward */
+	ipt_cop_set(&arr[1].prev, &arr[0]);
+	ipt_cop_set(&arr[1].next, &arr[3]);
+
+	assert ( ipt_cop_drf(&arr[1].prev) == &arr[0] );
+	assert ( ipt_cop_drf(&arr[1].next) == &arr[3] );
+	assert ( ipt_cop_offset(&arr[1].prev) == (char *)&arr[1] - (char *)&arr[0] );
+
+	/* Self */
+	ipt_cop_set(&arr[2].next, &arr[2]);
+
+	assert ( ipt_cop_drf(&arr[2].next) == &arr[2] );
+	assert ( ipt_cop_offset(&arr[2].next) == 0 );
+
+	/* Moving the block keeps the relative pointers valid */
+	arr[2] = arr[1];
+
+	assert ( ipt_cop_drf(&arr[2].prev) == &arr[1] );
+}
+
 int main(int argc, char *argv[])
 {
 	struct bob b = {1,2};
@@ -17,6 +56,8 @@ int main(int argc, char *argv[])
 
 	assert ( *((unsigned int *)ipt_op_drf(&b.ptr)) == 1 );
 
+	test_compact();
+
 	printf(" %s completed successfully\n", argv[0]);
 
 	return 0;
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "reactor.h"
+
+static int total_timeouts = 0;
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	int fd;
+	int reads;
+	int timeouts;
+	int closed;
+	int notified;
+};
+
+int handle_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct test_handler *th = (struct test_handler *)this;
+	char c;
+
+	/* Only take one byte, level triggered handlers are called again for the rest */
+	assert ( read(h, &c, 1) == 1 );
+
+	th->reads++;
+
+	return 0;
+}
+
+int notify_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	((struct test_handler *)this)->notified++;
+	return 0;
+}
+
+int handle_timeout(ipt_event_handler_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	((struct test_handler *)this)->timeouts++;
+	total_timeouts++;
+	return 0;
+}
+
+int handle_close(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask)
+{
+	((struct test_handler *)this)->closed++;
+	return 0;
+}
+
+int get_handle(ipt_event_handler_t *this)
+{
+	return ((struct test_handler *)this)->fd;
+}
+
+void test_handler_init(struct test_handler *this, int fd)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->fd = fd;
+	this->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) handle_input;
+	this->eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *tv, const void *act)) handle_timeout;
+	this->eh.handle_close = (int (*)(ipt_event_handler_t *, ipt_handle_t, ipt_event_handler_mask_t mask)) handle_close;
+	this->eh.get_handle = (int (*)(ipt_event_handler_t *)) get_handle;
+}
+
+/*
+ * Level triggered handlers are dispatched until the pipe is drained.
+ */
+static void
+test_1(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	ipt_time_value_t tv = {0,100000};
+	int pfd[2], i;
+
+	assert ( pipe(pfd) == 0 );
+
+	test_handler_init(&th, pfd[0]);
+
+	assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&th, EVENT_HANDLER_READ_MASK) == 0 );
+
+	assert ( write(pfd[1], "abc", 3) == 3 );
+
+	for ( i = 0; i < 5; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	assert ( th.reads == 3 );
+
+	assert ( reactor->remove_handler(reactor, (ipt_event_handler_t *)&th, EVENT_HANDLER_READ_MASK) == 0 );
+	assert ( th.closed == 1 );
+
+	/* No longer dispatched once removed */
+	assert ( write(pfd[1], "d", 1) == 1 );
+
+	tv.tv_sec = 0; tv.tv_usec = 100000;
+	reactor->run_event_loop(reactor, &tv);
+
+	assert ( th.reads == 3 );
+
+	close(pfd[0]);
+	close(pfd[1]);
+}
+
+/*
+ * Edge triggered handlers are dispatched once per write, even though a byte is left behind.
+ */
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	ipt_time_value_t tv;
+	int pfd[2], i;
+
+	assert ( pipe(pfd) == 0 );
+
+	test_handler_init(&th, pfd[0]);
+
+	assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&th, EVENT_HANDLER_READ_MASK | EVENT_HANDLER_EDGE_TRIGGERED_MASK) == 0 );
+
+	assert ( write(pfd[1], "ab", 2) == 2 );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	assert ( th.reads == 1 );
+
+	assert ( write(pfd[1], "c", 1) == 1 );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	assert ( th.reads == 2 );
+
+	assert ( reactor->remove_handler(reactor, (ipt_event_handler_t *)&th, EVENT_HANDLER_READ_MASK) == 0 );
+
+	close(pfd[0]);
+	close(pfd[1]);
+}
+
+/*
+ * Timers and notifications use the same wait as the descriptors. The sub-millisecond
+ * interval must not be rounded down to a busy loop or up past the deadline by much.
+ */
+static void
+test_3(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	ipt_time_value_t one_shot = {0,500};
+	ipt_time_value_t interval = {0,500};
+	ipt_time_value_t tv;
+	int i;
+
+	test_handler_init(&th, -1);
+
+	assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)&th, &one_shot, &interval, NULL) == 0 );
+
+	for ( i = 0; i < 10; i++ )
+	{
+		tv.tv_sec = 2; tv.tv_usec = 0;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	assert ( th.timeouts >= 10 );
+
+	assert ( reactor->remove_timer(reactor, (ipt_event_handler_t *)&th) == 0 );
+
+	th.eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) notify_input;
+
+	tv.tv_sec = 1;
+	assert ( reactor->notify(reactor, (ipt_event_handler_t *)&th, EVENT_HANDLER_READ_MASK, &tv) == 0 );
+
+	tv.tv_sec = 2; tv.tv_usec = 0;
+	reactor->run_event_loop(reactor, &tv);
+
+	assert ( th.notified == 1 );
+}
+
+/*
+ * Many more handlers and timers than the old fixed tables held. Every handle is used as
+ * an index, and every timer is found through the handler to timer map.
+ */
+#define NUMBER_OF_PIPES  (200)
+#define NUMBER_OF_TIMERS (10000)
+
+static void
+test_4(ipt_reactor_t *reactor)
+{
+	struct test_handler *ths = calloc(NUMBER_OF_PIPES, sizeof(struct test_handler));
+	struct test_handler *tms = calloc(NUMBER_OF_TIMERS, sizeof(struct test_handler));
+	struct test_handler dup;
+	ipt_time_value_t one_shot = {0,1000};
+	ipt_time_value_t tv;
+	int pfd[NUMBER_OF_PIPES][2];
+	int i, reads = 0, timeouts = 0;
+
+	assert ( ths && tms );
+
+	for ( i = 0; i < NUMBER_OF_PIPES; i++ )
+	{
+		assert ( pipe(pfd[i]) == 0 );
+
+		test_handler_init(&ths[i], pfd[i][0]);
+
+		assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+	}
+
+	/* A second handler for the same handle is refused */
+	test_handler_init(&dup, pfd[0][0]);
+
+	assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&dup, EVENT_HANDLER_READ_MASK) < 0 );
+
+	for ( i = 0; i < NUMBER_OF_PIPES; i += 7 )
+	{
+		assert ( write(pfd[i][1], "x", 1) == 1 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_TIMERS; i++ )
+	{
+		test_handler_init(&tms[i], -1);
+
+		assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)&tms[i], &one_shot, NULL, NULL) == 0 );
+	}
+
+	/* Remove every other timer */
+	for ( i = 0; i < NUMBER_OF_TIMERS; i += 2 )
+	{
+		assert ( reactor->remove_timer(reactor, (ipt_event_handler_t *)&tms[i]) == 0 );
+		assert ( reactor->remove_timer(reactor, (ipt_event_handler_t *)&tms[i]) < 0 );
+	}
+
+	/* Scheduling takes a while, so the timers expire over several passes */
+	total_timeouts = 0;
+
+	for ( i = 0; i < 3 || ( total_timeouts < NUMBER_OF_TIMERS / 2 && i < 100 ); i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	for ( i = 0; i < NUMBER_OF_PIPES; i++ )
+	{
+		reads += ths[i].reads;
+
+		assert ( ths[i].reads == (i % 7 == 0) );
+		assert ( reactor->remove_handler(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+
+		close(pfd[i][0]);
+		close(pfd[i][1]);
+	}
+
+	for ( i = 0; i < NUMBER_OF_TIMERS; i++ )
+	{
+		timeouts += tms[i].timeouts;
+
+		assert ( tms[i].timeouts == i % 2 );
+	}
+
+	assert ( reads == (NUMBER_OF_PIPES + 6) / 7 );
+	assert ( timeouts == NUMBER_OF_TIMERS / 2 );
+
+	free(ths);
+	free(tms);
+}
+
+int main(int argc , char *argv[])
+{
+	ipt_reactor_t *reactor = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL);
+
+	assert ( reactor != NULL );
+
+	test_1(reactor);
+
+	test_2(reactor);
+
+	test_3(reactor);
+
+	test_4(reactor);
+
+	reactor->destroy(reactor);
+
+	/* The select reactor uses the same tables */
+	assert ( (reactor = ipt_reactor_create()) != NULL );
+
+	test_4(reactor);
+
+	reactor->destroy(reactor);
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "reactor_group.h"
+#include "acceptor_handler.h"
+
+#define NUMBER_OF_LOOPS    (4)
+#define NUMBER_OF_HANDLERS (16)
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	volatile int reads;
+	volatile int notified;
+	pthread_t thread;
+	pthread_t notify_thread;
+};
+
+int handle_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct test_handler *th = (struct test_handler *)this;
+	char c;
+
+	if ( read(h, &c, 1) != 1 )
+	{
+		return -1;
+	}
+
+	th->thread = pthread_self();
+	__atomic_add_fetch(&th->reads, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int handle_output(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct test_handler *th = (struct test_handler *)this;
+
+	th->notify_thread = pthread_self();
+	__atomic_add_fetch(&th->notified, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int set_handle(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	this->_h = h;
+	return 0;
+}
+
+int get_handle(ipt_event_handler_t *this)
+{
+	return this->_h;
+}
+
+void test_handler_init(struct test_handler *this, int fd)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->eh._h = fd;
+	this->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) handle_input;
+	this->eh.handle_output = (int (*)(ipt_event_handler_t *, ipt_handle_t )) handle_output;
+	this->eh.set_handle = (int (*)(ipt_event_handler_t *, ipt_handle_t )) set_handle;
+	this->eh.get_handle = (int (*)(ipt_event_handler_t *)) get_handle;
+}
+
+/*
+ * Wait up to two seconds for the loops to bring the count up.
+ */
+static int
+wait_for(volatile int *count, int value)
+{
+	int i;
+
+	for ( i = 0; i < 2000 && __atomic_load_n(count, __ATOMIC_ACQUIRE) < value; i++ )
+	{
+		usleep(1000);
+	}
+
+	return __atomic_load_n(count, __ATOMIC_ACQUIRE) >= value;
+}
+
+/*
+ * Count the distinct loop threads that dispatched the handlers. Each thread must have dispatched
+ * the same number of handlers.
+ */
+static int
+count_threads(struct test_handler *ths, int n)
+{
+	pthread_t threads[NUMBER_OF_LOOPS];
+	int counts[NUMBER_OF_LOOPS];
+	int i, j, num_threads = 0;
+
+	for ( i = 0; i < n; i++ )
+	{
+		for ( j = 0; j < num_threads && !pthread_equal(threads[j], ths[i].thread); j++ );
+
+		if ( j == num_threads )
+		{
+			assert ( num_threads < NUMBER_OF_LOOPS );
+
+			threads[num_threads] = ths[i].thread;
+			counts[num_threads++] = 0;
+		}
+
+		counts[j]++;
+	}
+
+	for ( j = 0; j < num_threads; j++ )
+	{
+		assert ( counts[j] == n / num_threads );
+	}
+
+	return num_threads;
+}
+
+/*
+ * Handlers registered from outside the loops are passed to them round robin, and are dispatched
+ * on their loop's thread. Notifications from this thread are dispatched there as well.
+ */
+static void
+test_1(void)
+{
+	ipt_reactor_group_t *group = ipt_reactor_group_create(NUMBER_OF_LOOPS, IPT_REACTOR_EPOLL, IPT_REACTOR_GROUP_ROUND_ROBIN);
+	struct test_handler ths[NUMBER_OF_HANDLERS];
+	int sv[NUMBER_OF_HANDLERS][2];
+	unsigned int i;
+
+	assert ( group != NULL && group->size(group) == NUMBER_OF_LOOPS );
+	assert ( group->get_reactor(group, NUMBER_OF_LOOPS) == NULL );
+
+	assert ( group->start(group) == 0 );
+	assert ( group->start(group) < 0 );
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) == 0 );
+
+		test_handler_init(&ths[i], sv[i][0]);
+
+		assert ( group->register_handler(group, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( write(sv[i][1], "x", 1) == 1 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( wait_for(&ths[i].reads, 1) );
+		assert ( !pthread_equal(ths[i].thread, pthread_self()) );
+	}
+
+	assert ( count_threads(ths, NUMBER_OF_HANDLERS) == NUMBER_OF_LOOPS );
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		ipt_reactor_t *reactor = group->get_reactor(group, i);
+
+		assert ( reactor->num_handlers(reactor) == NUMBER_OF_HANDLERS / NUMBER_OF_LOOPS );
+	}
+
+	/* Notify each handler through the queue of the loop that owns it */
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		ipt_reactor_t *reactor = group->get_reactor(group, i % NUMBER_OF_LOOPS);
+
+		assert ( reactor->notify(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_WRITE_MASK, NULL) == 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( wait_for(&ths[i].notified, 1) );
+		assert ( pthread_equal(ths[i].notify_thread, ths[i].thread) );
+	}
+
+	assert ( group->stop(group) == 0 );
+	assert ( group->stop(group) < 0 );
+
+	group->destroy(group);
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+}
+
+/*
+ * The least loaded loop takes the next handler. The loops are not running, so the handlers are
+ * registered directly. The reactors' own descriptors are not part of the load.
+ */
+static void
+test_2(void)
+{
+	ipt_reactor_group_t *group = ipt_reactor_group_create(NUMBER_OF_LOOPS, IPT_REACTOR_SELECT | IPT_REACTOR_SIGNALFD | IPT_REACTOR_TIMERFD, IPT_REACTOR_GROUP_LEAST_LOADED);
+	struct test_handler ths[NUMBER_OF_HANDLERS];
+	int sv[NUMBER_OF_HANDLERS][2];
+	ipt_reactor_t *reactor;
+	unsigned int i;
+
+	assert ( group != NULL );
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( socketpair(AF_UNIX, SOCK_STREAM, 0, sv[i]) == 0 );
+
+		test_handler_init(&ths[i], sv[i][0]);
+	}
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		reactor = group->get_reactor(group, i);
+
+		assert ( reactor->num_handlers(reactor) == 0 );
+	}
+
+	/* Load the first loop */
+	reactor = group->get_reactor(group, 0);
+
+	for ( i = 0; i < 3; i++ )
+	{
+		assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+	}
+
+	for ( ; i < 3 + 3 * (NUMBER_OF_LOOPS - 1); i++ )
+	{
+		assert ( group->next_reactor(group) != reactor );
+		assert ( group->register_handler(group, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		reactor = group->get_reactor(group, i);
+
+		assert ( reactor->num_handlers(reactor) == 3 );
+	}
+
+	group->destroy(group);
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+}
+
+/*
+ * The acceptor runs on the first loop and spreads the connections over the group.
+ */
+static struct test_handler conns[NUMBER_OF_LOOPS];
+static volatile int num_conns = 0;
+
+static ipt_event_handler_t *
+create_conn(ipt_acceptor_handler_t *ah_ptr)
+{
+	struct test_handler *th = &conns[num_conns++];
+
+	test_handler_init(th, -1);
+
+	return (ipt_event_handler_t *)th;
+}
+
+static void
+test_3(void)
+{
+	ipt_reactor_group_t *group = ipt_reactor_group_create(NUMBER_OF_LOOPS, IPT_REACTOR_EPOLL, IPT_REACTOR_GROUP_ROUND_ROBIN);
+	ipt_acceptor_handler_t *ah_ptr;
+	ipt_reactor_t *reactor;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd, cfd[NUMBER_OF_LOOPS], i;
+
+	assert ( group != NULL );
+	assert ( (ah_ptr = ipt_acceptor_handler_create_with_group(group, create_conn)) != NULL );
+
+	assert ( (lfd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 );
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	assert ( bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 );
+	assert ( listen(lfd, NUMBER_OF_LOOPS) == 0 );
+	assert ( getsockname(lfd, (struct sockaddr *)&addr, &len) == 0 );
+
+	/* Registered before the loops start, so this thread still owns the reactor */
+	ah_ptr->eh.set_handle((ipt_event_handler_t *)ah_ptr, lfd);
+
+	reactor = group->get_reactor(group, 0);
+
+	assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)ah_ptr, EVENT_HANDLER_READ_MASK) == 0 );
+
+	assert ( group->start(group) == 0 );
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		assert ( (cfd[i] = socket(AF_INET, SOCK_STREAM, 0)) >= 0 );
+		assert ( connect(cfd[i], (struct sockaddr *)&addr, sizeof(addr)) == 0 );
+		assert ( write(cfd[i], "x", 1) == 1 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		assert ( wait_for(&num_conns, i + 1) );
+		assert ( wait_for(&conns[i].reads, 1) );
+	}
+
+	assert ( ah_ptr->num_cons == NUMBER_OF_LOOPS );
+	assert ( count_threads(conns, NUMBER_OF_LOOPS) == NUMBER_OF_LOOPS );
+
+	group->destroy(group);
+
+	for ( i = 0; i < NUMBER_OF_LOOPS; i++ )
+	{
+		close(conns[i].eh._h);
+		close(cfd[i]);
+	}
+
+	close(lfd);
+	free(ah_ptr);
+}
+
+int main(int argc , char *argv[])
+{
+	test_1();
+
+	test_2();
+
+	test_3();
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -4,6 +4,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "reactor.h"
 
@@ -48,6 +50,138 @@ void test_handler_init(struct test_handler *this)
 	this->eh.handle_close = (int (*)(ipt_event_handler_t *, ipt_handle_t, ipt_event_handler_mask_t mask)) handle_close;
 }
 
+/*
+ * Notifications from other threads. A thread waits for each notification to be handled before 
+ * sending the next, so a lost wakeup leaves the reactor asleep for the whole interval.
+ */
+#define NUMBER_OF_PING_PONGS (10000)
+#define NUMBER_OF_PRODUCERS  (4)
+#define NUMBER_OF_BURSTS     (100000)
+
+struct thread_handler
+{
+	ipt_event_handler_t eh;
+	volatile unsigned int sent;
+	volatile unsigned int seen;
+	unsigned int upcalls;
+	ipt_reactor_t *reactor;
+};
+
+static volatile int producers_done = 0;
+
+int thread_handle_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct thread_handler *th = (struct thread_handler *)this;
+
+	th->upcalls++;
+
+	/* Everything sent before the notification was queued is visible */
+	__atomic_store_n(&th->seen, __atomic_load_n(&th->sent, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static void *
+ping(void *arg)
+{
+	struct thread_handler *th = arg;
+	ipt_time_value_t tv = {1,0};
+	unsigned int i;
+
+	for ( i = 1; i <= NUMBER_OF_PING_PONGS; i++ )
+	{
+		__atomic_store_n(&th->sent, i, __ATOMIC_RELEASE);
+
+		assert ( th->reactor->notify(th->reactor, (ipt_event_handler_t *)th, EVENT_HANDLER_READ_MASK, &tv) == 0 );
+
+		while ( __atomic_load_n(&th->seen, __ATOMIC_ACQUIRE) != i )
+		{
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void *
+burst(void *arg)
+{
+	struct thread_handler *th = arg;
+	ipt_time_value_t tv = {10,0};
+	unsigned int i;
+
+	for ( i = 1; i <= NUMBER_OF_BURSTS; i++ )
+	{
+		__atomic_store_n(&th->sent, i, __ATOMIC_RELEASE);
+
+		assert ( th->reactor->notify(th->reactor, (ipt_event_handler_t *)th, EVENT_HANDLER_READ_MASK, &tv) == 0 );
+	}
+
+	__atomic_add_fetch(&producers_done, 1, __ATOMIC_SEQ_CST);
+
+	return NULL;
+}
+
+static void
+test_threads(ipt_reactor_t *r)
+{
+	struct thread_handler th[NUMBER_OF_PRODUCERS];
+	pthread_t tid[NUMBER_OF_PRODUCERS];
+	ipt_time_value_t tv;
+	int i;
+
+	memset(th, 0, sizeof(th));
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		th[i].eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) thread_handle_input;
+		th[i].reactor = r;
+	}
+
+	/* Ping pong with a single thread */
+	assert ( pthread_create(&tid[0], NULL, ping, &th[0]) == 0 );
+
+	while ( th[0].seen != NUMBER_OF_PING_PONGS )
+	{
+		tv.tv_sec = 30; tv.tv_usec = 0;
+		r->run_event_loop(r, &tv);
+	}
+
+	pthread_join(tid[0], NULL);
+
+	assert ( th[0].upcalls == NUMBER_OF_PING_PONGS );
+
+	/* Bursts from several threads, more than the queue holds. Repeats are coalesced. */
+	memset(th, 0, sizeof(th));
+
+	producers_done = 0;
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		th[i].eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) thread_handle_input;
+		th[i].reactor = r;
+
+		assert ( pthread_create(&tid[i], NULL, burst, &th[i]) == 0 );
+	}
+
+	while ( producers_done != NUMBER_OF_PRODUCERS )
+	{
+		tv.tv_sec = 30; tv.tv_usec = 0;
+		r->run_event_loop(r, &tv);
+	}
+
+	tv.tv_sec = 0; tv.tv_usec = 0;
+	r->run_event_loop(r, &tv);
+
+	for ( i = 0; i < NUMBER_OF_PRODUCERS; i++ )
+	{
+		pthread_join(tid[i], NULL);
+
+		assert ( th[i].seen == NUMBER_OF_BURSTS );
+		assert ( th[i].upcalls >= 1 && th[i].upcalls <= NUMBER_OF_BURSTS );
+	}
+}
+
 int main(int argc , char *argv[])
 {
 
@@ -78,6 +212,21 @@ int main(int argc , char *argv[])
 
 	assert ( count == NUMBER_OF_NOTIFICATIONS + 1 );
 
+	/* The handler above notifies itself on every upcall, so use new reactors */
+	reactor->destroy(reactor);
+
+	reactor = ipt_reactor_create();
+
+	test_threads(reactor);
+
+	reactor->destroy(reactor);
+
+	reactor = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL);
+
+	test_threads(reactor);
+
+	reactor->destroy(reactor);
+
 	printf(" %s completed successfully\n", argv[0]);
 
    	return 0;
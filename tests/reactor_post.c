@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "reactor.h"
+
+#define NUMBER_OF_HANDLERS (2)
+#define SLOW_WORK          (2000) /* microseconds */
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	ipt_reactor_t *reactor;
+	int fd;
+	int id;
+};
+
+/* The order the upcalls and the work ran in */
+static char trace[64];
+static int trace_len = 0;
+
+/* Output marked by the upcalls, and the flushes of the idle callback */
+static int dirty = 0;
+static int flushes = 0;
+static int flushed = 0;
+
+static void
+record(char c)
+{
+	assert ( trace_len < (int)sizeof(trace) - 1 );
+
+	trace[trace_len++] = c;
+}
+
+static void
+work(void *arg)
+{
+	record(*(char *)arg);
+}
+
+static void
+slow_work(void *arg)
+{
+	usleep(SLOW_WORK);
+
+	(*(int *)arg)++;
+}
+
+static void
+repost_work(void *arg)
+{
+	struct test_handler *th = arg;
+
+	if ( ++th->id < 5 )
+	{
+		assert ( th->reactor->post(th->reactor, repost_work, th) == 0 );
+	}
+}
+
+static int
+flush(void *arg)
+{
+	flushes++;
+	flushed += dirty;
+	dirty = 0;
+
+	return 0;
+}
+
+int handle_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct test_handler *th = (struct test_handler *)this;
+	static char work_id = 'w';
+	char c;
+
+	assert ( read(h, &c, 1) == 1 );
+
+	record('0' + th->id);
+
+	dirty++;
+
+	return th->id == 0 ? th->reactor->post(th->reactor, work, &work_id) : 0;
+}
+
+int get_handle(ipt_event_handler_t *this)
+{
+	return ((struct test_handler *)this)->fd;
+}
+
+void test_handler_init(struct test_handler *this, ipt_reactor_t *reactor, int fd, int id)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->reactor = reactor;
+	this->fd = fd;
+	this->id = id;
+	this->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) handle_input;
+	this->eh.get_handle = (int (*)(ipt_event_handler_t *)) get_handle;
+}
+
+static int
+run_once(ipt_reactor_t *reactor, long usec)
+{
+	ipt_time_value_t tv = { 0, usec };
+
+	int rtn = reactor->run_event_loop(reactor, &tv);
+
+	assert ( rtn >= 0 );
+
+	return rtn;
+}
+
+static long
+elapsed_usec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (now.tv_sec - start->tv_sec) * 1000000 + now.tv_usec - start->tv_usec;
+}
+
+/*
+ * Work posted by an upcall runs after all the upcalls of the pass. An idle callback flushes the
+ * output of both upcalls at once.
+ */
+static void
+test_1(ipt_reactor_t *reactor)
+{
+	struct test_handler ths[NUMBER_OF_HANDLERS];
+	int pfd[NUMBER_OF_HANDLERS][2], i;
+
+	trace_len = 0;
+	dirty = flushes = flushed = 0;
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( pipe(pfd[i]) == 0 );
+
+		test_handler_init(&ths[i], reactor, pfd[i][0], i);
+
+		assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK) == 0 );
+	}
+
+	assert ( reactor->on_idle(reactor, flush, NULL) == 0 );
+	assert ( reactor->on_idle(reactor, flush, NULL) < 0 );
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( write(pfd[i][1], "x", 1) == 1 );
+	}
+
+	/* Both reads, and the posted work */
+	assert ( run_once(reactor, 100000) == 3 );
+
+	assert ( trace_len == 3 && trace[2] == 'w' );
+	assert ( flushes == 1 && flushed == 2 && dirty == 0 );
+
+	/* The idle callback runs on every pass */
+	assert ( run_once(reactor, 1000) == 0 && flushes == 2 && flushed == 2 );
+
+	assert ( reactor->remove_idle(reactor, flush, NULL) == 0 );
+	assert ( reactor->remove_idle(reactor, flush, NULL) < 0 );
+
+	assert ( run_once(reactor, 1000) == 0 && flushes == 2 );
+
+	for ( i = 0; i < NUMBER_OF_HANDLERS; i++ )
+	{
+		assert ( reactor->remove_handler(reactor, (ipt_event_handler_t *)&ths[i], EVENT_HANDLER_READ_MASK | EVENT_HANDLER_DONT_CALL_MASK) == 0 );
+
+		close(pfd[i][0]);
+		close(pfd[i][1]);
+	}
+
+	assert ( reactor->post(reactor, NULL, NULL) < 0 );
+	assert ( reactor->on_idle(reactor, NULL, NULL) < 0 );
+}
+
+/*
+ * Work that does not fit in the budget waits for the next pass, which does not wait for events.
+ * Work posted by the work runs on the next pass.
+ */
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	ipt_time_value_t budget = { 0, SLOW_WORK / 2 };
+	ipt_time_value_t invalid = { 0, 1000000 };
+	struct test_handler th;
+	struct timeval start;
+	int count = 0, i;
+
+	assert ( reactor->set_budget(reactor, &invalid) < 0 );
+	assert ( reactor->set_budget(reactor, &budget) == 0 );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		assert ( reactor->post(reactor, slow_work, &count) == 0 );
+	}
+
+	gettimeofday(&start, NULL);
+
+	for ( i = 1; i <= 3; i++ )
+	{
+		assert ( run_once(reactor, 500000) == 1 && count == i );
+	}
+
+	/* None of the passes waited */
+	assert ( elapsed_usec(&start) < 500000 );
+
+	/* A large budget still runs reposted work a pass at a time */
+	budget.tv_sec = 1; budget.tv_usec = 0;
+
+	assert ( reactor->set_budget(reactor, &budget) == 0 );
+
+	test_handler_init(&th, reactor, -1, 0);
+
+	assert ( reactor->post(reactor, repost_work, &th) == 0 );
+
+	for ( i = 1; i <= 5; i++ )
+	{
+		assert ( run_once(reactor, 500000) == 1 && th.id == i );
+	}
+
+	assert ( run_once(reactor, 1000) == 0 );
+}
+
+/*
+ * Idle callbacks run once the posted work is done. A callback with more work keeps the loop from
+ * waiting, and the callbacks that did not fit in the budget run first on the next pass.
+ */
+static int idle_calls[2];
+
+static int
+busy_idle(void *arg)
+{
+	int *calls = arg;
+
+	usleep(SLOW_WORK);
+
+	/* More work for the first two calls, then removed on the fourth */
+	return ++(*calls) < 3 ? 1 : (*calls == 4 ? -1 : 0);
+}
+
+static void
+test_3(ipt_reactor_t *reactor)
+{
+	ipt_time_value_t budget = { 0, SLOW_WORK / 2 };
+	struct timeval start;
+	int count = 0;
+
+	memset(idle_calls, 0, sizeof(idle_calls));
+
+	assert ( reactor->set_budget(reactor, &budget) == 0 );
+
+	assert ( reactor->on_idle(reactor, busy_idle, &idle_calls[0]) == 0 );
+	assert ( reactor->on_idle(reactor, busy_idle, &idle_calls[1]) == 0 );
+
+	/* Not idle while there is posted work */
+	assert ( reactor->post(reactor, slow_work, &count) == 0 );
+
+	gettimeofday(&start, NULL);
+
+	assert ( run_once(reactor, 500000) == 1 && count == 1 );
+	assert ( idle_calls[0] == 0 && idle_calls[1] == 0 );
+
+	/* One callback fits in each pass, in turn */
+	assert ( run_once(reactor, 500000) == 0 && idle_calls[0] == 1 && idle_calls[1] == 0 );
+	assert ( run_once(reactor, 500000) == 0 && idle_calls[0] == 1 && idle_calls[1] == 1 );
+	assert ( run_once(reactor, 500000) == 0 && idle_calls[0] == 2 && idle_calls[1] == 1 );
+	assert ( run_once(reactor, 500000) == 0 && idle_calls[0] == 2 && idle_calls[1] == 2 );
+
+	assert ( elapsed_usec(&start) < 500000 );
+
+	/* Both are done after their third call, and removed after their fourth */
+	while ( idle_calls[0] < 4 || idle_calls[1] < 4 )
+	{
+		run_once(reactor, 1000);
+	}
+
+	assert ( run_once(reactor, 1000) == 0 && idle_calls[0] == 4 && idle_calls[1] == 4 );
+
+	assert ( reactor->remove_idle(reactor, busy_idle, &idle_calls[0]) < 0 );
+}
+
+int main(int argc , char *argv[])
+{
+	unsigned int flags[] = { IPT_REACTOR_SELECT, IPT_REACTOR_EPOLL, IPT_REACTOR_URING | IPT_REACTOR_SIGNALFD | IPT_REACTOR_TIMERFD | IPT_REACTOR_STATS };
+	unsigned int i;
+
+	for ( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ )
+	{
+		ipt_reactor_t *reactor = ipt_reactor_create_with_flags(flags[i]);
+
+		assert ( reactor != NULL );
+
+		test_1(reactor);
+
+		test_2(reactor);
+
+		test_3(reactor);
+
+		/* Work left behind is released with the reactor */
+		assert ( reactor->post(reactor, slow_work, NULL) == 0 );
+
+		reactor->destroy(reactor);
+	}
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "reactor.h"
+
+#define NUMBER_OF_SIGNALS (1000)
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	int signals;
+	int last_signum;
+	int timeouts;
+	int closed;
+};
+
+int handle_signal(ipt_event_handler_t *this, int signum)
+{
+	struct test_handler *th = (struct test_handler *)this;
+
+	th->signals++;
+	th->last_signum = signum;
+
+	return 0;
+}
+
+int handle_timeout(ipt_event_handler_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	((struct test_handler *)this)->timeouts++;
+	return 0;
+}
+
+int handle_close(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask)
+{
+	((struct test_handler *)this)->closed++;
+	return 0;
+}
+
+ipt_handle_t get_handle(ipt_event_handler_t *this)
+{
+	return -1;
+}
+
+void test_handler_init(struct test_handler *this)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->eh.handle_signal  = (int (*)(ipt_event_handler_t *, int )) handle_signal;
+	this->eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *tv, const void *act)) handle_timeout;
+	this->eh.handle_close   = (int (*)(ipt_event_handler_t *, ipt_handle_t, ipt_event_handler_mask_t mask)) handle_close;
+	this->eh.get_handle     = (ipt_handle_t (*)(ipt_event_handler_t *)) get_handle;
+}
+
+static long long
+elapsed_us(struct timespec a, struct timespec b)
+{
+	return (a.tv_sec - b.tv_sec) * 1000000LL + (a.tv_nsec - b.tv_nsec) / 1000;
+}
+
+/*
+ * Two reactors in one process, each with its own signal. Signals raised while neither
+ * reactor is waiting are delivered on the next pass.
+ */
+static void
+test_1(ipt_reactor_t *r1, ipt_reactor_t *r2)
+{
+	struct test_handler th1, th2;
+	ipt_time_value_t tv;
+	int i;
+
+	test_handler_init(&th1);
+	test_handler_init(&th2);
+
+	assert ( r1->register_sig_handler(r1, (ipt_event_handler_t *)&th1, SIGUSR1) == 0 );
+	assert ( r2->register_sig_handler(r2, (ipt_event_handler_t *)&th2, SIGUSR2) == 0 );
+
+	raise(SIGUSR1);
+	raise(SIGUSR2);
+
+	tv.tv_sec = 0; tv.tv_usec = 100000;
+	assert ( r2->run_event_loop(r2, &tv) > 0 );
+
+	assert ( th1.signals == 0 && th2.signals == 1 && th2.last_signum == SIGUSR2 );
+
+	tv.tv_sec = 0; tv.tv_usec = 100000;
+	assert ( r1->run_event_loop(r1, &tv) > 0 );
+
+	assert ( th1.signals == 1 && th1.last_signum == SIGUSR1 && th2.signals == 1 );
+
+	/* None are lost when raised between passes */
+	for ( i = 0; i < NUMBER_OF_SIGNALS; i++ )
+	{
+		raise(SIGUSR1);
+
+		tv.tv_sec = 1; tv.tv_usec = 0;
+		r1->run_event_loop(r1, &tv);
+	}
+
+	assert ( th1.signals == NUMBER_OF_SIGNALS + 1 );
+
+	assert ( r1->remove_handler(r1, (ipt_event_handler_t *)&th1, EVENT_HANDLER_SIGNAL_MASK) == 0 );
+	assert ( r2->remove_handler(r2, (ipt_event_handler_t *)&th2, EVENT_HANDLER_SIGNAL_MASK) == 0 );
+	assert ( th1.closed == 1 && th2.closed == 1 );
+}
+
+/*
+ * The timerfd dispatches the timers, even though the reactor is asked to wait much longer.
+ */
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	struct test_handler th1, th2;
+	ipt_time_value_t one_shot = {0,2000};
+	ipt_time_value_t interval = {0,5000};
+	ipt_time_value_t tv;
+	struct timespec start, now;
+
+	test_handler_init(&th1);
+	test_handler_init(&th2);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)&th1, &one_shot, NULL, NULL) == 0 );
+	assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)&th2, NULL, &interval, NULL) == 0 );
+
+	tv.tv_sec = 5; tv.tv_usec = 0;
+	assert ( reactor->run_event_loop(reactor, &tv) > 0 );
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	assert ( th1.timeouts == 1 && elapsed_us(now, start) >= 2000 && elapsed_us(now, start) < 1000000 );
+
+	while ( th2.timeouts < 3 )
+	{
+		tv.tv_sec = 5; tv.tv_usec = 0;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	assert ( elapsed_us(now, start) >= 15000 && elapsed_us(now, start) < 2000000 );
+
+	/* Disarmed once the last timer is removed */
+	assert ( reactor->remove_timer(reactor, (ipt_event_handler_t *)&th2) == 0 );
+
+	tv.tv_sec = 0; tv.tv_usec = 50000;
+	assert ( reactor->run_event_loop(reactor, &tv) == 0 );
+
+	assert ( th1.timeouts == 1 && th2.timeouts == 3 );
+}
+
+int main(int argc , char *argv[])
+{
+	ipt_reactor_t *r1 = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL | IPT_REACTOR_SIGNALFD | IPT_REACTOR_TIMERFD);
+	ipt_reactor_t *r2 = ipt_reactor_create_with_flags(IPT_REACTOR_SIGNALFD | IPT_REACTOR_TIMERFD);
+
+	assert ( r1 != NULL && r2 != NULL );
+
+	test_1(r1, r2);
+
+	test_2(r1);
+
+	test_2(r2);
+
+	r1->destroy(r1);
+	r2->destroy(r2);
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/wait.h>
+
+#include "reactor.h"
+#include "allocator_shm.h"
+#include "config.h"
+
+#define NUMBER_OF_PASSES (20)
+#define SLOW_UPCALL      (2000) /* microseconds */
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	int fd;
+	int reads;
+	int timeouts;
+	int notified;
+};
+
+int handle_input(ipt_event_handler_t *this, ipt_handle_t h)
+{
+	struct test_handler *th = (struct test_handler *)this;
+	char c;
+
+	/* Only notified */
+	if ( th->fd < 0 )
+	{
+		th->notified++;
+		return 0;
+	}
+
+	assert ( read(h, &c, 1) == 1 );
+
+	/* Block the loop */
+	usleep(SLOW_UPCALL);
+
+	th->reads++;
+
+	return 0;
+}
+
+int handle_timeout(ipt_event_handler_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	((struct test_handler *)this)->timeouts++;
+	return 0;
+}
+
+int get_handle(ipt_event_handler_t *this)
+{
+	return ((struct test_handler *)this)->fd;
+}
+
+void test_handler_init(struct test_handler *this, int fd)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->fd = fd;
+	this->eh.handle_input = (int (*)(ipt_event_handler_t *, ipt_handle_t )) handle_input;
+	this->eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *tv, const void *act)) handle_timeout;
+	this->eh.get_handle = (int (*)(ipt_event_handler_t *)) get_handle;
+}
+
+/*
+ * The slow handler is found among the slowest, and its upcalls are in the right bucket.
+ * Timers, notifications and the time spent waiting are counted.
+ */
+static void
+test_1(ipt_reactor_t *reactor)
+{
+	struct test_handler slow, fast;
+	ipt_time_value_t one_shot = {0,1000};
+	ipt_time_value_t tv;
+	ipt_reactor_stats_t stats;
+	ipt_reactor_histogram_t h;
+	int pfd[2], i, found = 0;
+
+	assert ( pipe(pfd) == 0 );
+
+	test_handler_init(&slow, pfd[0]);
+	test_handler_init(&fast, -1);
+
+	assert ( reactor->register_handler(reactor, (ipt_event_handler_t *)&slow, EVENT_HANDLER_READ_MASK) == 0 );
+	assert ( reactor->schedule_timer(reactor, (ipt_event_handler_t *)&fast, &one_shot, NULL, NULL) == 0 );
+
+	assert ( write(pfd[1], "abc", 3) == 3 );
+
+	for ( i = 0; i < 3; i++ )
+	{
+		assert ( reactor->notify(reactor, (ipt_event_handler_t *)&fast, EVENT_HANDLER_READ_MASK, NULL) == 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_PASSES; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 5000;
+		reactor->run_event_loop(reactor, &tv);
+	}
+
+	assert ( slow.reads == 3 && fast.timeouts == 1 && fast.notified == 1 );
+
+	assert ( reactor->get_stats(reactor, &stats) == 0 );
+
+	assert ( stats.iterations == NUMBER_OF_PASSES );
+	assert ( stats.wait_ns > 0 );
+	assert ( stats.notifications == 3 && stats.notify_depth_max == 3 && stats.notify_depth == 0 );
+
+	/* Three reads, the timer and the coalesced notification */
+	assert ( stats.dispatch.count == 5 );
+	assert ( stats.dispatch.total_ns >= 3 * SLOW_UPCALL * 1000ULL );
+	assert ( stats.timer_lateness.count == 1 );
+
+	for ( i = 0; i < IPT_REACTOR_STATS_HANDLERS; i++ )
+	{
+		if ( stats.slowest[i].dispatch.count && stats.slowest[i].handler == (uintptr_t)&slow )
+		{
+			assert ( stats.slowest[i].handle == pfd[0] && stats.slowest[i].dispatch.count == 3 );
+			assert ( stats.slowest[i].dispatch.max_ns >= SLOW_UPCALL * 1000ULL );
+
+			found = 1;
+		}
+	}
+
+	assert ( found );
+
+	assert ( reactor->get_handler_stats(reactor, (ipt_event_handler_t *)&slow, &h) == 0 );
+
+	/* 2^11 microseconds and up */
+	assert ( h.count == 3 && h.buckets[0] + h.buckets[1] + h.buckets[10] == 0 );
+
+	for ( i = 11, found = 0; i < IPT_REACTOR_STATS_BUCKETS; i++ )
+	{
+		found += h.buckets[i];
+	}
+
+	assert ( found == 3 );
+
+	/* Not registered */
+	assert ( reactor->get_handler_stats(reactor, (ipt_event_handler_t *)&fast, &h) < 0 );
+
+	assert ( reactor->remove_handler(reactor, (ipt_event_handler_t *)&slow, EVENT_HANDLER_READ_MASK | EVENT_HANDLER_DONT_CALL_MASK) == 0 );
+
+	close(pfd[0]);
+	close(pfd[1]);
+}
+
+/*
+ * Another process reads the statistics from shared memory while the reactor runs.
+ */
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	ipt_allocator_t *alloc_ptr = ipt_allocator_shm_create(1024 * 1024, IPT_TEST_ALLOCATOR_SHM_KEY);
+	ipt_reactor_stats_t stats;
+	ipt_time_value_t tv;
+	int status;
+
+	assert ( alloc_ptr != NULL );
+
+	assert ( reactor->get_stats(reactor, &stats) == 0 );
+
+	assert ( reactor->publish_stats(reactor, alloc_ptr, "reactor_stats") == 0 );
+	assert ( reactor->publish_stats(reactor, alloc_ptr, "reactor_stats") < 0 );
+
+	tv.tv_sec = 0; tv.tv_usec = 1000;
+	reactor->run_event_loop(reactor, &tv);
+
+	if ( fork() == 0 )
+	{
+		ipt_allocator_t *child_alloc_ptr = ipt_allocator_shm_attach(IPT_TEST_ALLOCATOR_SHM_KEY);
+		ipt_reactor_stats_t *shared;
+
+		if ( child_alloc_ptr == NULL || (shared = child_alloc_ptr->find_registered_object(child_alloc_ptr, "reactor_stats")) == NULL )
+		{
+			exit(1);
+		}
+
+		/* The statistics were carried over, and the next pass was added */
+		exit(shared->iterations == stats.iterations + 1 ? 0 : 2);
+	}
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	reactor->destroy(reactor);
+
+	/* Released with the reactor */
+	assert ( alloc_ptr->find_registered_object(alloc_ptr, "reactor_stats") == NULL );
+	assert ( alloc_ptr->blocks_allocated(alloc_ptr) == 0 );
+}
+
+int main(int argc , char *argv[])
+{
+	ipt_reactor_t *reactor = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL);
+	ipt_reactor_stats_t stats;
+
+	assert ( reactor != NULL );
+
+	/* Only collected when asked for */
+	assert ( reactor->get_stats(reactor, &stats) < 0 );
+
+	reactor->destroy(reactor);
+
+	reactor = ipt_reactor_create_with_flags(IPT_REACTOR_SELECT | IPT_REACTOR_STATS);
+
+	test_1(reactor);
+
+	reactor->destroy(reactor);
+
+	reactor = ipt_reactor_create_with_flags(IPT_REACTOR_EPOLL | IPT_REACTOR_TIMERFD | IPT_REACTOR_STATS);
+
+	test_1(reactor);
+
+	test_2(reactor);
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
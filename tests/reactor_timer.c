@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <time.h>
+
 #include "reactor.h"
 
 static unsigned int timers_fired = 0;
@@ -24,6 +26,130 @@ void test_handler_init(struct test_handler *this)
 	this->eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *tv, const void *act)) handle_timeout;
 }
 
+/*
+ * Timers spread over the levels of the timing wheel. Each must fire in order, never early,
+ * and close to its expiration.
+ */
+#define NUMBER_OF_WHEEL_TIMERS (64)
+
+struct wheel_handler
+{
+	ipt_event_handler_t eh;
+	struct timespec expected;
+	struct timespec fired;
+	int count;
+	struct wheel_handler *victim;
+};
+
+static ipt_reactor_t *wheel_reactor;
+static int wheel_order = 0;
+
+static long long
+elapsed_us(struct timespec a, struct timespec b)
+{
+	return (a.tv_sec - b.tv_sec) * 1000000LL + (a.tv_nsec - b.tv_nsec) / 1000;
+}
+
+int wheel_timeout(ipt_event_handler_t *this, const ipt_time_value_t *tv, const void *act)
+{
+	struct wheel_handler *wh = (struct wheel_handler *)this;
+
+	clock_gettime(CLOCK_MONOTONIC, &wh->fired);
+
+	wh->count = ++wheel_order;
+
+	/* Cancelling another timer, and itself, from the upcall */
+	if ( wh->victim )
+	{
+		assert ( wheel_reactor->remove_timer(wheel_reactor, (ipt_event_handler_t *)wh->victim) == 0 );
+		assert ( wheel_reactor->remove_timer(wheel_reactor, this) == 0 );
+	}
+
+	return 0;
+}
+
+static void
+test_wheel(void)
+{
+	static struct wheel_handler wh[NUMBER_OF_WHEEL_TIMERS + 2];
+	struct timespec start, now;
+	int i, j;
+
+	wheel_reactor = ipt_reactor_create();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for ( i = 0; i < NUMBER_OF_WHEEL_TIMERS + 2; i++ )
+	{
+		/* From 0.5ms to about 4.2 seconds, so the second and third levels are cascaded */
+		long us = i < NUMBER_OF_WHEEL_TIMERS ? 500 + (long)i * i * 1000 : 4200000;
+		ipt_time_value_t one_shot = { us / 1000000, us % 1000000 };
+
+		memset(&wh[i], 0, sizeof(wh[i]));
+
+		wh[i].eh.handle_timeout = (int (*)(ipt_event_handler_t *, const ipt_time_value_t *tv, const void *act)) wheel_timeout;
+		wh[i].expected.tv_sec = start.tv_sec + us / 1000000 + (start.tv_nsec + (us % 1000000) * 1000) / 1000000000;
+		wh[i].expected.tv_nsec = (start.tv_nsec + (us % 1000000) * 1000) % 1000000000;
+
+		assert ( wheel_reactor->schedule_timer(wheel_reactor, (ipt_event_handler_t *)&wh[i], &one_shot, NULL, NULL) == 0 );
+	}
+
+	/* The last timer has the same expiration as the one before it, and is cancelled by it */
+	wh[NUMBER_OF_WHEEL_TIMERS].victim = &wh[NUMBER_OF_WHEEL_TIMERS + 1];
+
+	do
+	{
+		ipt_time_value_t tv = {10,0};
+
+		wheel_reactor->run_event_loop(wheel_reactor, &tv);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+	} while ( wheel_order < NUMBER_OF_WHEEL_TIMERS + 1 && elapsed_us(now, start) < 10000000 );
+
+	/* No further timers are left */
+	{
+		ipt_time_value_t tv = {0,200000};
+
+		assert ( wheel_reactor->run_event_loop(wheel_reactor, &tv) == 0 );
+	}
+
+	for ( i = 0; i < NUMBER_OF_WHEEL_TIMERS + 1; i++ )
+	{
+		long long late = elapsed_us(wh[i].fired, wh[i].expected);
+
+		assert ( wh[i].count == i + 1 );
+
+		/* Never early, beyond the skew, and not a tick late on an idle machine */
+		assert ( late >= -100 && late < 20000 );
+	}
+
+	assert ( wh[NUMBER_OF_WHEEL_TIMERS + 1].count == 0 );
+
+	/* Cancel a large number of timers before they expire */
+	for ( i = 0; i < NUMBER_OF_WHEEL_TIMERS; i++ )
+	{
+		ipt_time_value_t one_shot = { 0, 1000 + i * 10000 };
+
+		for ( j = 0; j < 2; j++ )
+		{
+			assert ( wheel_reactor->schedule_timer(wheel_reactor, (ipt_event_handler_t *)&wh[i], &one_shot, NULL, NULL) == 0 );
+		}
+
+		assert ( wheel_reactor->remove_timer(wheel_reactor, (ipt_event_handler_t *)&wh[i]) == 0 );
+		assert ( wheel_reactor->remove_timer(wheel_reactor, (ipt_event_handler_t *)&wh[i]) == 0 );
+		assert ( wheel_reactor->remove_timer(wheel_reactor, (ipt_event_handler_t *)&wh[i]) < 0 );
+	}
+
+	{
+		ipt_time_value_t tv = {0,100000};
+
+		assert ( wheel_reactor->run_event_loop(wheel_reactor, &tv) == 0 );
+	}
+
+	wheel_reactor->destroy(wheel_reactor);
+}
+
 int main(int argc , char *argv[])
 {
 
@@ -57,6 +183,8 @@ int main(int argc , char *argv[])
    /* The timers cause the run_event_loop to exit. so the numbers should be equal if timers are working. */
    assert( timers_fired == --loops );
 
+   test_wheel();
+
    printf("%s completed successfully. %d timers fired\n",argv[0], timers_fired);
 
    return 0;
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "reactor.h"
+
+#define NUMBER_OF_MESSAGES (100)
+
+struct test_handler
+{
+	ipt_event_handler_t eh;
+	ipt_reactor_t *reactor;
+	int completions;
+	int closed;
+	ipt_event_handler_mask_t last_mask;
+	ssize_t last_result;
+	const void *last_act;
+
+	/* Submit the next read from the upcall until this many have completed */
+	int chain;
+	char buf[64];
+	char data[NUMBER_OF_MESSAGES + 1];
+};
+
+int handle_completion(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask, ssize_t result, void *buf, const void *act)
+{
+	struct test_handler *th = (struct test_handler *)this;
+
+	th->completions++;
+	th->last_mask = mask;
+	th->last_result = result;
+	th->last_act = act;
+
+	if ( mask == EVENT_HANDLER_READ_MASK && th->chain )
+	{
+		assert ( result == 1 && buf == th->buf );
+
+		th->data[th->completions - 1] = th->buf[0];
+
+		if ( th->completions < th->chain )
+		{
+			assert ( th->reactor->submit_read(th->reactor, this, h, th->buf, 1, act) == 0 );
+		}
+	}
+
+	return result < 0 ? -1 : 0;
+}
+
+int handle_close(ipt_event_handler_t *this, ipt_handle_t h, ipt_event_handler_mask_t mask)
+{
+	((struct test_handler *)this)->closed++;
+	return 0;
+}
+
+void test_handler_init(struct test_handler *this, ipt_reactor_t *reactor)
+{
+	memset(this, 0, sizeof(struct test_handler));
+
+	this->reactor = reactor;
+	this->eh.handle_completion = (int (*)(ipt_event_handler_t *, ipt_handle_t, ipt_event_handler_mask_t, ssize_t, void *, const void *)) handle_completion;
+	this->eh.handle_close = (int (*)(ipt_event_handler_t *, ipt_handle_t, ipt_event_handler_mask_t mask)) handle_close;
+}
+
+static void
+run_until(ipt_reactor_t *reactor, int *count, int value)
+{
+	ipt_time_value_t tv;
+	int i;
+
+	for ( i = 0; i < 1000 && *count < value; i++ )
+	{
+		tv.tv_sec = 0; tv.tv_usec = 100000;
+		assert ( reactor->run_event_loop(reactor, &tv) >= 0 );
+	}
+
+	assert ( *count == value );
+}
+
+/*
+ * A read completes once there is data, with the token it was submitted with. Reads submitted
+ * from the upcall complete in order.
+ */
+static void
+test_1(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	ipt_time_value_t tv;
+	int pfd[2], act, i;
+
+	test_handler_init(&th, reactor);
+
+	assert ( pipe(pfd) == 0 );
+
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, pfd[0], th.buf, sizeof(th.buf), &act) == 0 );
+
+	/* Nothing to read yet */
+	tv.tv_sec = 0; tv.tv_usec = 10000;
+	assert ( reactor->run_event_loop(reactor, &tv) == 0 && th.completions == 0 );
+
+	assert ( write(pfd[1], "hello", 5) == 5 );
+
+	run_until(reactor, &th.completions, 1);
+
+	assert ( th.last_mask == EVENT_HANDLER_READ_MASK && th.last_result == 5 && th.last_act == &act );
+	assert ( memcmp(th.buf, "hello", 5) == 0 );
+
+	/* The write completes as well */
+	assert ( reactor->submit_write(reactor, (ipt_event_handler_t *)&th, pfd[1], "world", 5, NULL) == 0 );
+
+	run_until(reactor, &th.completions, 2);
+
+	assert ( th.last_mask == EVENT_HANDLER_WRITE_MASK && th.last_result == 5 );
+	assert ( read(pfd[0], th.buf, sizeof(th.buf)) == 5 && memcmp(th.buf, "world", 5) == 0 );
+
+	/* A chain of single byte reads */
+	test_handler_init(&th, reactor);
+	th.chain = NUMBER_OF_MESSAGES;
+
+	for ( i = 0; i < NUMBER_OF_MESSAGES; i++ )
+	{
+		char c = 'a' + i % 26;
+
+		assert ( write(pfd[1], &c, 1) == 1 );
+	}
+
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, pfd[0], th.buf, 1, NULL) == 0 );
+
+	run_until(reactor, &th.completions, NUMBER_OF_MESSAGES);
+
+	for ( i = 0; i < NUMBER_OF_MESSAGES; i++ )
+	{
+		assert ( th.data[i] == 'a' + i % 26 );
+	}
+
+	/* An error is the result, and the handler is closed when it returns -1 */
+	test_handler_init(&th, reactor);
+	close(pfd[0]);
+
+	assert ( reactor->submit_write(reactor, (ipt_event_handler_t *)&th, pfd[1], "x", 1, NULL) == 0 );
+
+	run_until(reactor, &th.completions, 1);
+
+	assert ( th.last_result == -EPIPE && th.closed == 1 );
+
+	close(pfd[1]);
+
+	/* The handler needs the upcall */
+	th.eh.handle_completion = NULL;
+
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, 0, th.buf, 1, NULL) < 0 );
+}
+
+/*
+ * Accept a connection, then read from it.
+ */
+static void
+test_2(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd, cfd, sfd;
+
+	test_handler_init(&th, reactor);
+
+	assert ( (lfd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 );
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	assert ( bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 );
+	assert ( listen(lfd, 1) == 0 );
+	assert ( getsockname(lfd, (struct sockaddr *)&addr, &len) == 0 );
+
+	assert ( reactor->submit_accept(reactor, (ipt_event_handler_t *)&th, lfd, NULL) == 0 );
+
+	assert ( (cfd = socket(AF_INET, SOCK_STREAM, 0)) >= 0 );
+	assert ( connect(cfd, (struct sockaddr *)&addr, sizeof(addr)) == 0 );
+
+	run_until(reactor, &th.completions, 1);
+
+	assert ( th.last_mask == EVENT_HANDLER_ACCEPT_MASK && (sfd = th.last_result) >= 0 );
+
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, sfd, th.buf, sizeof(th.buf), NULL) == 0 );
+	assert ( write(cfd, "ping", 4) == 4 );
+
+	run_until(reactor, &th.completions, 2);
+
+	assert ( th.last_result == 4 && memcmp(th.buf, "ping", 4) == 0 );
+
+	close(sfd);
+	close(cfd);
+	close(lfd);
+}
+
+/*
+ * Reads into a registered buffer from a registered handle, and a batch of writes completed in order.
+ */
+static void
+test_3(ipt_reactor_t *reactor)
+{
+	struct test_handler th;
+	static char buffer[4096];
+	struct iovec iov = { buffer, sizeof(buffer) };
+	int pfd[2], i;
+
+	test_handler_init(&th, reactor);
+
+	assert ( pipe(pfd) == 0 );
+
+	assert ( reactor->register_buffers(reactor, &iov, 1) == 0 );
+	assert ( reactor->register_files(reactor, pfd, 2) == 0 );
+
+	for ( i = 0; i < NUMBER_OF_MESSAGES; i++ )
+	{
+		assert ( reactor->submit_write(reactor, (ipt_event_handler_t *)&th, pfd[1], "0123456789" + i % 10, 1, NULL) == 0 );
+	}
+
+	run_until(reactor, &th.completions, NUMBER_OF_MESSAGES);
+
+	assert ( th.last_mask == EVENT_HANDLER_WRITE_MASK && th.last_result == 1 );
+
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, pfd[0], buffer + 100, NUMBER_OF_MESSAGES, NULL) == 0 );
+
+	run_until(reactor, &th.completions, NUMBER_OF_MESSAGES + 1);
+
+	assert ( th.last_result == NUMBER_OF_MESSAGES );
+
+	for ( i = 0; i < NUMBER_OF_MESSAGES; i++ )
+	{
+		assert ( buffer[100 + i] == '0' + i % 10 );
+	}
+
+	assert ( reactor->register_files(reactor, NULL, 0) == 0 );
+	assert ( reactor->register_buffers(reactor, NULL, 0) == 0 );
+
+	/* Waiting operations are cancelled when the reactor is destroyed */
+	assert ( reactor->submit_read(reactor, (ipt_event_handler_t *)&th, pfd[0], buffer, 1, NULL) == 0 );
+
+	close(pfd[1]);
+}
+
+int main(int argc , char *argv[])
+{
+	unsigned int flags[] = { IPT_REACTOR_URING, IPT_REACTOR_URING | IPT_REACTOR_SIGNALFD | IPT_REACTOR_TIMERFD, IPT_REACTOR_EPOLL, IPT_REACTOR_SELECT };
+	unsigned int i;
+
+	/* The write to the closed pipe fails instead */
+	signal(SIGPIPE, SIG_IGN);
+
+	for ( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ )
+	{
+		ipt_reactor_t *reactor = ipt_reactor_create_with_flags(flags[i]);
+
+		assert ( reactor != NULL );
+
+		/* io_uring needs epoll, and falls back to select without it */
+		if ( reactor->get_flags(reactor) & IPT_REACTOR_URING )
+		{
+			assert ( reactor->get_flags(reactor) & IPT_REACTOR_EPOLL );
+		}
+		else if ( flags[i] & IPT_REACTOR_URING )
+		{
+			printf("io_uring is not available, testing the fallback.\n");
+
+			assert ( !(reactor->get_flags(reactor) & IPT_REACTOR_EPOLL) );
+		}
+
+		test_1(reactor);
+
+		test_2(reactor);
+
+		test_3(reactor);
+
+		reactor->destroy(reactor);
+	}
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}
@@ -3,8 +3,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "config.h"
 
+#define NUMBER_OF_WRITES (20000)
+#define NUMBER_OF_SNAPSHOTS (2000)
+#define MAX_ENTRIES (16)
+
 struct my_struct
 {
 	ipt_shared_in_list_node_t node;
@@ -13,6 +20,85 @@ struct my_struct
 	char name[256];
 };
 
+static int
+compare_a(ipt_shared_in_list_node_t *n_ptr, void *in_ptr)
+{
+	return ((struct my_struct *)n_ptr)->a != *(unsigned int *)in_ptr;
+}
+
+/*
+ * A child process keeps adding entries to the tail and removing them from the head, so
+ * the list always holds consecutive values. The optimistic readers must never see 
+ * anything else.
+ */
+static void
+test_optimistic(ipt_allocator_t *alloc_ptr, ipt_shared_in_list_t *sl_ptr)
+{
+	struct my_struct snap[MAX_ENTRIES];
+	struct my_struct copy;
+	struct my_struct *m_ptr;
+	size_t i, n;
+	int loop, status;
+	unsigned int a;
+
+	/* Start with an empty list */
+	while ( (m_ptr = (struct my_struct *) sl_ptr->head(sl_ptr)) )
+	{
+		sl_ptr->remove(sl_ptr, (ipt_shared_in_list_node_t *)m_ptr);
+		alloc_ptr->free(alloc_ptr, m_ptr);
+	}
+
+	if ( fork() == 0 )
+	{
+		for ( a = 0; a < NUMBER_OF_WRITES; a++ )
+		{
+			assert ( (m_ptr = alloc_ptr->malloc(alloc_ptr, sizeof(struct my_struct))) );
+
+			m_ptr->a = a;
+			m_ptr->b = ~a;
+
+			sl_ptr->add_tail(sl_ptr, (ipt_shared_in_list_node_t *)m_ptr);
+
+			if ( sl_ptr->count(sl_ptr) > MAX_ENTRIES / 2 )
+			{
+				m_ptr = (struct my_struct *) sl_ptr->head(sl_ptr);
+				sl_ptr->remove(sl_ptr, (ipt_shared_in_list_node_t *)m_ptr);
+				alloc_ptr->free(alloc_ptr, m_ptr);
+			}
+		}
+		exit(0);
+	}
+
+	for ( loop = 0; loop < NUMBER_OF_SNAPSHOTS; loop++ )
+	{
+		n = ipt_shared_in_list_snapshot(sl_ptr, snap, sizeof(struct my_struct), MAX_ENTRIES);
+
+		for ( i = 0; i < n; i++ )
+		{
+			assert ( snap[i].b == ~snap[i].a );
+			assert ( i == 0 || snap[i].a == snap[i - 1].a + 1 );
+		}
+
+		if ( n )
+		{
+			a = snap[n - 1].a;
+
+			if ( ipt_shared_in_list_find_copy(sl_ptr, compare_a, &a, &copy, sizeof(copy)) == 0 )
+			{
+				assert ( copy.a == a && copy.b == ~a );
+			}
+		}
+	}
+
+	wait(&status);
+
+	assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+
+	n = ipt_shared_in_list_snapshot(sl_ptr, snap, sizeof(struct my_struct), MAX_ENTRIES);
+
+	assert ( n == sl_ptr->count(sl_ptr) && snap[n - 1].a == NUMBER_OF_WRITES - 1 );
+}
+
 int main (int argc, char *argv[])
 {
 	char *ptr;
@@ -80,6 +166,8 @@ int main (int argc, char *argv[])
 	      return -1;
         }
 
+	test_optimistic(alloc_ptr, sl_ptr);
+
         printf(" %s completed successfully\n", argv[0]);
 
 	return 0;
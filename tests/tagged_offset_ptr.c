@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+#include <sched.h>
+
+#include "allocator_shm.h"
+#include "offset_ptr.h"
+#include "config.h"
+
+#define NUMBER_OF_PROCESSES (8)
+#define NUMBER_OF_NODES     (16)
+#define NUMBER_OF_LOOPS     (200000)
+
+/*
+ * Treiber stack in shared memory. The nodes are never returned to the allocator, so a
+ * node can be popped, pushed and popped again while another process still holds a stale
+ * snapshot of the top. Only the generation counter prevents that process from installing
+ * a stale next pointer.
+ */
+struct stack
+{
+	ipt_top_t top;
+};
+
+struct node
+{
+	ipt_top_t next;
+	volatile pid_t owner;
+	unsigned int id;
+};
+
+static void
+push(struct stack *s, struct node *n)
+{
+	ipt_top_val_t top = ipt_top_load(&s->top);
+
+	do
+	{
+		ipt_top_set(&n->next, ipt_top_ptr(&s->top, top));
+	} while ( !ipt_top_cas(&s->top, &top, n) );
+}
+
+static struct node *
+pop(struct stack *s)
+{
+	ipt_top_val_t top = ipt_top_load(&s->top);
+	struct node *n;
+
+	do
+	{
+		if ( (n = ipt_top_ptr(&s->top, top)) == NULL )
+		{
+			return NULL;
+		}
+	} while ( !ipt_top_cas(&s->top, &top, ipt_top_ptr(&n->next, ipt_top_load(&n->next))) );
+
+	return n;
+}
+
+/*
+ * Basic operations of the tagged pointer.
+ */
+static void
+test_1(ipt_allocator_t *alloc_ptr)
+{
+	struct node *arr = alloc_ptr->malloc(alloc_ptr, sizeof(struct node) * 2);
+	ipt_top_t *top = alloc_ptr->malloc(alloc_ptr, sizeof(ipt_top_t));
+	ipt_top_val_t val, stale;
+
+	assert ( sizeof(ipt_top_t) == 8 );
+
+	ipt_top_init(top, NULL);
+	val = ipt_top_load(top);
+
+	assert ( ipt_top_ptr(top, val) == NULL && ipt_top_tag(val) == 0 );
+
+	/* Both directions */
+	stale = val;
+	assert ( ipt_top_cas(top, &val, &arr[1]) );
+	val = ipt_top_load(top);
+	assert ( ipt_top_ptr(top, val) == &arr[1] && ipt_top_tag(val) == 1 );
+
+	ipt_top_set(top, &arr[0]);
+	val = ipt_top_load(top);
+	assert ( ipt_top_ptr(top, val) == &arr[0] && ipt_top_tag(val) == 2 );
+
+	/* Back to NULL, but the old snapshot must not match ( ABA ) */
+	assert ( ipt_top_cas(top, &val, NULL) );
+	assert ( ipt_top_ptr(top, ipt_top_load(top)) == NULL );
+	assert ( !ipt_top_cas(top, &stale, &arr[1]) );
+
+	/* The failed swap refreshes the snapshot */
+	assert ( stale == ipt_top_load(top) );
+	assert ( ipt_top_cas(top, &stale, &arr[1]) );
+
+	alloc_ptr->free(alloc_ptr, top);
+	alloc_ptr->free(alloc_ptr, arr);
+}
+
+/*
+ * Many processes pop a node, mark it as theirs, and push it back. A node handed to two
+ * processes at once, or a node lost from the stack, fails the test.
+ */
+static void
+test_2(ipt_allocator_t *alloc_ptr)
+{
+	struct stack *s;
+	struct node *n;
+	int i, count, status;
+	unsigned int seen = 0;
+
+	assert ( (s = alloc_ptr->malloc(alloc_ptr, sizeof(struct stack))) );
+
+	ipt_top_init(&s->top, NULL);
+
+	for ( i = 0; i < NUMBER_OF_NODES; i++ )
+	{
+		assert ( (n = alloc_ptr->malloc(alloc_ptr, sizeof(struct node))) );
+
+		n->owner = 0;
+		n->id = i;
+
+		push(s, n);
+	}
+
+	assert ( alloc_ptr->register_object(alloc_ptr, "treiber_stack", s) == 0 );
+
+	for ( i = 0; i < NUMBER_OF_PROCESSES; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			ipt_allocator_t *child_alloc_ptr = ipt_allocator_shm_attach(IPT_TEST_ALLOCATOR_SHM_KEY);
+			struct stack *child_s;
+			pid_t pid = getpid();
+			int loop;
+
+			if ( child_alloc_ptr == NULL ||
+			     (child_s = child_alloc_ptr->find_registered_object(child_alloc_ptr, "treiber_stack")) == NULL )
+			{
+				exit(1);
+			}
+
+			for ( loop = 0; loop < NUMBER_OF_LOOPS; loop++ )
+			{
+				if ( (n = pop(child_s)) == NULL )
+				{
+					sched_yield();
+					continue;
+				}
+
+				if ( n->owner != 0 )
+				{
+					exit(2);
+				}
+
+				n->owner = pid;
+
+				if ( loop % 64 == 0 )
+				{
+					sched_yield();
+				}
+
+				if ( n->owner != pid )
+				{
+					exit(2);
+				}
+
+				n->owner = 0;
+
+				push(child_s, n);
+			}
+
+			exit(0);
+		}
+	}
+
+	for ( i = 0; i < NUMBER_OF_PROCESSES; i++ )
+	{
+		wait(&status);
+
+		assert ( WIFEXITED(status) && WEXITSTATUS(status) == 0 );
+	}
+
+	/* Every node is back on the stack exactly once */
+	for ( count = 0; (n = pop(s)) != NULL; count++ )
+	{
+		assert ( n->id < NUMBER_OF_NODES && !(seen & (1U << n->id)) );
+
+		seen |= 1U << n->id;
+
+		alloc_ptr->free(alloc_ptr, n);
+	}
+
+	assert ( count == NUMBER_OF_NODES );
+
+	alloc_ptr->deregister_object(alloc_ptr, "treiber_stack");
+	alloc_ptr->free(alloc_ptr, s);
+}
+
+int main(int argc, char *argv[])
+{
+	ipt_allocator_t *alloc_ptr = ipt_allocator_shm_create(1024 * 1024, IPT_TEST_ALLOCATOR_SHM_KEY);
+
+	if ( alloc_ptr == NULL )
+	{
+		printf("Failed to create shared allocator \n");
+		return -1;
+	}
+
+	test_1(alloc_ptr);
+
+	test_2(alloc_ptr);
+
+	assert ( alloc_ptr->blocks_allocated(alloc_ptr) == 0 );
+
+	printf("%s completed successfully.\n", argv[0]);
+
+	return 0;
+}